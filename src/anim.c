@@ -0,0 +1,151 @@
+/**
+ * \file anim.c
+ * \brief Skin animation played from frames converted once in the frame buffer format
+ *
+ * Every frame of the animation is converted once when the skin is loaded and packed in a sprite strip :
+ * displaying a frame is then only a matter of lines copies.
+ * Each frame is displayed for the delay given by the animated file (GIF delays).
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <IL/il.h>
+
+#include "log.h"
+#include "font.h"
+#include "draw.h"
+#include "anim.h"
+
+/* Delay used for frames that do not specify one (ms) */
+#define ANIM_DEFAULT_DELAY  100
+/* Shortest delay between two frames (ms) */
+#define ANIM_MIN_DELAY      20
+
+static struct {
+    uint16_t * strip;   /**< Frames converted in frame buffer format, one after the other */
+    int * delays;       /**< Display delay of each frame (ms) */
+    int nb_frames;
+    int current;        /**< Next frame to display */
+    int x, y;           /**< Position on screen (skin coordinates) */
+    int width, height;  /**< Size of a frame */
+} anim;
+
+/** Convert an animation for the display
+ *
+ * \param img animated image (all frames are expected to have the size of the first one)
+ * \param x position of the animation on screen
+ * \param y position of the animation on screen
+ *
+ * \return true on success, false on failure
+ */
+bool anim_init(ILuint img, int x, int y){
+    unsigned char * buffer = NULL;
+    uint16_t * frame;
+    size_t frame_size;
+    int i;
+
+    anim_release();
+    if (img == 0)
+        return false;
+
+    ilBindImage(img);
+    /* IL_NUM_IMAGES does not count the parent image */
+    anim.nb_frames = ilGetInteger(IL_NUM_IMAGES) + 1;
+    anim.width  = ilGetInteger(IL_IMAGE_WIDTH);
+    anim.height = ilGetInteger(IL_IMAGE_HEIGHT);
+    anim.x = x;
+    anim.y = y;
+    frame_size = (size_t)anim.width * anim.height;
+    buffer = calloc(frame_size, 3);
+    anim.strip = malloc(frame_size * 2 * anim.nb_frames);
+    anim.delays = malloc(anim.nb_frames * sizeof(int));
+    if ((buffer == NULL) || (anim.strip == NULL) || (anim.delays == NULL)){
+        log_write(LOG_ERROR, "Unable to allocate animation (%d frames)", anim.nb_frames);
+        goto error;
+    }
+    for (i = 0; i < anim.nb_frames; i++){
+        /* ilActiveImage is relative to the current image */
+        ilBindImage(img);
+        ilActiveImage(i);
+        ilCopyPixels(0, 0, 0, anim.width, anim.height, 1, IL_RGB, IL_UNSIGNED_BYTE, buffer);
+        frame = draw_sprite_convert(buffer, anim.width, anim.height);
+        if (frame == NULL)
+            goto error;
+        memcpy(&anim.strip[i * frame_size], frame, frame_size * 2);
+        free(frame);
+        anim.delays[i] = ilGetInteger(IL_IMAGE_DURATION);
+        if (anim.delays[i] <= 0){
+            anim.delays[i] = ANIM_DEFAULT_DELAY;
+        } else if (anim.delays[i] < ANIM_MIN_DELAY){
+            anim.delays[i] = ANIM_MIN_DELAY;
+        }
+    }
+    ilBindImage(img);
+    free(buffer);
+    log_write(LOG_DEBUG, "Animation : %d frames %dx%d", anim.nb_frames, anim.width, anim.height);
+    return true;
+
+error:
+    ilBindImage(img);
+    free(buffer);
+    anim_release();
+    return false;
+}
+
+/** Release the converted animation */
+void anim_release(void){
+    free(anim.strip);
+    free(anim.delays);
+    anim.strip = NULL;
+    anim.delays = NULL;
+    anim.nb_frames = 0;
+    anim.current = 0;
+}
+
+/** Tell whether an animation is ready to be played */
+bool anim_is_loaded(void){
+    return (anim.strip != NULL);
+}
+
+/** Display the next frame of the animation
+ *
+ * \return the delay before the following frame (ms), 0 if there is no animation
+ */
+int anim_draw_next(void){
+    int delay;
+
+    if (anim.strip == NULL)
+        return 0;
+    draw_sprite(&anim.strip[(size_t)anim.current * anim.width * anim.height],
+                anim.x, anim.y, anim.width, anim.height);
+    delay = anim.delays[anim.current];
+    anim.current++;
+    if (anim.current >= anim.nb_frames)
+        anim.current = 0;
+    return delay;
+}
@@ -0,0 +1,39 @@
+/**
+ * \file anim.h
+ * \brief Skin animation played from frames converted once in the frame buffer format
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __ANIM_H__
+#define __ANIM_H__
+
+#include <stdbool.h>
+#include <IL/il.h>
+
+bool anim_init(ILuint img, int x, int y);
+void anim_release(void);
+bool anim_is_loaded(void);
+int anim_draw_next(void);
+
+#endif
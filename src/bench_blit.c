@@ -0,0 +1,103 @@
+/**
+ * \file bench_blit.c
+ * \brief Micro benchmark of the RGB565 conversion kernels (see blit.c)
+ *
+ * Measures the throughput in Mpixels/s of RGB24 and RGBA32 full screen blits for
+ * the usual screen sizes in both orientations.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "blit.h"
+
+#define BENCH_ITERATIONS 200
+
+static double get_time(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(int w, int h, int bpp, enum blit_orientation orientation){
+    uint16_t * screen;
+    uint8_t * src;
+    double start, elapsed;
+    int i;
+
+    screen = calloc(w * h, 2);
+    src = malloc(w * h * bpp);
+    if ((screen == NULL) || (src == NULL)){
+        fprintf(stderr, "Allocation error\n");
+        exit(1);
+    }
+    /* Mix opaque, transparent and translucent pixels for RGBA */
+    for (i = 0; i < w * h * bpp; i++){
+        src[i] = (uint8_t)(i * 7);
+    }
+
+    start = get_time();
+    for (i = 0; i < BENCH_ITERATIONS; i++){
+        if (orientation == BLIT_NORMAL){
+            if (bpp == 4)
+                blit_rgba32_to_rgb565(screen, w, src, w * bpp, w, h, BLIT_NORMAL);
+            else
+                blit_rgb24_to_rgb565(screen, w, src, w * bpp, w, h, BLIT_NORMAL);
+        } else {
+            /* Screen is w pixels height and h pixels wide */
+            if (bpp == 4)
+                blit_rgba32_to_rgb565(&screen[h - 1], h, src, w * bpp, w, h, BLIT_INVERTED);
+            else
+                blit_rgb24_to_rgb565(&screen[h - 1], h, src, w * bpp, w, h, BLIT_INVERTED);
+        }
+    }
+    elapsed = get_time() - start;
+
+    printf("%-6s %3dx%3d %-8s : %7.2f Mpixels/s\n", (bpp == 4 ? "RGBA32" : "RGB24"), w, h,
+           (orientation == BLIT_NORMAL ? "normal" : "inverted"),
+           (double)w * h * BENCH_ITERATIONS / elapsed / 1e6);
+    free(src);
+    free(screen);
+}
+
+int main(int argc, char **argv){
+    static const int sizes[][2] = {{320, 240}, {480, 272}};
+    int i;
+
+#ifdef BLIT_UNROLL
+    printf("Unrolled kernels\n");
+#else
+    printf("Generic kernels\n");
+#endif
+    for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+        bench(sizes[i][0], sizes[i][1], 3, BLIT_NORMAL);
+        bench(sizes[i][0], sizes[i][1], 4, BLIT_NORMAL);
+        bench(sizes[i][0], sizes[i][1], 3, BLIT_INVERTED);
+        bench(sizes[i][0], sizes[i][1], 4, BLIT_INVERTED);
+    }
+    return 0;
+}
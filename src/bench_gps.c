@@ -0,0 +1,88 @@
+/**
+ * \file bench_gps.c
+ * \brief Replay of a GPS capture through the GPS parser (see gps.c)
+ *
+ * Parses a capture of the GPS device (SiRF binary and/or NMEA) as fast as possible,
+ * reports the parsing statistics and throughput, and the last fix decoded.
+ * Usage : bench_gps capture_file [iterations]
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "gps.h"
+
+static double get_time(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+    struct gps_stats stats;
+    struct gps_data info;
+    struct stat st;
+    double start, elapsed;
+    int iterations = 1;
+    int i;
+
+    if (argc < 2){
+        fprintf(stderr, "Usage : %s capture_file [iterations]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2){
+        iterations = atoi(argv[2]);
+    }
+    if ((stat(argv[1], &st) != 0) || (iterations <= 0)){
+        fprintf(stderr, "Unable to read %s\n", argv[1]);
+        return 1;
+    }
+
+    start = get_time();
+    for (i = 0; i < iterations; i++){
+        if (gps_replay(argv[1], &stats) != 0){
+            fprintf(stderr, "Unable to read %s\n", argv[1]);
+            return 1;
+        }
+    }
+    elapsed = get_time() - start;
+
+    printf("SiRF frames    : %u\n", stats.sirf_frames);
+    printf("NMEA sentences : %u\n", stats.nmea_sentences);
+    printf("Errors         : %u\n", stats.errors);
+    printf("Throughput     : %.2f MB/s\n", (double)st.st_size * iterations / elapsed / 1e6);
+    if (gps_get_data(&info) == 0){
+        printf("Fixes          : %i\n", info.seq);
+        printf("Lat  : %i %i'\n", info.lat_deg, info.lat_mins);
+        printf("Long : %i %i'\n", info.long_deg, info.long_mins);  
+        printf("Alt  : %i,%02im\n", info.alt_cm / 100, info.alt_cm % 100);
+        printf("Sats : %i\n", info.sat_nb);
+        printf("Speed: %ikm/h\n", info.speed_kmh);
+        printf("Time : %s", asctime(&info.time));
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * \file blit.c
+ * \brief This module implements the pixel format conversions used to write into the RGB565 screen buffer
+ *
+ * Conversions are performed directly into the destination buffer, row by row, without any intermediate allocation.
+ *
+ * There is one kernel per source format and per orientation :
+ *    \li normal orientation : source rows are written as destination rows
+ *    \li inverted axes : source rows are written as destination columns (from right to left)
+ *
+ * If BLIT_UNROLL is defined at build time, unrolled kernels are used. They handle 4 pixels per iteration
+ * and write the RGB24 pixels two by two with 32 bits stores in normal orientation (suits better ARMv5 cores).
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdint.h>
+#include <endian.h>
+
+#include "blit.h"
+
+/* RGB565 components spread in a 32 bits word (G in high half) to blend them in one multiplication */
+#define SPREAD_MASK 0x07E0F81F
+
+/** Blend a RGB565 source pixel over a RGB565 destination pixel
+ * \param a alpha in range [0..32]
+ */
+static inline uint16_t blend_rgb565(uint16_t d, uint16_t s, uint32_t a){
+    uint32_t bg = (d | (d << 16)) & SPREAD_MASK;
+    uint32_t fg = (s | (s << 16)) & SPREAD_MASK;
+    uint32_t res;
+
+    res = ((((fg - bg) * a) >> 5) + bg) & SPREAD_MASK;
+    return (uint16_t)(res | (res >> 16));
+}
+
+/** Write one RGBA pixel on a RGB565 destination pixel */
+static inline void put_rgba_pixel(uint16_t * d, const uint8_t * s){
+    uint32_t a = s[3];
+
+    if (a == 0)
+        return;
+    if (a == 0xFF){
+        *d = BLIT_RGB565(s[0], s[1], s[2]);
+    } else {
+        /* alpha [1..254] -> [0..32] */
+        *d = blend_rgb565(*d, BLIT_RGB565(s[0], s[1], s[2]), (a + 4) >> 3);
+    }
+}
+
+/* Rows of the normal orientation kernels */
+
+static inline void row_rgb24_normal(uint16_t * d, const uint8_t * s, int w){
+#ifdef BLIT_UNROLL
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (((uintptr_t)d & 2) && (w > 0)){
+        *d++ = BLIT_RGB565(s[0], s[1], s[2]);
+        s += 3;
+        w--;
+    }
+    /* Destination is now 32 bits aligned : write pixels by pair */
+    while (w >= 4){
+        ((uint32_t *)d)[0] = BLIT_RGB565(s[0], s[1], s[2])  | ((uint32_t)BLIT_RGB565(s[3], s[4], s[5])  << 16);
+        ((uint32_t *)d)[1] = BLIT_RGB565(s[6], s[7], s[8])  | ((uint32_t)BLIT_RGB565(s[9], s[10], s[11]) << 16);
+        d += 4;
+        s += 12;
+        w -= 4;
+    }
+#else
+    while (w >= 4){
+        d[0] = BLIT_RGB565(s[0], s[1], s[2]);
+        d[1] = BLIT_RGB565(s[3], s[4], s[5]);
+        d[2] = BLIT_RGB565(s[6], s[7], s[8]);
+        d[3] = BLIT_RGB565(s[9], s[10], s[11]);
+        d += 4;
+        s += 12;
+        w -= 4;
+    }
+#endif
+#endif
+    while (w-- > 0){
+        *d++ = BLIT_RGB565(s[0], s[1], s[2]);
+        s += 3;
+    }
+}
+
+static inline void row_rgba32_normal(uint16_t * d, const uint8_t * s, int w){
+#ifdef BLIT_UNROLL
+    while (w >= 4){
+        /* Fast path for fully opaque or fully transparent spans */
+        uint32_t alphas = s[3] & s[7] & s[11] & s[15];
+        if (alphas == 0xFF){
+            d[0] = BLIT_RGB565(s[0], s[1], s[2]);
+            d[1] = BLIT_RGB565(s[4], s[5], s[6]);
+            d[2] = BLIT_RGB565(s[8], s[9], s[10]);
+            d[3] = BLIT_RGB565(s[12], s[13], s[14]);
+        } else if ((s[3] | s[7] | s[11] | s[15]) != 0){
+            put_rgba_pixel(&d[0], &s[0]);
+            put_rgba_pixel(&d[1], &s[4]);
+            put_rgba_pixel(&d[2], &s[8]);
+            put_rgba_pixel(&d[3], &s[12]);
+        }
+        d += 4;
+        s += 16;
+        w -= 4;
+    }
+#endif
+    while (w-- > 0){
+        put_rgba_pixel(d++, s);
+        s += 4;
+    }
+}
+
+/* Rows of the inverted orientation kernels : one source row is a destination column */
+
+static inline void row_rgb24_inverted(uint16_t * d, int step, const uint8_t * s, int w){
+#ifdef BLIT_UNROLL
+    while (w >= 4){
+        d[0]      = BLIT_RGB565(s[0], s[1], s[2]);
+        d[step]   = BLIT_RGB565(s[3], s[4], s[5]);
+        d[2*step] = BLIT_RGB565(s[6], s[7], s[8]);
+        d[3*step] = BLIT_RGB565(s[9], s[10], s[11]);
+        d += 4 * step;
+        s += 12;
+        w -= 4;
+    }
+#endif
+    while (w-- > 0){
+        *d = BLIT_RGB565(s[0], s[1], s[2]);
+        d += step;
+        s += 3;
+    }
+}
+
+static inline void row_rgba32_inverted(uint16_t * d, int step, const uint8_t * s, int w){
+#ifdef BLIT_UNROLL
+    while (w >= 4){
+        put_rgba_pixel(&d[0], &s[0]);
+        put_rgba_pixel(&d[step], &s[4]);
+        put_rgba_pixel(&d[2*step], &s[8]);
+        put_rgba_pixel(&d[3*step], &s[12]);
+        d += 4 * step;
+        s += 16;
+        w -= 4;
+    }
+#endif
+    while (w-- > 0){
+        put_rgba_pixel(d, s);
+        d += step;
+        s += 4;
+    }
+}
+
+
+/** Convert a RGB24 buffer into a RGB565 buffer
+ *
+ * \param dst destination of the first source pixel
+ * \param dst_stride destination line length (in pixels)
+ * \param src source buffer
+ * \param src_stride source line length (in bytes)
+ * \param w width of the source zone
+ * \param h height of the source zone
+ * \param orientation if BLIT_INVERTED, source row i is written on the column on the left of row i-1,
+ *                    from top to bottom
+ */
+void blit_rgb24_to_rgb565(uint16_t * dst, int dst_stride, const uint8_t * src, int src_stride,
+                          int w, int h, enum blit_orientation orientation){
+    if (orientation == BLIT_NORMAL){
+        while (h-- > 0){
+            row_rgb24_normal(dst, src, w);
+            dst += dst_stride;
+            src += src_stride;
+        }
+    } else {
+        while (h-- > 0){
+            row_rgb24_inverted(dst, dst_stride, src, w);
+            dst--;
+            src += src_stride;
+        }
+    }
+}
+
+/** Blend a RGBA32 buffer over a RGB565 buffer
+ *
+ * Same parameters as :blit_rgb24_to_rgb565()
+ */
+void blit_rgba32_to_rgb565(uint16_t * dst, int dst_stride, const uint8_t * src, int src_stride,
+                           int w, int h, enum blit_orientation orientation){
+    if (orientation == BLIT_NORMAL){
+        while (h-- > 0){
+            row_rgba32_normal(dst, src, w);
+            dst += dst_stride;
+            src += src_stride;
+        }
+    } else {
+        while (h-- > 0){
+            row_rgba32_inverted(dst, dst_stride, src, w);
+            dst--;
+            src += src_stride;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * \file blit.h
+ * \brief This module implements the pixel format conversions used to write into the RGB565 screen buffer
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __BLIT_H__
+#define __BLIT_H__
+
+#include <stdint.h>
+
+/** Layout of the destination buffer */
+enum blit_orientation{
+    BLIT_NORMAL,      /**< Source rows are destination rows */
+    BLIT_INVERTED     /**< Source rows are destination columns (axes inverted screens) */
+};
+
+/** Conversion from a RGB or RGBA pixel to RGB565 */
+#define BLIT_RGB565(r,g,b) ((uint16_t)((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | ((b) >> 3)))
+
+void blit_rgb24_to_rgb565(uint16_t * dst, int dst_stride, const uint8_t * src, int src_stride,
+                          int w, int h, enum blit_orientation orientation);
+void blit_rgba32_to_rgb565(uint16_t * dst, int dst_stride, const uint8_t * src, int src_stride,
+                           int w, int h, enum blit_orientation orientation);
+
+#endif
@@ -66,10 +66,15 @@
 #define KEY_AUTO_RESUME   "auto_resume"
 #define KEY_LOG_LEVEL     "log_level"
 #define KEY_MILES     "use_miles"
+#define KEY_BATTERY_PERIOD "battery_period"
+#define KEY_GPS_REPLAY     "gps_replay"
 
 /* Default timeout in seconds before turning OFF screen while playing audio if screen saver is active */
 #define SCREEN_SAVER_TO_S 6
 
+/* Default period in seconds of the battery sampling */
+#define BATTERY_PERIOD_S 30
+
 /* Default folder for media if the specified one doesn't exist */
 #define DEFAULT_FOLDER "/mnt"
 
@@ -103,6 +108,8 @@ struct tomplayer_config{
     int auto_resume;                    /*!<Enable auto resume*/    
     enum log_level log_level;           /*!<Log level*/
     int use_miles;			/*!<Use miles/hour instead of Km/h*/
+    int battery_period;                 /*!<Period of the battery sampling in seconds*/
+    char *gps_replay;                   /*!<GPS capture replayed instead of the GPS device (NULL if none)*/
 };
 
 /* Current configuration object */ 
@@ -202,6 +209,14 @@ static bool load_config( struct tomplayer_config * conf ){
     
     conf->enable_small_text = iniparser_getint(ini, SECTION_GENERAL":"KEY_EN_SMALL_TEXT, 0);   
     conf->use_miles = iniparser_getint(ini, SECTION_GENERAL":"KEY_MILES, 0);   
+    conf->battery_period = iniparser_getint(ini, SECTION_GENERAL":"KEY_BATTERY_PERIOD, BATTERY_PERIOD_S);
+    if (conf->battery_period <= 0){
+        conf->battery_period = BATTERY_PERIOD_S;
+    }
+    s = iniparser_getstring(ini, SECTION_GENERAL":"KEY_GPS_REPLAY, NULL);
+    if ((s != NULL) && (s[0] != 0)){
+        conf->gps_replay = strdup(s);
+    }
     
     iniparser_freedict(ini);
   
@@ -250,6 +265,14 @@ bool config_get_use_miles(void){
     return config.use_miles;
 }
 
+int config_get_battery_period(void){
+    return config.battery_period;
+}
+
+const char *config_get_gps_replay(void){
+    return config.gps_replay;
+}
+
 bool config_get_auto_resume(void){
     return config.auto_resume;
 }
@@ -527,6 +550,7 @@ void config_free(void){
   free(config.audio_skin_filename);
   free(config.diapo.filter);
   free(config.diapo.file_path);
+  free(config.gps_replay);
   config.filter_video_ext = NULL;
   config.filter_audio_ext = NULL;
   config.video_folder = NULL;
@@ -535,6 +559,7 @@ void config_free(void){
   config.audio_skin_filename = NULL;
   config.diapo.filter = NULL;
   config.diapo.file_path = NULL;
+  config.gps_replay = NULL;
 }
 
 /** Relaod configuration */
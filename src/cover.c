@@ -0,0 +1,443 @@
+/**
+ * \file cover.c
+ * \brief Background decoding of the cover arts and cache of their thumbnails
+ *
+ * Covers are decoded by a worker thread and scaled once to the size of the default cover of the skin.
+ * The resulting RGB thumbnails are kept in a small LRU cache so that redrawing a cover only costs a blit.
+ *
+ * JPEG covers are decoded with libjpeg, using its DCT scaling to decode directly at a size close
+ * to the thumbnail one. The other formats are decoded with DevIL, which is not thread safe :
+ * the worker then holds the mutex protecting the DevIL users.
+ *
+ * Once the cover of the current track is ready, the worker prefetches the cover of the next playlist entry.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <jpeglib.h>
+#include <IL/ilu.h>
+
+#include "log.h"
+#include "track.h"
+#include "font.h"
+#include "draw.h"
+#include "cover.h"
+
+/* Number of thumbnails kept in cache */
+#define COVER_CACHE_SIZE 4
+
+/** Thumbnail cache entry */
+struct cover_thumb{
+    char * filename;           /**< Media file (NULL if entry is free) */
+    enum cover_status status;  /**< COVER_READY or COVER_NONE */
+    unsigned char * pixels;    /**< RGB thumbnail */
+    unsigned int last_use;
+};
+
+/* state module variables */
+static struct{
+    bool initialized;
+    int width, height;             /**< Thumbnail size */
+    pthread_mutex_t * il_mutex;    /**< Protects the DevIL users */
+    pthread_t tid;
+    bool stop;
+    char * request;                /**< Cover of the current track to decode */
+    char * prefetch;               /**< Cover to decode in advance */
+    char * playlist;
+    struct cover_thumb cache[COVER_CACHE_SIZE];
+    unsigned int use_counter;
+} state;
+
+/* Protects the state of the module */
+static pthread_mutex_t cover_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cover_cond = PTHREAD_COND_INITIALIZER;
+
+
+/* libjpeg memory source (not provided by libjpeg 6b) */
+
+static void mem_init_source(j_decompress_ptr cinfo){
+}
+
+static boolean mem_fill_input_buffer(j_decompress_ptr cinfo){
+    static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+    /* Truncated file : insert a fake EOI marker */
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void mem_skip_input_data(j_decompress_ptr cinfo, long num_bytes){
+    if (num_bytes <= 0)
+        return;
+    if (num_bytes > cinfo->src->bytes_in_buffer){
+        mem_fill_input_buffer(cinfo);
+    } else {
+        cinfo->src->next_input_byte += num_bytes;
+        cinfo->src->bytes_in_buffer -= num_bytes;
+    }
+}
+
+static void mem_term_source(j_decompress_ptr cinfo){
+}
+
+struct jpeg_error{
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo){
+    struct jpeg_error * err = (struct jpeg_error *)cinfo->err;
+    longjmp(err->jmp, 1);
+}
+
+/** Scale down a RGB buffer to the thumbnail size (box filter) */
+static void scale_rgb(const unsigned char * src, int sw, int sh, unsigned char * dst, int dw, int dh){
+    int dx, dy, x, y, x0, x1, y0, y1;
+    unsigned int r, g, b, n;
+    const unsigned char * p;
+
+    for (dy = 0; dy < dh; dy++){
+        y0 = dy * sh / dh;
+        y1 = (dy + 1) * sh / dh;
+        if (y1 <= y0) y1 = y0 + 1;
+        for (dx = 0; dx < dw; dx++){
+            x0 = dx * sw / dw;
+            x1 = (dx + 1) * sw / dw;
+            if (x1 <= x0) x1 = x0 + 1;
+            r = g = b = n = 0;
+            for (y = y0; y < y1; y++){
+                p = &src[(y * sw + x0) * 3];
+                for (x = x0; x < x1; x++){
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    p += 3;
+                    n++;
+                }
+            }
+            *dst++ = r / n;
+            *dst++ = g / n;
+            *dst++ = b / n;
+        }
+    }
+}
+
+/** Decode a JPEG cover into a thumbnail */
+static unsigned char * decode_jpeg(const void * data, size_t len){
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_source_mgr src;
+    struct jpeg_error jerr;
+    unsigned char * volatile decoded = NULL;
+    unsigned char * volatile thumb = NULL;
+    JSAMPROW row;
+    int stride;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_error_exit;
+    if (setjmp(jerr.jmp)){
+        log_write(LOG_ERROR, "Cover - Error while decoding JPEG");
+        jpeg_destroy_decompress(&cinfo);
+        free(decoded);
+        free(thumb);
+        return NULL;
+    }
+    jpeg_create_decompress(&cinfo);
+    src.next_input_byte = data;
+    src.bytes_in_buffer = len;
+    src.init_source = mem_init_source;
+    src.fill_input_buffer = mem_fill_input_buffer;
+    src.skip_input_data = mem_skip_input_data;
+    src.resync_to_restart = jpeg_resync_to_restart;
+    src.term_source = mem_term_source;
+    cinfo.src = &src;
+    jpeg_read_header(&cinfo, TRUE);
+
+    /* Decode at the smallest DCT scale still bigger than the thumbnail */
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 8;
+    while ((cinfo.scale_denom > 1) &&
+           ((cinfo.image_width / cinfo.scale_denom < state.width) ||
+            (cinfo.image_height / cinfo.scale_denom < state.height))){
+        cinfo.scale_denom /= 2;
+    }
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_decompress(&cinfo);
+
+    stride = cinfo.output_width * 3;
+    decoded = malloc(stride * cinfo.output_height);
+    thumb = malloc(state.width * state.height * 3);
+    if ((decoded == NULL) || (thumb == NULL))
+        longjmp(jerr.jmp, 1);
+    while (cinfo.output_scanline < cinfo.output_height){
+        row = &decoded[cinfo.output_scanline * stride];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    scale_rgb(decoded, cinfo.output_width, cinfo.output_height, thumb, state.width, state.height);
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    free(decoded);
+    return thumb;
+}
+
+/** Decode any other cover format with DevIL */
+static unsigned char * decode_devil(const void * data, size_t len){
+    unsigned char * thumb;
+    ILuint img;
+
+    thumb = malloc(state.width * state.height * 3);
+    if (thumb == NULL)
+        return NULL;
+    pthread_mutex_lock(state.il_mutex);
+    ilGenImages(1, &img);
+    ilBindImage(img);
+    if (!ilLoadL(IL_TYPE_UNKNOWN, (void *)data, len)){
+        log_write(LOG_ERROR, "Cover - Error while loading coverart");
+        free(thumb);
+        thumb = NULL;
+    } else {
+        iluScale(state.width, state.height, 1);
+        ilCopyPixels(0, 0, 0, state.width, state.height, 1, IL_RGB, IL_UNSIGNED_BYTE, thumb);
+    }
+    ilDeleteImages(1, &img);
+    pthread_mutex_unlock(state.il_mutex);
+    return thumb;
+}
+
+static struct cover_thumb * cache_find(const char * filename){
+    int i;
+    for (i = 0; i < COVER_CACHE_SIZE; i++){
+        if ((state.cache[i].filename != NULL) && (strcmp(state.cache[i].filename, filename) == 0)){
+            state.cache[i].last_use = ++state.use_counter;
+            return &state.cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void cache_store(const char * filename, unsigned char * pixels){
+    struct cover_thumb * thumb = &state.cache[0];
+    char * name;
+    int i;
+
+    name = strdup(filename);
+    if (name == NULL){
+        free(pixels);
+        return;
+    }
+    /* Replace the least recently used thumbnail */
+    for (i = 1; i < COVER_CACHE_SIZE; i++){
+        if (state.cache[i].last_use < thumb->last_use)
+            thumb = &state.cache[i];
+    }
+    free(thumb->filename);
+    free(thumb->pixels);
+    thumb->filename = name;
+    thumb->pixels = pixels;
+    thumb->status = (pixels != NULL) ? COVER_READY : COVER_NONE;
+    thumb->last_use = ++state.use_counter;
+}
+
+/** Find the entry following a file in a playlist
+ * \param playlist m3u file (NULL if none)
+ * \return the next filename to be released with free() or NULL
+ */
+static char * find_next(const char * playlist, const char * filename){
+    char line[PATH_MAX];
+    bool found = false;
+    char * ret = NULL;
+    size_t len;
+    FILE * fp;
+
+    if (playlist == NULL)
+        return NULL;
+    fp = fopen(playlist, "r");
+    if (fp == NULL)
+        return NULL;
+    while (fgets(line, sizeof(line), fp) != NULL){
+        len = strlen(line);
+        while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r'))){
+            line[--len] = 0;
+        }
+        if ((len == 0) || (line[0] == '#'))
+            continue;
+        if (found){
+            ret = strdup(line);
+            break;
+        }
+        found = (strcmp(line, filename) == 0);
+    }
+    fclose(fp);
+    return ret;
+}
+
+static void decode_cover(const char * filename){
+    const unsigned char * data;
+    unsigned char * pixels = NULL;
+    void * cover;
+    size_t len;
+
+    if (track_read_cover(filename, &cover, &len)){
+        data = cover;
+        if ((len > 2) && (data[0] == 0xFF) && (data[1] == 0xD8)){
+            pixels = decode_jpeg(cover, len);
+        } else {
+            pixels = decode_devil(cover, len);
+        }
+        free(cover);
+    }
+    pthread_mutex_lock(&cover_mutex);
+    cache_store(filename, pixels);
+    pthread_mutex_unlock(&cover_mutex);
+}
+
+static void * worker_thread(void * param){
+    char * filename;
+    char * playlist;
+    char * next;
+    bool is_prefetch;
+    bool cached;
+
+    pthread_mutex_lock(&cover_mutex);
+    while (!state.stop){
+        if ((state.request == NULL) && (state.prefetch == NULL)){
+            pthread_cond_wait(&cover_cond, &cover_mutex);
+            continue;
+        }
+        is_prefetch = (state.request == NULL);
+        if (is_prefetch){
+            filename = state.prefetch;
+            state.prefetch = NULL;
+        } else {
+            filename = state.request;
+            state.request = NULL;
+        }
+        cached = (cache_find(filename) != NULL);
+        /* The playlist may be replaced while it is read */
+        playlist = (!is_prefetch && (state.playlist != NULL)) ? strdup(state.playlist) : NULL;
+        pthread_mutex_unlock(&cover_mutex);
+
+        if (!cached){
+            decode_cover(filename);
+        }
+        next = find_next(playlist, filename);
+        free(playlist);
+        free(filename);
+
+        pthread_mutex_lock(&cover_mutex);
+        if (next != NULL){
+            free(state.prefetch);
+            state.prefetch = next;
+        }
+    }
+    pthread_mutex_unlock(&cover_mutex);
+    return NULL;
+}
+
+/** Initialize the cover module
+ *
+ * \param width width of the thumbnails
+ * \param height height of the thumbnails
+ * \param il_mutex mutex held by the DevIL users
+ */
+bool cover_init(int width, int height, pthread_mutex_t * il_mutex){
+    if (state.initialized || (width <= 0) || (height <= 0))
+        return false;
+    state.width = width;
+    state.height = height;
+    state.il_mutex = il_mutex;
+    state.stop = false;
+    if (pthread_create(&state.tid, NULL, worker_thread, NULL) != 0){
+        log_write(LOG_ERROR, "Cover - Unable to create worker thread");
+        return false;
+    }
+    state.initialized = true;
+    return true;
+}
+
+void cover_release(void){
+    int i;
+
+    if (!state.initialized)
+        return;
+    pthread_mutex_lock(&cover_mutex);
+    state.stop = true;
+    pthread_cond_signal(&cover_cond);
+    pthread_mutex_unlock(&cover_mutex);
+    pthread_join(state.tid, NULL);
+    for (i = 0; i < COVER_CACHE_SIZE; i++){
+        free(state.cache[i].filename);
+        free(state.cache[i].pixels);
+    }
+    free(state.request);
+    free(state.prefetch);
+    free(state.playlist);
+    memset(&state, 0, sizeof(state));
+}
+
+/** Set the playlist used to find the cover to prefetch */
+void cover_set_playlist(const char * playlist){
+    pthread_mutex_lock(&cover_mutex);
+    free(state.playlist);
+    state.playlist = (playlist != NULL) ? strdup(playlist) : NULL;
+    pthread_mutex_unlock(&cover_mutex);
+}
+
+/** Ask for the cover of a file to be decoded (replaces any pending request) */
+void cover_request(const char * filename){
+    if (!state.initialized)
+        return;
+    pthread_mutex_lock(&cover_mutex);
+    free(state.request);
+    state.request = strdup(filename);
+    pthread_cond_signal(&cover_cond);
+    pthread_mutex_unlock(&cover_mutex);
+}
+
+/** Draw the thumbnail of the cover of a file if it is available
+ *
+ * \return status of the cover, nothing is drawn if not COVER_READY
+ */
+enum cover_status cover_draw(const char * filename, int x, int y){
+    struct cover_thumb * thumb;
+    enum cover_status ret = COVER_PENDING;
+
+    if (!state.initialized)
+        return COVER_NONE;
+    pthread_mutex_lock(&cover_mutex);
+    thumb = cache_find(filename);
+    if (thumb != NULL){
+        ret = thumb->status;
+        if (ret == COVER_READY){
+            draw_RGB_buffer(thumb->pixels, x, y, state.width, state.height, false);
+        }
+    }
+    pthread_mutex_unlock(&cover_mutex);
+    return ret;
+}
@@ -0,0 +1,47 @@
+/**
+ * \file cover.h
+ * \brief Background decoding of the cover arts and cache of their thumbnails
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __COVER_H__
+#define __COVER_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/** State of the cover of a file */
+enum cover_status{
+    COVER_PENDING,     /**< Not decoded yet */
+    COVER_NONE,        /**< File has no (valid) cover */
+    COVER_READY        /**< Thumbnail is available */
+};
+
+bool cover_init(int width, int height, pthread_mutex_t * il_mutex);
+void cover_release(void);
+void cover_set_playlist(const char * playlist);
+void cover_request(const char * filename);
+enum cover_status cover_draw(const char * filename, int x, int y);
+
+#endif
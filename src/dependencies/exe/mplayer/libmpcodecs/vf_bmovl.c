@@ -28,6 +28,9 @@
  *   * Hide bitmap
  * SHOW
  *   * Show bitmap
+ * UPDATE seq buffer width height xpos ypos
+ *   * Read an area from the shared memory buffer (see below).
+ *     seq is written back in the shared memory once the area has been read.
  *
  * Arguments are:
  * width, height    Size of image/area
@@ -43,10 +46,19 @@
  *                  one, so you don't need to send 1,8MB of RGBA32 data
  *                  everytime a small part of the screen is updated.
  *
- * Arguments for the filter are hidden:opaque:fifo
+ * Arguments for the filter are hidden:opaque:fifo[:shm]
  * For example 1:0:/tmp/myfifo.fifo will start the filter hidden, transparent
  * and use /tmp/myfifo.fifo as the fifo.
  *
+ * The optional shm is a POSIX shared memory object created by the client :
+ * a 64 bytes header (magic, width, height, last processed seq as 32 bits
+ * integers) followed by two width*height RGBA32 buffers. The client writes
+ * an area in a buffer and then only sends its coordinates with UPDATE,
+ * alternating buffers so that it never writes in the one being read.
+ *
+ * The bitmap is also kept premultiplied by its alpha so that blending a
+ * pixel over each video frame costs a single multiplication per plane.
+ *
  * If you find bugs, please send me patches! ;)
  *
  * This filter was developed for use in Freevo (http://freevo.sf.net), but
@@ -62,7 +74,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include "config.h"
 #include "mp_image.h"
 #include "vf.h"
@@ -84,6 +98,19 @@
 #define IMG_PNG		0x201
 #define CMD_CLEAR	0x001
 #define CMD_ALPHA	0x002
+#define CMD_UPDATE	0x003
+
+/* Shared memory layout : must match the client one (tomplayer overlay.c) */
+#define SHM_MAGIC	0x4C564F42
+#define SHM_HEADER_SIZE	64
+#define SHM_NB_BUFFERS	2
+
+struct shm_header {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	volatile uint32_t done_seq;
+};
 
 #define TRUE  1
 #define FALSE 0
@@ -100,10 +127,14 @@ struct vf_priv_s {
     int w, h, x1, y1, x2, y2;
 	struct {
 		unsigned char *y, *u, *v, *a, *oa;
+		unsigned char *py, *pu, *pv;	// y, u and v premultiplied by a
 	} bitmap;
     int stream_fd;
 	fd_set stream_fdset;
 	int opaque, hidden;
+	char shm_name[256];
+	struct shm_header *shm;
+	size_t shm_len;
 };
 
 static int
@@ -123,11 +154,17 @@ config(struct vf_instance_s* vf,
 	vf->priv->bitmap.v  = malloc( width*height/4 );
 	vf->priv->bitmap.a  = malloc( width*height );
 	vf->priv->bitmap.oa = malloc( width*height );
+	vf->priv->bitmap.py = calloc( 1, width*height );
+	vf->priv->bitmap.pu = calloc( 1, width*height/4 );
+	vf->priv->bitmap.pv = calloc( 1, width*height/4 );
 	if(!( vf->priv->bitmap.y &&
 	      vf->priv->bitmap.u &&
 		  vf->priv->bitmap.v &&
 		  vf->priv->bitmap.a &&
-		  vf->priv->bitmap.oa )) {
+		  vf->priv->bitmap.oa &&
+		  vf->priv->bitmap.py &&
+		  vf->priv->bitmap.pu &&
+		  vf->priv->bitmap.pv )) {
 		mp_msg(MSGT_VFILTER, MSGL_ERR, "vf_bmovl: Could not allocate memory for bitmap buffer: %s\n", strerror(errno) );
 		return FALSE;
 	}
@@ -152,6 +189,11 @@ uninit(struct vf_instance_s *vf)
 		free(vf->priv->bitmap.v);
 		free(vf->priv->bitmap.a);
 		free(vf->priv->bitmap.oa);
+		free(vf->priv->bitmap.py);
+		free(vf->priv->bitmap.pu);
+		free(vf->priv->bitmap.pv);
+		if (vf->priv->shm)
+		  munmap(vf->priv->shm, vf->priv->shm_len);
 		if (vf->priv->stream_fd >= 0)
 		  close(vf->priv->stream_fd);
 		free(vf->priv);
@@ -194,6 +236,105 @@ _read_cmd(int fd, char *cmd, char *args) {
 	return TRUE;
 }
 			
+// Update the premultiplied values of a pixel of the bitmap
+static void
+premultiply(struct vf_priv_s *priv, mp_image_t *dmpi, int x, int y)
+{
+	int pos = (y * priv->w) + x;
+	int alpha = priv->bitmap.a[pos];
+
+	priv->bitmap.py[pos] = (alpha * priv->bitmap.y[pos]) >> 8;
+	if ((y%2) && (x%2)) {
+		pos = ( (y/2) * dmpi->stride[1] ) + (x/2);
+		priv->bitmap.pu[pos] = (alpha * priv->bitmap.u[pos]) >> 8;
+		priv->bitmap.pv[pos] = (alpha * priv->bitmap.v[pos]) >> 8;
+	}
+}
+
+// Set a pixel of the bitmap
+static void
+set_pixel(struct vf_priv_s *priv, mp_image_t *dmpi, int x, int y,
+          unsigned char red, unsigned char green, unsigned char blue,
+          int alpha, int imgalpha)
+{
+	int pos = (y * priv->w) + x;
+
+	priv->bitmap.y[pos]  = rgb2y(red,green,blue);
+	priv->bitmap.oa[pos] = alpha;
+	priv->bitmap.a[pos]  = INRANGE((alpha+imgalpha),0,255);
+	if ((y%2) && (x%2)) {
+		pos = ( (y/2) * dmpi->stride[1] ) + (x/2);
+		priv->bitmap.u[pos] = rgb2u(red,green,blue);
+		priv->bitmap.v[pos] = rgb2v(red,green,blue);
+	}
+	premultiply(priv, dmpi, x, y);
+}
+
+// Map the shared memory given on the command line (once the client created it)
+static int
+map_shm(struct vf_priv_s *priv)
+{
+	struct shm_header hdr;
+	int fd;
+
+	if (priv->shm)
+		return TRUE;
+	if (!priv->shm_name[0])
+		return FALSE;
+	fd = shm_open(priv->shm_name, O_RDWR, 0);
+	if (fd < 0) {
+		mp_msg(MSGT_VFILTER, MSGL_WARN, "vf_bmovl: Couldn't open shared memory %s: %s\n", priv->shm_name, strerror(errno));
+		return FALSE;
+	}
+	if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) || (hdr.magic != SHM_MAGIC)) {
+		mp_msg(MSGT_VFILTER, MSGL_WARN, "vf_bmovl: Invalid shared memory %s\n", priv->shm_name);
+		close(fd);
+		return FALSE;
+	}
+	priv->shm_len = SHM_HEADER_SIZE + (size_t)SHM_NB_BUFFERS * hdr.width * hdr.height * 4;
+	priv->shm = mmap(NULL, priv->shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (priv->shm == MAP_FAILED) {
+		priv->shm = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Read an area of a shared memory buffer into the bitmap
+static void
+update_from_shm(struct vf_priv_s *priv, mp_image_t *dmpi, const char *args)
+{
+	unsigned int seq;
+	int buf, imgw, imgh, imgx, imgy, x, y;
+	const unsigned char *src;
+
+	if (sscanf(args, "%u %d %d %d %d %d", &seq, &buf, &imgw, &imgh, &imgx, &imgy) != 6)
+		return;
+	if (!map_shm(priv) || (buf < 0) || (buf >= SHM_NB_BUFFERS))
+		return;
+	imgw = FFMIN(imgw, (int)priv->shm->width - imgx);
+	imgh = FFMIN(imgh, (int)priv->shm->height - imgy);
+	imgw = FFMIN(imgw, priv->w - imgx);
+	imgh = FFMIN(imgh, priv->h - imgy);
+	if ((imgx >= 0) && (imgy >= 0) && (imgw > 0) && (imgh > 0)) {
+		for (y = imgy; y < imgy + imgh; y++) {
+			src = (const unsigned char *)priv->shm + SHM_HEADER_SIZE +
+			      (((size_t)buf * priv->shm->height + y) * priv->shm->width + imgx) * 4;
+			for (x = imgx; x < imgx + imgw; x++, src += 4)
+				set_pixel(priv, dmpi, x, y, src[0], src[1], src[2], src[3], 0);
+		}
+		// Define how much of our bitmap that contains graphics!
+		priv->x1 = FFMIN(imgx, priv->x1);
+		priv->y1 = FFMIN(imgy, priv->y1);
+		priv->x2 = FFMAX(imgx + imgw, priv->x2);
+		priv->y2 = FFMAX(imgy + imgh, priv->y2);
+	}
+	// Buffer can be written again by the client
+	__sync_synchronize();
+	priv->shm->done_seq = seq;
+}
+
 
 static int
 put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
@@ -220,7 +361,7 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 		tv.tv_sec=0; tv.tv_usec=0;
 
 		ready = select( vf->priv->stream_fd+1, &vf->priv->stream_fdset, NULL, NULL, &tv );
-		if(ready > 0) {
+		while(ready > 0) {
 			// We've got new data from the FIFO
 
 			char cmd[20], args[100];
@@ -233,6 +374,15 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 			}
 			mp_msg(MSGT_VFILTER, MSGL_DBG2, "\nDEBUG: Got: %s+%s\n", cmd, args);
 
+			if( strncmp(cmd,"UPDATE",6)==0 ) {
+				update_from_shm(vf->priv, dmpi, args);
+				// Areas are usually updated several at once : process them all now
+				FD_SET( vf->priv->stream_fd, &vf->priv->stream_fdset );
+				tv.tv_sec=0; tv.tv_usec=0;
+				ready = select( vf->priv->stream_fd+1, &vf->priv->stream_fdset, NULL, NULL, &tv );
+				continue;
+			}
+
 			command=NONE;
 			if     ( strncmp(cmd,"RGBA32",6)==0 ) { pxsz=4; command = IMG_RGBA32; }
 			else if( strncmp(cmd,"ABGR32",6)==0 ) { pxsz=4; command = IMG_ABGR32; }
@@ -290,6 +440,9 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 					memset( vf->priv->bitmap.v, 128, vf->priv->w*vf->priv->h/4 );
 					memset( vf->priv->bitmap.a,   0, vf->priv->w*vf->priv->h );
 					memset( vf->priv->bitmap.oa,  0, vf->priv->w*vf->priv->h );
+					memset( vf->priv->bitmap.py,  0, vf->priv->w*vf->priv->h );
+					memset( vf->priv->bitmap.pu,  0, vf->priv->w*vf->priv->h/4 );
+					memset( vf->priv->bitmap.pv,  0, vf->priv->w*vf->priv->h/4 );
 					vf->priv->x1 = dmpi->width;
 					vf->priv->y1 = dmpi->height;
 					vf->priv->x2 = vf->priv->y2 = 0;
@@ -309,9 +462,12 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 					memset( vf->priv->bitmap.y  + (ypos*vf->priv->w) + imgx, 0, imgw );
 					memset( vf->priv->bitmap.a  + (ypos*vf->priv->w) + imgx, 0, imgw );
 					memset( vf->priv->bitmap.oa + (ypos*vf->priv->w) + imgx, 0, imgw );
+					memset( vf->priv->bitmap.py + (ypos*vf->priv->w) + imgx, 0, imgw );
 					if(ypos%2) {
 						memset( vf->priv->bitmap.u + ((ypos/2)*dmpi->stride[1]) + (imgx/2), 128, imgw/2 );
 						memset( vf->priv->bitmap.v + ((ypos/2)*dmpi->stride[2]) + (imgx/2), 128, imgw/2 );
+						memset( vf->priv->bitmap.pu + ((ypos/2)*dmpi->stride[1]) + (imgx/2), 0, imgw/2 );
+						memset( vf->priv->bitmap.pv + ((ypos/2)*dmpi->stride[2]) + (imgx/2), 0, imgw/2 );
 					}
 				}	// Recalculate area that contains graphics
 				if( (imgx <= vf->priv->x1) && ( (imgw+imgx) >= vf->priv->x2) ) {
@@ -361,25 +517,22 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 		    				break;
 						case CMD_ALPHA:
 							vf->priv->bitmap.a[pos] = INRANGE((vf->priv->bitmap.oa[pos]+imgalpha),0,255);
+							premultiply(vf->priv, dmpi, (buf_x/pxsz)+imgx, buf_y+imgy);
 							break;
 						default:
 					   		mp_msg(MSGT_VFILTER, MSGL_ERR, "vf_bmovl: Internal error!\n");
 							return FALSE;
 					}
 					if( command & IS_RAWIMG ) {
-						vf->priv->bitmap.y[pos]  = rgb2y(red,green,blue);
-						vf->priv->bitmap.oa[pos] = alpha;
-						vf->priv->bitmap.a[pos]  = INRANGE((alpha+imgalpha),0,255);
-						if((buf_y%2) && ((buf_x/pxsz)%2)) {
-							pos = ( ((buf_y+imgy)/2) * dmpi->stride[1] ) + (((buf_x/pxsz)+imgx)/2);
-							vf->priv->bitmap.u[pos] = rgb2u(red,green,blue);
-							vf->priv->bitmap.v[pos] = rgb2v(red,green,blue);
-						}
+						set_pixel(vf->priv, dmpi, (buf_x/pxsz)+imgx, buf_y+imgy,
+						          red, green, blue, alpha, imgalpha);
 					}
 				} // for buf_x
 			} // for buf_y
 			free (buffer);
-		} else if(ready < 0) {
+			break;
+		}
+		if(ready < 0) {
 			mp_msg(MSGT_VFILTER, MSGL_WARN, "\nvf_bmovl: Error %d in fifo: %s\n\n", errno, strerror(errno));
 		}
     }
@@ -416,21 +569,19 @@ put_image(struct vf_instance_s* vf, mp_image_t* mpi, double pts){
 						dmpi->planes[1][pos] = vf->priv->bitmap.u[pos];
 						dmpi->planes[2][pos] = vf->priv->bitmap.v[pos];
 					}
-				} else { // Alphablended pixel
+				} else { // Alphablended pixel : bitmap is premultiplied
+					alpha = 255 - alpha;
 					dmpi->planes[0][pos] = 
-						((255 - alpha) * (int)dmpi->planes[0][pos] + 
-						alpha * (int)vf->priv->bitmap.y[pos]) >> 8;
+						((alpha * (int)dmpi->planes[0][pos]) >> 8) + vf->priv->bitmap.py[pos];
 					
 					if ((ypos%2) && (xpos%2)) {
 						pos = ( (ypos/2) * dmpi->stride[1] ) + (xpos/2);
 
 						dmpi->planes[1][pos] = 
-							((255 - alpha) * (int)dmpi->planes[1][pos] + 
-							alpha * (int)vf->priv->bitmap.u[pos]) >> 8;
+							((alpha * (int)dmpi->planes[1][pos]) >> 8) + vf->priv->bitmap.pu[pos];
 						
 						dmpi->planes[2][pos] = 
-							((255 - alpha) * (int)dmpi->planes[2][pos] + 
-							alpha * (int)vf->priv->bitmap.v[pos]) >> 8;
+							((alpha * (int)dmpi->planes[2][pos]) >> 8) + vf->priv->bitmap.pv[pos];
 					}
 			    }
 			} // for xpos
@@ -443,6 +594,7 @@ static int
 vf_open(vf_instance_t* vf, char* args)
 {
     char filename[1000];
+    char *shm;
 
     vf->config = config;
     vf->put_image = put_image;
@@ -451,12 +603,23 @@ vf_open(vf_instance_t* vf, char* args)
 
     vf->priv = malloc(sizeof(struct vf_priv_s));
 
+	vf->priv->shm = NULL;
+	vf->priv->shm_name[0] = '\0';
 	if(!args || sscanf(args, "%d:%d:%s", &vf->priv->hidden, &vf->priv->opaque, filename) < 3 ) {
         mp_msg(MSGT_VFILTER, MSGL_ERR, "vf_bmovl: Bad arguments!\n");
 		mp_msg(MSGT_VFILTER, MSGL_ERR, "vf_bmovl: Arguments are 'bool hidden:bool opaque:string fifo'\n");
 		return FALSE;
     }
 
+    // Optional shared memory follows the fifo
+    shm = strchr(filename, ':');
+    if(shm) {
+		*shm++ = '\0';
+		strncpy(vf->priv->shm_name, shm, sizeof(vf->priv->shm_name) - 1);
+		vf->priv->shm_name[sizeof(vf->priv->shm_name) - 1] = '\0';
+		mp_msg(MSGT_VFILTER, MSGL_INFO, "vf_bmovl: Using shared memory %s\n", vf->priv->shm_name);
+    }
+
     vf->priv->stream_fd = open(filename, O_RDWR);
     if(vf->priv->stream_fd >= 0) {
 		FD_ZERO( &vf->priv->stream_fdset );
@@ -512,6 +512,58 @@ static line_status iniparser_line(
     return sta ;
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Add a complete (stripped) line of an INI file to a dictionary
+  @param    dict    Dictionary to fill
+  @param    line    Line to parse
+  @param    section Current section (updated on section lines)
+  @param    name    Name of the INI input (for error messages)
+  @param    lineno  Line number (for error messages)
+  @param    errs    Current error count
+  @return   Updated error count, negative on allocation failure
+ */
+/*--------------------------------------------------------------------------*/
+static int iniparser_add_line(
+    dictionary * dict,
+    char * line,
+    char * section,
+    const char * name,
+    int lineno,
+    int errs)
+{
+    char key     [ASCIILINESZ+1] ;
+    char tmp     [ASCIILINESZ+1] ;
+    char val     [ASCIILINESZ+1] ;
+
+    switch (iniparser_line(line, section, key, val)) {
+        case LINE_EMPTY:
+        case LINE_COMMENT:
+        break ;
+
+        case LINE_SECTION:
+        errs = dictionary_set(dict, section, NULL);
+        break ;
+
+        case LINE_VALUE:
+        sprintf(tmp, "%s:%s", section, key);
+        errs = dictionary_set(dict, tmp, val) ;
+        break ;
+
+        case LINE_ERROR:
+        fprintf(stderr, "iniparser: syntax error in %s (%d):\n",
+                name,
+                lineno);
+        fprintf(stderr, "-> %s\n", line);
+        errs++ ;
+        break;
+
+        default:
+        break ;
+    }
+    return errs ;
+}
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Parse an ini file and return an allocated dictionary object
@@ -532,9 +584,6 @@ dictionary * iniparser_load(const char * ininame)
 
     char line    [ASCIILINESZ+1] ;
     char section [ASCIILINESZ+1] ;
-    char key     [ASCIILINESZ+1] ;
-    char tmp     [ASCIILINESZ+1] ;
-    char val     [ASCIILINESZ+1] ;
 
     int  last=0 ;
     int  len ;
@@ -556,8 +605,6 @@ dictionary * iniparser_load(const char * ininame)
 
     memset(line,    0, ASCIILINESZ);
     memset(section, 0, ASCIILINESZ);
-    memset(key,     0, ASCIILINESZ);
-    memset(val,     0, ASCIILINESZ);
     last=0 ;
 
     while (fgets(line+last, ASCIILINESZ-last, in)!=NULL) {
@@ -587,31 +634,7 @@ dictionary * iniparser_load(const char * ininame)
         } else {
             last=0 ;
         }
-        switch (iniparser_line(line, section, key, val)) {
-            case LINE_EMPTY:
-            case LINE_COMMENT:
-            break ;
-
-            case LINE_SECTION:
-            errs = dictionary_set(dict, section, NULL);
-            break ;
-
-            case LINE_VALUE:
-            sprintf(tmp, "%s:%s", section, key);
-            errs = dictionary_set(dict, tmp, val) ;
-            break ;
-
-            case LINE_ERROR:
-            fprintf(stderr, "iniparser: syntax error in %s (%d):\n",
-                    ininame,
-                    lineno);
-            fprintf(stderr, "-> %s\n", line);
-            errs++ ;
-            break;
-
-            default:
-            break ;
-        }
+        errs = iniparser_add_line(dict, line, section, ininame, lineno, errs);
         memset(line, 0, ASCIILINESZ);
         last=0;
         if (errs<0) {
@@ -643,4 +666,87 @@ void iniparser_freedict(dictionary * d)
     dictionary_del(d);
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file held in memory
+  @param    buffer  Content of the ini file (need not be NUL terminated)
+  @param    size    Size of the content in bytes
+  @return   Pointer to newly allocated dictionary
+
+  Same as iniparser_load() but the ini content is read from a buffer.
+  Lines may end with LF, CRLF or CR.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_buffer(const char * buffer, int size)
+{
+    char line    [ASCIILINESZ+1] ;
+    char section [ASCIILINESZ+1] ;
+
+    const char * end = buffer + size ;
+    int  last=0 ;
+    int  len ;
+    int  lineno=0 ;
+    int  errs=0;
+
+    dictionary * dict ;
+
+    dict = dictionary_new(0) ;
+    if (!dict) {
+        return NULL ;
+    }
+
+    memset(line,    0, ASCIILINESZ);
+    memset(section, 0, ASCIILINESZ);
+
+    while (buffer < end) {
+        lineno++ ;
+        len = last ;
+        while ((buffer < end) && (*buffer != '\n') && (*buffer != '\r')) {
+            /* Safety check against buffer overflows */
+            if (len >= ASCIILINESZ) {
+                fprintf(stderr,
+                        "iniparser: input line too long in buffer (%d)\n",
+                        lineno);
+                dictionary_del(dict);
+                return NULL ;
+            }
+            line[len++] = *buffer++ ;
+        }
+        /* Skip the end of line : LF, CR or CRLF */
+        if ((buffer < end) && (*buffer == '\r')) {
+            buffer++ ;
+        }
+        if ((buffer < end) && (*buffer == '\n')) {
+            buffer++ ;
+        }
+        line[len--] = 0 ;
+        /* Get rid of spaces at end of line */
+        while ((len>=0) && (isspace((unsigned char)line[len]))) {
+            line[len]=0 ;
+            len-- ;
+        }
+        /* Detect multi-line */
+        if ((len>=0) && (line[len]=='\\')) {
+            /* Multi-line value */
+            last=len ;
+            continue ;
+        } else {
+            last=0 ;
+        }
+        errs = iniparser_add_line(dict, line, section, "buffer", lineno, errs);
+        memset(line, 0, ASCIILINESZ);
+        if (errs<0) {
+            fprintf(stderr, "iniparser: memory allocation failure\n");
+            break ;
+        }
+    }
+    if (errs) {
+        dictionary_del(dict);
+        dict = NULL ;
+    }
+    return dict ;
+}
+
 /* vim: set ts=4 et sw=4 tw=75 */
@@ -264,6 +264,21 @@ int iniparser_find_entry(dictionary * ini, char * entry) ;
 /*--------------------------------------------------------------------------*/
 dictionary * iniparser_load(const char * ininame);
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief    Parse an ini file held in memory
+  @param    buffer  Content of the ini file (need not be NUL terminated)
+  @param    size    Size of the content in bytes
+  @return   Pointer to newly allocated dictionary
+
+  Same as iniparser_load() but the ini content is read from a buffer.
+  Lines may end with LF, CRLF or CR.
+
+  The returned dictionary must be freed using iniparser_freedict().
+ */
+/*--------------------------------------------------------------------------*/
+dictionary * iniparser_load_buffer(const char * buffer, int size);
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief    Free all memory associated to an ini dictionary
@@ -32,7 +32,6 @@
 #include <string.h>
 #include <unistd.h>
 #include <regex.h>
-#include <pthread.h>
 #include <time.h>
 
 #include "widescreen.h"
@@ -43,24 +42,42 @@
 #include "font.h"
 #include "gps.h"
 #include "draw.h"
+#include "loop.h"
 #include "diapo.h"
 
+/* Period of the backlight steps during a transition (ms) */
+#define DIAPO_FADE_PERIOD_MS 15
+/* Period of the clock refresh (ms) */
+#define DIAPO_CLOCK_PERIOD_MS 1000
+
+/** Steps of the slide show */
+enum diapo_step{
+  DIAPO_STEP_LOAD,      /**< Load the next picture */
+  DIAPO_STEP_FADE_OUT,  /**< Turn down the backlight on the current picture */
+  DIAPO_STEP_FADE_IN    /**< Turn up the backlight on the next picture */
+};
+
 
 static struct {
   char * path;
   unsigned int delay ;   
   regex_t compiled_re;
   flenum pict_list; 
-  bool end_asked; 
   int screen_x;
   int screen_y;
-  pthread_t thread_id;
-  pthread_mutex_t mutex;
+  int timer;             /**< Event loop timer while running, -1 otherwise */
+  enum diapo_step step;
+  ILuint current_image_id;
+  ILuint next_image_id;
+  int init_bright;       /**< Backlight level before the transition */
+  int bright;            /**< Current backlight level of the transition */
+  unsigned char * img_buffer; /**< Clock screen */
+  ILuint img_id;         /**< Clock screen */
   bool error;
   bool inv_axes;         /**< Are the axes inverted */
   enum diapo_type type;
 } diapo_state = {
-  .mutex = PTHREAD_MUTEX_INITIALIZER
+  .timer = -1
 };
 
 
@@ -80,24 +97,13 @@ static inline bool init_list(void){
   return true;
 }
 
-static void img_transition(ILuint next){
-  int init_bright = 0;
-  int bright;
+/** Display the next picture (screen is dark) */
+static void show_next(void){
   int im_width, im_height;
   int x, y;
-      
-  pwm_get_brightness(&init_bright);
-  for (bright=init_bright; bright>=1; bright--) {
-    pwm_set_brightness(bright);
-    usleep(15000);
-    if (diapo_state.end_asked){
-      pwm_set_brightness(init_bright);
-      break;
-   }
-  }
-  
+
   draw_screen_clear();
-  ilBindImage(next);
+  ilBindImage(diapo_state.next_image_id);
   im_width = ilGetInteger(IL_IMAGE_WIDTH);
   im_height = ilGetInteger(IL_IMAGE_HEIGHT);
   if (diapo_state.inv_axes){
@@ -107,29 +113,10 @@ static void img_transition(ILuint next){
       x = (diapo_state.screen_x - im_width) / 2;
       y = (diapo_state.screen_y - im_height) / 2; 
   }
-  draw_cursor(next, 0, x, y);
-      
-  for (bright=1; bright<=init_bright; bright++) {
-    pwm_set_brightness(bright);
-    usleep(15000);
-    if (diapo_state.end_asked){
-       pwm_set_brightness(init_bright);
-      break;
-    }
-  }
-  return;
-}
-
-static inline void wait_next_cycle(int delay){
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);      
-    ts.tv_sec  += delay;
-    if (pthread_mutex_timedlock(&diapo_state.mutex, &ts) == 0){
-      pthread_mutex_unlock(&diapo_state.mutex);
-    }
+  draw_cursor(diapo_state.next_image_id, 0, x, y);
+  draw_refresh();
 }
 
-
 static void scale(int screen_width, int screen_height){
     int im_width, im_height;
     double x_ratio, y_ratio;
@@ -145,51 +132,81 @@ static void scale(int screen_width, int screen_height){
     }    
 }
 
-static void * diapo_thread(void *param){
-  
+/** Load and scale the next picture of the list
+ *
+ * \retval false no picture can be loaded
+ */
+static bool load_next(void){
   bool no_file = false;
   const char * next_file;
-  static ILuint current_image_id, next_image_id;  
-  int loop;
-  loop = 0;
-  
+  int loop = 0;
 
-  while (!diapo_state.end_asked){
-    do{   
+  do{   
+    next_file = flenum_get_next_file(diapo_state.pict_list,true);    
+    if (next_file == NULL){            
+      flenum_release(diapo_state.pict_list);
+      init_list();
       next_file = flenum_get_next_file(diapo_state.pict_list,true);    
-      if (next_file == NULL){            
-        flenum_release(diapo_state.pict_list);
-        init_list();
-        next_file = flenum_get_next_file(diapo_state.pict_list,true);    
-        loop++;
-        if ((loop>=2) || (next_file == NULL)) {
-          no_file = true;
-        }
-    }} while ( (!no_file) && (!skin_load_bitmap(&next_image_id, next_file)) ) ;
-    if (no_file) break;   
-    loop = 0;
-       
-    if (diapo_state.inv_axes){
-        scale(diapo_state.screen_y, diapo_state.screen_x);
-    } else{
-        scale(diapo_state.screen_x, diapo_state.screen_y);        
-    }
-    
-    
-    if (current_image_id != 0){
-      img_transition(next_image_id);
-      ilDeleteImages( 1, &current_image_id);
-      wait_next_cycle(diapo_state.delay);
-    }
-    current_image_id = next_image_id;
-    next_image_id = 0;    
+      loop++;
+      if ((loop>=2) || (next_file == NULL)) {
+        no_file = true;
+      }
+  }} while ( (!no_file) && (!skin_load_bitmap(&diapo_state.next_image_id, next_file)) ) ;
+  if (no_file)
+    return false;
+
+  if (diapo_state.inv_axes){
+      scale(diapo_state.screen_y, diapo_state.screen_x);
+  } else{
+      scale(diapo_state.screen_x, diapo_state.screen_y);        
   }
-  if (current_image_id != 0){
-    ilDeleteImages( 1, &current_image_id);
+  return true;
+}
+
+/** Event loop callback : next step of the slide show
+ *
+ * Pictures are changed with a transition on the backlight : one backlight step per call.
+ */
+static void diapo_tick(void * data){
+  switch (diapo_state.step){
+    case DIAPO_STEP_LOAD :
+      if (!load_next()){
+        diapo_state.error = true;
+        loop_set_timer(diapo_state.timer, -1, 0);
+        return;
+      }
+      pwm_get_brightness(&diapo_state.init_bright);
+      diapo_state.bright = diapo_state.init_bright;
+      diapo_state.step = DIAPO_STEP_FADE_OUT;
+      loop_set_timer(diapo_state.timer, 0, DIAPO_FADE_PERIOD_MS);
+      break;
+
+    case DIAPO_STEP_FADE_OUT :
+      if (diapo_state.bright >= 1){
+        pwm_set_brightness(diapo_state.bright);
+        diapo_state.bright--;
+        break;
+      }
+      show_next();
+      diapo_state.bright = 1;
+      diapo_state.step = DIAPO_STEP_FADE_IN;
+      break;
+
+    case DIAPO_STEP_FADE_IN :
+      if (diapo_state.bright <= diapo_state.init_bright){
+        pwm_set_brightness(diapo_state.bright);
+        diapo_state.bright++;
+        break;
+      }
+      if (diapo_state.current_image_id != 0){
+        ilDeleteImages( 1, &diapo_state.current_image_id);
+      }
+      diapo_state.current_image_id = diapo_state.next_image_id;
+      diapo_state.next_image_id = 0;
+      diapo_state.step = DIAPO_STEP_LOAD;
+      loop_set_timer(diapo_state.timer, diapo_state.delay * 1000, 0);
+      break;
   }
-  if (no_file)
-    diapo_state.error = true;
-  return NULL;
 }
     
 static void draw_string(ILuint back_id, const char * text, int x, int y, int size){
@@ -220,93 +237,71 @@ static void draw_string(ILuint back_id, const char * text, int x, int y, int siz
 }
 
                           
-void clock_thread(void){
+/** Event loop callback : refresh the clock screen */
+static void clock_tick(void * data){
   char buff_text[32];
   time_t curr_time;
   struct tm * ptm;   
-  unsigned char * img_buffer;   
+  unsigned char * img_buffer = diapo_state.img_buffer;   
   int text_width, text_height, orig;  
   struct gps_data info;
   int y, i;
-  ILuint  img_id; 
- 
+  ILuint  img_id = diapo_state.img_id; 
 
-  /* Generate ILut image for background */
-  img_buffer = calloc(4 * diapo_state.screen_x * diapo_state.screen_y, 1); 
+  memset (&info, 0, sizeof(struct gps_data));
+  /* Get GPS info */
+  gps_get_data(&info);
+  
+  /* Set background to black */
+  memset(img_buffer, 0, 4 * diapo_state.screen_x * diapo_state.screen_y);     
   for (i = 0; i < diapo_state.screen_x * diapo_state.screen_y; i++){
-      img_buffer[i*4 + 3] = 255;
+    img_buffer[i*4 + 3] = 255;
   }
-  /* FIXME cas degrade */
-  ilGenImages(1, &img_id);   
-  memset (&info, 0, sizeof(struct gps_data));
+  ilBindImage(img_id);
+  ilTexImage(diapo_state.screen_x, diapo_state.screen_y, 1, 
+             4, IL_RGBA, IL_UNSIGNED_BYTE, img_buffer);
+             
   
-  while (!diapo_state.end_asked){
-    /* Get GPS info */
-    gps_get_data(&info);
-    
-    /* Set background to black */
-    memset(img_buffer, 0, 4 * diapo_state.screen_x * diapo_state.screen_y);     
-    for (i = 0; i < diapo_state.screen_x * diapo_state.screen_y; i++){
-      img_buffer[i*4 + 3] = 255;
-    }
-    ilBindImage(img_id);
-    ilTexImage(diapo_state.screen_x, diapo_state.screen_y, 1, 
-               4, IL_RGBA, IL_UNSIGNED_BYTE, img_buffer);
-               
-    
-    /* Display time */
-    time(&curr_time);
-    ptm = localtime(&curr_time);
-    snprintf(buff_text,sizeof(buff_text),"%02d : %02d",ptm->tm_hour, ptm->tm_min);   
-    font_change_size(50);      
-    font_get_size(buff_text, &text_width, &text_height, &orig);
-    draw_string(img_id, buff_text,  diapo_state.screen_x - text_width - 20, 20, 50);
-     
+  /* Display time */
+  time(&curr_time);
+  ptm = localtime(&curr_time);
+  snprintf(buff_text,sizeof(buff_text),"%02d : %02d",ptm->tm_hour, ptm->tm_min);   
+  font_change_size(50);      
+  font_get_size(buff_text, &text_width, &text_height, &orig);
+  draw_string(img_id, buff_text,  diapo_state.screen_x - text_width - 20, 20, 50);
+   
 
-    /* Display GPS infos */    
-    y = 20;
-    snprintf(buff_text,sizeof(buff_text),"Lat    : %02i %02i", info.lat_deg, info.lat_mins);
-    font_change_size(15); 
-    font_get_size(buff_text, &text_width, &text_height, &orig);
-    draw_string(img_id, buff_text,  20, y, 15);
-    y += text_height + 15;
-    snprintf(buff_text,sizeof(buff_text),"Long : %02i %02i", info.long_deg, info.long_mins);  
-    draw_string(img_id, buff_text,  20, y, 15);    
-    y += text_height + 15;
-    snprintf(buff_text,sizeof(buff_text),"Alt     : %04i m", info.alt_cm / 100);
-    draw_string(img_id, buff_text,  20, y, 15);        
-    y += text_height + 15;
-    
-    /* Display speed */    
-    if (config_get_use_miles())
-        snprintf(buff_text,sizeof(buff_text),"%03i mph", (info.speed_kmh * 621) / 1000);
-    else
-        snprintf(buff_text,sizeof(buff_text),"%03i km/h", info.speed_kmh);
-    font_change_size(40);      
-    font_get_size(buff_text, &text_width, &text_height, &orig);
-    draw_string(img_id, buff_text, (diapo_state.screen_x - text_width) / 2, 
-                (diapo_state.screen_y + y - text_height) / 2, 40);            
-
-    /* Display final image on framebuffer */
-    
-    ilBindImage(img_id);      
-    ilCopyPixels(0, 0, 0, diapo_state.screen_x, diapo_state.screen_y, 1,
-                 IL_RGBA, IL_UNSIGNED_BYTE, img_buffer);    
-    draw_RGB_buffer(img_buffer, 0, 0, diapo_state.screen_x, diapo_state.screen_y, true);        
-    
-    wait_next_cycle(1);
-  }
-  free(img_buffer);    
-  ilDeleteImages( 1, &img_id);
-}
+  /* Display GPS infos */    
+  y = 20;
+  snprintf(buff_text,sizeof(buff_text),"Lat    : %02i %02i", info.lat_deg, info.lat_mins);
+  font_change_size(15); 
+  font_get_size(buff_text, &text_width, &text_height, &orig);
+  draw_string(img_id, buff_text,  20, y, 15);
+  y += text_height + 15;
+  snprintf(buff_text,sizeof(buff_text),"Long : %02i %02i", info.long_deg, info.long_mins);  
+  draw_string(img_id, buff_text,  20, y, 15);    
+  y += text_height + 15;
+  snprintf(buff_text,sizeof(buff_text),"Alt     : %04i m", info.alt_cm / 100);
+  draw_string(img_id, buff_text,  20, y, 15);        
+  y += text_height + 15;
+  
+  /* Display speed */    
+  if (config_get_use_miles())
+      snprintf(buff_text,sizeof(buff_text),"%03i mph", (info.speed_kmh * 621) / 1000);
+  else
+      snprintf(buff_text,sizeof(buff_text),"%03i km/h", info.speed_kmh);
+  font_change_size(40);      
+  font_get_size(buff_text, &text_width, &text_height, &orig);
+  draw_string(img_id, buff_text, (diapo_state.screen_x - text_width) / 2, 
+              (diapo_state.screen_y + y - text_height) / 2, 40);            
 
-static void * periodic_thread(void *param){
-    if (diapo_state.type == DIAPO_CLOCK ){
-        clock_thread();
-    } else {
-        diapo_thread(param);
-    }
-    return NULL;
+  /* Display final image on framebuffer */
+  
+  ilBindImage(img_id);      
+  ilCopyPixels(0, 0, 0, diapo_state.screen_x, diapo_state.screen_y, 1,
+               IL_RGBA, IL_UNSIGNED_BYTE, img_buffer);    
+  draw_RGB_buffer(img_buffer, 0, 0, diapo_state.screen_x, diapo_state.screen_y, true);        
+  draw_refresh();
 }
 
 void diapo_release(void){
@@ -352,31 +347,50 @@ bool diapo_init(const  struct diapo_config * conf ){
 }
 
 bool diapo_resume (void){
-  pthread_attr_t attr;
-
   if ((diapo_state.error) ||
-      (diapo_state.thread_id != 0)){
+      (diapo_state.timer >= 0)){
     return false;
   }
-  pthread_attr_init(&attr);   
-  diapo_state.end_asked = false;  
-  pthread_mutex_lock(&diapo_state.mutex);
-  if (pthread_create(&diapo_state.thread_id, &attr, periodic_thread, NULL) != 0){
-   pthread_attr_destroy(&attr);
-    return false;
+  if (diapo_state.type == DIAPO_CLOCK){
+    /* FIXME cas degrade */
+    diapo_state.img_buffer = calloc(4 * diapo_state.screen_x * diapo_state.screen_y, 1); 
+    if (diapo_state.img_buffer == NULL){
+      return false;
+    }
+    ilGenImages(1, &diapo_state.img_id);   
+    diapo_state.timer = loop_add_timer(0, DIAPO_CLOCK_PERIOD_MS, clock_tick, NULL);
+  } else {
+    diapo_state.step = DIAPO_STEP_LOAD;
+    diapo_state.timer = loop_add_timer(0, 0, diapo_tick, NULL);
   }
-  pthread_attr_destroy(&attr);
-  return true;
+  return (diapo_state.timer >= 0);
 }
 
 bool diapo_stop (void){  
-  if (diapo_state.thread_id == 0){
+  if (diapo_state.timer < 0){
     return false;
   }  
-  diapo_state.end_asked = true;   
-  pthread_mutex_unlock(&diapo_state.mutex);
-  pthread_join(diapo_state.thread_id, NULL);
-  diapo_state.thread_id = 0;
+  loop_remove_timer(diapo_state.timer);
+  diapo_state.timer = -1;
+  if (diapo_state.type == DIAPO_CLOCK){
+    free(diapo_state.img_buffer);
+    diapo_state.img_buffer = NULL;
+    ilDeleteImages( 1, &diapo_state.img_id);
+    diapo_state.img_id = 0;
+  } else {
+    /* Transition interrupted : restore the backlight */
+    if (diapo_state.step != DIAPO_STEP_LOAD){
+      pwm_set_brightness(diapo_state.init_bright);
+    }
+    if (diapo_state.current_image_id != 0){
+      ilDeleteImages( 1, &diapo_state.current_image_id);
+      diapo_state.current_image_id = 0;
+    }
+    if (diapo_state.next_image_id != 0){
+      ilDeleteImages( 1, &diapo_state.next_image_id);
+      diapo_state.next_image_id = 0;
+    }
+  }
   return true;
 }
 
@@ -33,6 +33,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <linux/fb.h>
@@ -40,103 +41,513 @@
 #include <IL/ilu.h>
 
 #include "debug.h"
+#include "log.h"
 #include "widescreen.h"
+#include "blit.h"
 #include "play_int.h"
+#include "overlay.h"
 #include "font.h"
 #include "engine.h"
 #include "draw.h"
 
+/* Max number of damaged rectangles tracked between two refreshes */
+#define DAMAGE_MAX_RECTS 8
+
+/** A rectangle in frame buffer coordinates */
+struct draw_rect{
+    int x1, y1; /**< Top left corner (included) */
+    int x2, y2; /**< Bottom right corner (excluded) */
+};
+
 static unsigned short *screen_buffer;
 static bool refresh;
 
-/** Write directly a RGB or RGBA buffer to the frame buffer */
-static void display_RGB_to_fb(unsigned char * buffer, int x, int y, int w, int h, bool transparency){        
-    unsigned short * buffer16;
-    int buffer_size;
-    int i,j ;
+/* Regions of screen_buffer that changed since last draw_refresh() */
+static struct {
+    struct draw_rect rects[DAMAGE_MAX_RECTS];
+    int nb;
+} damage;
+
+/* Skin background converted in the frame buffer format */
+static struct {
+    uint16_t * pixels;
+    ILuint img;
+    bool owned;             /**< pixels have been allocated by this module */
+} bg_cache;
+
+/* Called each time a zone of the background is restored on screen */
+static draw_restore_cb restore_cb;
+
+/* Frame buffer flush statistics */
+static struct {
+    unsigned long bytes;        /**< Bytes flushed during current period */
+    unsigned long rate;         /**< Bytes flushed during last complete second */
+    time_t period_start;
+} flush_stats;
+
+
+static inline bool rect_touch(const struct draw_rect * a, const struct draw_rect * b){
+    return ((a->x1 <= b->x2) && (b->x1 <= a->x2) &&
+            (a->y1 <= b->y2) && (b->y1 <= a->y2));
+}
+
+static inline void rect_union(struct draw_rect * a, const struct draw_rect * b){
+    if (b->x1 < a->x1) a->x1 = b->x1;
+    if (b->y1 < a->y1) a->y1 = b->y1;
+    if (b->x2 > a->x2) a->x2 = b->x2;
+    if (b->y2 > a->y2) a->y2 = b->y2;
+}
+
+static inline int rect_area(const struct draw_rect * a){
+    return (a->x2 - a->x1) * (a->y2 - a->y1);
+}
+
+/** Record a damaged zone (frame buffer coordinates) to be flushed on next draw_refresh()
+ *
+ * Overlapping or adjacent rectangles are merged. When the list is full, the new zone is merged
+ * with the rectangle whose area grows the less.
+ */
+static void damage_add(int x1, int y1, int x2, int y2){
+    struct draw_rect r;
+    struct draw_rect tmp;
     int screen_width, screen_height;
+    int i, best, best_cost, cost;
+    bool merged;
+
     ws_get_size(&screen_width, &screen_height);
+    r.x1 = (x1 < 0) ? 0 : x1;
+    r.y1 = (y1 < 0) ? 0 : y1;
+    r.x2 = (x2 > screen_width) ? screen_width : x2;
+    r.y2 = (y2 > screen_height) ? screen_height : y2;
+    if ((r.x1 >= r.x2) || (r.y1 >= r.y2))
+        return;
+
+    /* Merge with every touched rectangle until the list is stable */
+    do {
+        merged = false;
+        for (i = 0; i < damage.nb; i++){
+            if (rect_touch(&r, &damage.rects[i])){
+                rect_union(&r, &damage.rects[i]);
+                damage.rects[i] = damage.rects[--damage.nb];
+                merged = true;
+                break;
+            }
+        }
+    } while (merged);
+
+    if (damage.nb < DAMAGE_MAX_RECTS){
+        damage.rects[damage.nb++] = r;
+        return;
+    }
+    /* List full : merge with the cheapest candidate */
+    best = 0;
+    best_cost = -1;
+    for (i = 0; i < damage.nb; i++){
+        tmp = damage.rects[i];
+        rect_union(&tmp, &r);
+        cost = rect_area(&tmp) - rect_area(&damage.rects[i]);
+        if ((best_cost < 0) || (cost < best_cost)){
+            best_cost = cost;
+            best = i;
+        }
+    }
+    rect_union(&damage.rects[best], &r);
+}
+
+/** Return the number of bytes flushed to the frame buffer during the last second */
+unsigned long draw_get_flush_rate(void){
+    return flush_stats.rate;
+}
+
+static void update_flush_stats(unsigned long bytes){
+    time_t now = time(NULL);
+
+    if (now != flush_stats.period_start){
+        flush_stats.rate = (now == flush_stats.period_start + 1) ? flush_stats.bytes : 0;
+        if (flush_stats.rate != 0)
+            log_write(LOG_VERBOSE, "Frame buffer flush : %lu bytes/s", flush_stats.rate);
+        flush_stats.bytes = 0;
+        flush_stats.period_start = now;
+    }
+    flush_stats.bytes += bytes;
+}
+
+static bool alloc_screen_buffer(void){
+    int screen_width, screen_height;
 
     if (screen_buffer == NULL){
+        ws_get_size(&screen_width, &screen_height);
         screen_buffer = malloc(screen_width * screen_height * 2);
+        if (screen_buffer == NULL){
+            fprintf(stderr, "Allocation error\n");
+            return false;
+        }
     }
-    if (x < 0) {
-        x = 0;
+    return true;
+}
+
+/** Clip a zone given in skin coordinates to the screen
+ *
+ * \param[out] dx number of columns removed on the left
+ * \param[out] dy number of lines removed on the top
+ *
+ * \retval false nothing left to display
+ */
+static bool clip_zone(int * x, int * y, int * w, int * h, int * dx, int * dy){
+    int screen_width, screen_height;
+    int max_x, max_y;
+
+    ws_get_size(&screen_width, &screen_height);
+    max_x = (ws_are_axes_inverted() ? screen_height : screen_width);
+    max_y = (ws_are_axes_inverted() ? screen_width : screen_height);
+    *dx = (*x < 0) ? -*x : 0;
+    *dy = (*y < 0) ? -*y : 0;
+    *x += *dx;
+    *w -= *dx;
+    *y += *dy;
+    *h -= *dy;
+    if (*x + *w > max_x)
+        *w = max_x - *x;
+    if (*y + *h > max_y)
+        *h = max_y - *y;
+    return ((*w > 0) && (*h > 0));
+}
+
+/** Compute the frame buffer rectangle of a clipped zone given in skin coordinates */
+static void zone_to_fb(int x, int y, int w, int h, struct draw_rect * r){
+    int screen_width, screen_height;
+
+    ws_get_size(&screen_width, &screen_height);
+    if (ws_are_axes_inverted() == 0){
+        r->x1 = x;
+        r->y1 = y;
+        r->x2 = x + w;
+        r->y2 = y + h;
+    } else {
+        /* Skin pixel (x,y) is displayed at column (screen_width - 1 - y) of line x */
+        r->x1 = screen_width - y - h;
+        r->y1 = x;
+        r->x2 = screen_width - y;
+        r->y2 = x + w;
     }
-    if (y < 0) {
-        y = 0;
+}
+
+/** Write a RGB or RGBA buffer in a RGB565 buffer with the frame buffer layout
+ *
+ * RGBA buffers are alpha blended over the current content of the target
+ *
+ * \param target screen_buffer or the background cache
+ * \param src_stride length of a buffer line in bytes
+ */
+static void blit_to_target(uint16_t * target, const unsigned char * buffer, int src_stride,
+                           int x, int y, int w, int h, bool transparency){        
+    int screen_width, screen_height;
+    int bpp = (transparency ? 4 : 3);
+    int dx, dy;
+    struct draw_rect r;
+
+    if (!clip_zone(&x, &y, &w, &h, &dx, &dy))
+        return;
+    buffer += dy * src_stride + dx * bpp;
+    ws_get_size(&screen_width, &screen_height);
+    zone_to_fb(x, y, w, h, &r);
+
+    if (ws_are_axes_inverted() == 0){
+        uint16_t * dst = &target[r.y1 * screen_width + r.x1];
+        if (transparency)
+            blit_rgba32_to_rgb565(dst, screen_width, buffer, src_stride, w, h, BLIT_NORMAL);
+        else
+            blit_rgb24_to_rgb565(dst, screen_width, buffer, src_stride, w, h, BLIT_NORMAL);
+    } else {
+        /* First source pixel is on the top right corner */
+        uint16_t * dst = &target[r.y1 * screen_width + r.x2 - 1];
+        if (transparency)
+            blit_rgba32_to_rgb565(dst, screen_width, buffer, src_stride, w, h, BLIT_INVERTED);
+        else
+            blit_rgb24_to_rgb565(dst, screen_width, buffer, src_stride, w, h, BLIT_INVERTED);
     }
-  
-    
-    /* Alloc buffer for RBG conversion */
-    buffer_size = w * h * 2 ;
-    buffer16 = malloc( buffer_size );
-    if (buffer16 == NULL){
-      fprintf(stderr, "Allocation error\n");
-      return;
+    if (target == screen_buffer){
+        damage_add(r.x1, r.y1, r.x2, r.y2);
+        refresh = true;   
     }
+}
 
-    if (transparency){
-        if (ws_are_axes_inverted() == 0){
-            for (i=y; i<y+h; i++){
-                for(j=x; j<x+w; j++){
-                    buffer16[((i-y)*w)+(j-x)] = screen_buffer[j+(i*screen_width)];
-                }
-            }
-        }else{
-            int tmp;
-            tmp = y;
-            y = x;
-            x = screen_width - tmp;
-            /* Magic combination for inverted coordinates */
-            for (i=x; i>x-h; i--){
-                for(j=y; j<y+w; j++){
-                    buffer16[(-i+x)*w+(j-y)] = screen_buffer[j*screen_width+i];
-                }
-            }
-        }
+/** Write directly a RGB or RGBA buffer to the frame buffer
+ *
+ * RGBA buffers are alpha blended over the current content of the screen buffer
+ */
+static void display_RGB_to_fb(unsigned char * buffer, int x, int y, int w, int h, bool transparency){        
+    if (!alloc_screen_buffer())
+        return;
+    blit_to_target(screen_buffer, buffer, w * (transparency ? 4 : 3), x, y, w, h, transparency);
+}
+
+/** Blend a part of a RGBA buffer over the screen
+ *
+ * \param buffer the whole RGBA buffer, whose top left corner is displayed at (x, y)
+ * \param w the width of the whole buffer
+ * \param part_x, part_y, part_w, part_h the part to display, in skin coordinates
+ */
+void draw_RGBA_part(const unsigned char * buffer, int x, int y, int w,
+                    int part_x, int part_y, int part_w, int part_h){
+    if (!alloc_screen_buffer())
+        return;
+    buffer += ((part_y - y) * w + (part_x - x)) * 4;
+    blit_to_target(screen_buffer, buffer, w * 4, part_x, part_y, part_w, part_h, true);
+}
+
+/** Is the background cache usable for the current display */
+static inline bool bg_cache_available(void){
+    return ((bg_cache.pixels != NULL) && (eng_get_mode() != MODE_VIDEO));
+}
+
+/** Convert the skin background once in the frame buffer format
+ *
+ * The cache is then used to restore any zone of the background with simple lines copies.
+ * It is only used in audio mode (in video mode the display is sent to mplayer as RGBA).
+ *
+ * \param img the skin background (0 to release the cache)
+ * \retval true on success
+ */
+bool draw_background_cache_init(ILuint img){
+    int screen_width, screen_height;
+    int width, height;
+    unsigned char * buffer;
+
+    if (bg_cache.owned)
+        free(bg_cache.pixels);
+    bg_cache.pixels = NULL;
+    bg_cache.img = 0;
+    bg_cache.owned = false;
+    if (img == 0)
+        return true;
+
+    ws_get_size(&screen_width, &screen_height);
+    ilBindImage(img);
+    width  = ilGetInteger(IL_IMAGE_WIDTH);
+    height = ilGetInteger(IL_IMAGE_HEIGHT);
+    buffer = malloc(width * height * 4);
+    bg_cache.pixels = calloc(screen_width * screen_height, 2);
+    if ((buffer == NULL) || (bg_cache.pixels == NULL)){
+        fprintf(stderr, "Allocation error\n");
+        free(buffer);
+        free(bg_cache.pixels);
+        bg_cache.pixels = NULL;
+        return false;
     }
+    ilCopyPixels(0, 0, 0, width, height, 1, IL_RGBA, IL_UNSIGNED_BYTE, buffer);
+    blit_to_target(bg_cache.pixels, buffer, width * 4, 0, 0, width, height, true);
+    bg_cache.img = img;
+    bg_cache.owned = true;
+    free(buffer);
+    return true;
+}
 
-    for( i = 0; i < (w * h); i++ ){
-        if (transparency == false ){
-            /* Initial buffer is RGB24 */
-            buffer16[i] =  ( (buffer[3*i] & 0xF8)  <<  8 | /* R 5 bits*/
-                            (buffer[3*i+1] & 0xFC) << 3 | /* G 6 bits */
-                            (buffer[3*i+2]>>3));          /* B 5 bits*/
-        } else {
-            /* Initial buffer is RGBA*/   
-            /* FIXME only binary transparency for now ... */
-            if (buffer[4*i+3] != 0){
-                buffer16[i] =  ( (buffer[4*i] & 0xF8) << 8 |   /* R 5 bits*/
-                                 (buffer[4*i+1] & 0xFC) << 3 | /* G 6 bits */
-                                 (buffer[4*i+2]>>3));          /* B 5 bits*/
-            }                       
-        }
+/** Use a skin background already converted in the frame buffer format
+ *
+ * \param img the skin background
+ * \param pixels converted background (not copied : it must remain valid until the cache is released)
+ * \param len length of the converted background
+ * \retval true on success
+ * \retval false pixels do not match the current screen (nothing done)
+ */
+bool draw_background_cache_attach(ILuint img, const void * pixels, size_t len){
+    int screen_width, screen_height;
+
+    ws_get_size(&screen_width, &screen_height);
+    if ((pixels == NULL) || (len != (size_t)screen_width * screen_height * 2))
+        return false;
+    draw_background_cache_init(0);
+    bg_cache.pixels = (uint16_t *)pixels;
+    bg_cache.img = img;
+    return true;
+}
+
+/** Get the skin background converted in the frame buffer format
+ *
+ * \param len [out] length of the converted background
+ * \return the converted background, NULL if there is none
+ */
+const void * draw_background_cache_get(size_t * len){
+    int screen_width, screen_height;
+
+    ws_get_size(&screen_width, &screen_height);
+    *len = (size_t)screen_width * screen_height * 2;
+    return bg_cache.pixels;
+}
+
+/** Set the function called each time a zone of the skin background is restored on screen (NULL for none) */
+void draw_set_restore_cb(draw_restore_cb cb){
+    restore_cb = cb;
+}
+
+/** Restore a zone of the skin background on screen
+ *
+ * \retval true the zone has been restored
+ * \retval false no background cache is available for the current display (nothing done)
+ */
+bool draw_restore_background(int x, int y, int w, int h){
+    int screen_width, screen_height;
+    int dx, dy, line;
+    int line_size;
+    struct draw_rect r;
+
+    if (!bg_cache_available() || !alloc_screen_buffer())
+        return false;
+    if (!clip_zone(&x, &y, &w, &h, &dx, &dy))
+        return true;
+    ws_get_size(&screen_width, &screen_height);
+    zone_to_fb(x, y, w, h, &r);
+    line_size = (r.x2 - r.x1) * 2;
+    for (line = r.y1; line < r.y2; line++){
+        memcpy(&screen_buffer[line * screen_width + r.x1], &bg_cache.pixels[line * screen_width + r.x1], line_size);
     }
+    damage_add(r.x1, r.y1, r.x2, r.y2);
+    refresh = true;
+    if (restore_cb != NULL)
+        restore_cb(x, y, w, h);
+    return true;
+}
+
+/** Redraw a zone of the skin background
+ *
+ * The background cache is used if available, otherwise the zone is copied from the skin image.
+ */
+void draw_background_zone(int x, int y, int w, int h){
+    unsigned char * buffer;
+
+    if (draw_restore_background(x, y, w, h))
+        return;
+    buffer = malloc(4 * w * h);
+    if (buffer == NULL)
+        return;
+    ilBindImage(skin_get_background());
+    ilCopyPixels(x, y, 0, w, h, 1, IL_RGBA, IL_UNSIGNED_BYTE, buffer);
+    draw_RGB_buffer(buffer, x, y, w, h, true);
+    free(buffer);
+}
+
+/** Blend an image (or one frame of an animation) over the screen
+ *
+ * \note only available when the background cache is used, see :draw_restore_background()
+ */
+static void overlay_img(ILuint img, ILuint frame_id, int x, int y){
+    int width, height;
+    unsigned char * buffer;
+
+    ilBindImage(img);
+    if (frame_id != 0)
+        ilActiveImage(frame_id);
+    width  = ilGetInteger(IL_IMAGE_WIDTH);
+    height = ilGetInteger(IL_IMAGE_HEIGHT);
+    buffer = malloc(width * height * 4);
+    if (buffer == NULL){
+        fprintf(stderr, "Allocation error\n");
+        return;
+    }
+    ilCopyPixels(0, 0, 0, width, height, 1, IL_RGBA, IL_UNSIGNED_BYTE, buffer);
+    display_RGB_to_fb(buffer, x, y, width, height, true);
+    free(buffer);
+}
+
+/** Blend an image over the skin background restored from the cache
+ *
+ * \retval false no background cache is available for the current display (nothing done)
+ */
+bool draw_img_over_background(ILuint img, int x, int y, int bg_x, int bg_y, int bg_w, int bg_h){
+    if (!draw_restore_background(bg_x, bg_y, bg_w, bg_h))
+        return false;
+    overlay_img(img, 0, x, y);
+    return true;
+}
+
+/** Draw the outline of a rectangle directly in the screen buffer
+ *
+ * Lines are drawn on columns 1 and w-1 and on lines 1 and h-1 of the zone
+ * \retval false no background cache is available for the current display (nothing done)
+ */
+bool draw_select_frame(int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b){
+    unsigned char * line;
+    int i;
+
+    if (!bg_cache_available() || !alloc_screen_buffer())
+        return false;
+    if ((w < 2) || (h < 2))
+        return true;
+    line = malloc(w * 3);
+    if (line == NULL)
+        return true;
+    for (i = 0; i < w; i++){
+        line[3*i]   = r;
+        line[3*i+1] = g;
+        line[3*i+2] = b;
+    }
+    /* Horizontal lines (w-1 pixels from column 1) */
+    blit_to_target(screen_buffer, line, 0, x + 1, y + 1, w - 1, 1, false);
+    blit_to_target(screen_buffer, line, 0, x + 1, y + h - 1, w - 1, 1, false);
+    /* Vertical lines : a null stride repeats the same source pixel on each line */
+    blit_to_target(screen_buffer, line, 0, x + 1, y + 1, 1, h - 1, false);
+    blit_to_target(screen_buffer, line, 0, x + w - 1, y + 1, 1, h - 1, false);
+    free(line);
+    return true;
+}
+
+
+/** Convert a RGB image once in the frame buffer format
+ *
+ * The result can then be displayed any number of times with :draw_sprite() without any conversion.
+ *
+ * \param buffer RGB pixels (w x h)
+ * \return the converted pixels (w x h RGB565 pixels with the frame buffer layout) to be freed by the caller,
+ *         NULL on error
+ */
+uint16_t * draw_sprite_convert(const unsigned char * buffer, int w, int h){
+    uint16_t * sprite;
 
+    sprite = malloc(w * h * 2);
+    if (sprite == NULL){
+        fprintf(stderr, "Allocation error\n");
+        return NULL;
+    }
     if (ws_are_axes_inverted() == 0){
-        for (i=y; i<y+h; i++){
-            for(j=x; j<x+w; j++){
-                screen_buffer[j+(i*screen_width)] = buffer16[((i-y)*w)+(j-x)];
-            }
-        }
+        blit_rgb24_to_rgb565(sprite, w, buffer, w * 3, w, h, BLIT_NORMAL);
     } else {
-        int tmp;
-
-        tmp = y;
-        y = x;
-        x = screen_width - tmp;
-        /* Magic combination for inverted coordinates */
-        for (i=x; i>x-h; i--){
-            for(j=y; j<y+w; j++){
-                screen_buffer[j*screen_width+i] = buffer16[(-i+x)*w+(j-y)];
-            }
-        }
+        /* Sprite is h pixels wide once rotated : first source pixel is on the top right corner */
+        blit_rgb24_to_rgb565(&sprite[h - 1], h, buffer, w * 3, w, h, BLIT_INVERTED);
     }
-    free( buffer16 );
-    refresh = true;   
+    return sprite;
 }
 
+/** Display a sprite converted by :draw_sprite_convert()
+ *
+ * Lines are simply copied to the screen buffer.
+ *
+ * \note only available in audio mode (frame buffer display)
+ */
+void draw_sprite(const uint16_t * sprite, int x, int y, int w, int h){
+    int screen_width, screen_height;
+    int sprite_width, line;
+    struct draw_rect r, clip;
+
+    if ((eng_get_mode() == MODE_VIDEO) || !alloc_screen_buffer())
+        return;
+    ws_get_size(&screen_width, &screen_height);
+    zone_to_fb(x, y, w, h, &r);
+    sprite_width = r.x2 - r.x1;
+    clip.x1 = (r.x1 < 0) ? 0 : r.x1;
+    clip.y1 = (r.y1 < 0) ? 0 : r.y1;
+    clip.x2 = (r.x2 > screen_width) ? screen_width : r.x2;
+    clip.y2 = (r.y2 > screen_height) ? screen_height : r.y2;
+    if ((clip.x1 >= clip.x2) || (clip.y1 >= clip.y2))
+        return;
+    for (line = clip.y1; line < clip.y2; line++){
+        memcpy(&screen_buffer[line * screen_width + clip.x1],
+               &sprite[(line - r.y1) * sprite_width + clip.x1 - r.x1],
+               (clip.x2 - clip.x1) * 2);
+    }
+    damage_add(clip.x1, clip.y1, clip.x2, clip.y2);
+    refresh = true;
+}
 
 /** Display a RGB or RGBA buffer on screen */ 
 void draw_RGB_buffer(unsigned char * buffer, int x, int y, int w, int h, bool transparency){
@@ -145,6 +556,9 @@ void draw_RGB_buffer(unsigned char * buffer, int x, int y, int w, int h, bool tr
   int i;
     
   if (eng_get_mode() == MODE_VIDEO) {
+    /* Only the dirty zone is named when the OSD is shared with mplayer */
+    if (overlay_update(buffer, x, y, w, h, transparency))
+      return;
     if (transparency){
       const struct skin_config * conf = skin_get_config();
       buffer_size = w * h * 4;
@@ -173,57 +587,60 @@ void draw_RGB_buffer(unsigned char * buffer, int x, int y, int w, int h, bool tr
 }
 
 
+/** Build the RGBA patch of a text drawn over the skin background
+ *
+ * \param size font size, if 0 then default size is used
+ * \return the patch (w x h RGBA pixels) to be freed by the caller, NULL on error
+ */
+unsigned char * draw_text_patch(const char * text, int x, int y, int w, int h, const struct font_color *color, int size){
+    unsigned char * patch;
+
+    patch = malloc(4 * w * h);    
+    if (patch == NULL)
+        return NULL;
+    /* Copy the appropriate portion of the background */
+    ilBindImage(skin_get_background()); 
+    ilCopyPixels(x, y, 0, w, h, 1,
+                 IL_RGBA, IL_UNSIGNED_BYTE, patch);                             
+    /* Blend the glyphs directly over it */
+    if (size != 0){
+        font_change_size(size);
+    }    
+    font_render(color, text, patch, w, h);
+    if (size != 0)
+        font_restore_default_size();    
+    return patch;
+}
+
 /** Daw text on the skin 
  * \param size font size, if 0 then default size is used
  */
 void draw_text(const char * text, int x, int y, int w, int h, const struct font_color *color, int size){
     unsigned char * buffer_to_display;    
     unsigned char * text_buffer;
-    ILuint  img_id; 
-    ILuint text_id;
     int text_width, text_height;         
         
-    buffer_to_display = malloc(4 * w * h);    
-    if (buffer_to_display == NULL)
+    if (draw_restore_background(x, y, w, h)){
+        /* Fast path : blend the text directly over the restored background */
+        if (size != 0){
+            font_change_size(size);
+        }    
+        if (font_draw(color, text, &text_buffer, &text_width, &text_height)){
+            blit_to_target(screen_buffer, text_buffer, text_width * 4, x, y,
+                           (text_width < w) ? text_width : w, (text_height < h) ? text_height : h, true);
+            free(text_buffer);
+        }
+        if (size != 0)
+            font_restore_default_size();    
         return;
-    ilGenImages(1, &img_id);
-    /* Bind to backgound image and copy the appropriate portion */
-    ilBindImage(skin_get_background()); 
-    ilCopyPixels(x, y, 0, w, h, 1,
-                 IL_RGBA, IL_UNSIGNED_BYTE, buffer_to_display);                             
-    ilBindImage(img_id);
-    ilTexImage(w, h, 1, 
-               4, IL_RGBA, IL_UNSIGNED_BYTE, buffer_to_display);
-    /* Flip image because an ilTexImage is always LOWER_LEFT */
-    iluFlipImage();
-    
-    /* Generate the font rendering in a dedicated image */    
-    if (size != 0){
-        font_change_size(size);
-    }    
-    if (font_draw(color, text, &text_buffer, &text_width, &text_height) == false){
-        goto out_release_buffer;
     }
-    
-    ilGenImages(1, &text_id);
-    ilBindImage(text_id);
-    ilTexImage(text_width, text_height, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE, text_buffer);         
-    iluFlipImage();
-    /* Combinate font and background */
-    ilBindImage(img_id);  
-    ilOverlayImage(text_id, 0, 0, 0);     
-    ilCopyPixels(0, 0, 0, w, h, 1,
-                 IL_RGBA, IL_UNSIGNED_BYTE, buffer_to_display);                 
+
+    buffer_to_display = draw_text_patch(text, x, y, w, h, color, size);
+    if (buffer_to_display == NULL)
+        return;
     /* Display the result on screen */
     draw_RGB_buffer(buffer_to_display, x, y, w, h, true);     
-    /* Free resources */      
-    free(text_buffer);
-    ilDeleteImages( 1, &text_id);
-out_release_buffer:    
     free(buffer_to_display);
-    ilDeleteImages( 1, &img_id);
-    if (size != 0)
-        font_restore_default_size();    
     return ;        
 }
 
@@ -247,6 +664,11 @@ void draw_cursor(ILuint cursor_id, ILuint frame_id, int x, int y ){
   ilBindImage(cursor_id);
   width  = ilGetInteger(IL_IMAGE_WIDTH);
   height = ilGetInteger(IL_IMAGE_HEIGHT);
+  if (draw_restore_background(x, y, width, height)){
+    /* Fast path : blend the cursor directly over the restored background */
+    overlay_img(cursor_id, frame_id, x, y);
+    return;
+  }
   /* Alloc buffer for RBGA conversion */
   buffer_size = width * height * 4;
     buffer = malloc( buffer_size );
@@ -298,6 +720,11 @@ void draw_img(ILuint img){
     unsigned char * buffer;
     int buffer_size;
 
+    if ((img == bg_cache.img) && bg_cache_available()){
+        ilBindImage(img);
+        if (draw_restore_background(0, 0, ilGetInteger(IL_IMAGE_WIDTH), ilGetInteger(IL_IMAGE_HEIGHT)))
+            return;
+    }
     ilBindImage(img);
     width  = ilGetInteger(IL_IMAGE_WIDTH);
     height = ilGetInteger(IL_IMAGE_HEIGHT);
@@ -319,6 +746,7 @@ void draw_screen_clear(void){
     
     ws_get_size(&screen_width, &screen_height);    
     memset(screen_buffer, 0, screen_width*screen_height*2);
+    damage_add(0, 0, screen_width, screen_height);
     refresh = true;
 }
 
@@ -326,6 +754,8 @@ void draw_refresh(void){
     int fb;
     static unsigned short * fb_mmap;   
     int screen_width, screen_height;
+    unsigned long flushed = 0;
+    int i, y;
     
     if (!refresh)
         return;    
@@ -345,6 +775,25 @@ void draw_refresh(void){
             }
             close(fb);
     }
-    memcpy(fb_mmap, screen_buffer, screen_width*screen_height*2);
+    /* Only copy the damaged zones */
+    for (i = 0; i < damage.nb; i++){
+        const struct draw_rect * r = &damage.rects[i];
+        int line_size = (r->x2 - r->x1) * 2;
+        int offset;
+
+        if (line_size == screen_width * 2){
+            /* Full width zone : one single copy */
+            offset = r->y1 * screen_width;
+            memcpy(&fb_mmap[offset], &screen_buffer[offset], line_size * (r->y2 - r->y1));
+        } else {
+            for (y = r->y1; y < r->y2; y++){
+                offset = y * screen_width + r->x1;
+                memcpy(&fb_mmap[offset], &screen_buffer[offset], line_size);
+            }
+        }
+        flushed += line_size * (r->y2 - r->y1);
+    }
+    damage.nb = 0;
+    update_flush_stats(flushed);
     refresh = false;    
 }
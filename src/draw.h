@@ -35,13 +35,32 @@
 #define __DRAW_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <IL/ilu.h>
 
+/** Called each time a zone of the skin background is restored on screen */
+typedef void (*draw_restore_cb)(int x, int y, int w, int h);
+
 void draw_RGB_buffer(unsigned char * buffer, int x, int y, int w, int h, bool transparency);
+void draw_RGBA_part(const unsigned char * buffer, int x, int y, int w,
+                    int part_x, int part_y, int part_w, int part_h);
+uint16_t * draw_sprite_convert(const unsigned char * buffer, int w, int h);
+void draw_sprite(const uint16_t * sprite, int x, int y, int w, int h);
 void draw_img(ILuint img);
 void draw_text(const char * text, int x, int y, int w, int h, const struct font_color *color, int size);
+unsigned char * draw_text_patch(const char * text, int x, int y, int w, int h, const struct font_color *color, int size);
 void draw_cursor(ILuint cursor_id, ILuint frame_id, int x, int y );
 void draw_screen_clear(void);
+bool draw_background_cache_init(ILuint img);
+bool draw_background_cache_attach(ILuint img, const void * pixels, size_t len);
+const void * draw_background_cache_get(size_t * len);
+bool draw_restore_background(int x, int y, int w, int h);
+void draw_set_restore_cb(draw_restore_cb cb);
+void draw_background_zone(int x, int y, int w, int h);
+bool draw_img_over_background(ILuint img, int x, int y, int bg_x, int bg_y, int bg_w, int bg_h);
+bool draw_select_frame(int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b);
 void draw_refresh(void);
+unsigned long draw_get_flush_rate(void);
 
 #endif
@@ -8,6 +8,9 @@
  * \li It takes cares of restoring and saving the current settings
  * \li It Drives mplayer through the slave interface available in play_int.h 
  * \li It triggers the update of skins through the interface skin_display.h 
+ *
+ * Everything runs from the event loop (loop.h) : inputs, mplayer answers, GPS data and the periodic tasks
+ * are callbacks of this loop. Only the covers decoding and the tags indexing have their own threads.
  * 
  * $URL$
  * $Rev$
@@ -52,20 +55,44 @@
 #include "event_inputs.h"
 #include "draw.h"
 #include "track.h"
+#include "library.h"
+#include "cover.h"
 #include "skin_display.h"
 #include "fm.h"
+#include "overlay.h"
+#include "anim.h"
+#include "loop.h"
 #include "engine.h"
 
 /* Update period in ms */
 #define UPDATE_PERIOD_MS 250
+/* Period of the position checkpoint in resume file (in s) */
+#define CHECKPOINT_PERIOD_S 30
+/* Period of the power button sampling (ms) */
+#define BUTTON_PERIOD_MS 250
+/* Period of the speakers update (ms) */
+#define SPEAKER_PERIOD_MS 1000
+/* Period of the animation checks while nothing is displayed (ms) */
+#define ANIM_IDLE_PERIOD_MS 200
 
 /* Engine state */
 static struct{
     enum eng_mode current_mode;
     bool menu_showed;
     bool quit_asked;
+    int resume_pos;         /**< Position to seek to once the first track is known */
+    int update_timer;       /**< Periodic update of the display */
+    int anim_timer;         /**< Next frame of the skin animation */
+    int button_timer;       /**< Power button sampling */
+    int battery_timer;      /**< Battery sampling */
+    int speaker_timer;      /**< Speakers update */
 }state = { .menu_showed = false, 
-           .quit_asked = false
+           .quit_asked = false,
+           .update_timer = -1,
+           .anim_timer = -1,
+           .button_timer = -1,
+           .battery_timer = -1,
+           .speaker_timer = -1
          };
 
 /* Screen saver state */
@@ -83,15 +110,12 @@ static struct {
   struct general_settings gen;
 }settings;
 
-/* Mutex to prevent animation thread to interact badly with standard update thread */
+/* Mutex to prevent the covers decoding thread to interact badly with the display updates (DevIL is not thread safe)
+ * It is held by the event loop while it runs the callbacks */
 static pthread_mutex_t display_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 
-static void alarm_handler(int sig) { 
- return;
-}
-
 static void quit(){
   int pos;  
   
@@ -222,8 +246,7 @@ static int screen_saver_update(void){
                 }
             }
         }    
-        /* Check if it is time to exit screen saver 
-        * (Done in this thread to avoid concurrent display update from events thread) */
+        /* Check if it is time to exit screen saver */
         if (screen_saver_state.stop_asked){       
             if (config_get_diapo_activation()){
                 diapo_stop();
@@ -241,142 +264,135 @@ static int screen_saver_update(void){
     return 0;
 }
 
-static void *anim_thread(void * param){
-
-  int nb_frame,width,height;
-  int current_num, x, y;
-  unsigned char * buffer;
-  ILuint img;
-  struct skin_rectangular_shape zone;
-  
-  img = skin_get_img(SKIN_CMD_ANIM);
+/** Loop timer : display the next frame of the skin animation
+ *
+ * Frames are already converted (see :anim_init()) : each one is displayed for its own delay.
+ * Nothing is done while the screen saver is running or the backlight is off.
+ */
+static void anim_tick(void * data){
+  int delay;
 
-  
-  if (( state.current_mode == MODE_AUDIO ) &&
-      ( img != 0)){
-    zone = skin_ctrl_get_zone(skin_get_ctrl(SKIN_CMD_ANIM));
-    ilBindImage(img);
-    nb_frame = ilGetInteger(IL_NUM_IMAGES);
-    width  = ilGetInteger(IL_IMAGE_WIDTH);
-    height = ilGetInteger(IL_IMAGE_HEIGHT);
-    PRINTDF(" anim : frames : %i - WxH : %ix%i \n", nb_frame, width,height);
-    x = zone.x1;
-    y = zone.y1;
-    current_num = 0;
-    while (playint_is_running()){
-			 /*PRINTD("New anim frame : %i \n", current_num);*/
-			 pthread_mutex_lock(&display_mutex);
-			 ilBindImage(img);
-			 ilActiveImage(current_num);
-			 ilConvertImage(IL_RGB, IL_UNSIGNED_BYTE);
-	 		 buffer = ilGetData();
-			 draw_RGB_buffer(buffer, x, y, width, height, false);
-			 pthread_mutex_unlock(&display_mutex);
-			 current_num++;
-			 if (current_num >= nb_frame){
-				 current_num=0;
-			 }
-			 usleep(100000);
-		 }
-
-    }
-    return NULL;
+  if (screen_saver_is_running() || pwm_is_off()){
+    loop_set_timer(state.anim_timer, ANIM_IDLE_PERIOD_MS, 0);
+    return;
+  }
+  delay = anim_draw_next();
+  draw_refresh();
+  loop_set_timer(state.anim_timer, delay, 0);
 }
 
 
-/** Thread that updates peridocally OSD if needed
-*
-* \note it also flushes mplayer stdout
-*/
-static void * update_thread(void *val){
-  int resume_pos = (int)val;
-  char buffer_filename[200];
+/** Loop timer : periodic update of the OSD and of the engine state */
+static void update_tick(void * data){
+  static time_t checkpoint_time;
+  struct playint_snapshot snap;
+  bool answered;
   
-  log_write(LOG_INFO, "Update thread is starting");
-  while (playint_is_running()){
-    if (playint_wait_output(UPDATE_PERIOD_MS) == 0){        
-        playint_flush_stdout();
-    }
-    /* Quick path to exit the loop if mplayer is over */
-    if (!playint_is_running()){
-        break;
-    }
+  if (!playint_is_running()){
+    return;
+  }
+  if (checkpoint_time == 0){
+    checkpoint_time = time(NULL);
+  }
     
-    pthread_mutex_lock(&display_mutex);
-    /* DO Not send periodic commands to mplayer while in pause because it unlocks the pause for a brief delay 
-     * Anyway it does not make sense to test for a new track while paused... 
-     */ 
-    if (playint_is_paused() == false){
-      if (playint_get_path(buffer_filename, sizeof(buffer_filename)) > 0){                   
-        if (track_has_changed(buffer_filename)){
-          /* Current filename has changed (new track)*/          
-          settings_update();
-          if (resume_pos != 0){
-            playint_seek(resume_pos, PLAYINT_SEEK_ABS);
-            resume_pos = 0;
-          }
-          /* Load new tags and update internal filename */
-          track_update(buffer_filename);
-          if (!screen_saver_is_running()){
-            skin_display_refresh(SKIN_DISPLAY_NEW_TRACK);
-          }
+  /* DO Not send periodic commands to mplayer while in pause because it unlocks the pause for a brief delay 
+   * Anyway it does not make sense to test for a new track while paused... 
+   */ 
+  if (playint_is_paused() == false){
+    /* One batch of requests per tick, answered in the background : the last complete one is used */
+    answered = (playint_get_snapshot(&snap) == 0);
+    if (snap.path[0] != 0){
+      if (track_has_changed(snap.path)){
+        /* Current filename has changed (new track)*/          
+        settings_update();
+        if (state.resume_pos != 0){
+          playint_seek(state.resume_pos, PLAYINT_SEEK_ABS);
+          state.resume_pos = 0;
+        }
+        /* Load new tags and update internal filename */
+        track_update(snap.path);
+        resume_track_changed(state.current_mode, snap.path);
+        if (!screen_saver_is_running()){
+          skin_display_refresh(SKIN_DISPLAY_NEW_TRACK);
         }
-      } else {
-        log_write(LOG_WARNING, "Unable to retrieve current filename from mplayer");  
       }
+    } else if (answered){
+      log_write(LOG_WARNING, "Unable to retrieve current filename from mplayer");  
     }
-    
-    /* Quick path to exit the loop if mplayer is over */
-    if (!playint_is_running()){
-        pthread_mutex_unlock(&display_mutex);
-        break;
-    }
-    
-    /* Update info from GPS */
-    gps_update() ;
-    
-    /* Periodic update of the skin controls if they are visible */
-    if (((state.menu_showed == true) ||  
-        ((state.current_mode == MODE_AUDIO) && (!screen_saver_is_running())))) {
-        skin_display_refresh(SKIN_DISPLAY_PERIODIC);
+    /* Checkpoint the position so that a power loss still resumes close to it */
+    if ((snap.time_pos > 0) && (time(NULL) - checkpoint_time >= CHECKPOINT_PERIOD_S)){
+      resume_write_pos(state.current_mode, snap.time_pos);
+      checkpoint_time = time(NULL);
     }
-    pthread_mutex_unlock(&display_mutex);
+  }
+  
+  /* Periodic update of the skin controls if they are visible */
+  if (((state.menu_showed == true) ||  
+      ((state.current_mode == MODE_AUDIO) && (!screen_saver_is_running())))) {
+      skin_display_refresh(SKIN_DISPLAY_PERIODIC);
+  }
+
+  /* Write the resume changes once they are settled */
+  resume_sync();
 
-    /* Handle screen saver */
-    screen_saver_update();
+  /* Handle screen saver */
+  screen_saver_update();
    
-    /* speakers config update */
-    if (config_get_speaker() == CONF_INT_SPEAKER_AUTO) {
-      if (!config_get_fm_activation()){
-      /* No FM transmitter : Check for headphones presence to turn on/off internal speaker */
-        snd_check_headphone();
-      } else {
-        /* FM transmitter : always mute */
-        snd_mute_internal(true);
-      }
+  draw_refresh();
+}
+
+/** Loop timer : speakers update */
+static void speaker_tick(void * data){
+  /* speakers config update */
+  if (config_get_speaker() == CONF_INT_SPEAKER_AUTO) {
+    if (!config_get_fm_activation()){
+    /* No FM transmitter : Check for headphones presence to turn on/off internal speaker */
+      snd_check_headphone();
     } else {
-      if (config_get_speaker() == CONF_INT_SPEAKER_NO ){
-        snd_mute_internal(true);
-      } else { /* CONF_INT_SPEAKER_ALWAYS */
-        snd_mute_internal(false);	
-      }
+      /* FM transmitter : always mute */
+      snd_mute_internal(true);
     }
-    
-    /* FIXME Test for tomtom START */
-    snd_set_volume_db(15);
-/*    snd_mute_internal(false);   
-    snd_mute_external(false);  */
-    
-    /* Handle power button*/
-    if (power_is_off_button_pushed() == true){
-      quit();      
-    }        
-    
-    draw_refresh();
-  } /* End main loop */
+  } else {
+    if (config_get_speaker() == CONF_INT_SPEAKER_NO ){
+      snd_mute_internal(true);
+    } else { /* CONF_INT_SPEAKER_ALWAYS */
+      snd_mute_internal(false);	
+    }
+  }
   
-  log_write(LOG_INFO, "Update thread is leaving"); 
-  /* Stop screen saver if active on exit */
+  /* FIXME Test for tomtom START */
+  snd_set_volume_db(15);
+/*    snd_mute_internal(false);   
+  snd_mute_external(false);  */
+}
+
+/** Loop timer : power button sampling (pushes are handled by :power_cb()) */
+static void button_tick(void * data){
+  power_sample_button();
+}
+
+/** Loop timer : battery sampling */
+static void battery_tick(void * data){
+  power_sample_battery();
+}
+
+/** Power module callback : a power state has changed */
+static void power_cb(enum power_event event, void * data){
+  switch (event){
+    case POWER_EVENT_OFF_BUTTON :
+      if (playint_is_running()){
+        quit();
+      }
+      break;
+    case POWER_EVENT_BATTERY :
+      /* Battery control is refreshed with the periodic OSD update */
+      log_write(LOG_INFO, "Battery state : %d", power_get_bat_state());
+      break;
+  }
+}
+
+/** Stop the screen saver if active when leaving */
+static void screen_saver_stop(void){
   if (screen_saver_is_running()){   
     if (config_get_diapo_activation()){
       diapo_stop();   
@@ -384,30 +400,17 @@ static void * update_thread(void *val){
       pwm_resume();
     }
   }
-  
-  pthread_exit(NULL);
-}
-
-
-static void *mplayer_thread(void *filename){
-    log_write(LOG_INFO, "Launching mplayer");
-    playint_run((char *)filename);   
-    log_write(LOG_INFO, "Mplayer has exited");    
-    pthread_exit(NULL);
 }
 
 
 static int init(const char * mode){    
-    struct sigaction new_action;
     bool is_video;      
+    const void * fb_background;
+    size_t fb_background_len;
+    struct skin_rectangular_shape zone;
     
     /* Dont want to be killed by SIGPIPE */
     signal (SIGPIPE, SIG_IGN);    
-    /*Handler on alarm signal */
-    new_action.sa_handler=alarm_handler;
-    sigemptyset(&new_action.sa_mask);
-    new_action.sa_flags=0;
-    sigaction(SIGALRM, &new_action, NULL);
 
     /* Read generic configuration  */
     if (config_init() == false){
@@ -426,8 +429,18 @@ static int init(const char * mode){
     }
     log_write(LOG_DEBUG, "Mode : %s", (is_video?"video":"audio"));
     
-    /* Initialize GPS module */
-    gps_init();
+    /* Every subsystem registers its fds and timers in the event loop */
+    if (loop_init() == false){
+        fprintf( stderr, "Error while creating event loop\n" );
+        return -1;
+    }
+    loop_set_lock(&display_mutex);
+    
+    /* Open the power devices */
+    power_init(power_cb, NULL);
+    
+    /* Start GPS module */
+    gps_init(config_get_gps_replay());
     
     /* Initialize DevIL. */
     ilInit();
@@ -447,18 +460,49 @@ static int init(const char * mode){
       state.current_mode = MODE_AUDIO;          
       skin_init(config_get_skin_filename(CONFIG_AUDIO), true);        
     }
+    /* Background is converted once in frame buffer format for the OSD redraws :
+     * the conversion is kept in the precompiled skin for the next launches */
+    fb_background = skin_get_fb_background(&fb_background_len);
+    if (!draw_background_cache_attach(skin_get_background(), fb_background, fb_background_len)){
+      draw_background_cache_init(skin_get_background());
+      fb_background = draw_background_cache_get(&fb_background_len);
+      skin_cache_save(fb_background, fb_background_len);
+    }
+    /* Animation frames are converted once for the whole session */
+    if (!is_video && (skin_get_img(SKIN_CMD_ANIM) != 0)){
+      zone = skin_ctrl_get_zone(skin_get_ctrl(SKIN_CMD_ANIM));
+      anim_init(skin_get_img(SKIN_CMD_ANIM), zone.x1, zone.y1);
+    }
     
     /* Initialize Screen saver */
     screen_saver_init();
     
+    /* Cached texts are part of the background */
+    skin_display_init();
+    
     /* Initialize resume function */
     resume_file_init(state.current_mode);
+
+    /* Map the tags index and launch the covers decoding */
+    if (!is_video){
+        library_open(LIBRARY_FILENAME);
+        if (skin_get_img(SKIN_CMD_COVERART) != 0){
+            ilBindImage(skin_get_img(SKIN_CMD_COVERART));
+            cover_init(ilGetInteger(IL_IMAGE_WIDTH), ilGetInteger(IL_IMAGE_HEIGHT), &display_mutex);
+        }
+    }
     
     /* Initialize settings module*/
     settings_init();    
           
     /* Init interface with mplayer */
     playint_init();
+#ifndef NATIVE
+    /* OSD is shared with our bmovl filter (a stock mplayer only knows the FIFO protocol) */
+    if (is_video){
+        overlay_init(ws_probe() ? WS_XMAX : WS_NOXL_XMAX, ws_probe() ? WS_YMAX : WS_NOXL_YMAX);
+    }
+#endif
   
     /* Initialize diaporama */
     if (config_get_diapo_activation()){
@@ -495,36 +539,73 @@ static void release(void){
     }
   
     /* Free resources */    
+    overlay_release();
+    anim_release();
+    cover_release();
+    track_library_stop();
     track_release();
+    library_close();
     diapo_release();
     config_free();
     ilShutDown();
     font_release();    
+    draw_background_cache_init(0);
     skin_release();
+    power_release();
+    gps_release();
+    loop_release();
     log_release();
     return;
 }
 
 static void play(char * filename, int pos){
-    pthread_t up_tid;    
-    pthread_t player_tid;                
-    pthread_t anim_tid;
-    int resume_pos;
-    
     if (pos > 5){
-      resume_pos = pos - 5;
+      state.resume_pos = pos - 5;
     } else {
-      resume_pos = 0;
+      state.resume_pos = 0;
     }    
     
-    /* Launch all threads */
-    pthread_create(&up_tid, NULL, update_thread, (void *)resume_pos);
-    pthread_create(&anim_tid, NULL, anim_thread, NULL);
-    pthread_create(&player_tid, NULL, mplayer_thread, filename);             
+    /* Index in background the tags and prefetch the covers of the playlist files */
+    if ((state.current_mode == MODE_AUDIO) && (strstr(filename, ".m3u") != NULL)){
+        cover_set_playlist(filename);
+        track_library_start(filename);
+    }
+
+    /* Periodic tasks */
+    log_write(LOG_INFO, "Starting periodic tasks");
+    state.update_timer = loop_add_timer(UPDATE_PERIOD_MS, UPDATE_PERIOD_MS, update_tick, NULL);
+    state.button_timer = loop_add_timer(BUTTON_PERIOD_MS, BUTTON_PERIOD_MS, button_tick, NULL);
+    state.battery_timer = loop_add_timer(config_get_battery_period() * 1000, config_get_battery_period() * 1000,
+                                         battery_tick, NULL);
+    state.speaker_timer = loop_add_timer(0, SPEAKER_PERIOD_MS, speaker_tick, NULL);
+    if (anim_is_loaded()){
+      state.anim_timer = loop_add_timer(0, 0, anim_tick, NULL);
+    }
+    
+    /* Input events */
+    event_init();
     
-    /* Handle input events */
-    event_loop();
+    /* Launch mplayer then handle all events until it exits */
+    log_write(LOG_INFO, "Launching mplayer");
+    if (playint_start(filename)){
+      loop_run();
+      log_write(LOG_INFO, "Mplayer has exited");    
+    } else {
+      log_write(LOG_ERROR, "Unable to launch mplayer");    
+    }
     
+    event_release();
+    loop_remove_timer(state.anim_timer);
+    loop_remove_timer(state.update_timer);
+    loop_remove_timer(state.button_timer);
+    loop_remove_timer(state.battery_timer);
+    loop_remove_timer(state.speaker_timer);
+    state.anim_timer = -1;
+    state.update_timer = -1;
+    state.button_timer = -1;
+    state.battery_timer = -1;
+    state.speaker_timer = -1;
+    screen_saver_stop();
     
     /* Save settings to resume file */
     if (pwm_get_brightness(&settings.gen.brightness) == 0) {
@@ -535,22 +616,11 @@ static void play(char * filename, int pos){
     } else {
         resume_set_audio_settings(&settings.audio);
     }
-    /* Save audio playlist if quit has been required 
-       (as opposed to an end of playlist exit) */
-    if (state.quit_asked)
-        resume_save_playslist(state.current_mode, track_get_current_filename());
-    else {
-        resume_restore_playslist(state.current_mode); 
-        resume_write_pos(state.current_mode, 0);
-    }
-    
-    /* Wait for everyone termination */
-    /* FIXME Comment out to bypass bug freeze in 0.240b4 and 0.240b5 */
-    /*
-    pthread_join(up_tid, NULL);
-    pthread_join(anim_tid, NULL);        
-    */
-    sleep(2);
+    /* Current entry of the playlist is already saved : rewind it on an end of playlist exit
+       (as opposed to a quit request) */
+    if (!state.quit_asked)
+        resume_rewind_playlist(state.current_mode); 
+    resume_flush();
 }
 
 
@@ -584,6 +654,10 @@ void eng_handle_cmd(int cmd, int p)
     switch(cmd){
         case SKIN_CMD_PAUSE:
             playint_pause();
+            if (!playint_is_paused()){
+              /* OSD changes made during the pause can be taken by the filter again */
+              overlay_flush();
+            }
             break;
         case SKIN_CMD_STOP:
             quit();            
@@ -706,6 +780,12 @@ int eng_select_ctrl(const struct skin_control * ctrl, bool state){
     y = zone.y1;
     w = zone.x2 - zone.x1 ;
     h = zone.y2 - zone.y1 ;    
+    /* Fast path : restore the zone from the background cache and draw the square on screen */
+    if (draw_restore_background(x, y, w, h)){
+        if (state)
+            draw_select_frame(x, y, w, h, 255, 0, 0);
+        return 0;
+    }
     select_square = malloc(3*w*h);        
     if (select_square == NULL){
         return -1;
@@ -45,59 +45,11 @@
 #include "gps.h"
 #include "skin.h"
 #include "play_int.h"
+#include "loop.h"
 
 /* FIXME indexer par skin */
 static int selected_ctrl_idx;
 
-static bool ctrl_is_selectable (enum skin_cmd type){
-  bool ret;
-  switch (type){
-    case SKIN_CMD_PAUSE :
-    case SKIN_CMD_STOP :
-    case SKIN_CMD_MUTE :
-    case SKIN_CMD_VOL_MOINS :
-    case SKIN_CMD_VOL_PLUS : 
-    case SKIN_CMD_LIGHT_MOINS :
-    case SKIN_CMD_LIGHT_PLUS :
-    case SKIN_CMD_DELAY_MOINS :
-    case SKIN_CMD_DELAY_PLUS :
-    case SKIN_CMD_GAMMA_MOINS :
-    case SKIN_CMD_GAMMA_PLUS :
-    case SKIN_CMD_FORWARD :
-    case SKIN_CMD_BACKWARD :
-    case SKIN_CMD_NEXT : 
-    case SKIN_CMD_PREVIOUS :
-      ret = true;
-      break;
-    case SKIN_CMD_BATTERY_STATUS :
-    case SKIN_CMD_ANIM :
-    default :
-      ret = false;
-      break;       
-  }
-  return ret;
-}
-
-static int get_ctrl(int idx, int step){
-  int checked_idx = 0;
-  int current_idx = idx;    
-  const struct skin_config * skin = skin_get_config();
-  
-  while (checked_idx < skin->nb){
-    checked_idx++;
-    current_idx += step;
-    if (current_idx >= skin->nb) current_idx = 0;
-    if (current_idx < 0) current_idx = (skin->nb-1);
-    if (skin->controls[current_idx].type < SKIN_CONTROL_PROGRESS_X) 
-      if (ctrl_is_selectable(skin->controls[current_idx].cmd)){
-        return current_idx;        
-      }
-  }
-  return -1;
-}
-
-
-
 static void handle_key(DFBInputDeviceKeyIdentifier id){
   /* FIXME remplacer boolean par ID de la skin */
   static bool is_selection_active = false;
@@ -117,12 +69,12 @@ static void handle_key(DFBInputDeviceKeyIdentifier id){
       case DIKI_KP_4: 
       case DIKI_LEFT :
         if (playint_is_paused() == false)
-            new_idx = get_ctrl(selected_ctrl_idx, -1);
+            new_idx = skin_get_neighbour(selected_ctrl_idx, SKIN_NAV_LEFT);
         break;
       case DIKI_KP_6:
       case DIKI_RIGHT :
         if (playint_is_paused() == false)
-            new_idx = get_ctrl(selected_ctrl_idx, +1);          
+            new_idx = skin_get_neighbour(selected_ctrl_idx, SKIN_NAV_RIGHT);
         break;   
       case DIKI_KP_MINUS: /*top left*/
         eng_brightness(-5);
@@ -131,8 +83,13 @@ static void handle_key(DFBInputDeviceKeyIdentifier id){
         eng_brightness(5);
         break;  
       case DIKI_DOWN :
+        if (playint_is_paused() == false)
+            new_idx = skin_get_neighbour(selected_ctrl_idx, SKIN_NAV_DOWN);
+        break;
       case DIKI_UP : 
-          break;
+        if (playint_is_paused() == false)
+            new_idx = skin_get_neighbour(selected_ctrl_idx, SKIN_NAV_UP);
+        break;
       case DIKI_ENTER :{        
         eng_handle_cmd(skin->controls[selected_ctrl_idx].cmd, -1);
         break;
@@ -205,7 +162,8 @@ static void handle_key(DFBInputDeviceKeyIdentifier id){
   }
   if (new_idx != -1){
     /* update selected control */   
-    eng_select_ctrl(&skin->controls[selected_ctrl_idx], false);  
+    if (selected_ctrl_idx >= 0)
+      eng_select_ctrl(&skin->controls[selected_ctrl_idx], false);  
     eng_select_ctrl(&skin->controls[new_idx], true);
     selected_ctrl_idx = new_idx;      
   }  
@@ -251,115 +209,106 @@ static void handle_ts(struct ts_sample * sample){
 }
 
 
-void event_loop(void){
+/* Opened inputs */
+static struct {
   struct tsdev *ts;
+  int input_fd;
+} inputs = {
+  .ts = NULL,
+  .input_fd = -1
+};
+
+/** Event loop callback : touchscreen samples are available */
+static void ts_cb(int fd, void * data){
+  struct ts_sample samp;
+
+  while (ts_read(inputs.ts, &samp, 1) > 0){
+    handle_ts(&samp);
+  }
+}
+
+/** Event loop callback : keys are available in the inputs FIFO */
+static void key_cb(int fd, void * data){
+  DFBInputDeviceKeyIdentifier key;
+
+  while (read(fd, &key, sizeof(key)) == sizeof(key)){
+    handle_key(key);
+  }
+}
+
+/** Open the inputs and register them in the event loop
+ *
+ * \retval true at least one input is available
+ * \retval false no input available
+ */
+bool event_init(void){
   char *tsdevice=NULL;
   struct ts_sample samp;
-  int ts_samp, ret;
-  bool ts_available = true;  
   DFBInputDeviceKeyIdentifier key;
-  const struct skin_config * skin;
   struct stat info_file;
-  int input_fd = -1;
-  
-  #define TIMER_PERIOD_US 100000
-  const struct itimerval timer_value = {.it_interval = {0,TIMER_PERIOD_US},
-                                        .it_value = {0,TIMER_PERIOD_US}
-                                       };               
   
-  log_write(LOG_INFO, "Enter Main event loop");
+  log_write(LOG_INFO, "Initializing inputs");
   if( (tsdevice = getenv("TSLIB_TSDEVICE")) != NULL ) {
-    ts = ts_open(tsdevice,0);
-    if ((ts == NULL) || (ts_config(ts) != 0)){
+    inputs.ts = ts_open(tsdevice, 1);
+    if ((inputs.ts != NULL) && (ts_config(inputs.ts) != 0)){
       perror("ts_config");
-      ts_available = false;            
+      ts_close(inputs.ts);
+      inputs.ts = NULL;
     }    
-  } else {
-    ts_available = false;
   }
   
   /* Quick and dirty trick : Only carminat TT use a path which begins with /media */
- 
-  if (strstr( config_get_folder(CONFIG_AUDIO), "/media") ==  config_get_folder(CONFIG_AUDIO))
-    ts_available = false;
-  else 
-    ts_available = true;
-  log_write(LOG_INFO, "Touchscreen availability : %d", ts_available);
+  if ((inputs.ts != NULL) &&
+      (strstr( config_get_folder(CONFIG_AUDIO), "/media") ==  config_get_folder(CONFIG_AUDIO))){
+    ts_close(inputs.ts);
+    inputs.ts = NULL;
+  }
+  log_write(LOG_INFO, "Touchscreen availability : %d", (inputs.ts != NULL));
   
-  /* Try to open tomplayer inputs FIFO */
+  /* Try to open tomplayer inputs FIFO 
+   * (also opened for writing so that it is never hung up when the remote inputs process exits) */
   if (stat(KEY_INPUT_FIFO, &info_file) == 0){
-    input_fd = open(KEY_INPUT_FIFO, O_RDONLY);  
+    inputs.input_fd = open(KEY_INPUT_FIFO, O_RDWR | O_NONBLOCK);  
   }
-  log_write(LOG_INFO, "FIFO availability : %d", input_fd);   
+  log_write(LOG_INFO, "FIFO availability : %d", inputs.input_fd);   
 
-  if (input_fd > 0){
+  if (inputs.input_fd >= 0){
     /* Purge FIFO events */
-    /* To interrupt blocking read */    
-    setitimer(ITIMER_REAL, &timer_value, NULL);         
-    while (read(input_fd, &key, sizeof(key)) > 0);
+    while (read(inputs.input_fd, &key, sizeof(key)) > 0);
     /* Initialize selected control */
-    skin = skin_get_config();      
-    if (skin->first_selection >= 0) {
-        selected_ctrl_idx = skin->first_selection;        
-    } else {
-        selected_ctrl_idx = get_ctrl(0, +1);
-    }    
+    selected_ctrl_idx = skin_get_first_selection();
+    if (!loop_add_fd(inputs.input_fd, key_cb, NULL)){
+      close(inputs.input_fd);
+      inputs.input_fd = -1;
+    }
   }
-  if (ts_available){
+  if (inputs.ts != NULL){
     /* Purge touchscreen events */
-    do {
-      /* To interrupt blocking read */
-      setitimer(ITIMER_REAL, &timer_value, NULL);     
-      if (ts_read(ts, &samp, 1) < 0) {
-        break;
-      }
-    } while (samp.pressure == 0);
-  
-    /* No touchscreen available */
-    if (input_fd > 0){
-      int flags;    
-      /* FIFO read is made non blocking */      
-      flags = fcntl(input_fd, F_GETFL);
-      //printf("initial flags : %x\n", flags);
-      flags |= O_NONBLOCK;
-      ret = fcntl(input_fd, F_SETFL, flags);      
-      //printf("ret : %d - flags :%x \n", ret, flags);
-    }
-  } else {
-    ts_samp = 0;      
-    if (input_fd < 0){
-      /* No inputs available */
-      log_write(LOG_ERROR, "No inputs available...");      
-      return;  
+    while (ts_read(inputs.ts, &samp, 1) > 0);
+    if (!loop_add_fd(ts_fd(inputs.ts), ts_cb, NULL)){
+      ts_close(inputs.ts);
+      inputs.ts = NULL;
     }
   }
-  
-  /* Main events loop */
-  while (playint_is_running()) {    
-    /* To interrupt blocking read */
-    setitimer(ITIMER_REAL, &timer_value, NULL);         
-    if (ts_available){
-      ts_samp = ts_read(ts, &samp, 1);          
-      //printf("Wake up ts samp : %d\n", ts_samp);
-    }
-    if (ts_samp < 1){
-      if (input_fd > 0){
-        ret =  read(input_fd, &key, sizeof(key));
-        //printf("ret : %d\n", ret);
-        if ( ret > 0) {                         
-          handle_key(key);          
-        } else {      
-            /* FIXME test deco teleco */
-            usleep(TIMER_PERIOD_US);
-            if (errno != EINTR)/* && (errno != EAGAIN))*/{
-                log_write(LOG_ERROR, "Event spurious wakeup errno %d : %s\n", errno, strerror(errno));                
-                usleep(TIMER_PERIOD_US);
-            }                        
-        }
-      }
-    } else {
-      handle_ts(&samp);
-    }
+  if ((inputs.ts == NULL) && (inputs.input_fd < 0)){
+    /* No inputs available */
+    log_write(LOG_ERROR, "No inputs available...");      
+    return false;
+  }
+  return true;
+}
+
+/** Unregister and close the inputs */
+void event_release(void){
+  if (inputs.ts != NULL){
+    loop_remove_fd(ts_fd(inputs.ts));
+    ts_close(inputs.ts);
+    inputs.ts = NULL;
+  }
+  if (inputs.input_fd >= 0){
+    loop_remove_fd(inputs.input_fd);
+    close(inputs.input_fd);
+    inputs.input_fd = -1;
   }
-  log_write(LOG_INFO, "Leaving events input loop");  
+  log_write(LOG_INFO, "Inputs released");  
 }
@@ -27,6 +27,10 @@
  */ 
 #ifndef __EVENT_INPUTS_H__
 #define __EVENT_INPUTS_H__
-void event_loop(void);
+
+#include <stdbool.h>
+
+bool event_init(void);
+void event_release(void);
 #endif
 
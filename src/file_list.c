@@ -46,20 +46,36 @@ struct _fl_handle {
   char ** filenames;                           /**< Array holding filenames (full pathname) */
 };
 
-#define FILE_LIST_INC 32
+/* Size of the memory chunks holding the filenames */
+#define FL_ARENA_CHUNK_SIZE 8192
+
+/** Memory chunk holding filenames : filenames are released all at once with the list */
+struct fl_arena{
+  struct fl_arena * next;                      /**< Previous chunk */
+  size_t used;                                 /**< Bytes used in data */
+  size_t size;                                 /**< Size of data */
+  char data[];
+};
+
+/** An entry of the file list */
+struct fl_entry{
+  char * name;                                 /**< Filename (stored in arena) */
+  bool is_folder;                              /**< Is it a folder or a regular file */
+  bool is_selected;                            /**< Is the file selected */
+};
+
 /** Internal file list representation for the file selector 
   *  \note Do not use linked list to implement file list as there is no modification once the list is created
   */
 struct file_list{
   bool multiple_select;                        /**< Is multiple selection allowed*/
-  int entries_number;                          /**< Number of entries in the following arrays...*/  
+  int entries_number;                          /**< Number of entries in the following array...*/  
   char * basename;                             /**< Folder basename */
   int last_selected;                           /**< Index of last selected item */
   int max_entries_number;                      /**< Maximum entries that can be stored in the object */
 
-  char ** filenames;                           /**< Array of entries_number elements containing the filenames (including folders) */
-  bool * is_selected;                          /**< Array of entries_number elements indicating whether the corresponding file is selected or not*/
-  bool * is_folder;                            /**< Array of entries_number elements indicating whether the corresponding file is a folder or a regular file*/
+  struct fl_entry * entries;                   /**< Array of entries_number elements sorted (folders first) */
+  struct fl_arena * arena;                     /**< Filenames storage */
 };
 
 
@@ -71,63 +87,43 @@ static bool match(const char *string, const regex_t * re)
     return !regexec(re, string, (size_t) 0, NULL, 0);    
 }
 
-
-/** Find an entry in file list 
- *
- * \return index of the entry if found or index where it should be added to let the list sorted
- */
-static int fl_find_pos(struct file_list *fl, const char * filename, bool is_folder, bool * find){
-  int i;  
-  int ret_cmp = 1;
-  *find= false;
-
-  if (!is_folder){
-    i = fl->entries_number-1;
-    while  ((i>=0) && (!fl->is_folder[i])){ 
-      ret_cmp = strcmp(fl->filenames[i],filename);
-      if (ret_cmp<=0)
-        break;
-      i--;
-    }
-  } else{
-    i = 0 ;
-    
-    while  ((i<fl->entries_number) && (fl->is_folder[i])){ 
-      ret_cmp = strcmp(fl->filenames[i],filename);
-      if ( ret_cmp >= 0)
-        break;
-      i++;
-    }
-  }
-  
-  if (!is_folder){  
-      i++;  
+/** Copy a filename in the arena of the file list */
+static char * fl_arena_strdup(struct file_list *fl, const char * name){
+  size_t len = strlen(name) + 1;
+  struct fl_arena * chunk = fl->arena;
+  size_t size;
+  char * str;
+
+  if ((chunk == NULL) || (chunk->used + len > chunk->size)){
+    size = (len > FL_ARENA_CHUNK_SIZE) ? len : FL_ARENA_CHUNK_SIZE;
+    chunk = malloc(sizeof(*chunk) + size);
+    if (chunk == NULL)
+      return NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = fl->arena;
+    fl->arena = chunk;
   }
-
-  if (ret_cmp ==0){
-    *find = true;
-  }
-  return i;
+  str = &chunk->data[chunk->used];
+  memcpy(str, name, len);
+  chunk->used += len;
+  return str;
 }
 
-/** Insert a slot in file list 
- *
- * \warning  No check on file list size (has to be big enough). Only called by :fl_add() that ensures this... 
- */
-static bool fl_shift(struct file_list *fl, int idx){
-  int i ;
-  for (i=fl->entries_number-1; i>=idx;i--){
-     fl->is_folder[i+1] = fl->is_folder[i];
-     fl->is_selected[i+1] = fl->is_selected[i];
-     fl->filenames[i+1] = fl->filenames[i];
-  }
-  return true;
+/** Sort order of the list : folders first then alphabetical order */
+static int fl_entry_compare(const void * a, const void * b){
+  const struct fl_entry * e1 = a;
+  const struct fl_entry * e2 = b;
+
+  if (e1->is_folder != e2->is_folder)
+    return (e1->is_folder ? -1 : 1);
+  return strcmp(e1->name, e2->name);
 }
 
 /** Add a filename to a file list
  *
- * Adds an entry to file lits. Itmay be a regular file or a folder.
- * File list is automatically allocated or reallocated to contain this new entry.
+ * Adds an entry at the end of the file list. It may be a regular file or a folder.
+ * File list is automatically reallocated to contain this new entry.
  *
  * \param[in] fl  file list object 
  * \param[in] filename  filename to add
@@ -136,50 +132,54 @@ static bool fl_shift(struct file_list *fl, int idx){
  * \retval true success
  * \retval false Failure
  *
- * \note the file list is always sorted
+ * \note the file list has to be sorted once all entries are added
 */
-static bool fl_add(struct file_list *fl, char* filename, bool is_folder){
-  int index;
-  bool find;
+static bool fl_add(struct file_list *fl, const char* filename, bool is_folder){
+  struct fl_entry * entries;
+  int max;
 
   if (fl->max_entries_number <= fl->entries_number){
-    fl->max_entries_number += FILE_LIST_INC;
-    fl->filenames = realloc(fl->filenames, fl->max_entries_number * sizeof(*fl->filenames));
-    fl->is_selected = realloc(fl->is_selected, fl->max_entries_number * sizeof(*fl->is_selected));
-    fl->is_folder = realloc(fl->is_folder, fl->max_entries_number * sizeof(*fl->is_folder));
-    if ((fl->filenames == NULL ) ||
-        (fl->is_selected == NULL) ||
-        ( fl->is_folder == NULL ) ) {
+    max = (fl->max_entries_number == 0) ? 64 : fl->max_entries_number * 2;
+    entries = realloc(fl->entries, max * sizeof(*fl->entries));
+    if (entries == NULL) {
         return false;
     }
+    fl->entries = entries;
+    fl->max_entries_number = max;
   }
   
-  index = fl_find_pos(fl, filename, is_folder, &find);
-  if (index < fl->entries_number){
-    fl_shift(fl,index);
-  }
-
+  fl->entries[fl->entries_number].name = fl_arena_strdup(fl, filename);
+  if (fl->entries[fl->entries_number].name == NULL)
+    return false;
+  fl->entries[fl->entries_number].is_folder = is_folder;
+  fl->entries[fl->entries_number].is_selected = false;
   fl->entries_number++;
-  fl->is_folder[index] = is_folder;
-  fl->is_selected[index] = false;
-  fl->filenames[index] = strdup(filename);
   return true;
 }
 
-/** Create a file list object 
+/** Create a file list object and report the first entries while scanning
+ *
+ * The type of entries is retrieved from readdir() when the filesystem provides it,
+ * stat() is only called for unknown types and symbolic links.
  *
  * \param[in] path path from which the file list has to be built
  * \param[in] re compiled regular expression to use to filter filenames
- * \param[in] fl file list handle
+ * \param[in] mul multiple selection allowed
+ * \param[in] first_nb number of entries after which cb is called (0 for no call)
+ * \param[in] cb callback called once with the list of the first_nb entries found (sorted)
+ *               The list is only valid during the callback and must not be released
+ * \param[in] data user parameter passed to cb
  *
  * \return a file list or NULL if an rerror occured  
  */
-file_list fl_create(const char * path, regex_t *re, bool mul){
+file_list fl_create_progressive(const char * path, regex_t *re, bool mul,
+                                int first_nb, fl_progress_cb * cb, void * data){
   struct dirent* dir_ent;
   DIR*   dir;
   struct stat ftype;
   struct file_list * fl;
   char   fullpath [PATH_MAX + 1];
+  bool   is_folder;
   
   fl = calloc(1, sizeof(*fl));
   if (fl == NULL) {
@@ -192,40 +192,75 @@ file_list fl_create(const char * path, regex_t *re, bool mul){
 
   fl->basename = strdup(path);
   while ( (dir_ent = readdir ( dir )) != NULL ) {
-          snprintf(fullpath,PATH_MAX,"%s/%s",path,  dir_ent->d_name);
-          if (stat (fullpath, &ftype) < 0 ) {
-            continue;
-          }
-          if (strcmp( dir_ent->d_name, ".")) {
-            if ((S_ISDIR (ftype.st_mode)) ||
-                (re == NULL) ||
-                (match(dir_ent->d_name,re))){ 
-              if (!fl_add(fl, dir_ent->d_name, S_ISDIR (ftype.st_mode))){
-                goto out_error;                                
-              }
-            }
-          }
+    if (!strcmp( dir_ent->d_name, "."))
+      continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (dir_ent->d_type == DT_DIR) {
+      is_folder = true;
+    } else if (dir_ent->d_type == DT_REG) {
+      is_folder = false;
+    } else
+#endif
+    {
+      /* Unknown type or link : stat is needed */
+      if ((re != NULL) && !match(dir_ent->d_name, re)) {
+        /* Only a folder could be kept, do not stat files that are filtered anyway */
+#ifdef _DIRENT_HAVE_D_TYPE
+        if ((dir_ent->d_type != DT_UNKNOWN) && (dir_ent->d_type != DT_LNK))
+          continue;
+#endif
+      }
+      snprintf(fullpath,PATH_MAX,"%s/%s",path,  dir_ent->d_name);
+      if (stat (fullpath, &ftype) < 0 ) {
+        continue;
+      }
+      is_folder = S_ISDIR (ftype.st_mode);
+    }
+    if (is_folder || (re == NULL) || match(dir_ent->d_name,re)) { 
+      if (!fl_add(fl, dir_ent->d_name, is_folder)){
+        closedir (dir);
+        goto out_error;                                
+      }
+      if ((cb != NULL) && (fl->entries_number == first_nb)){
+        /* Give a sorted view of the first entries */
+        qsort(fl->entries, fl->entries_number, sizeof(*fl->entries), fl_entry_compare);
+        cb(fl, data);
+      }
+    }
   }
   closedir (dir);
+  qsort(fl->entries, fl->entries_number, sizeof(*fl->entries), fl_entry_compare);
   return fl;
 
   out_error:
-    free(fl);
+    fl_release(fl);
     return NULL;
 }
 
+/** Create a file list object 
+ *
+ * \param[in] path path from which the file list has to be built
+ * \param[in] re compiled regular expression to use to filter filenames
+ * \param[in] mul multiple selection allowed
+ *
+ * \return a file list or NULL if an rerror occured  
+ */
+file_list fl_create(const char * path, regex_t *re, bool mul){
+  return fl_create_progressive(path, re, mul, 0, NULL, NULL);
+}
+
 
 /** Release file list object */
 void fl_release(file_list fl){  
-  int i ;
+  struct fl_arena * chunk;
 
   if (fl == NULL) return; 
-  for (i=0; i<fl->entries_number; i++){
-    free(fl->filenames[i]);
+  while (fl->arena != NULL){
+    chunk = fl->arena;
+    fl->arena = chunk->next;
+    free(chunk);
   }
-  free(fl->filenames);
-  free(fl->is_selected);
-  free(fl->is_folder);  
+  free(fl->entries);
   free(fl->basename);  
   free(fl);
   return;
@@ -240,18 +275,18 @@ bool fl_select_by_pos(file_list fl, int idx, bool * change){
   if ( (idx < 0) || (idx >= fl->entries_number)){
     return false;
   }
-  if  (fl->is_folder[idx])
+  if  (fl->entries[idx].is_folder)
     return false;
 
   if ( fl->multiple_select ){
-    fl->is_selected[idx] = !fl->is_selected[idx];
+    fl->entries[idx].is_selected = !fl->entries[idx].is_selected;
   } else {
-    if (fl->is_selected[idx]){
+    if (fl->entries[idx].is_selected){
       if (change != NULL)
         *change = false;
     } else {
-      fl->is_selected[fl->last_selected] = false;
-      fl->is_selected[idx] = true; 
+      fl->entries[fl->last_selected].is_selected = false;
+      fl->entries[idx].is_selected = true; 
       fl->last_selected = idx;    
     }
   }
@@ -266,7 +301,7 @@ bool fl_select_all(file_list fl){
     return false;
 
   for(i=0; i<fl->entries_number; i++){  
-    if (!fl->is_selected[i])
+    if (!fl->entries[i].is_selected)
       fl_select_by_pos(fl, i, NULL);       
   }
 
@@ -280,8 +315,8 @@ const char * fl_get_single_selection(file_list fl){
   if (fl->multiple_select) {
     return NULL;
   }
-  if (fl->is_selected[fl->last_selected]) {
-    return fl->filenames[fl->last_selected];
+  if (fl->entries[fl->last_selected].is_selected) {
+    return fl->entries[fl->last_selected].name;
   } else {
      return NULL;
   }     
@@ -293,19 +328,19 @@ bool fl_unselect_by_pos(file_list fl, int i){
   if ( (i < 0) || (i >= fl->entries_number)){
     return false;
   }
-  fl->is_selected[i] = false;
+  fl->entries[i].is_selected = false;
   return true;
 }
 
 
 bool fl_is_selected(file_list fl, int i){
   if (fl == NULL) return false;
-  return fl->is_selected[i];
+  return fl->entries[i].is_selected;
 }
 
 bool fl_is_folder(file_list fl, int i){
   if (fl == NULL) return false;
-  return fl->is_folder[i];
+  return fl->entries[i].is_folder;
 }
 
 int fl_get_entries_nb(file_list fl){
@@ -315,7 +350,7 @@ int fl_get_entries_nb(file_list fl){
 
 const char * fl_get_filename(file_list fl, int i){
   if (fl == NULL) return NULL;
-  return fl->filenames[i];
+  return fl->entries[i].name;
 }
 
 const char * fl_get_basename(file_list fl){
@@ -337,7 +372,7 @@ int fl_get_selected_number(const file_list fl){
   
   if (fl == NULL) return 0;
   for (i=0; i< fl->entries_number; i++){
-    if (fl->is_selected[i]) nb_selected++;                 
+    if (fl->entries[i].is_selected) nb_selected++;                 
   }
 
   return nb_selected;
@@ -365,10 +400,10 @@ flenum fl_get_selection(file_list fl){
     } else {
       j=0;
       for(i=0;i<fle->entries_number ;i++){
-        while ((j<fl->entries_number) && (!fl->is_selected[j])){j++;}
+        while ((j<fl->entries_number) && (!fl->entries[j].is_selected)){j++;}
         if (j<fl->entries_number){
-          fle->filenames[i] = malloc(strlen(fl->basename) + strlen(fl->filenames[j]) + 2);
-          sprintf(fle->filenames[i],"%s/%s",fl->basename,fl->filenames[j]);          
+          fle->filenames[i] = malloc(strlen(fl->basename) + strlen(fl->entries[j].name) + 2);
+          sprintf(fle->filenames[i],"%s/%s",fl->basename,fl->entries[j].name);          
           j++;
         }
       }
@@ -36,8 +36,11 @@
 
 typedef struct file_list* file_list ;
 typedef struct _fl_handle * flenum ;
+/** Callback prototype to receive the first entries of a file list while it is built */
+typedef void (fl_progress_cb)(file_list, void *);
 
 file_list fl_create(const char *, regex_t *, bool);
+file_list fl_create_progressive(const char *, regex_t *, bool, int, fl_progress_cb *, void *);
 void fl_release(file_list);
 bool fl_select_by_pos(file_list, int, bool *);
 bool fl_select_all(file_list);
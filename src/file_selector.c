@@ -48,11 +48,44 @@
 #include <directfb.h>
 #include <pthread.h>
 #include <regex.h>
+#include <sys/time.h>
 
 #include "file_list.h"
 #include "file_selector.h"
 #include "debug.h"
-
+#include "res_cache.h"
+
+/* Number of pages of rows kept pre-rendered */
+#define FS_ROW_CACHE_PAGES 3
+
+/* Rendering flags of a row */
+#define FS_ROW_CURSOR   1       /**< Row of the cursor ("> " prefix) */
+#define FS_ROW_SELECTED 2       /**< Selected entry (check icon) */
+#define FS_ROW_PLACEHOLDER 4    /**< Entry not loaded yet */
+
+/* Kinetic scrolling */
+#define FS_FRAME_MS           25    /**< Period of the scrolling animation frames */
+#define FS_FLING_TAU_MS       325   /**< Time constant of the fling speed decrease */
+#define FS_FLING_MIN_SPEED    60    /**< Speed under which a fling stops (pixels/s) */
+#define FS_FLING_MAX_SPEED    4000  /**< Max fling speed (pixels/s) */
+#define FS_DRAG_STALL_MS      100   /**< Drag released without any move since that time : no fling */
+
+/* Content of a line that has to be drawn whatever the wanted content */
+#define FS_LINE_UNKNOWN -2
+
+/** Pre-rendered row : the icons and the filename of an entry */
+struct fs_row {
+  IDirectFBSurface * surf;                     /**< Rendering of the row (NULL until first use) */
+  int idx;                                     /**< Entry rendered (-1 if none) */
+  int flags;                                   /**< FS_ROW_xxx flags of the rendering */
+  unsigned int last_use;                       /**< Date of last use for LRU replacement */
+};
+
+/** Content displayed on a line of the object */
+struct fs_line {
+  int idx;                                     /**< Entry displayed, -1 if blank, FS_LINE_UNKNOWN to force a redraw */
+  int flags;                                   /**< FS_ROW_xxx flags of the displayed row */
+};
 
 /** Internal data describing the file selector */
 struct fs_data {
@@ -66,10 +99,19 @@ struct fs_data {
   DFBRectangle file_zone;                      /**< Zone containing the filenames in the object */  
   DFBRectangle refresh_zone;                   /**< Zone to be refreshed (both file zone and check or folder icons)*/  
   DFBRectangle preview_zone;                   /**< Preview zone */
-  IDirectFBSurface * refresh_zone_surf;        /**< Surface in which filenames & associated icons are drawed */    
+  struct fs_row * rows;                        /**< Cache of pre-rendered rows */
+  int rows_nb;                                 /**< Number of rows in cache */
+  unsigned int rows_date;                      /**< Date incremented on each row use */
+  struct fs_line * lines;                      /**< Content currently displayed on each line (nb_lines + 1 when scrolled) */
+  int lines_offset;                            /**< Scroll offset of the displayed lines */
+  bool clear_zone;                             /**< The whole zone has to be cleared on next refresh */
+  int cursor_width;                            /**< Width of the cursor prefix */
   IDirectFBSurface * preview_surf;             /**< Surface in which preview is drawed (if any) */
+  char * preview_path;                         /**< File currently previewed (NULL if none) */
+  int preview_idx;                             /**< Index of the previewed file in the list */
   IDirectFBFont *font;                         /**< Font used to display filenames */
   int idx_first_displayed;                     /**< Index of the first displayed filename */  
+  int scroll_offset;                           /**< Pixels of the first displayed filename scrolled out */
   int nb_lines;                                /**< Number of displayed lines */
   int line_height;                             /**< Height of a single line : font + interline...*/
   file_list list;                      	       /**< Files list displayed by the object */
@@ -78,8 +120,38 @@ struct fs_data {
   select_cb *prev_cb;                          /**< callback funtion */
   regex_t compiled_re_filter;                  /**< Compiled re filter to apply filter */
   int selected_item ;                          /**< Currently selected item */
+  pthread_mutex_t lock;                        /**< Protects the object against the animation and loading threads */
+  pthread_t anim_thread;                       /**< Thread that animates the drag and fling scrolling */
+  pthread_cond_t anim_cond;                    /**< Wakes the animation thread up */
+  struct {
+    bool pressed;                              /**< Touch screen pressed on the files */
+    bool dragging;                             /**< Press turned into a drag */
+    int press_x, press_y;                      /**< Position of the press */
+    int last_y;                                /**< Last position of the drag */
+    unsigned int last_ms;                      /**< Date of the last drag move */
+    int pos;                                   /**< Scrolling position wanted by the drag (pixels) */
+    int velocity;                              /**< Fling speed (pixels/s, positive to scroll down) */
+  } touch;
+  struct {
+    unsigned int gen;                          /**< Generation of the last load asked */
+    int threads;                               /**< Number of running loading threads */
+    pthread_cond_t done;                       /**< Signaled when a loading thread ends */
+    char * path;                               /**< Folder being loaded (NULL if none) */
+    char ** names;                             /**< First entries found in the folder being loaded */
+    bool * is_folder;
+    int nb;                                    /**< Number of first entries */
+  } loading;
 } ;
 
+/** Parameters of a loading thread */
+struct fs_load {
+  fs_handle hdl;
+  unsigned int gen;
+  char * path;
+  bool use_filter;
+  bool multiple_selection;
+};
+
 
 
 /** Return min between two int values
@@ -163,6 +235,29 @@ error:
   return false;
 }
 
+/** Forget the folder being loaded */
+static void loading_clear(fs_handle hdl){
+  int i;
+
+  for (i = 0; i < hdl->loading.nb; i++){
+    free(hdl->loading.names[i]);
+  }
+  free(hdl->loading.names);
+  free(hdl->loading.is_folder);
+  free(hdl->loading.path);
+  hdl->loading.names = NULL;
+  hdl->loading.is_folder = NULL;
+  hdl->loading.nb = 0;
+  hdl->loading.path = NULL;
+}
+
+/** Wait for the end of the loading threads */
+static void wait_loading(fs_handle hdl){
+  while (hdl->loading.threads > 0){
+    pthread_cond_wait(&hdl->loading.done, &hdl->lock);
+  }
+}
+
 /** Release a fs object 
  *
  *\param[in] hdl Handle of the fs object
@@ -186,6 +281,16 @@ static bool release(fs_handle hdl) {
   if (hdl->thread){
     pthread_join(hdl->thread,NULL);
   }
+  /* Stop the animation and wait for the loading threads (their result is discarded) */
+  pthread_mutex_lock(&hdl->lock);
+  hdl->loading.gen++;
+  pthread_cond_signal(&hdl->anim_cond);
+  wait_loading(hdl);
+  loading_clear(hdl);
+  pthread_mutex_unlock(&hdl->lock);
+  if (hdl->anim_thread){
+    pthread_join(hdl->anim_thread, NULL);
+  }
 
 
   if (hdl->destination != NULL) {
@@ -197,19 +302,27 @@ static bool release(fs_handle hdl) {
   
   for (i =0; i< FS_MAX_ICON_ID; i++){
     if (hdl->icon_surf[i] != NULL){
-      hdl->icon_surf[i]->Release(hdl->icon_surf[i]);
+      res_put_image(hdl->icon_surf[i]);
       hdl->icon_surf[i] = NULL;
     }
   }
   if (hdl->font != NULL){
-    hdl->font->Release(hdl->font);
+    res_put_font(hdl->font);
   }
-  if (hdl->refresh_zone_surf != NULL) {
-    hdl->refresh_zone_surf->Release(hdl->refresh_zone_surf);
-  }  
+  if (hdl->rows != NULL) {
+    for (i = 0; i < hdl->rows_nb; i++){
+      if (hdl->rows[i].surf != NULL){
+        hdl->rows[i].surf->Release(hdl->rows[i].surf);
+      }
+    }
+    free(hdl->rows);
+  }
+  free(hdl->lines);
   if (hdl->preview_surf != NULL){
     hdl->preview_surf->Release(hdl->preview_surf);
   }
+  free(hdl->preview_path);
+  hdl->preview_path = NULL;
   if (hdl->config->folder.filter != NULL){
     regfree(&hdl->compiled_re_filter);
   }
@@ -223,6 +336,9 @@ static bool release(fs_handle hdl) {
   hdl->dfb = NULL;
   hdl->win = NULL;
   
+  pthread_cond_destroy(&hdl->loading.done);
+  pthread_cond_destroy(&hdl->anim_cond);
+  pthread_mutex_destroy(&hdl->lock);
   free(hdl);
 
   return true;
@@ -251,28 +367,24 @@ static bool display_obj(fs_handle hdl, enum fs_icon_ids id, DFBPoint * point){
   }
 
   if (hdl->icon_surf[id] == NULL){
+    IDirectFBSurface * icon;
+    int h,w;
 
-    IDirectFBImageProvider *provider;
-    DFBSurfaceDescription dsc;  
-    
-    if (hdl->dfb->CreateImageProvider (hdl->dfb,  hdl->config->graphics.filename[id], &provider) !=DFB_OK ){
-      return false;
-    }
-
-    if (provider->GetSurfaceDescription (provider, &dsc) != DFB_OK){
+    icon = res_get_image(hdl->dfb, hdl->config->graphics.filename[id], -1, -1);
+    if (icon == NULL){
       return false;
     }
-
+    icon->GetSize(icon, &w, &h);
     /* odd value give stange results so lets stay on even values...*/
-    dsc.width &=0xFFFFFFFE;
-
-   if (hdl->dfb->CreateSurface (hdl->dfb, &dsc, &hdl->icon_surf[id]) != DFB_OK) {
-      provider->Release (provider);
-      return false;
+    if (w & 1){
+      hdl->icon_surf[id] = res_get_image(hdl->dfb, hdl->config->graphics.filename[id], w & ~1, h);
+      res_put_image(icon);
+      if (hdl->icon_surf[id] == NULL){
+        return false;
+      }
+    } else {
+      hdl->icon_surf[id] = icon;
     }
-
-    provider->RenderTo (provider, hdl->icon_surf[id], NULL);
-    provider->Release (provider);
   }
 
   if (point == NULL){
@@ -307,7 +419,8 @@ static bool display_obj(fs_handle hdl, enum fs_icon_ids id, DFBPoint * point){
   switch (id){
       case FS_ICON_CHECK : /* Volontary no break */
       case FS_ICON_FOLDER :
-        dest_surf = hdl->refresh_zone_surf;
+        /* Drawn in the rows (see render_row()) */
+        dest_surf = NULL;
         break;
       default :
         dest_surf = hdl->destination;
@@ -324,7 +437,123 @@ static bool display_obj(fs_handle hdl, enum fs_icon_ids id, DFBPoint * point){
 
 
 
+/** Forget all the rendered rows and the displayed content
+ *
+ * To be called when the entries of the list change
+ */
+static void flush_rows(fs_handle hdl){
+  int i;
+
+  for (i = 0; i < hdl->rows_nb; i++){
+    hdl->rows[i].idx = -1;
+    hdl->rows[i].flags = 0;
+  }
+  for (i = 0; i <= hdl->nb_lines; i++){
+    hdl->lines[i].idx = FS_LINE_UNKNOWN;
+  }
+  hdl->clear_zone = true;
+}
+
+/** Number of entries displayed 
+ *
+ * While a folder is loaded, the first entries found are displayed on a page of placeholders 
+ */
+static int entries_nb(fs_handle hdl){
+  if (hdl->loading.path != NULL){
+    return (hdl->loading.nb > hdl->nb_lines) ? hdl->loading.nb : hdl->nb_lines;
+  }
+  return fl_get_entries_nb(hdl->list);
+}
+
+/** Filename of a displayed entry (NULL if not loaded yet) */
+static const char * entry_name(fs_handle hdl, int idx){
+  if (hdl->loading.path != NULL){
+    return (idx < hdl->loading.nb) ? hdl->loading.names[idx] : NULL;
+  }
+  return fl_get_filename(hdl->list, idx);
+}
+
+/** Is a displayed entry a folder */
+static bool entry_is_folder(fs_handle hdl, int idx){
+  if (hdl->loading.path != NULL){
+    return (idx < hdl->loading.nb) ? hdl->loading.is_folder[idx] : false;
+  }
+  return fl_is_folder(hdl->list, idx);
+}
+
+/** Render an entry in a row surface */
+static void render_row(fs_handle hdl, struct fs_row * row){
+  IDirectFBSurface * surf = row->surf;
+  int x = hdl->file_zone.x - hdl->refresh_zone.x;
+
+  clear_surface(surf);
+  surf->SetColor(surf,
+                 hdl->config->graphics.font_color.r,
+                 hdl->config->graphics.font_color.g,
+                 hdl->config->graphics.font_color.b,
+                 hdl->config->graphics.font_color.a);
+  if (row->flags & FS_ROW_PLACEHOLDER) {
+    surf->DrawString(surf, "...", -1, x, 0, DSTF_TOPLEFT);
+    return;
+  }
+  if (row->flags & FS_ROW_SELECTED) {
+    surf->Blit(surf, hdl->icon_surf[FS_ICON_CHECK], NULL, 0, 0);
+  }
+  if (entry_is_folder(hdl, row->idx)){
+    surf->Blit(surf, hdl->icon_surf[FS_ICON_FOLDER], NULL, 0, 0);
+  }
+  if (row->flags & FS_ROW_CURSOR) {
+    surf->DrawString(surf, "> ", -1, x, 0, DSTF_TOPLEFT);
+    x += hdl->cursor_width;
+  }
+  surf->DrawString(surf, entry_name(hdl, row->idx), -1, x, 0, DSTF_TOPLEFT);
+}
+
+/** Get the rendering of an entry, from the cache or by rendering it in the least recently used row
+ *
+ * \return the row surface, NULL on failure
+ */
+static IDirectFBSurface * get_row(fs_handle hdl, int idx, int flags){
+  struct fs_row * row = &hdl->rows[0];
+  DFBSurfaceDescription dsc;
+  int i;
+
+  hdl->rows_date++;
+  for (i = 0; i < hdl->rows_nb; i++){
+    if ((hdl->rows[i].idx == idx) && (hdl->rows[i].flags == flags)){
+      hdl->rows[i].last_use = hdl->rows_date;
+      return hdl->rows[i].surf;
+    }
+    /* Prefer a free row, else the least recently used one */
+    if ((row->idx >= 0) && 
+        ((hdl->rows[i].idx < 0) || ((int)(hdl->rows[i].last_use - row->last_use) < 0))){
+      row = &hdl->rows[i];
+    }
+  }
+
+  if (row->surf == NULL){
+    dsc.flags = DSDESC_WIDTH | DSDESC_HEIGHT;
+    dsc.width = hdl->refresh_zone.w;
+    dsc.height = hdl->line_height;
+    if (hdl->dfb->CreateSurface(hdl->dfb, &dsc, &row->surf) != DFB_OK) {
+      row->surf = NULL;
+      return NULL;
+    }
+    row->surf->SetFont(row->surf, hdl->font);
+  }
+  row->idx = idx;
+  row->flags = flags;
+  row->last_use = hdl->rows_date;
+  render_row(hdl, row);
+  return row->surf;
+}
+
 /** Refresh the fs object
+ *
+ * Only the lines whose content changed are drawn, from the pre-rendered rows.
+ * A row is rendered only if it is not in the cache : moving the cursor renders two rows at most,
+ * and scrolling renders only the newly displayed entries.
+ * While scrolling by pixels, all the lines move but they are only blitted from the cache.
  *
  *\param[in] hdl Handle of the fs object
  *
@@ -333,74 +562,203 @@ static bool display_obj(fs_handle hdl, enum fs_icon_ids id, DFBPoint * point){
  *
  */
 static bool refresh_display(fs_handle hdl){
-  char *filename;  
-  int len;
-  int i,y = 0;
-  DFBPoint point;
-  int max_idx;
-  DFBRegion region;
+  IDirectFBSurface * row;
+  int nb = entries_nb(hdl);
+  int first_line = -1;
+  int last_line = -1;
+  int lines_nb;
+  int i, idx, flags;
+  DFBRegion region, clip;
+
+  if (hdl->nb_lines <= 0){
+    return true;
+  }
+  if (hdl->scroll_offset != hdl->lines_offset){
+    /* Every line moved */
+    for (i = 0; i <= hdl->nb_lines; i++){
+      hdl->lines[i].idx = FS_LINE_UNKNOWN;
+    }
+    hdl->lines_offset = hdl->scroll_offset;
+  }
+  if (hdl->clear_zone){
+    /* Clear the whole zone, including the margin below the last line */
+    hdl->destination->SetColor(hdl->destination, 0x0, 0x0, 0x0, 0xFF);  
+    hdl->destination->FillRectangle(hdl->destination, hdl->refresh_zone.x, hdl->refresh_zone.y,
+                                    hdl->refresh_zone.w, hdl->refresh_zone.h);
+  }
 
-  clear_surface( hdl->refresh_zone_surf);
-
-  /* Set color */
-  hdl->refresh_zone_surf->SetColor( hdl->refresh_zone_surf,
-                                       hdl->config->graphics.font_color.r,
-                                       hdl->config->graphics.font_color.g,
-                                       hdl->config->graphics.font_color.b,
-                                       hdl->config->graphics.font_color.a);
-
-  point.x = 0;
-  point.y = 0;
-  max_idx = hdl->idx_first_displayed + min(hdl->nb_lines, fl_get_entries_nb(hdl->list)- hdl->idx_first_displayed);
-
-  /* Display zone content */
-  for (i=hdl->idx_first_displayed; i< max_idx; i++){  
-
-    if (i != hdl->selected_item){
-        hdl->refresh_zone_surf->DrawString( hdl->refresh_zone_surf, 
-                                            fl_get_filename(hdl->list, i),                                        
-                                            -1,
-                                            hdl->file_zone.x - hdl->refresh_zone.x ,  
-                                            y, 
-                                            DSTF_TOPLEFT);
+  /* A partially scrolled line shows up at the bottom */
+  lines_nb = hdl->nb_lines + ((hdl->scroll_offset > 0) ? 1 : 0);
+  clip.x1 = hdl->refresh_zone.x;
+  clip.y1 = hdl->refresh_zone.y;
+  clip.x2 = clip.x1 + hdl->refresh_zone.w - 1;
+  clip.y2 = clip.y1 + hdl->nb_lines * hdl->line_height - 1;
+  hdl->destination->SetClip(hdl->destination, &clip);
+  for (i = 0; i < lines_nb; i++){
+    idx = hdl->idx_first_displayed + i;
+    flags = 0;
+    if (idx < nb){
+      if (entry_name(hdl, idx) == NULL){
+        flags = FS_ROW_PLACEHOLDER;
+      } else {
+        if (idx == hdl->selected_item){
+          flags |= FS_ROW_CURSOR;
+        }
+        if ((hdl->loading.path == NULL) && fl_is_selected(hdl->list, idx)) {
+          flags |= FS_ROW_SELECTED;
+        }
+      }
     } else {
-        len = strlen(fl_get_filename(hdl->list, i));       
-        /*2 addtional characters + terminal 0*/
-        filename = malloc(len+3);
-        memcpy (&filename[2],fl_get_filename(hdl->list, i), len+1);        
-        filename[0] = '>';
-        filename[1] = ' ';
-        hdl->refresh_zone_surf->DrawString( hdl->refresh_zone_surf, 
-                                            filename,                                        
-                                            -1,
-                                            hdl->file_zone.x - hdl->refresh_zone.x ,  
-                                            y, 
-                                            DSTF_TOPLEFT);
-        free(filename);
+      idx = -1;
     }
-    if (fl_is_selected(hdl->list,i)) {
-      display_obj(hdl,FS_ICON_CHECK,&point);
+    if ((hdl->lines[i].idx == idx) && (hdl->lines[i].flags == flags)){
+      continue;
+    }
+
+    row = NULL;
+    if (flags & FS_ROW_PLACEHOLDER){
+      row = get_row(hdl, -1, flags);
+    } else if (idx >= 0){
+      row = get_row(hdl, idx, flags);
+    }
+    if (row != NULL){
+      hdl->destination->Blit(hdl->destination, row, NULL, hdl->refresh_zone.x, 
+                             hdl->refresh_zone.y + i * hdl->line_height - hdl->scroll_offset);
+    } else {
+      hdl->destination->SetColor(hdl->destination, 0x0, 0x0, 0x0, 0xFF);  
+      hdl->destination->FillRectangle(hdl->destination, hdl->refresh_zone.x, 
+                                      hdl->refresh_zone.y + i * hdl->line_height - hdl->scroll_offset,
+                                      hdl->refresh_zone.w, hdl->line_height);
     }
-    if (fl_is_folder(hdl->list,i)){
-      display_obj(hdl,FS_ICON_FOLDER,&point);
+    hdl->lines[i].idx = ((row != NULL) || (idx < 0)) ? idx : FS_LINE_UNKNOWN;
+    hdl->lines[i].flags = flags;
+    if (first_line < 0){
+      first_line = i;
     }
-    y += hdl->line_height ;
-    point.y = y;
+    last_line = i;
   }
-  
-  hdl->destination->Blit(hdl->destination, hdl->refresh_zone_surf, NULL, hdl->refresh_zone.x, hdl->refresh_zone.y);
-  region.x1 = hdl->refresh_zone.x;
-  region.y1 = hdl->refresh_zone.y;
-  region.x2 = region.x1 + hdl->refresh_zone.w;
-  region.y2 = region.y1 + hdl->refresh_zone.h;
-  hdl->destination->Flip(hdl->destination, &region, DSFLIP_WAITFORSYNC);
+  hdl->destination->SetClip(hdl->destination, NULL);
+  if (lines_nb == hdl->nb_lines){
+    /* Bottom line is not displayed anymore */
+    hdl->lines[hdl->nb_lines].idx = FS_LINE_UNKNOWN;
+  }
+
+  if (hdl->clear_zone){
+    hdl->clear_zone = false;
+    region.x1 = hdl->refresh_zone.x;
+    region.y1 = hdl->refresh_zone.y;
+    region.x2 = region.x1 + hdl->refresh_zone.w - 1;
+    region.y2 = region.y1 + hdl->refresh_zone.h - 1;
+  } else if (first_line >= 0){
+    /* Only update the changed band */
+    region.x1 = hdl->refresh_zone.x;
+    region.y1 = hdl->refresh_zone.y + first_line * hdl->line_height - hdl->scroll_offset;
+    region.x2 = region.x1 + hdl->refresh_zone.w - 1;
+    region.y2 = hdl->refresh_zone.y + (last_line + 1) * hdl->line_height - hdl->scroll_offset - 1;
+    if (region.y1 < clip.y1)
+      region.y1 = clip.y1;
+    if (region.y2 > clip.y2)
+      region.y2 = clip.y2;
+  } else {
+    /* Nothing changed */
+    return true;
+  }
+  hdl->destination->Flip(hdl->destination, &region, DSFLIP_NONE);
   
   return true;
 
 }
 
+/** Current scrolling position in pixels */
+static int get_scroll(fs_handle hdl){
+  return hdl->idx_first_displayed * hdl->line_height + hdl->scroll_offset;
+}
+
+/** Last scrolling position in pixels (last entry at the bottom) */
+static int get_scroll_max(fs_handle hdl){
+  int max = (entries_nb(hdl) - hdl->nb_lines) * hdl->line_height;
+
+  return (max > 0) ? max : 0;
+}
+
+/** Set the scrolling position in pixels */
+static void set_scroll(fs_handle hdl, int pos){
+  hdl->idx_first_displayed = pos / hdl->line_height;
+  hdl->scroll_offset = pos % hdl->line_height;
+}
+
+/** Stop any drag or fling and align the display on the first displayed line */
+static void stop_scrolling(fs_handle hdl){
+  hdl->touch.pressed = false;
+  hdl->touch.dragging = false;
+  hdl->touch.velocity = 0;
+  hdl->scroll_offset = 0;
+}
+
+/** Date in ms */
+static unsigned int get_ms(void){
+  struct timeval tv;
 
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/** Compute and display a frame of the scrolling animation 
+ *
+ * \return true if the animation goes on
+ */
+static bool animate(fs_handle hdl){
+  int pos, max;
+  int speed;
+
+  if (hdl->touch.dragging){
+    pos = hdl->touch.pos;
+  } else {
+    /* Fling : the speed decreases exponentially */
+    pos = get_scroll(hdl) + (hdl->touch.velocity * FS_FRAME_MS) / 1000;
+    hdl->touch.velocity -= (hdl->touch.velocity * FS_FRAME_MS) / FS_FLING_TAU_MS;
+    speed = (hdl->touch.velocity > 0) ? hdl->touch.velocity : -hdl->touch.velocity;
+    if (speed < FS_FLING_MIN_SPEED){
+      hdl->touch.velocity = 0;
+      /* Align on the nearest line */
+      pos = ((pos + hdl->line_height / 2) / hdl->line_height) * hdl->line_height;
+    }
+  }
+  max = get_scroll_max(hdl);
+  if (pos > max){
+    pos = max;
+    hdl->touch.velocity = 0;
+  }
+  if (pos < 0){
+    pos = 0;
+    hdl->touch.velocity = 0;
+  }
+  set_scroll(hdl, pos);
+  refresh_display(hdl);
+  return (hdl->touch.dragging || (hdl->touch.velocity != 0));
+}
+
+/** Thread animating the drag and fling scrolling at a fixed frame rate
+ *
+ * Touch screen events only update the wanted position or speed : the frames are computed here.
+ */
+static void * anim_thread(void *param){
+  fs_handle hdl = param;
 
+  pthread_mutex_lock(&hdl->lock);
+  while (!hdl->end_asked){
+    if (!hdl->touch.dragging && (hdl->touch.velocity == 0)){
+      pthread_cond_wait(&hdl->anim_cond, &hdl->lock);
+      continue;
+    }
+    animate(hdl);
+    pthread_mutex_unlock(&hdl->lock);
+    usleep(FS_FRAME_MS * 1000);
+    pthread_mutex_lock(&hdl->lock);
+  }
+  pthread_mutex_unlock(&hdl->lock);
+  return NULL;
+}
 
 
 /** Thread that handles input events 
@@ -429,11 +787,17 @@ static void * thread(void *param){
 				  break;
 			}
 		}		
+	  hdl->win->GetPosition(hdl->win, &win_x, &win_y);
+          fs_handle_motion(hdl, x - win_x,y -win_y);
 	}
 	else if (evt.type == DIET_BUTTONPRESS ){	
 	  hdl->win->GetPosition(hdl->win, &win_x, &win_y);
           fs_handle_click(hdl, x - win_x,y -win_y);
         }
+	else if (evt.type == DIET_BUTTONRELEASE ){	
+	  hdl->win->GetPosition(hdl->win, &win_x, &win_y);
+          fs_handle_release(hdl, x - win_x,y -win_y);
+        }
       }      
   }
   return NULL;
@@ -441,8 +805,141 @@ static void * thread(void *param){
 
 
 
+/** Display the first entries of a folder while the file list is still being built */
+static void first_screen_cb(file_list list, void * data){
+  fs_handle hdl = data;
+
+  hdl->list = list;
+  flush_rows(hdl);
+  refresh_display(hdl);
+}
+
+/** Loading thread callback : keep a copy of the first entries found to display them */
+static void load_first_screen_cb(file_list list, void * data){
+  struct fs_load * load = data;
+  fs_handle hdl = load->hdl;
+  int nb = fl_get_entries_nb(list);
+  int i;
+
+  pthread_mutex_lock(&hdl->lock);
+  if ((load->gen == hdl->loading.gen) && (hdl->loading.names == NULL)){
+    hdl->loading.names = calloc(nb, sizeof(*hdl->loading.names));
+    hdl->loading.is_folder = calloc(nb, sizeof(*hdl->loading.is_folder));
+    if ((hdl->loading.names != NULL) && (hdl->loading.is_folder != NULL)){
+      for (i = 0; i < nb; i++){
+        hdl->loading.names[i] = strdup(fl_get_filename(list, i));
+        if (hdl->loading.names[i] == NULL){
+          break;
+        }
+        hdl->loading.is_folder[i] = fl_is_folder(list, i);
+      }
+      hdl->loading.nb = i;
+    }
+    flush_rows(hdl);
+    refresh_display(hdl);
+  }
+  pthread_mutex_unlock(&hdl->lock);
+}
+
+/** Thread building the file list of a folder
+ *
+ * The list replaces the displayed one, unless another folder has been asked meanwhile.
+ */
+static void * load_thread(void *param){
+  struct fs_load * load = param;
+  fs_handle hdl = load->hdl;
+  file_list list;
+
+  list = fl_create_progressive(load->path, load->use_filter ? &hdl->compiled_re_filter : NULL,
+                               load->multiple_selection, hdl->nb_lines, load_first_screen_cb, load);
+  pthread_mutex_lock(&hdl->lock);
+  if (load->gen == hdl->loading.gen){
+    loading_clear(hdl);
+    fl_release(hdl->list);
+    hdl->list = list;
+    hdl->selected_item = 0;
+    hdl->idx_first_displayed = 0;
+    stop_scrolling(hdl);
+    flush_rows(hdl);
+    refresh_display(hdl);
+  } else {
+    fl_release(list);
+  }
+  hdl->loading.threads--;
+  pthread_cond_broadcast(&hdl->loading.done);
+  pthread_mutex_unlock(&hdl->lock);
+  free(load->path);
+  free(load);
+  return NULL;
+}
+
+/** Display a new folder
+ *
+ * \param[in] async true to build the file list in a thread : the display is never blocked 
+ *                  by the storage, the first entries are displayed as soon as they are found.
+ */
+static void load_path(fs_handle hdl, const char * path, bool async){
+  struct fs_load * load;
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  fs_unselect_all(hdl);
+  stop_scrolling(hdl);
+  free(hdl->preview_path);
+  hdl->preview_path = NULL;
+  hdl->idx_first_displayed = 0;
+  hdl->selected_item = 0;
+  /* Discard the folder being loaded if any */
+  loading_clear(hdl);
+  hdl->loading.gen++;
+  fl_release(hdl->list);
+  hdl->list = NULL;
+
+  if (async){
+    load = calloc(1, sizeof(*load));
+    if (load != NULL){
+      load->hdl = hdl;
+      load->gen = hdl->loading.gen;
+      load->path = strdup(path);
+      load->use_filter = (hdl->config->folder.filter != NULL);
+      load->multiple_selection = hdl->config->options.multiple_selection;
+      hdl->loading.path = strdup(path);
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      if ((load->path != NULL) && (hdl->loading.path != NULL) &&
+          (pthread_create(&thread, &attr, load_thread, load) == 0)){
+        pthread_attr_destroy(&attr);
+        hdl->loading.threads++;
+        /* Placeholders until the first entries are found */
+        flush_rows(hdl);
+        refresh_display(hdl);
+        return;
+      }
+      pthread_attr_destroy(&attr);
+      free(load->path);
+      free(load);
+      free(hdl->loading.path);
+      hdl->loading.path = NULL;
+    }
+  }
+
+  /* Display the first screen as soon as it is available on big folders */
+  hdl->list = fl_create_progressive(path, hdl->config->folder.filter ? &hdl->compiled_re_filter : NULL,
+                                    hdl->config->options.multiple_selection,
+                                    hdl->nb_lines, first_screen_cb, hdl);
+  hdl->selected_item = 0;
+  /* Entries have been sorted again since the first screen */
+  flush_rows(hdl);
+  refresh_display(hdl);
+}
+
+
 static int item_selection(fs_handle hdl, int idx){
     bool refresh = false;
+    if (hdl->loading.path != NULL) {
+        /* Entries are not known yet */
+        return false;
+    }
     if (!fl_is_folder(hdl->list,idx)) {
         /* Regular file */
         fs_select(hdl,idx);        
@@ -466,7 +963,7 @@ static int item_selection(fs_handle hdl, int idx){
             strcat(full_path , "/");
             strcat(full_path, fl_get_filename(hdl->list,idx));
         }
-        fs_new_path(hdl,full_path, NULL);
+        load_path(hdl, full_path, true);
     }
     return refresh;
 }
@@ -515,6 +1012,7 @@ fs_handle fs_create (IDirectFB  * dfb, IDirectFBWindow * win, const struct fs_co
   fs_handle  handle ;
   DFBFontDescription font_dsc;
   DFBSurfaceDescription dsc;  
+  pthread_mutexattr_t attr;
   int w1,h1,w2,h2;
   int shift_y;
 
@@ -523,6 +1021,13 @@ fs_handle fs_create (IDirectFB  * dfb, IDirectFBWindow * win, const struct fs_co
       goto error;
   handle->dfb = dfb;
   handle->win = win;
+  /* Recursive : the selection callbacks may call the object back */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&handle->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  pthread_cond_init(&handle->anim_cond, NULL);
+  pthread_cond_init(&handle->loading.done, NULL);
 
   if (!copy_config(config, &handle->config)) {
     goto error;
@@ -609,23 +1114,22 @@ fs_handle fs_create (IDirectFB  * dfb, IDirectFBWindow * win, const struct fs_co
 
   handle->idx_first_displayed = 0;
 
-  /* Init font */
-  font_dsc.flags = DFDESC_HEIGHT;
-  if (dfb->CreateFont(dfb, config->graphics.font, &font_dsc, &handle->font) != DFB_OK) {
+  /* Init font : encoding is latin 1 ISO 8859-1 instead of UTF-8 */
+  handle->font = res_get_font(dfb, config->graphics.font, font_dsc.height, DTEID_OTHER);
+  if (handle->font == NULL) {
     goto error;
   }
 
+  handle->font->GetStringWidth(handle->font, "> ", -1, &handle->cursor_width);
 
-  dsc.flags = DSDESC_WIDTH | DSDESC_HEIGHT/* | DSDESC_CAPS*/;
-  dsc.width = handle->refresh_zone.w;
-  dsc.height = handle->refresh_zone.h;
-  /*dsc.caps = DSCAPS_DOUBLE;*/
-  if (dfb->CreateSurface(dfb, &dsc, &handle->refresh_zone_surf ) != DFB_OK) {
+  /* Rows cache : row surfaces are created on first use */
+  handle->rows_nb = FS_ROW_CACHE_PAGES * handle->nb_lines;
+  handle->rows = calloc(handle->rows_nb, sizeof(*handle->rows));
+  handle->lines = calloc(handle->nb_lines + 1, sizeof(*handle->lines));
+  if ((handle->rows == NULL) || (handle->lines == NULL)) {
     goto error;
   }
-  /* Set encodings to latin 1 ISO 8859-1 instead of UTF-8 */
-  handle->font->SetEncoding(handle->font,DTEID_OTHER);
-  handle->refresh_zone_surf->SetFont (handle->refresh_zone_surf, handle->font);
+  flush_rows(handle);
  
   /* Create preview surface if needed */
   if (config->options.preview_box){
@@ -661,6 +1165,10 @@ fs_handle fs_create (IDirectFB  * dfb, IDirectFBWindow * win, const struct fs_co
 /*  refresh_display(handle);*/
  
   /* thread creation */
+  if (pthread_create(&handle->anim_thread, NULL, anim_thread, handle) != 0){
+    handle->anim_thread = 0;
+    goto error;
+  }
   if (config->options.events_thread){
     handle->end_asked = false;
 	pthread_create(&handle->thread, NULL, thread, handle);
@@ -704,6 +1212,8 @@ bool fs_set_select_cb(fs_handle hdl, select_cb * f){
 void fs_handle_key(fs_handle hdl, DFBInputDeviceKeyIdentifier id){    
     bool refresh = false;
     
+    pthread_mutex_lock(&hdl->lock);
+    stop_scrolling(hdl);
     switch(id){    
     case DIKI_DOWN:
         if  (hdl->selected_item < (fl_get_entries_nb(hdl->list) - 1))
@@ -736,21 +1246,24 @@ void fs_handle_key(fs_handle hdl, DFBInputDeviceKeyIdentifier id){
     if (refresh){
         refresh_display(hdl);
     }          
+    pthread_mutex_unlock(&hdl->lock);
 }
 
 
 
 /** Handle click on the object
+ *
+ * A press on the files starts a drag : the entry is only selected on release if the press did not move.
  *
  * \param[in] x x coordonate of the click (relative to the window)
  * \param[in] y y coordonate of the click (relative to the window)
  *
  */
 void fs_handle_click(fs_handle hdl,int x, int y){
-  int idx; 
   bool refresh = false;
-  int entries_nb = fl_get_entries_nb(hdl->list);
+  bool was_moving;
 
+  pthread_mutex_lock(&hdl->lock);
   if( (x >= hdl->config->geometry.pos.x) && 
     (x <= (hdl->config->geometry.pos.x + hdl->config->geometry.pos.w )) && 
     (y >= hdl->config->geometry.pos.y) && 
@@ -762,6 +1275,7 @@ void fs_handle_click(fs_handle hdl,int x, int y){
         (y >= hdl->arrow_list[FS_ICON_UP].y) &&
         (y <= (hdl->arrow_list[FS_ICON_UP].y + hdl->arrow_list[FS_ICON_UP].h))){          
           /* Scroll up */
+          stop_scrolling(hdl);
           refresh = scroll_up(hdl);
     }
     
@@ -770,25 +1284,120 @@ void fs_handle_click(fs_handle hdl,int x, int y){
         (y >= hdl->arrow_list[FS_ICON_DOWN].y) &&
         (y <= (hdl->arrow_list[FS_ICON_DOWN].y + hdl->arrow_list[FS_ICON_UP].h))){
           /* Scroll down */                             
+          stop_scrolling(hdl);
           refresh = scroll_down(hdl);
     }
     if ((x >= hdl->refresh_zone.x) &&
         (x <= (hdl->refresh_zone.x + hdl->refresh_zone.w)) &&
         (y >= hdl->refresh_zone.y) &&
         (y <= (hdl->refresh_zone.y + hdl->refresh_zone.h))) {
-        /* Test a file selection */
-        idx = hdl->idx_first_displayed + ((y - hdl->refresh_zone.y) / hdl->line_height);
-        if (idx < entries_nb) {
-            refresh = item_selection(hdl, idx);
-        }
+        /* A press during a fling stops it and can not select an entry */
+        was_moving = (hdl->touch.velocity != 0);
+        hdl->touch.velocity = 0;
+        hdl->touch.pressed = true;
+        hdl->touch.dragging = was_moving;
+        hdl->touch.press_x = x;
+        hdl->touch.press_y = y;
+        hdl->touch.last_y = y;
+        hdl->touch.last_ms = get_ms();
+        hdl->touch.pos = get_scroll(hdl);
     }
   }
   if (refresh){
     refresh_display(hdl);
   }        
+  pthread_mutex_unlock(&hdl->lock);
   return;
 }
 
+/** Handle a move on the touch screen
+ *
+ * Once the press moved by half a line, the files follow it.
+ *
+ * \param[in] x x coordonate of the touch (relative to the window)
+ * \param[in] y y coordonate of the touch (relative to the window)
+ */
+void fs_handle_motion(fs_handle hdl, int x, int y){
+  unsigned int now;
+  int speed, max;
+
+  pthread_mutex_lock(&hdl->lock);
+  if (!hdl->touch.pressed || (y == hdl->touch.last_y)){
+    pthread_mutex_unlock(&hdl->lock);
+    return;
+  }
+  now = get_ms();
+  if (!hdl->touch.dragging){
+    if (abs(y - hdl->touch.press_y) < hdl->line_height / 2){
+      pthread_mutex_unlock(&hdl->lock);
+      return;
+    }
+    hdl->touch.dragging = true;
+    pthread_cond_signal(&hdl->anim_cond);
+  }
+  /* Smoothed speed of the drag */
+  if (now != hdl->touch.last_ms){
+    speed = ((hdl->touch.last_y - y) * 1000) / (int)(now - hdl->touch.last_ms);
+    hdl->touch.velocity = (4 * speed + hdl->touch.velocity) / 5;
+  }
+  hdl->touch.pos += hdl->touch.last_y - y;
+  max = get_scroll_max(hdl);
+  if (hdl->touch.pos > max)
+    hdl->touch.pos = max;
+  if (hdl->touch.pos < 0)
+    hdl->touch.pos = 0;
+  hdl->touch.last_y = y;
+  hdl->touch.last_ms = now;
+  pthread_mutex_unlock(&hdl->lock);
+}
+
+/** Handle the release of the touch screen
+ *
+ * Ends a drag with a fling at the speed of the drag, or selects the pressed entry.
+ *
+ * \param[in] x x coordonate of the touch (relative to the window)
+ * \param[in] y y coordonate of the touch (relative to the window)
+ */
+void fs_handle_release(fs_handle hdl, int x, int y){
+  bool refresh = false;
+  int idx;
+
+  pthread_mutex_lock(&hdl->lock);
+  if (!hdl->touch.pressed){
+    pthread_mutex_unlock(&hdl->lock);
+    return;
+  }
+  hdl->touch.pressed = false;
+  if (hdl->touch.dragging){
+    hdl->touch.dragging = false;
+    if ((get_ms() - hdl->touch.last_ms) > FS_DRAG_STALL_MS){
+      hdl->touch.velocity = 0;
+    }
+    if (hdl->touch.velocity > FS_FLING_MAX_SPEED)
+      hdl->touch.velocity = FS_FLING_MAX_SPEED;
+    if (hdl->touch.velocity < -FS_FLING_MAX_SPEED)
+      hdl->touch.velocity = -FS_FLING_MAX_SPEED;
+    if (hdl->touch.velocity == 0){
+      /* No fling : just align on the nearest line */
+      animate(hdl);
+    } else {
+      pthread_cond_signal(&hdl->anim_cond);
+    }
+  } else {
+    /* Test a file selection */
+    hdl->touch.velocity = 0;
+    idx = hdl->idx_first_displayed + 
+          ((hdl->touch.press_y - hdl->refresh_zone.y + hdl->scroll_offset) / hdl->line_height);
+    if (idx < entries_nb(hdl)) {
+      refresh = item_selection(hdl, idx);
+    }
+  }
+  if (refresh){
+    refresh_display(hdl);
+  }        
+  pthread_mutex_unlock(&hdl->lock);
+}
+
 /** Change current folder for file selector object 
  *
  * \param[in] hdl Handle of the fs object
@@ -798,6 +1407,7 @@ void fs_handle_click(fs_handle hdl,int x, int y){
  * \retval true success
  * \retval false Failure
  *
+ * \note The file list is built before returning (unlike the navigation in the folders)
  */
 bool fs_new_path(fs_handle hdl, const char * path, const char * filter){
   struct stat buf;
@@ -808,7 +1418,10 @@ bool fs_new_path(fs_handle hdl, const char * path, const char * filter){
   if (!S_ISDIR(buf.st_mode))
     return false;  
 
+  pthread_mutex_lock(&hdl->lock);
   if (filter != NULL){
+    /* Filter may be in use by a loading thread */
+    wait_loading(hdl);
     if (hdl->config->folder.filter != NULL){
       free(hdl->config->folder.filter);
       regfree(&hdl->compiled_re_filter);
@@ -824,12 +1437,8 @@ bool fs_new_path(fs_handle hdl, const char * path, const char * filter){
       hdl->config->folder.filter = NULL;
     }
   }
-  fs_unselect_all(hdl);
-  hdl->idx_first_displayed = 0;
-  fl_release(hdl->list);
-  hdl->list = fl_create(path, hdl->config->folder.filter ? &hdl->compiled_re_filter : NULL,  hdl->config->options.multiple_selection );
-  hdl->selected_item = 0;
-  refresh_display(hdl);
+  load_path(hdl, path, false);
+  pthread_mutex_unlock(&hdl->lock);
   return true;
 }
 
@@ -846,7 +1455,9 @@ bool fs_new_path(fs_handle hdl, const char * path, const char * filter){
 bool fs_select(fs_handle hdl, int idx) {
   bool new_state = true;
 
+  pthread_mutex_lock(&hdl->lock);
   if (!fl_select_by_pos(hdl->list, idx, &new_state)){
+    pthread_mutex_unlock(&hdl->lock);
     return false;
   }
 
@@ -857,13 +1468,16 @@ bool fs_select(fs_handle hdl, int idx) {
       strcpy(full_path, fl_get_basename(hdl->list));
       strcat(full_path,"/");
       strcat(full_path, fl_get_filename(hdl->list,idx));      
+      free(hdl->preview_path);
+      hdl->preview_path = full_path;
+      hdl->preview_idx = idx;
       clear_surface(hdl->preview_surf);
       hdl->prev_cb(hdl, full_path, fl_is_selected(hdl->list,idx)?FS_EVT_SELECT:FS_EVT_UNSELECT);                  
-      free(full_path);
       hdl->destination->Blit(hdl->destination, hdl->preview_surf, NULL, hdl->preview_zone.x, hdl->preview_zone.y);
       hdl->destination->Flip(hdl->destination, NULL, DSFLIP_WAITFORSYNC);
   }
 
+  pthread_mutex_unlock(&hdl->lock);
   return true;
 }
 
@@ -878,8 +1492,10 @@ bool fs_select(fs_handle hdl, int idx) {
  */
 bool fs_select_all(fs_handle hdl) {
   
+  pthread_mutex_lock(&hdl->lock);
   fl_select_all(hdl->list);
   refresh_display(hdl);
+  pthread_mutex_unlock(&hdl->lock);
   return true;
 }
 
@@ -892,6 +1508,7 @@ bool  fs_unselect_all(fs_handle hdl){
   int i;
   char * full_path;
 
+  pthread_mutex_lock(&hdl->lock);
   for(i=0; i<fl_get_entries_nb(hdl->list); i++){  
     if (fl_is_selected(hdl->list,i)) {
       if (hdl->prev_cb != NULL){
@@ -905,6 +1522,7 @@ bool  fs_unselect_all(fs_handle hdl){
       }
   }
   refresh_display(hdl); 
+  pthread_mutex_unlock(&hdl->lock);
   return true;
 }
 
@@ -921,19 +1539,19 @@ bool  fs_unselect_all(fs_handle hdl){
 const char * fs_get_single_selection(fs_handle hdl){
   static char return_filename[PATH_MAX];
   const char * file;
+  const char * ret = NULL;
 
+  pthread_mutex_lock(&hdl->lock);
   file = fl_get_single_selection(hdl->list);
-  if (file == NULL){
-    return NULL;
-  }
-
-  if ((strlen(fl_get_basename(hdl->list)) + strlen(file) + 2) > PATH_MAX){
-    return NULL;
+  if ((file != NULL) && 
+      ((strlen(fl_get_basename(hdl->list)) + strlen(file) + 2) <= PATH_MAX)){
+    strcpy(return_filename, fl_get_basename(hdl->list));
+    strcat(return_filename,"/");
+    strcat(return_filename, file);
+    ret = return_filename;
   }  
-  strcpy(return_filename, fl_get_basename(hdl->list));
-  strcat(return_filename,"/");
-  strcat(return_filename, file);
-  return return_filename;       
+  pthread_mutex_unlock(&hdl->lock);
+  return ret;       
 }
 
 
@@ -948,12 +1566,15 @@ const char * fs_get_single_selection(fs_handle hdl){
 int fs_select_filename(fs_handle hdl, const char * filename){
   int i;
   
+  pthread_mutex_lock(&hdl->lock);
   for (i=0; i <fl_get_entries_nb(hdl->list) ; i++){
     if (strcmp(fl_get_filename(hdl->list,i), filename) == 0){
       fs_select(hdl, i);
+      pthread_mutex_unlock(&hdl->lock);
       return i;
     }
   }
+  pthread_mutex_unlock(&hdl->lock);
   return -1;
 }
 
@@ -967,11 +1588,16 @@ int fs_select_filename(fs_handle hdl, const char * filename){
  * \retval false Failure
  */
 bool fs_set_first_displayed_item(fs_handle hdl, int i){
+  pthread_mutex_lock(&hdl->lock);
   if ((i < 0) || 
-      (i >= fl_get_entries_nb(hdl->list)))
+      (i >= fl_get_entries_nb(hdl->list))){
+    pthread_mutex_unlock(&hdl->lock);
     return false;
+  }
+  stop_scrolling(hdl);
   hdl->idx_first_displayed = i;
   refresh_display(hdl);  
+  pthread_mutex_unlock(&hdl->lock);
   return true;
 }
 
@@ -983,7 +1609,61 @@ bool fs_set_first_displayed_item(fs_handle hdl, int i){
  * \return the selected files list enumerator containing the selected files or NULL if error
  */
 flenum   fs_get_selection(fs_handle hdl){
-  return fl_get_selection(hdl->list);
+  flenum selection;
+
+  pthread_mutex_lock(&hdl->lock);
+  selection = fl_get_selection(hdl->list);
+  pthread_mutex_unlock(&hdl->lock);
+  return selection;
+}
+
+/** Redraw the preview of a file if it is still the previewed one
+ *
+ * The selection callback is called again so that it can draw a preview that was not available at selection time.
+ *
+ * \param[in] hdl Handle of the fs object
+ * \param[in] path Full path of the file
+ */
+void fs_refresh_preview(fs_handle hdl, const char * path){
+  DFBRegion region;
+
+  pthread_mutex_lock(&hdl->lock);
+  if ((hdl->prev_cb != NULL) && (hdl->preview_path != NULL) && (strcmp(hdl->preview_path, path) == 0)){
+    clear_surface(hdl->preview_surf);
+    hdl->prev_cb(hdl, hdl->preview_path, FS_EVT_SELECT);
+    hdl->destination->Blit(hdl->destination, hdl->preview_surf, NULL, hdl->preview_zone.x, hdl->preview_zone.y);
+    region.x1 = hdl->preview_zone.x;
+    region.y1 = hdl->preview_zone.y;
+    region.x2 = hdl->preview_zone.x + hdl->preview_zone.w - 1;
+    region.y2 = hdl->preview_zone.y + hdl->preview_zone.h - 1;
+    hdl->destination->Flip(hdl->destination, &region, DSFLIP_WAITFORSYNC);
+  }
+  pthread_mutex_unlock(&hdl->lock);
+}
+
+/** Get the full path of a file displayed near the previewed one
+ *
+ * \param[in] hdl Handle of the fs object
+ * \param[in] offset Position of the file relative to the previewed one
+ * \param[out] path Receives the full path of the file
+ * \param[in] len Size of path
+ *
+ * \retval true success
+ * \retval false No regular file at this position
+ */
+bool fs_get_preview_neighbour(fs_handle hdl, int offset, char * path, size_t len){
+  bool ret = false;
+  int idx;
+
+  pthread_mutex_lock(&hdl->lock);
+  if ((hdl->preview_path != NULL) && (hdl->list != NULL)){
+    idx = hdl->preview_idx + offset;
+    if ((idx >= 0) && (idx < fl_get_entries_nb(hdl->list)) && !fl_is_folder(hdl->list, idx)){
+      ret = (snprintf(path, len, "%s/%s", fl_get_basename(hdl->list), fl_get_filename(hdl->list, idx)) < (int)len);
+    }
+  }
+  pthread_mutex_unlock(&hdl->lock);
+  return ret;
 }
 
 /** Retrieve the preview surface associated with the file selector object
@@ -1019,6 +1699,10 @@ const struct fs_config * fs_get_config(fs_handle hdl){
 
 /** retrieve the current folder */
 const char * fs_get_folder(fs_handle hdl){
+  /* The folder being loaded is already the current one */
+  if (hdl->loading.path != NULL){
+    return hdl->loading.path;
+  }
   return fl_get_basename(hdl->list);
 }
 
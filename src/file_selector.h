@@ -74,7 +74,8 @@ struct fs_config{
     bool preview_box ;                    /**< Is there a preview zone */
     bool multiple_selection;              /**< Are multiple file selection enabled*/
     bool events_thread;                   /**< Is there an autonomous thread to handle events 
-                                              (if no :fs_handle_click() has to be called on mouse click on the file selector) */
+                                              (if no :fs_handle_click(), :fs_handle_motion() and :fs_handle_release()
+                                               have to be called on touch screen events on the file selector) */
   } options;
   
   struct {
@@ -95,6 +96,8 @@ fs_handle fs_create (IDirectFB  *, IDirectFBWindow *,const struct fs_config *);
 bool fs_release(fs_handle);
 bool fs_set_select_cb(fs_handle, select_cb * );
 void fs_handle_click(fs_handle,int , int );
+void fs_handle_motion(fs_handle, int, int);
+void fs_handle_release(fs_handle, int, int);
 void  fs_handle_key(fs_handle, DFBInputDeviceKeyIdentifier);
 bool fs_new_path(fs_handle hdl, const char * path, const char * filter);
 bool fs_select(fs_handle, int);
@@ -104,6 +107,8 @@ int  fs_get_selected_number(fs_handle);
 int  fs_select_filename(fs_handle, const char * );
 bool fs_set_first_displayed_item(fs_handle, int );
 IDirectFBSurface * fs_get_preview_surface(fs_handle);
+void fs_refresh_preview(fs_handle, const char *);
+bool fs_get_preview_neighbour(fs_handle, int, char *, size_t);
 IDirectFBWindow *  fs_get_window(fs_handle);
 const struct fs_config * fs_get_config(fs_handle);
 const char * fs_get_single_selection(fs_handle);
@@ -29,6 +29,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ft2build.h>
@@ -43,6 +44,31 @@
 #define FONT_FILENAME "res/font/decker.ttf" 
 #define max(a,b) ((a>b)?a:b)
 
+/* Budget of the FreeType cache manager (the glyph atlas below is the main cache) */
+#define FONT_FTC_MAX_FACES 1
+#define FONT_FTC_MAX_SIZES 4
+#define FONT_FTC_MAX_BYTES (128 * 1024)
+
+/* Glyph atlas : fixed number of slots with a fixed bitmap size (about 600KB) */
+#define FONT_ATLAS_SLOTS 256
+#define FONT_ATLAS_SLOT_BYTES (48 * 48)
+#define FONT_ATLAS_HASH_SIZE 128
+
+/** A glyph ready to be drawn */
+struct font_glyph{
+    FT_UInt32 code;              /**< Unicode code point */
+    int size;                    /**< Font size */
+    FT_UInt index;               /**< Glyph index in face */
+    int left, top;
+    int width, height, pitch;
+    int xadvance, yadvance;
+    unsigned char * bitmap;      /**< 8 bits coverage */
+    struct font_glyph * prev;    /**< LRU list (head is the most recently used) */
+    struct font_glyph * next;
+    struct font_glyph * hnext;   /**< Hash bucket chain */
+    bool used;
+};
+
 /* state module variables */
 static struct{
     /* FT objects instanciated on init */
@@ -58,43 +84,249 @@ static struct{
     /* Default and current Font sizes */
     int default_size;
     int size;
+
+    /* Glyph atlas */
+    struct {
+        struct font_glyph slots[FONT_ATLAS_SLOTS];
+        unsigned char * bitmaps;              /**< FONT_ATLAS_SLOTS * FONT_ATLAS_SLOT_BYTES */
+        struct font_glyph * hash[FONT_ATLAS_HASH_SIZE];
+        struct font_glyph * head, * tail;     /**< LRU list */
+        struct font_glyph uncached;           /**< Glyph too large for a slot */
+    } atlas;
 } state;
 
-static bool draw_bitmap(const struct font_color * color,
-                        FTC_SBit sbit,
-                        int x, int y)
-{
+/** Decode the next code point of an UTF-8 string
+ *
+ * Invalid sequences are decoded as latin1 characters to keep displaying latin1 filenames.
+ *
+ * \param[in,out] text current position in the string
+ * \return the code point, 0 at end of string
+ */
+static FT_UInt32 utf8_next(const unsigned char ** text){
+  const unsigned char * p = *text;
+  FT_UInt32 code;
+  int nb, i;
 
-  FT_Int  i, j, p, q;
-  FT_Int  x_max;
-  FT_Int  y_max;
-  int index;
-  
-  if (x < 0) {
-    x = 0;
+  if (*p == 0)
+    return 0;
+  if (*p < 0x80){
+    *text = p + 1;
+    return *p;
+  } else if ((*p & 0xE0) == 0xC0){
+    code = *p & 0x1F;
+    nb = 1;
+  } else if ((*p & 0xF0) == 0xE0){
+    code = *p & 0x0F;
+    nb = 2;
+  } else if ((*p & 0xF8) == 0xF0){
+    code = *p & 0x07;
+    nb = 3;
+  } else {
+    goto latin1;
+  }
+  for (i = 1; i <= nb; i++){
+    if ((p[i] & 0xC0) != 0x80)
+      goto latin1;
+    code = (code << 6) | (p[i] & 0x3F);
   }
-  x_max = x + sbit->width;
-  y_max = y + sbit->height;
-  //printf("draw_bitmap  %i %i %i %i %i %p %p\n",x, x_max, y, y_max, state.width, state.image, color);
+  *text = p + nb + 1;
+  return code;
 
+latin1:
+  *text = p + 1;
+  return *p;
+}
 
-//  log_write(LOG_DEBUG, "draw_bitmap  %i %i %i %i",x, x_max, y, y_max);
+static inline unsigned int atlas_hash(FT_UInt32 code, int size){
+  return (code * 31 + size) % FONT_ATLAS_HASH_SIZE;
+}
 
+static void atlas_unlink(struct font_glyph * g){
+  if (g->prev != NULL)
+    g->prev->next = g->next;
+  else
+    state.atlas.head = g->next;
+  if (g->next != NULL)
+    g->next->prev = g->prev;
+  else
+    state.atlas.tail = g->prev;
+  g->prev = g->next = NULL;
+}
 
-  for (i = x, p = 0; i < x_max; i++, p++) {
-    for (j = y, q = 0; j < y_max; j++, q++) {
-          index = 4 * ((j * state.width) + i);
-          /*printf("index : %d\n", index);*/
-          state.image[index + 0] = color->r;
-          state.image[index + 1] = color->g;
-          state.image[index + 2] = color->b;
-          state.image[index + 3] = sbit->buffer[ q * sbit->width + p];
+static void atlas_push_front(struct font_glyph * g){
+  g->prev = NULL;
+  g->next = state.atlas.head;
+  if (state.atlas.head != NULL)
+    state.atlas.head->prev = g;
+  state.atlas.head = g;
+  if (state.atlas.tail == NULL)
+    state.atlas.tail = g;
+}
+
+static void atlas_hash_remove(struct font_glyph * g){
+  struct font_glyph ** pp = &state.atlas.hash[atlas_hash(g->code, g->size)];
+  while (*pp != NULL){
+    if (*pp == g){
+      *pp = g->hnext;
+      break;
     }
+    pp = &(*pp)->hnext;
   }
+  g->hnext = NULL;
+}
 
+static bool atlas_init(void){
+  int i;
+
+  memset(&state.atlas, 0, sizeof(state.atlas));
+  state.atlas.bitmaps = malloc(FONT_ATLAS_SLOTS * FONT_ATLAS_SLOT_BYTES);
+  if (state.atlas.bitmaps == NULL)
+    return false;
+  for (i = 0; i < FONT_ATLAS_SLOTS; i++){
+    state.atlas.slots[i].bitmap = &state.atlas.bitmaps[i * FONT_ATLAS_SLOT_BYTES];
+    atlas_push_front(&state.atlas.slots[i]);
+  }
   return true;
 }
 
+static void atlas_release(void){
+  free(state.atlas.bitmaps);
+  memset(&state.atlas, 0, sizeof(state.atlas));
+}
+
+/** Retrieve a glyph for the current size
+ *
+ * \warning The returned glyph is only valid until next call
+ * \return NULL if the glyph cannot be rendered
+ */
+static const struct font_glyph * get_glyph(FT_UInt32 code){
+  struct font_glyph * g;
+  FTC_ImageTypeRec im_type;
+  FTC_SBit sbit;
+  FT_UInt index;
+  int bitmap_size;
+
+  for (g = state.atlas.hash[atlas_hash(code, state.size)]; g != NULL; g = g->hnext){
+    if ((g->code == code) && (g->size == state.size)){
+      atlas_unlink(g);
+      atlas_push_front(g);
+      return g;
+    }
+  }
+
+  /* Not in atlas : render it through FreeType cache */
+  index = FT_Get_Char_Index(state.face, code);
+  im_type.face_id = &state;
+  im_type.width = state.size; 
+  im_type.height = state.size;
+  im_type.flags = FT_LOAD_TARGET_NORMAL;
+  if (FTC_SBitCache_Lookup(state.sbits_cache, &im_type, index, &sbit, NULL) != 0)
+    return NULL;
+
+  bitmap_size = sbit->pitch * sbit->height;
+  if ((state.atlas.bitmaps == NULL) || (bitmap_size > FONT_ATLAS_SLOT_BYTES)){
+    /* Too large : use FreeType cache bitmap directly */
+    g = &state.atlas.uncached;
+    g->bitmap = sbit->buffer;
+  } else {
+    /* Evict the least recently used slot */
+    g = state.atlas.tail;
+    atlas_unlink(g);
+    if (g->used)
+      atlas_hash_remove(g);
+    memcpy(g->bitmap, sbit->buffer, bitmap_size);
+    g->used = true;
+    g->hnext = state.atlas.hash[atlas_hash(code, state.size)];
+    state.atlas.hash[atlas_hash(code, state.size)] = g;
+    atlas_push_front(g);
+  }
+  g->code = code;
+  g->size = state.size;
+  g->index = index;
+  g->left = sbit->left;
+  g->top = sbit->top;
+  g->width = sbit->width;
+  g->height = sbit->height;
+  g->pitch = sbit->pitch;
+  g->xadvance = sbit->xadvance;
+  g->yadvance = sbit->yadvance;
+  return g;
+}
+
+/** Return the kerning (in pixels) to apply between two glyphs */
+static int get_kerning(FT_UInt prev_index, FT_UInt index){
+  FTC_ScalerRec scaler;
+  FT_Size size;
+  FT_Vector delta;
+
+  if ((prev_index == 0) || (index == 0) || !FT_HAS_KERNING(state.face))
+    return 0;
+  /* Activate the current size on the face */
+  scaler.face_id = &state;
+  scaler.width = state.size;
+  scaler.height = state.size;
+  scaler.pixel = 1;
+  scaler.x_res = scaler.y_res = 0;
+  if (FTC_Manager_LookupSize(state.cache_manager, &scaler, &size) != 0)
+    return 0;
+  if (FT_Get_Kerning(size->face, prev_index, index, FT_KERNING_DEFAULT, &delta) != 0)
+    return 0;
+  return delta.x >> 6;
+}
+
+/** Blend a glyph bitmap over a RGBA buffer
+ *
+ * \param color text color
+ * \param glyph glyph to draw
+ * \param x, y coordinate of the glyph top left corner in the buffer
+ * \param image RGBA target buffer
+ * \param width, height size of the target buffer
+ */
+static void blend_bitmap(const struct font_color * color,
+                         const struct font_glyph * glyph,
+                         int x, int y,
+                         unsigned char * image, int width, int height)
+{
+  int i, j, p, q;
+  int x_max, y_max;
+  unsigned int a, da, out_a;
+  unsigned char * dst;
+
+  x_max = x + glyph->width;
+  y_max = y + glyph->height;
+  if (x_max > width)
+    x_max = width;
+  if (y_max > height)
+    y_max = height;
+
+  for (j = y, q = 0; j < y_max; j++, q++) {
+    if (j < 0)
+      continue;
+    p = (x < 0) ? -x : 0;
+    dst = &image[4 * (j * width + x + p)];
+    for (i = x + p; i < x_max; i++, p++, dst += 4) {
+      a = glyph->bitmap[q * glyph->pitch + p];
+      if (a == 0)
+        continue;
+      da = dst[3];
+      if ((a == 255) || (da == 0)) {
+        dst[0] = color->r;
+        dst[1] = color->g;
+        dst[2] = color->b;
+        dst[3] = a;
+        continue;
+      }
+      /* "Over" operator on non premultiplied colors */
+      da = da * (255 - a) / 255;
+      out_a = a + da;
+      dst[0] = (color->r * a + dst[0] * da) / out_a;
+      dst[1] = (color->g * a + dst[1] * da) / out_a;
+      dst[2] = (color->b * a + dst[2] * da) / out_a;
+      dst[3] = out_a;
+    }
+  }
+}
+
 
 /* FIXME Only one face is used for now... */
 static FT_Error face_requester( FTC_FaceID  face_id,
@@ -109,40 +341,30 @@ static FT_Error face_requester( FTC_FaceID  face_id,
   
 bool  font_get_size(const char * text, int * width, int * height, int * orig)
 {
-  int n;
-  int num_chars;
   FT_Vector pen;
-  FT_Error  error;
   int up, down, max_up, max_down;
-  FTC_SBit sbit;
-  FTC_ImageTypeRec im_type;
-  FT_UInt index;
-  
-  im_type.flags = FT_LOAD_TARGET_NORMAL;  
-  im_type.face_id = &state;  
-  im_type.width =  state.size;
-  im_type.height = state.size;
+  const struct font_glyph * glyph;
+  const unsigned char * p = (const unsigned char *)text;
+  FT_UInt32 code;
+  FT_UInt prev_index = 0;
   
   max_up = max_down = *orig = 0;
-  num_chars = strlen(text);
   pen.x = 0;
   pen.y = 0;
   *height = 0;
 
-  for (n = 0; n < num_chars; n++) {
-    index = FT_Get_Char_Index(state.face, text[n]);
-    error = FTC_SBitCache_Lookup(state.sbits_cache,
-                                 &im_type,                                       
-                                 index,
-                                 &sbit,
-                                 NULL);
-     //log_write(LOG_DEBUG, " xadv :%i - yadv : %i - h :%i top :%i", sbit->xadvance, sbit->yadvance, sbit->height, sbit->top);
+  while ((code = utf8_next(&p)) != 0) {
+    glyph = get_glyph(code);
+    if (glyph == NULL)
+      continue;
+    pen.x += get_kerning(prev_index, glyph->index);
+    prev_index = glyph->index;
 
     /* increment pen position */
-    pen.x += max(sbit->xadvance, (sbit->left + sbit->width));
-    pen.y += sbit->yadvance;
-    up = sbit->top;
-    down =  sbit->height - sbit->top;    
+    pen.x += max(glyph->xadvance, (glyph->left + glyph->width));
+    pen.y += glyph->yadvance;
+    up = glyph->top;
+    down =  glyph->height - glyph->top;    
     if (up > max_up)
       max_up = up;
     if (down > max_down){ 
@@ -155,13 +377,13 @@ bool  font_get_size(const char * text, int * width, int * height, int * orig)
   }
 
   *width  = pen.x;
-  //log_write(LOG_DEBUG, "height : %i - width : %i - orig %i", *height, *width, *orig);
   return true;
 }
 
 
 
 void font_release(void) {
+  atlas_release();
   if (state.face != NULL) {
     FT_Done_Face(state.face);
     state.face = NULL;
@@ -173,19 +395,56 @@ void font_release(void) {
 }
 
 
+/** Render a text over an existing RGBA buffer
+ *
+ * Glyphs are blended directly from the cache bitmaps, the text is drawn from the top left corner
+ * and truncated to the buffer size.
+ *
+ * \param color text color
+ * \param text the string to draw
+ * \param image RGBA buffer
+ * \param w, h size of the buffer
+ */
+bool font_render(const struct font_color *color, const char *text, unsigned char *image, int w, int h)
+{
+  const struct font_glyph * glyph;
+  const unsigned char * p = (const unsigned char *)text;
+  FT_UInt32 code;
+  FT_UInt prev_index = 0;
+  FT_Vector pen;
+  int text_width, text_height;
+  int orig;
+
+  if (font_get_size(text, &text_width, &text_height, &orig) == false){
+    return false;
+  }
+
+  pen.x = 0;
+  pen.y = 0;
+  while ((code = utf8_next(&p)) != 0) {
+    glyph = get_glyph(code);
+    if (glyph == NULL)
+      continue;
+    pen.x += get_kerning(prev_index, glyph->index);
+    prev_index = glyph->index;
+    /* now, draw to our target surface (convert position) */    
+    blend_bitmap(color, glyph,
+                 pen.x + ((glyph->left < 0) ? 0 : glyph->left),
+                 text_height - glyph->top - orig,
+                 image, w, h);
+    /* increment pen position */
+    pen.x += glyph->xadvance;
+    pen.y += glyph->yadvance;
+  }
+  return true;
+}
+
 /**
  * \warning The caller will have to free image_buffer
  */
 bool font_draw(const struct font_color *color,  const char *text, unsigned char **image_buffer, int *w, int *h)
 {
-  FTC_SBit sbit;
-  FTC_ImageTypeRec im_type;
-  FT_UInt index;
-  FT_Vector pen;
-  FT_Error  error;
-  int num_chars;
   int orig;
-  int n;
 
   if (font_get_size(text, &state.width, &state.height, &orig) == false){
     return false;
@@ -193,42 +452,12 @@ bool font_draw(const struct font_color *color,  const char *text, unsigned char
 
   *w = state.width;
   *h = state.height;
-  state.image = malloc(state.width * state.height * 4);
+  state.image = calloc(state.width * state.height, 4);
   if (state.image == NULL){
     return false;
   }
-  memset (state.image, 0, state.width * state.height * 4);
   *image_buffer = state.image;
-
-  num_chars = strlen(text);
-  pen.x = 0;
-  pen.y = 0;
-
-  im_type.face_id = &state;
-  im_type.width = state.size; 
-  im_type.height = state.size;
-  im_type.flags = FT_LOAD_TARGET_NORMAL;
-  
-  for (n = 0; n < num_chars; n++) {
-    index = FT_Get_Char_Index(state.face, text[n]);  
-    //printf("char : %c - index : %d\n", text[n], index);    
-    error = FTC_SBitCache_Lookup(state.sbits_cache,
-                                 &im_type,                                       
-                                 index,
-                                 &sbit,
-                                 NULL);
-    //log_write(LOG_DEBUG, "err : %i size : %i for index %i - sbit :%x - xadvance : %i left %i top %i", error, state.size, index, sbit, sbit->xadvance, sbit->left, sbit->top );
-    //printf("err : %i size : %i for index %i - sbit :%x - xadvance : %i left %i top %i width : %i \n", error, state.size, index, sbit, sbit->xadvance, sbit->left, sbit->top, sbit->width );
-    /* now, draw to our target surface (convert position) */    
-    
-    draw_bitmap( color,
-                 sbit,
-                 pen.x + sbit->left,
-                 state.height - sbit->top - orig);
-    /* increment pen position */
-    pen.x += sbit->xadvance; //slot->advance.x;
-    pen.y += sbit->yadvance; //slot->advance.y;
-  }
+  font_render(color, text, state.image, state.width, state.height);
   state.image = NULL;
   return true;
 }
@@ -249,9 +478,12 @@ bool font_init(int size)
   /* Load font */
   error |= FT_New_Face(state.library, FONT_FILENAME, 0, &state.face); 
   /* Initialize cache */
-  error |= FTC_Manager_New(state.library, 0, 0, 0,
+  error |= FTC_Manager_New(state.library, FONT_FTC_MAX_FACES, FONT_FTC_MAX_SIZES, FONT_FTC_MAX_BYTES,
                           face_requester, 0, &state.cache_manager);
   error |= FTC_SBitCache_New(state.cache_manager, &state.sbits_cache);  
+  if (!atlas_init()){
+    log_write(LOG_WARNING, __FILE__ ":Unable to allocate glyph atlas");
+  }
   log_write(LOG_DEBUG, __FILE__ ":Font module initialized : %i", error);
   
   state.default_size = size;
@@ -38,6 +38,7 @@ struct font_color{
 
 bool font_init(int );
 bool font_draw(const struct font_color * ,  const char *, unsigned char ** , int * , int *);
+bool font_render(const struct font_color *, const char *, unsigned char *, int, int);
 int  font_change_size(int);
 int  font_restore_default_size(void);
 bool font_get_size(const char *, int *, int *, int *);
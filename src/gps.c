@@ -2,7 +2,8 @@
  * \file gps.c
  * \author Stephan Rafin
  *
- * This module handles GPS to extract useful information from SiRF geodetic message
+ * This module handles GPS to extract useful information from SiRF geodetic messages
+ * and NMEA sentences.
  *
  * $URL$
  * $Rev$
@@ -27,15 +28,30 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+/*
+ * GPS data are read by a dedicated thread and fed byte per byte to an incremental parser :
+ * a frame split between two reads is simply continued, nothing is copied back nor scanned again.
+ * Each fix is published in a snapshot protected by a sequence lock, so that readers (display,
+ * diaporama clock) never block nor are blocked by the clock synchronisation.
+ *
+ * The data can also be replayed from a capture file, either in real time (gps_replay configuration
+ * key) or as fast as possible with gps_replay() to test and benchmark the parser on a host.
+ */
+
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "log.h"
 #include "gps.h"
 
 #ifdef DEBUG
@@ -44,19 +60,32 @@
 #define PRINTDF(s, ...)
 #endif
 
+#define GPS_DEVICE "/dev/gpsdata"
+
+/* Max time the reader thread waits for data before checking whether it has to stop (ms) */
+#define GPS_POLL_MS 500
+/* Size of the reads from the GPS device */
+#define GPS_READ_LEN 256
+/* Size of the reads from a capture file in real time replay, and delay after each fix (ms) */
+#define GPS_REPLAY_READ_LEN 64
+#define GPS_REPLAY_PERIOD_MS 1000
 
 /* Internal SiRF constants and format description */
-#define SIRF_SYNC 0xA2A0
-#define SIRF_POST 0xB3B0
-#define SIRF_FRAME_LEN_MIN 8
-#define SIRF_FRAME_FOOTER_LEN 4
-#define SIRF_FRAME_HEADER_LEN 4
-#define SIRF_FRAME_CHCKSUM_LEN 2
+#define SIRF_SYNC1 0xA0
+#define SIRF_SYNC2 0xA2
+#define SIRF_POST1 0xB0
+#define SIRF_POST2 0xB3
 #define SIRF_PAYLOAD_MAX 1023
-#define SIRF_CKSUM_MASK 0x7FFF;
+#define SIRF_CKSUM_MASK 0x7FFF
 #define SIRF_GEODETIC_MSGID 0x29
 #define SIRF_GEODETIC_MSG_LEN 91
 
+/* NMEA constants */
+#define NMEA_START '$'
+#define NMEA_CKSUM_SEP '*'
+#define NMEA_SENTENCE_MAX 96
+#define NMEA_FIELDS_MAX 20
+
 #pragma pack(1)
 struct geodetic_nav_data{
     uint8_t  msg_id;
@@ -81,61 +110,105 @@ struct geodetic_nav_data{
     uint8_t sv_nb;
     uint8_t dummy2[2];
 };
+#pragma pack() 
 
-
-struct sirf_header{
-    uint16_t sync;
-    uint16_t len;
+/** States of the frame parser */
+enum parser_state{
+    WAIT_START,     /**< Looking for a SiRF sync or a NMEA start */
+    SIRF_SYNC,      /**< First SiRF sync byte received */
+    SIRF_LEN_HI,
+    SIRF_LEN_LO,
+    SIRF_PAYLOAD,
+    SIRF_CKSUM_HI,
+    SIRF_CKSUM_LO,
+    SIRF_POST,
+    SIRF_POST_END,
+    NMEA_SENTENCE   /**< Inside a NMEA sentence, up to its end of line */
 };
 
-struct sirf_footer{
-    uint16_t chk;
-    uint16_t post_sync;
+/** Incremental parser context */
+struct gps_parser{
+    enum parser_state state;
+    unsigned char frame[SIRF_PAYLOAD_MAX + 1];  /**< Payload of the current frame */
+    int len;                                    /**< Bytes of the current frame received */
+    int expected;                               /**< Length of the current SiRF payload */
+    uint16_t cksum;                             /**< Checksum of the current SiRF frame */
+    struct gps_data fix;                        /**< Fix being built (NMEA sentences are merged) */
+    bool sync_clock;                            /**< Set the system clock from GPS time */
+    struct gps_stats stats;
 };
 
-#pragma pack() 
+/* Latest fix, protected by a sequence lock : odd while being written */
+static struct {
+    volatile unsigned int lock_seq;
+    struct gps_data data;
+} snapshot;
 
 /* GPS module status */
 static struct {
     int gpsfd;
-    struct gps_data data;
-    pthread_mutex_t data_mutex;    
+    bool replay;
+    volatile bool stop;
+    pthread_t thread;
+    struct gps_parser parser;
 }gps_state = {
-    .gpsfd = -1,
-    .data_mutex = PTHREAD_MUTEX_INITIALIZER
+    .gpsfd = -1
 };
 
 
-/** Stupid dump buffer debug function */
-#if DEBUG
-static void dump(unsigned char * buffer, int len ){
-    int i;
-    for(i = 0; i < len; i++){
-        if ((i % 16) == 0){
-            PRINTDF ("\n");
-        }
-        PRINTDF("%0.2X ", buffer[i]);
-          
+/** Publish a new fix (only one writer : the parser) */
+static void publish(struct gps_data * fix){
+    fix->seq += 1;
+    snapshot.lock_seq++;
+    __sync_synchronize();
+    snapshot.data = *fix;
+    __sync_synchronize();
+    snapshot.lock_seq++;
+}
+
+/** Number of seconds since the epoch of a UTC broken-down time
+ *
+ * \note Unlike mktime(), does not depend on the TZ environment variable
+ */
+static time_t utc_time(const struct tm * t){
+    int y = t->tm_year + 1900;
+    int m = t->tm_mon + 1;
+    long days;
+
+    /* Years start in March so that the leap day is the last one */
+    if (m <= 2){
+        y--;
+        m += 12;
+    }
+    days = 365L * y + y / 4 - y / 100 + y / 400 + (153 * (m - 3) + 2) / 5 + t->tm_mday - 1 - 719468;
+    return (time_t)days * 86400 + t->tm_hour * 3600 + t->tm_min * 60 + t->tm_sec;
+}
+
+/** Set the system clock if it drifted from GPS time */
+static void sync_clock(const struct tm * gps_tm){
+    struct timeval new_time;     
+    time_t curr_time, gps_time;
+
+    time(&curr_time);  
+    gps_time = utc_time(gps_tm);
+    if (labs(gps_time - curr_time) > 10){
+        PRINTDF("Syncing clock needed ! system : %ld - GPS : %ld\n", (long)curr_time, (long)gps_time);
+        new_time.tv_sec = gps_time;
+        new_time.tv_usec = 0;        
+        settimeofday(&new_time, NULL);
     }
-    PRINTDF("\n");
 }
-#else 
-#define dump(x,y) do{}while(0)
-#endif
 
-/** 16 bits endianess hleper */
-static inline uint16_t endian16_swap(uint16_t val){    
-    uint16_t temp;
-    temp = val & 0xFF;
-    temp = (val >> 8) | (temp << 8);    
-    return temp;
+/** 16 bits big endian helper */
+static inline uint16_t be16(uint16_t val){
+    const uint8_t * p = (const uint8_t *)&val;
+    return (p[0] << 8) | p[1];
 }
 
-/** 32 bits endianess hleper */
-static inline uint32_t endian32_swap(uint32_t val){    
-    uint32_t temp;
-    temp = ( val >> 24) | ((val & 0x00FF0000) >> 8) |  ((val & 0x0000FF00) << 8) | ((val & 0x000000FF) << 24); 
-    return temp;
+/** 32 bits big endian helper */
+static inline uint32_t be32(uint32_t val){
+    const uint8_t * p = (const uint8_t *)&val;
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
 }
 
 
@@ -143,225 +216,439 @@ static inline uint32_t endian32_swap(uint32_t val){
  *
  * \note For now we are only interested in Geodetic message
  */
-static void handle_msg(unsigned char * buffer, int len ){
-    time_t curr_time, gps_time;
-    struct timeval new_time;     
-    char * saved_tz = NULL;    
-    struct geodetic_nav_data * msg = (struct geodetic_nav_data *)buffer;
+static bool handle_sirf(struct gps_parser * parser){
+    struct geodetic_nav_data * msg = (struct geodetic_nav_data *)parser->frame;
+    struct gps_data * fix = &parser->fix;
+    long long lat, lon;
     
-    if ((len != SIRF_GEODETIC_MSG_LEN) || (msg->msg_id != SIRF_GEODETIC_MSGID)){
-        return;
+    if ((parser->len != SIRF_GEODETIC_MSG_LEN) || (msg->msg_id != SIRF_GEODETIC_MSGID)){
+        return false;
     }
     /* Extract values from geodetic msg */
-    pthread_mutex_lock(&gps_state.data_mutex);
-    gps_state.data.seq += 1;
-    gps_state.data.lat_deg = ((int32_t)endian32_swap(msg->latitude)) / 10000000;
-    gps_state.data.lat_mins = ((endian32_swap(msg->latitude) * 60) / 10000000 ) % 60;     
-    gps_state.data.long_deg =((int32_t)endian32_swap(msg->longitude)) / 10000000;    
-    gps_state.data.long_mins = ((endian32_swap(msg->longitude) * 60) / 10000000 ) % 60;     
-    gps_state.data.alt_cm = endian32_swap(msg->altitude);
-    gps_state.data.sat_id_list = endian32_swap(msg->sat_id_list);
-    gps_state.data.sat_nb = msg->sv_nb;
-    gps_state.data.speed_kmh = (endian16_swap(msg->speed) * 36) / 1000;
-    gps_state.data.time.tm_sec = endian16_swap(msg->msecs)/1000;    
-    gps_state.data.time.tm_min = msg->minuts;    
-    gps_state.data.time.tm_hour = msg->hour;    
-    gps_state.data.time.tm_mday = msg->day;
-    gps_state.data.time.tm_mon = msg->month - 1;
-    gps_state.data.time.tm_year = endian16_swap(msg->year) - 1900;
-    gps_state.data.time.tm_isdst = -1;
-    time(&curr_time);  
-    if (getenv("TZ") != NULL){
-        saved_tz = strdup(getenv("TZ"));    
-    } else{
-        saved_tz = NULL;
-    }
-    unsetenv("TZ");
-    gps_time = mktime(&gps_state.data.time);
-    if (abs(gps_time - curr_time) > 10){
-        PRINTDF("Syncing clock needed ! system : %d - GPS : %d\n", curr_time, gps_time);
-        new_time.tv_sec = gps_time;
-        new_time.tv_usec = 0;        
-        settimeofday(&new_time, NULL);
+    lat = (int32_t)be32(msg->latitude);
+    lon = (int32_t)be32(msg->longitude);
+    fix->lat_deg = lat / 10000000;
+    fix->lat_mins = ((llabs(lat) * 60) / 10000000 ) % 60;     
+    fix->long_deg = lon / 10000000;    
+    fix->long_mins = ((llabs(lon) * 60) / 10000000 ) % 60;     
+    fix->alt_cm = be32(msg->altitude);
+    fix->sat_id_list = be32(msg->sat_id_list);
+    fix->sat_nb = msg->sv_nb;
+    fix->speed_kmh = (be16(msg->speed) * 36) / 1000;
+    fix->time.tm_sec = be16(msg->msecs)/1000;    
+    fix->time.tm_min = msg->minuts;    
+    fix->time.tm_hour = msg->hour;    
+    fix->time.tm_mday = msg->day;
+    fix->time.tm_mon = msg->month - 1;
+    fix->time.tm_year = be16(msg->year) - 1900;
+    fix->time.tm_isdst = -1;
+    publish(fix);
+    if (parser->sync_clock){
+        sync_clock(&fix->time);
     }
-    if (saved_tz != NULL){
-        setenv("TZ", saved_tz, 1);
-        free(saved_tz);
-    }    
-    pthread_mutex_unlock(&gps_state.data_mutex);
     PRINTDF("Geodetic OK !\n");
-};
-
-/** Compute SiRF checksum 
- * \return The computed checksum
- */
-static uint16_t sirf_chksum(unsigned char * buffer, int len ){
-    int i;
-    uint16_t cksum = 0;
-    
-    for (i = 0; i < len; i++){
-        cksum = (cksum + buffer[i]) & SIRF_CKSUM_MASK;
-    }
-    return cksum ;
+    return true;
 }
 
-/** Check SiRF frame validity 
+/** Parse a decimal NMEA field as a fixed point value
  *
- * 
- * \retval >0 Valid frame, returns its length (full frame len including header and footer)
- * \retval  0 Incomplete frame
- * \retval -1 Invalid frame
+ * \param scale 10^(number of decimals to keep)
+ * \return the value multiplied by scale (decimals beyond scale are truncated)
  */
-static int check_frame(unsigned char * buffer, int len ){
-    uint16_t payload_len;
-    struct sirf_footer * footer;
-    struct sirf_header * header = (struct sirf_header *)buffer;
-    if (len <= SIRF_FRAME_LEN_MIN){
-        return 0;
+static long nmea_fixed(const char * field, long scale){
+    long val = 0;
+    long frac = 0;
+    bool neg = false;
+
+    if (*field == '-'){
+        neg = true;
+        field++;
     }
-    payload_len = endian16_swap(header->len);
-    if (payload_len >= SIRF_PAYLOAD_MAX){      
-        PRINTDF("Error payload length : %d\n", payload_len);
-        return -1;
-    } else {
-        if ((payload_len + SIRF_FRAME_HEADER_LEN + SIRF_FRAME_FOOTER_LEN) > len){
-            PRINTDF("Not enough data \n");
-            return 0;
-        } else {
-            footer = ((struct sirf_footer * )&buffer[payload_len  + SIRF_FRAME_HEADER_LEN]);
-            
-            /* We have enought bytes - Perform sanity check */
-            if (footer->post_sync != SIRF_POST){     
-                PRINTDF("Post sync not found \n");
-                return -1;
-            }
-            if (sirf_chksum(&buffer[SIRF_FRAME_HEADER_LEN], payload_len) != endian16_swap(footer->chk)){
-                PRINTDF("Bad cksum !\n");
-                return -1;
-            }
-            /* Frame is valid ! */ 
-            handle_msg(&buffer[SIRF_FRAME_HEADER_LEN], payload_len);
-            return (payload_len + SIRF_FRAME_HEADER_LEN + SIRF_FRAME_FOOTER_LEN);      
+    while ((*field >= '0') && (*field <= '9')){
+        val = val * 10 + (*field++ - '0');
+    }
+    val *= scale;
+    if (*field == '.'){
+        field++;
+        while ((scale > 1) && (*field >= '0') && (*field <= '9')){
+            scale /= 10;
+            frac += (*field++ - '0') * scale;
         }
     }
+    val += frac;
+    return (neg ? -val : val);
 }
 
+/** Parse two digits */
+static int nmea_2digits(const char * field){
+    return (field[0] - '0') * 10 + (field[1] - '0');
+}
 
-/** Initialize the GPS module */
-int gps_init (void){      
-    gps_state.gpsfd = open("/dev/gpsdata", O_RDONLY|O_NONBLOCK);
-    if (gps_state.gpsfd < 0)
-    {    
-        gps_state.gpsfd = -1;
-        return -1;        
-    }       
-    return 0;
+/** Parse a NMEA (d)ddmm.mmmm coordinate and its hemisphere */
+static void nmea_coord(const char * field, const char * hemisphere, short int * deg, unsigned short int * mins){
+    long val = strtol(field, NULL, 10);
+
+    *deg = val / 100;
+    *mins = val % 100;
+    if ((*hemisphere == 'S') || (*hemisphere == 'W')){
+        *deg = -*deg;
+    }
 }
 
+/** Parse a NMEA hhmmss time */
+static void nmea_time(const char * field, struct tm * time){
+    if (strlen(field) >= 6){
+        time->tm_hour = nmea_2digits(field);
+        time->tm_min = nmea_2digits(field + 2);
+        time->tm_sec = nmea_2digits(field + 4);
+    }
+}
 
-/** Read and Parse available GPS data
- *  This function has to be called regulary to refresh the data provided by gps_get_data()
+/** Handle a NMEA sentence (without the leading '$' and trailing end of line)
  *
- * \retval -1 No data was available
- * \retval  0 Data has been handled
+ * \note GGA, RMC and GSA sentences are merged in the current fix, which is published on GGA and RMC
  */
-int gps_update(void){
-    #define BUFFER_LEN 1034 /* More than max SIRF frame */
-    static unsigned char buffer[BUFFER_LEN];    
-    static int curr_idx = 0; 
-    struct sirf_header * header;
-    int frame_state;
-    int read_len;
-    int len;
+static bool handle_nmea(struct gps_parser * parser){
+    struct gps_data * fix = &parser->fix;
+    char * sentence = (char *)parser->frame;
+    char * field[NMEA_FIELDS_MAX];
+    char * p;
+    uint8_t cksum = 0;
+    int nb = 0;
     int i;
-    
-    if (gps_state.gpsfd == -1){
-        return -1;
+
+    /* Check checksum if present */
+    sentence[parser->len] = 0;
+    for (p = sentence; (*p != 0) && (*p != NMEA_CKSUM_SEP); p++){
+        cksum ^= *p;
     }
-    read_len = read(gps_state.gpsfd, &buffer[curr_idx], sizeof (buffer)-curr_idx);
-    if (read_len <= 0)
-        return -1;
+    if (*p == NMEA_CKSUM_SEP){
+        *p = 0;
+        if (strtol(p + 1, NULL, 16) != cksum){
+            PRINTDF("Bad NMEA cksum !\n");
+            return false;
+        }
+    }
+    /* Split fields, keeping the empty ones */
+    p = sentence;
+    while (nb < NMEA_FIELDS_MAX){
+        field[nb++] = p;
+        p = strchr(p, ',');
+        if (p == NULL)
+            break;
+        *p++ = 0;
+    }
+    /* Sentence type follows the 2 chars talker ID (GP, GN, ...) */
+    if (strlen(field[0]) != 5){
+        return false;
+    }
+    if (!strcmp(&field[0][2], "GGA") && (nb >= 10)){
+        /* Fix quality 0 : no position */
+        if (atoi(field[6]) == 0){
+            return true;
+        }
+        nmea_time(field[1], &fix->time);
+        nmea_coord(field[2], field[3], &fix->lat_deg, &fix->lat_mins);
+        nmea_coord(field[4], field[5], &fix->long_deg, &fix->long_mins);
+        fix->sat_nb = atoi(field[7]);
+        fix->alt_cm = nmea_fixed(field[9], 100);
+        publish(fix);
+    } else if (!strcmp(&field[0][2], "RMC") && (nb >= 10)){
+        /* Status V : navigation receiver warning */
+        if (field[2][0] != 'A'){
+            return true;
+        }
+        nmea_time(field[1], &fix->time);
+        nmea_coord(field[3], field[4], &fix->lat_deg, &fix->lat_mins);
+        nmea_coord(field[5], field[6], &fix->long_deg, &fix->long_mins);
+        /* Knots to km/h */
+        fix->speed_kmh = (nmea_fixed(field[7], 1000) * 1852) / 1000000;
+        if (strlen(field[9]) >= 6){
+            fix->time.tm_mday = nmea_2digits(field[9]);
+            fix->time.tm_mon = nmea_2digits(field[9] + 2) - 1;
+            /* Two digits year : from 1980 to 2079 */
+            fix->time.tm_year = nmea_2digits(field[9] + 4);
+            if (fix->time.tm_year < 80){
+                fix->time.tm_year += 100;
+            }
+        }
+        fix->time.tm_isdst = -1;
+        publish(fix);
+        if (parser->sync_clock){
+            sync_clock(&fix->time);
+        }
+    } else if (!strcmp(&field[0][2], "GSA") && (nb >= 15)){
+        /* PRN of the satellites used for the fix */
+        fix->sat_id_list = 0;
+        for (i = 3; i < 15; i++){
+            int prn = atoi(field[i]);
+            if ((prn > 0) && (prn <= 32)){
+                fix->sat_id_list |= 1 << (prn - 1);
+            }
+        }
+    }
+    return true;
+}
 
-    /* Search Prelude Sync            
-        We look for a 16 bits synchro word */
-    len = curr_idx + read_len ;        
-    PRINTDF("Buffer : curr idx : %d - %d \n", curr_idx, read_len );
-    dump(buffer, len);
-    i = 0;
-    while (i < (len -1)){        
-        header = (struct sirf_header *)&buffer[i];
-        if (header->sync == SIRF_SYNC){
-            PRINTDF("Sync found at %d\n", i);
-            frame_state = check_frame(&buffer[i], len - i);
-            PRINTDF("frame state : %d\n", frame_state);
-            if (frame_state > 0){
-                /* valid frame */                
-                i += frame_state;
-            } else {
-                if (frame_state == 0) {
-                    /* Incomplete frame*/                        
+/** Feed the parser with the received bytes
+ *
+ * \return the number of valid frames handled
+ */
+static int parse(struct gps_parser * parser, const unsigned char * buffer, int len){
+    int handled = 0;
+    unsigned char c;
+    int i;
+
+    for (i = 0; i < len; i++){
+        c = buffer[i];
+        switch (parser->state){
+            case WAIT_START :
+                if (c == SIRF_SYNC1){
+                    parser->state = SIRF_SYNC;
+                } else if (c == NMEA_START){
+                    parser->len = 0;
+                    parser->state = NMEA_SENTENCE;
+                }
+                break;
+            case SIRF_SYNC :
+                if (c == SIRF_SYNC2){
+                    parser->state = SIRF_LEN_HI;
+                } else if (c != SIRF_SYNC1){
+                    parser->state = WAIT_START;
+                }
+                break;
+            case SIRF_LEN_HI :
+                parser->expected = c << 8;
+                parser->state = SIRF_LEN_LO;
+                break;
+            case SIRF_LEN_LO :
+                parser->expected |= c;
+                parser->len = 0;
+                parser->cksum = 0;
+                if ((parser->expected == 0) || (parser->expected >= SIRF_PAYLOAD_MAX)){
+                    PRINTDF("Error payload length : %d\n", parser->expected);
+                    parser->stats.errors++;
+                    parser->state = WAIT_START;
+                } else {
+                    parser->state = SIRF_PAYLOAD;
+                }
+                break;
+            case SIRF_PAYLOAD :
+                parser->frame[parser->len++] = c;
+                parser->cksum = (parser->cksum + c) & SIRF_CKSUM_MASK;
+                if (parser->len == parser->expected){
+                    parser->state = SIRF_CKSUM_HI;
+                }
+                break;
+            case SIRF_CKSUM_HI :
+                parser->expected = c << 8;
+                parser->state = SIRF_CKSUM_LO;
+                break;
+            case SIRF_CKSUM_LO :
+                parser->expected |= c;
+                if (parser->expected != parser->cksum){
+                    PRINTDF("Bad cksum !\n");
+                    parser->stats.errors++;
+                    parser->state = WAIT_START;
+                } else {
+                    parser->state = SIRF_POST;
+                }
+                break;
+            case SIRF_POST :
+                parser->state = (c == SIRF_POST1) ? SIRF_POST_END : WAIT_START;
+                if (parser->state == WAIT_START){
+                    PRINTDF("Post sync not found \n");
+                    parser->stats.errors++;
+                }
+                break;
+            case SIRF_POST_END :
+                parser->state = WAIT_START;
+                if (c != SIRF_POST2){
+                    PRINTDF("Post sync not found \n");
+                    parser->stats.errors++;
                     break;
+                }
+                /* Frame is valid ! */ 
+                parser->stats.sirf_frames++;
+                if (handle_sirf(parser)){
+                    handled++;
+                }
+                break;
+            case NMEA_SENTENCE :
+                if ((c == '\r') || (c == '\n')){
+                    parser->state = WAIT_START;
+                    parser->stats.nmea_sentences++;
+                    if (handle_nmea(parser)){
+                        handled++;
+                    } else {
+                        parser->stats.errors++;
+                    }
+                } else if (c == NMEA_START){
+                    /* Truncated sentence : restart */
+                    parser->stats.errors++;
+                    parser->len = 0;
+                } else if ((c < ' ') || (c > '~') || (parser->len >= NMEA_SENTENCE_MAX)){
+                    /* Binary data or no end of line : not NMEA */
+                    parser->stats.errors++;
+                    parser->state = (c == SIRF_SYNC1) ? SIRF_SYNC : WAIT_START;
                 } else {
-                    /* Invalid frame */
-                    i++;
+                    parser->frame[parser->len++] = c;
+                }
+                break;
+        }
+    }
+    return handled;
+}
+
+/** GPS reader thread : reads the device (or the replayed file) and feeds the parser */
+static void * reader_thread(void * param){
+    unsigned char buffer[GPS_READ_LEN];
+    struct pollfd pfd;
+    bool fix_in_pass = false;
+    int len;
+    int i;
+
+    pfd.fd = gps_state.gpsfd;
+    pfd.events = POLLIN;
+    while (!gps_state.stop){
+        if (gps_state.replay){
+            len = read(gps_state.gpsfd, buffer, GPS_REPLAY_READ_LEN);
+            if (len == 0){
+                /* Loop on the capture : a capture without any fix must not spin */
+                if (!fix_in_pass){
+                    usleep(GPS_POLL_MS * 1000);
                 }
+                fix_in_pass = false;
+                lseek(gps_state.gpsfd, 0, SEEK_SET);
+                continue;
             }
         } else {
-            i++;
+            if (poll(&pfd, 1, GPS_POLL_MS) <= 0){
+                continue;
+            }
+            len = read(gps_state.gpsfd, buffer, sizeof(buffer));
         }
+        if (len < 0){
+            if ((errno == EAGAIN) || (errno == EINTR)){
+                continue;
+            }
+            log_write(LOG_ERROR, "Error while reading GPS data : %s", strerror(errno));
+            break;
+        }
+        if ((parse(&gps_state.parser, buffer, len) > 0) && gps_state.replay){
+            /* Replay at the receiver rate */
+            fix_in_pass = true;
+            for (i = 0; (i < GPS_REPLAY_PERIOD_MS / GPS_POLL_MS) && !gps_state.stop; i++){
+                usleep(GPS_POLL_MS * 1000);
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/** Initialize the GPS module and start reading data
+ *
+ * \param replay_file capture of GPS data to replay instead of reading the GPS device (NULL for the device)
+ *
+ * \retval  0 OK
+ * \retval -1 GPS not available
+ */
+int gps_init (const char * replay_file){      
+    if (gps_state.gpsfd >= 0){
+        return 0;
     }
-    if (len >= i) {
-        memmove(&buffer[0] , &buffer[i], len - i);
-        curr_idx = len - i;
-        PRINTDF("i : %d - cur idx = %i \n", i,  len - i);
+    memset(&gps_state.parser, 0, sizeof(gps_state.parser));
+    gps_state.replay = (replay_file != NULL);
+    gps_state.stop = false;
+    if (gps_state.replay){
+        gps_state.gpsfd = open(replay_file, O_RDONLY);
+        log_write(LOG_INFO, "Replaying GPS data from %s", replay_file);
     } else {
-        PRINTDF("Error  we should never be there\n");
+        gps_state.gpsfd = open(GPS_DEVICE, O_RDONLY|O_NONBLOCK);
+        gps_state.parser.sync_clock = true;
+    }
+    if (gps_state.gpsfd < 0)
+    {    
+        gps_state.gpsfd = -1;
+        return -1;        
+    }       
+    if (pthread_create(&gps_state.thread, NULL, reader_thread, NULL) != 0){
+        log_write(LOG_ERROR, "Unable to create GPS thread");
+        close(gps_state.gpsfd);
+        gps_state.gpsfd = -1;
+        return -1;
     }
     return 0;
 }
 
+/** Stop reading GPS data */
+void gps_release(void){
+    if (gps_state.gpsfd < 0){
+        return;
+    }
+    gps_state.stop = true;
+    pthread_join(gps_state.thread, NULL);
+    close(gps_state.gpsfd);
+    gps_state.gpsfd = -1;
+}
+
 /** Retrieve GPS data 
   * \param[out] data the retrieved GPS data
   *
   * \retval  0 OK
   * \retval -1 KO
-  * \note this function can be called by another thread than the one which calls gps_read()
+  * \note Never blocks : the copy is retried if a new fix was published meanwhile
   */
 int gps_get_data(struct gps_data *data){
-    if (gps_state.gpsfd == -1) 
+    unsigned int seq;
+
+    /* Data are also available after a gps_replay() */
+    if ((gps_state.gpsfd == -1) && (snapshot.lock_seq == 0))
         return -1;
-    pthread_mutex_lock(&gps_state.data_mutex);
-    *data = gps_state.data;
-    pthread_mutex_unlock(&gps_state.data_mutex);
+    do {
+        while ((seq = snapshot.lock_seq) & 1){
+            sched_yield();
+        }
+        __sync_synchronize();
+        *data = snapshot.data;
+        __sync_synchronize();
+    } while (seq != snapshot.lock_seq);
     return 0;
 }
 
-#if 0
-/* To test as a standalone executable */
-int main(){
-    struct gps_data info;
-    int disp_seq = 0;
-    
-    gps_init();
-    while (1){
-        if (gps_update() == -1){
-            gps_get_data(&info);
-            if (info.seq != disp_seq){
-                time_t curr_time;
-                struct tm * ptm;   
-                disp_seq = info.seq;
-                printf("Lat  : %i°%i'\n", info.lat_deg, info.lat_mins);
-                printf("Long : %i°%i'\n", info.long_deg, info.long_mins);  
-                printf("Alt  : %i,%im\n", info.alt_cm / 100, info.alt_cm % 100);
-                printf("Sats : %i\n",    info.sat_nb );
-                printf("vit  : %ikm/h\n", info.speed_kmh);
-                printf("TimeG: %s",asctime(&info.time));
-                time(&curr_time);
-                ptm = localtime(&curr_time);
-                printf("TimeS: %02d : %02d\n",ptm->tm_hour, ptm->tm_min );  
-            }
-            usleep(100000);
-        }
+/** Parse a whole capture file as fast as possible
+ *
+ * The fixes are published as with the GPS device, but the system clock is never changed.
+ * The fixes have only one writer : it can not be used while the reader thread runs (see :gps_init()).
+ *
+ * \param filename capture of GPS data (SiRF binary and/or NMEA)
+ * \param[out] stats statistics of the parsing
+ *
+ * \retval  0 OK
+ * \retval -1 File can not be read or the GPS module is running
+ */
+int gps_replay(const char * filename, struct gps_stats * stats){
+    static struct gps_parser parser;
+    unsigned char buffer[4096];
+    int fd;
+    int len;
+
+    if (gps_state.gpsfd >= 0){
+        log_write(LOG_ERROR, "GPS data can not be replayed while the GPS module is running");
+        return -1;
+    }
+    fd = open(filename, O_RDONLY);
+    if (fd < 0){
+        return -1;
     }
+    memset(&parser, 0, sizeof(parser));
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0){
+        parse(&parser, buffer, len);
+    }
+    close(fd);
+    if (stats != NULL){
+        *stats = parser.stats;
+    }
+    return 0;
 }
-#endif
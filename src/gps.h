@@ -1,6 +1,6 @@
 /**
  * \file gps.h 
- * \brief  This module handles GPS to extract useful information from SiRF geodetic message 
+ * \brief  This module handles GPS to extract useful information from SiRF geodetic messages and NMEA sentences
  *
  * $URL$
  * $Rev$
@@ -42,8 +42,16 @@ struct gps_data{
     struct tm time;
 };
 
-int gps_init (void);
-int gps_update(void);
+/** Statistics of the GPS data parsing */
+struct gps_stats{
+    unsigned int sirf_frames;       /**< Valid SiRF frames */
+    unsigned int nmea_sentences;    /**< NMEA sentences */
+    unsigned int errors;            /**< Invalid frames or sentences */
+};
+
+int gps_init (const char * replay_file);
+void gps_release(void);
 int gps_get_data(struct gps_data *);
+int gps_replay(const char * filename, struct gps_stats * stats);
 
 #endif
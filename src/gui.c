@@ -41,10 +41,14 @@
 #include "power.h"
 #include "screens.h"
 #include "window.h"
+#include "res_cache.h"
 #include "gps.h"
 #include "resume.h"
 #include "pwm.h"
 
+/* Number of 50ms main loop iterations between two power button samplings */
+#define BUTTON_SAMPLING 5
+
 static IDirectFB	      *dfb;
 static IDirectFBDisplayLayer  *layer;   
 static IDirectFBEventBuffer   *keybuffer;
@@ -57,6 +61,7 @@ static void release_resources( void )
 
   /* Free all windows */
   gui_window_release_all();
+  res_cache_release();
   
   if (layer != NULL)
     layer->Release(layer);
@@ -70,17 +75,11 @@ static void release_resources( void )
 /* Auto resume function */
 static int auto_resume (void){
     int pos = 0;
-    struct stat ftype;
-    char filename[PATH_MAX - 32];    
-    char mv_command[PATH_MAX];       
+    bool is_video;
     
-    if (resume_get_file_infos(MODE_UNKNOWN, filename, PATH_MAX, &pos) == 0){                    
-        if( stat(filename, &ftype) == 0){            
-            snprintf(mv_command, sizeof(mv_command), "mv %s " RESUME_VOLATILE_PLAYLIST, filename);
-            system(mv_command);             
-            setup_engine(RESUME_VOLATILE_PLAYLIST, pos, (strstr(filename, RESUME_PLAYLIST_FILENAME(MODE_AUDIO)) == NULL));                
-            return 0;
-        }
+    if (resume_start_playlist(MODE_UNKNOWN, &pos, &is_video) == 0){                    
+        setup_engine(RESUME_VOLATILE_PLAYLIST, pos, is_video);                
+        return 0;
     }
     return -1;
 }
@@ -127,6 +126,7 @@ static void save_settings(void) {
 
     if (pwm_get_brightness(&settings.brightness) == 0) {    
         resume_set_general_settings(&settings);
+        resume_flush();
     }
 }
 
@@ -153,6 +153,7 @@ static bool dispatch_ts_event(DFBInputEvent *evt )
                           case DIAI_LAST:
                                   break;
                   }
+                  gui_window_handle_motion( mouse_x, mouse_y);
           }
 /*
           mouse_x = CLAMP (mouse_x, 0, screen_width  - 1);
@@ -162,6 +163,9 @@ static bool dispatch_ts_event(DFBInputEvent *evt )
   else if (evt->type == DIET_BUTTONPRESS ){
     gui_window_handle_click( mouse_x, mouse_y);
   }
+  else if (evt->type == DIET_BUTTONRELEASE ){
+    gui_window_handle_release( mouse_x, mouse_y);
+  }
   else if (evt->type == DIET_KEYPRESS){
       gui_window_handle_key(evt->key_id); 	  
   }
@@ -190,6 +194,7 @@ int main( int argc, char *argv[] ){
   static bool splash_wanted = true ;
   static bool first_launch = false;
   bool power_off_asked = false;
+  int button_count = 0;
   
   static struct option long_options[] = {               
                {"no-splash", no_argument,(int *)&splash_wanted, 0},
@@ -224,8 +229,11 @@ int main( int argc, char *argv[] ){
   
     init_settings();
   
-    /* Initialize GPS module */
-    gps_init();
+    /* Start GPS module (only to keep the system clock synchronized) */
+    gps_init(config_get_gps_replay());
+    
+    /* Open the power devices */
+    power_init(NULL, NULL);
   
     /* FIFO for key events */
     input_fd = open(KEY_INPUT_FIFO,O_RDONLY|O_NONBLOCK);
@@ -243,13 +251,15 @@ int main( int argc, char *argv[] ){
                         dispatch_ts_event( &evt );
                     }
                 }     
-                /* Update info from GPS */
-                gps_update() ;
               }
               while (keybuffer->GetEvent( keybuffer, DFB_EVENT(&evt)) == DFB_OK) {
                       dispatch_ts_event( &evt );
               }
-              /* Test OFF button */
+              /* Test OFF button (sampled every BUTTON_SAMPLING loops) */
+              if (++button_count >= BUTTON_SAMPLING){
+                button_count = 0;
+                power_sample_button();
+              }
               if (power_is_off_button_pushed()){
                 power_off_asked = true;
                 break;
@@ -258,6 +268,8 @@ int main( int argc, char *argv[] ){
     }
     
     save_settings();
+    power_release();
+    gps_release();
     
     /*FIXME proper release of directfb may hang...
       Pb seems to appear from time to time when releasing directfb layer : i have not found the root of this pb */
@@ -29,6 +29,7 @@
 
 #include <directfb.h>
 #include "debug.h"
+#include "res_cache.h"
 #include "label.h"
 
 
@@ -72,7 +73,7 @@ void label_release(label_handle hdl){
     free(hdl->msg);
   }
   if (hdl->font != NULL){
-    hdl->font->Release(hdl->font);
+    res_put_font(hdl->font);
   }
   if (hdl->surf != NULL) {
     hdl->surf->Release(hdl->surf);
@@ -86,7 +87,6 @@ void label_release(label_handle hdl){
  * \warnig dfb and win reference passed in config must remain valid during the life of the label object
  */
 label_handle label_create(const struct label_config * config){  
-  DFBFontDescription desc;  
   label_handle state;
 
   state = calloc(1,sizeof(*state));
@@ -96,9 +96,8 @@ label_handle label_create(const struct label_config * config){
   }
   copy_config(state, config);  
 
-  desc.flags = DFDESC_HEIGHT;
-  desc.height = config->height;
-  if (config->dfb->CreateFont( config->dfb, config->name, &desc, &state->font ) != DFB_OK){
+  state->font = res_get_font(config->dfb, config->name, config->height, DTEID_UTF8);
+  if (state->font == NULL){
           label_release(state);
           return false;
   }
@@ -0,0 +1,584 @@
+/**
+ * \file library.c
+ * \brief Persistent index of the media files tags
+ *
+ * The index is a single file memory mapped at start-up. It holds, for every indexed media file,
+ * its tags, audio properties and the position of its embedded cover picture so that they can be
+ * retrieved without parsing the media file again. Cover pictures stay in the media files : they
+ * are read from there, which keeps the index small.
+ *
+ * The file is made of :
+ *    \li a header
+ *    \li an array of fixed size records sorted by path hash (binary search)
+ *    \li a data pool holding the strings referenced by the records
+ *
+ * An entry is valid only if the modification time and size of the file did not change.
+ * New entries are kept in memory until :library_save() rewrites the whole index
+ * (temporary file + rename) and maps it again. The new index is built in memory with the
+ * lock held, but written to the SD card without it so that the lookups are not delayed.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "library.h"
+
+#define LIBRARY_MAGIC   0x494C5054 /* "TPLI" */
+#define LIBRARY_VERSION 2
+
+/** Index file header */
+struct library_header{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb;              /**< Number of records */
+    uint32_t pool_size;       /**< Size of the data pool following the records */
+};
+
+/** Index file record - Offsets are relative to the data pool (0 means no data) */
+struct library_record{
+    uint32_t hash;            /**< Hash of the path */
+    uint32_t path;
+    uint32_t mtime;
+    uint32_t size;
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+    uint32_t comment;
+    uint32_t genre;
+    uint32_t cover_offset;    /**< Position of the cover in the media file (0 if unknown) */
+    uint32_t cover_len;       /**< Length of the cover (0 if none) */
+    int16_t  year;
+    int16_t  track;
+    int32_t  length;
+    int32_t  bitrate;
+    int32_t  sample_rate;
+    int32_t  channels;
+};
+
+/* state module variables */
+static struct{
+    char * filename;
+    /* Mapped index */
+    void * map;
+    size_t map_size;
+    const struct library_record * records;
+    const char * pool;
+    uint32_t nb;
+    /* Entries not saved yet */
+    struct library_entry ** pending;
+    int pending_nb;
+    int pending_max;
+} state;
+
+/* Protects the state from the concurrent lookups and the index update */
+static pthread_mutex_t library_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes the saves (the index file is written without library_mutex) */
+static pthread_mutex_t save_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** FNV-1a hash of a path */
+static uint32_t path_hash(const char * path){
+    uint32_t h = 2166136261u;
+    while (*path){
+        h ^= (unsigned char)*path++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const char * pool_string(uint32_t off){
+    return (off != 0) ? &state.pool[off] : NULL;
+}
+
+static void unmap_index(void){
+    if (state.map != NULL){
+        munmap(state.map, state.map_size);
+    }
+    state.map = NULL;
+    state.map_size = 0;
+    state.records = NULL;
+    state.pool = NULL;
+    state.nb = 0;
+}
+
+/** Check that a string of the data pool is NUL terminated inside the pool (0 means no string) */
+static bool check_string(const char * pool, uint32_t pool_size, uint32_t off){
+    if (off == 0)
+        return true;
+    return (off < pool_size) && (memchr(pool + off, 0, pool_size - off) != NULL);
+}
+
+/** Check the records of a mapped index : sorted by hash, with a path and strings inside the pool */
+static bool check_records(const struct library_record * records, uint32_t nb, const char * pool, uint32_t pool_size){
+    const struct library_record * rec;
+    uint32_t i;
+
+    for (i = 0; i < nb; i++){
+        rec = &records[i];
+        if ((rec->path == 0) || ((i > 0) && (rec->hash < records[i - 1].hash)) ||
+            !check_string(pool, pool_size, rec->path) ||
+            !check_string(pool, pool_size, rec->title) ||
+            !check_string(pool, pool_size, rec->artist) ||
+            !check_string(pool, pool_size, rec->album) ||
+            !check_string(pool, pool_size, rec->comment) ||
+            !check_string(pool, pool_size, rec->genre))
+            return false;
+    }
+    return true;
+}
+
+/** Map the index file, an absent or invalid file gives an empty index */
+static bool map_index(void){
+    const struct library_header * header;
+    const struct library_record * records;
+    struct stat st;
+    int fd;
+
+    unmap_index();
+    fd = open(state.filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if ((fstat(fd, &st) != 0) || (st.st_size < sizeof(*header))){
+        close(fd);
+        return false;
+    }
+    state.map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (state.map == MAP_FAILED){
+        state.map = NULL;
+        return false;
+    }
+    state.map_size = st.st_size;
+    header = state.map;
+    if ((header->magic != LIBRARY_MAGIC) || (header->version != LIBRARY_VERSION) ||
+        (sizeof(*header) + (uint64_t)header->nb * sizeof(struct library_record) + header->pool_size != st.st_size))
+        goto invalid;
+    records = (const struct library_record *)(header + 1);
+    if (!check_records(records, header->nb, (const char *)(records + header->nb), header->pool_size))
+        goto invalid;
+    state.nb = header->nb;
+    state.records = records;
+    state.pool = (const char *)(state.records + state.nb);
+    return true;
+
+invalid:
+    log_write(LOG_WARNING, "Library index %s is invalid - ignored", state.filename);
+    unmap_index();
+    return false;
+}
+
+/** Find a record given a path
+ * \return index of the record or -1 if not found
+ */
+static int find_record(const char * path, uint32_t hash){
+    int low = 0;
+    int high = (int)state.nb - 1;
+    int mid;
+
+    while (low <= high){
+        mid = (low + high) / 2;
+        if (state.records[mid].hash < hash){
+            low = mid + 1;
+        } else if (state.records[mid].hash > hash){
+            high = mid - 1;
+        } else {
+            /* Look at every record with the same hash */
+            while ((mid > 0) && (state.records[mid - 1].hash == hash))
+                mid--;
+            for (; (mid < state.nb) && (state.records[mid].hash == hash); mid++){
+                if (strcmp(pool_string(state.records[mid].path), path) == 0)
+                    return mid;
+            }
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static size_t str_size(const char * str){
+    return (str != NULL) ? strlen(str) + 1 : 0;
+}
+
+static char * copy_str(char ** dst, const char * str){
+    char * ret;
+    if (str == NULL)
+        return NULL;
+    ret = *dst;
+    strcpy(ret, str);
+    *dst += strlen(str) + 1;
+    return ret;
+}
+
+/** Make a copy of an entry in one single allocation (to be released with free)
+ *
+ * \note The cover picture is not copied, only its position in the media file
+ */
+static struct library_entry * dup_entry(const struct library_entry * entry){
+    struct library_entry * copy;
+    char * data;
+    size_t len;
+
+    len = sizeof(*copy) + str_size(entry->path) + str_size(entry->title) + str_size(entry->artist) +
+          str_size(entry->album) + str_size(entry->comment) + str_size(entry->genre);
+    copy = malloc(len);
+    if (copy == NULL)
+        return NULL;
+    *copy = *entry;
+    data = (char *)(copy + 1);
+    copy->cover = NULL;
+    copy->path    = copy_str(&data, entry->path);
+    copy->title   = copy_str(&data, entry->title);
+    copy->artist  = copy_str(&data, entry->artist);
+    copy->album   = copy_str(&data, entry->album);
+    copy->comment = copy_str(&data, entry->comment);
+    copy->genre   = copy_str(&data, entry->genre);
+    return copy;
+}
+
+/** Convert a record into an entry (pointers refer to the mapped index) */
+static void record_to_entry(const struct library_record * rec, struct library_entry * entry){
+    entry->path        = pool_string(rec->path);
+    entry->mtime       = rec->mtime;
+    entry->size        = rec->size;
+    entry->title       = pool_string(rec->title);
+    entry->artist      = pool_string(rec->artist);
+    entry->album       = pool_string(rec->album);
+    entry->comment     = pool_string(rec->comment);
+    entry->genre       = pool_string(rec->genre);
+    entry->year        = rec->year;
+    entry->track       = rec->track;
+    entry->length      = rec->length;
+    entry->bitrate     = rec->bitrate;
+    entry->sample_rate = rec->sample_rate;
+    entry->channels    = rec->channels;
+    entry->cover       = NULL;
+    entry->cover_len   = rec->cover_len;
+    entry->cover_offset = rec->cover_offset;
+}
+
+/** Open (map) the library index
+ *
+ * \param filename index filename
+ * \retval true an index has been loaded
+ * \retval false no valid index (an empty one is used)
+ */
+bool library_open(const char * filename){
+    bool ret;
+
+    pthread_mutex_lock(&library_mutex);
+    free(state.filename);
+    state.filename = strdup(filename);
+    ret = (state.filename != NULL) && map_index();
+    log_write(LOG_INFO, "Library index : %d entries", state.nb);
+    pthread_mutex_unlock(&library_mutex);
+    return ret;
+}
+
+/** Release the library (pending entries that are not saved are lost) */
+void library_close(void){
+    int i;
+
+    pthread_mutex_lock(&library_mutex);
+    unmap_index();
+    for (i = 0; i < state.pending_nb; i++){
+        free(state.pending[i]);
+    }
+    free(state.pending);
+    free(state.filename);
+    memset(&state, 0, sizeof(state));
+    pthread_mutex_unlock(&library_mutex);
+}
+
+/** Look for a file in the library
+ *
+ * \param path full pathname of the file
+ * \param st current status of the file (entry is discarded if mtime or size changed)
+ *
+ * \return a copy of the entry to be released with free() or NULL if not found
+ */
+struct library_entry * library_lookup(const char * path, const struct stat * st){
+    struct library_entry entry;
+    struct library_entry * ret = NULL;
+    int idx;
+    int i;
+
+    pthread_mutex_lock(&library_mutex);
+    /* Most recent entries first */
+    for (i = state.pending_nb - 1; i >= 0; i--){
+        if (strcmp(state.pending[i]->path, path) == 0){
+            if ((state.pending[i]->mtime == st->st_mtime) && (state.pending[i]->size == st->st_size))
+                ret = dup_entry(state.pending[i]);
+            goto out;
+        }
+    }
+    idx = find_record(path, path_hash(path));
+    if (idx >= 0){
+        record_to_entry(&state.records[idx], &entry);
+        if ((entry.mtime == st->st_mtime) && (entry.size == st->st_size))
+            ret = dup_entry(&entry);
+    }
+out:
+    pthread_mutex_unlock(&library_mutex);
+    return ret;
+}
+
+/** Add (or replace) an entry in the library
+ *
+ * \note The entry is only written on disk on next :library_save()
+ */
+bool library_add(const struct library_entry * entry){
+    struct library_entry * copy;
+    struct library_entry ** pending;
+    int max;
+
+    copy = dup_entry(entry);
+    if (copy == NULL)
+        return false;
+    pthread_mutex_lock(&library_mutex);
+    if (state.pending_nb >= state.pending_max){
+        max = (state.pending_max == 0) ? 16 : state.pending_max * 2;
+        pending = realloc(state.pending, max * sizeof(*state.pending));
+        if (pending == NULL){
+            pthread_mutex_unlock(&library_mutex);
+            free(copy);
+            return false;
+        }
+        state.pending = pending;
+        state.pending_max = max;
+    }
+    state.pending[state.pending_nb++] = copy;
+    pthread_mutex_unlock(&library_mutex);
+    return true;
+}
+
+/** Return the number of entries not saved yet */
+int library_pending_nb(void){
+    int nb;
+    pthread_mutex_lock(&library_mutex);
+    nb = state.pending_nb;
+    pthread_mutex_unlock(&library_mutex);
+    return nb;
+}
+
+static int record_compare(const void * a, const void * b){
+    const struct library_record * r1 = a;
+    const struct library_record * r2 = b;
+    if (r1->hash == r2->hash)
+        return 0;
+    return (r1->hash < r2->hash) ? -1 : 1;
+}
+
+/** Reserve room in the pool being built
+ * \return offset of the data in pool (0 if no data)
+ */
+static uint32_t pool_reserve(uint32_t * pool_size, size_t len){
+    uint32_t off;
+    if (len == 0)
+        return 0;
+    off = *pool_size;
+    *pool_size += len;
+    return off;
+}
+
+static void entry_to_record(uint32_t * pool_size, const struct library_entry * entry,
+                            struct library_record * rec){
+    rec->hash        = path_hash(entry->path);
+    rec->path        = pool_reserve(pool_size, str_size(entry->path));
+    rec->mtime       = entry->mtime;
+    rec->size        = entry->size;
+    rec->title       = pool_reserve(pool_size, str_size(entry->title));
+    rec->artist      = pool_reserve(pool_size, str_size(entry->artist));
+    rec->album       = pool_reserve(pool_size, str_size(entry->album));
+    rec->comment     = pool_reserve(pool_size, str_size(entry->comment));
+    rec->genre       = pool_reserve(pool_size, str_size(entry->genre));
+    rec->cover_offset = (entry->cover_offset <= UINT32_MAX) ? entry->cover_offset : 0;
+    rec->cover_len   = entry->cover_len;
+    rec->year        = entry->year;
+    rec->track       = entry->track;
+    rec->length      = entry->length;
+    rec->bitrate     = entry->bitrate;
+    rec->sample_rate = entry->sample_rate;
+    rec->channels    = entry->channels;
+}
+
+/** Copy the pool data of an entry at the offsets reserved by :entry_to_record() */
+static void copy_entry_data(char * pool, const struct library_entry * entry, const struct library_record * rec){
+    const char * data[] = {entry->path, entry->title, entry->artist, entry->album,
+                           entry->comment, entry->genre};
+    const uint32_t off[] = {rec->path, rec->title, rec->artist, rec->album,
+                            rec->comment, rec->genre};
+    int i;
+
+    for (i = 0; i < sizeof(data) / sizeof(data[0]); i++){
+        if (off[i] != 0)
+            memcpy(&pool[off[i]], data[i], str_size(data[i]));
+    }
+}
+
+/** Tell whether a path is replaced by a pending entry of index greater or equal to first */
+static bool is_superseded(const char * path, int first){
+    int i;
+    for (i = first; i < state.pending_nb; i++){
+        if (strcmp(state.pending[i]->path, path) == 0)
+            return true;
+    }
+    return false;
+}
+
+/** Build in memory the index made of the mapped and of the pending entries
+ *
+ * \param len [out] length of the index
+ * \return the index to be released with free(), NULL on allocation error
+ */
+static void * build_index(size_t * len){
+    struct library_header * header;
+    struct library_record * records = NULL;
+    struct library_entry * entries;
+    void * index = NULL;
+    uint32_t pool_size = 1;  /* Offset 0 means no data */
+    uint32_t nb = 0;
+    uint32_t i;
+    int j;
+
+    entries = malloc((state.nb + state.pending_nb) * sizeof(*entries));
+    records = malloc((state.nb + state.pending_nb) * sizeof(*records));
+    if ((entries == NULL) || (records == NULL))
+        goto out;
+
+    /* Merge the mapped and the pending entries (last added wins) */
+    for (i = 0; i < state.nb; i++){
+        record_to_entry(&state.records[i], &entries[nb]);
+        if (!is_superseded(entries[nb].path, 0))
+            nb++;
+    }
+    for (j = 0; j < state.pending_nb; j++){
+        if (!is_superseded(state.pending[j]->path, j + 1))
+            entries[nb++] = *state.pending[j];
+    }
+    for (i = 0; i < nb; i++){
+        entry_to_record(&pool_size, &entries[i], &records[i]);
+    }
+
+    *len = sizeof(*header) + nb * sizeof(*records) + pool_size;
+    index = calloc(1, *len);
+    if (index == NULL)
+        goto out;
+    header = index;
+    header->magic = LIBRARY_MAGIC;
+    header->version = LIBRARY_VERSION;
+    header->nb = nb;
+    header->pool_size = pool_size;
+    for (i = 0; i < nb; i++){
+        copy_entry_data((char *)index + *len - pool_size, &entries[i], &records[i]);
+    }
+    /* Offsets are absolute in pool so records can be sorted independently of the pool */
+    qsort(records, nb, sizeof(*records), record_compare);
+    memcpy(header + 1, records, nb * sizeof(*records));
+out:
+    free(entries);
+    free(records);
+    return index;
+}
+
+/** Write the index with the pending entries and map it again
+ *
+ * The new index is written in a temporary file then renamed so that a power loss
+ * never leaves a truncated index. The lookups can go on while it is written :
+ * entries added meanwhile are kept pending for the next save.
+ */
+bool library_save(void){
+    char tmp_filename[PATH_MAX];
+    void * index = NULL;
+    size_t len = 0;
+    int saved_nb;
+    int j;
+    FILE * fp = NULL;
+
+    pthread_mutex_lock(&save_mutex);
+    pthread_mutex_lock(&library_mutex);
+    if ((state.filename == NULL) || (state.pending_nb == 0)){
+        pthread_mutex_unlock(&library_mutex);
+        pthread_mutex_unlock(&save_mutex);
+        return true;
+    }
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", state.filename);
+    index = build_index(&len);
+    saved_nb = state.pending_nb;
+    pthread_mutex_unlock(&library_mutex);
+    if (index == NULL)
+        goto error;
+
+    fp = fopen(tmp_filename, "w");
+    if (fp == NULL)
+        goto error;
+    if ((fwrite(index, len, 1, fp) != 1) ||
+        (fflush(fp) != 0) || (fsync(fileno(fp)) != 0))
+        goto error;
+    fclose(fp);
+    fp = NULL;
+    free(index);
+    index = NULL;
+
+    pthread_mutex_lock(&library_mutex);
+    if (state.filename == NULL){
+        /* Library closed meanwhile */
+        pthread_mutex_unlock(&library_mutex);
+        goto error;
+    }
+    unmap_index();
+    if (rename(tmp_filename, state.filename) != 0){
+        map_index();
+        pthread_mutex_unlock(&library_mutex);
+        goto error;
+    }
+    /* The saved entries are now in the index, the ones added meanwhile stay pending */
+    for (j = 0; j < saved_nb; j++){
+        free(state.pending[j]);
+    }
+    memmove(state.pending, &state.pending[saved_nb], (state.pending_nb - saved_nb) * sizeof(*state.pending));
+    state.pending_nb -= saved_nb;
+    map_index();
+    log_write(LOG_INFO, "Library index saved : %d entries", state.nb);
+    pthread_mutex_unlock(&library_mutex);
+    pthread_mutex_unlock(&save_mutex);
+    return true;
+
+error:
+    log_write(LOG_ERROR, "Unable to save library index %s", tmp_filename);
+    if (fp != NULL)
+        fclose(fp);
+    free(index);
+    unlink(tmp_filename);
+    pthread_mutex_unlock(&save_mutex);
+    return false;
+}
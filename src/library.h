@@ -0,0 +1,66 @@
+/**
+ * \file library.h
+ * \brief Persistent index of the media files tags
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define LIBRARY_FILENAME "./conf/library.idx"
+
+/** Tags of a media file as stored in the library */
+struct library_entry{
+    const char * path;        /**< Full pathname */
+    time_t mtime;             /**< Modification time of the file when indexed */
+    off_t  size;              /**< Size of the file when indexed */
+    const char * title;
+    const char * artist;
+    const char * album;
+    const char * comment;
+    const char * genre;
+    int year;
+    int track;
+    int length;
+    int bitrate;
+    int sample_rate;
+    int channels;
+    const void * cover;       /**< Encoded cover picture, only set on parsing (never stored in the index) */
+    size_t cover_len;         /**< Length of the cover picture (0 if none) */
+    off_t  cover_offset;      /**< Position of the cover picture in the media file (0 if unknown) */
+};
+
+bool library_open(const char * filename);
+void library_close(void);
+struct library_entry * library_lookup(const char * path, const struct stat * st);
+bool library_add(const struct library_entry * entry);
+int  library_pending_nb(void);
+bool library_save(void);
+
+#endif
@@ -0,0 +1,308 @@
+/**
+ * \file loop.c
+ * \brief Main event loop of the engine
+ *
+ * Every subsystem of the engine registers here the file descriptors it reads from (mplayer stdout,
+ * touchscreen, keys FIFO, GPS...) and its periodic tasks. All the callbacks are then run from
+ * the thread calling :loop_run() : they do not have to be synchronized with each other,
+ * and the CPU sleeps in epoll_wait() until the next event or the next timer deadline.
+ *
+ * Timers are kept in a small table : the nearest deadline gives the epoll_wait() time out.
+ * (timerfd is not available on the target kernel)
+ *
+ * An optional lock (see :loop_set_lock()) is held while the callbacks run and only released
+ * in epoll_wait() : the threads of the engine use it to stay out of the display updates.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#include "log.h"
+#include "loop.h"
+
+#define LOOP_MAX_FDS    8
+#define LOOP_MAX_TIMERS 8
+
+/** A watched file descriptor */
+struct loop_fd{
+    int fd;             /**< -1 if the slot is free */
+    uint32_t gen;       /**< Incremented on each use of the slot */
+    loop_fd_cb cb;
+    void * data;
+};
+
+/** A timer */
+struct loop_timer{
+    bool used;
+    bool armed;
+    long long deadline; /**< Next expiration (ms) */
+    int period;         /**< Period (ms), 0 for a one shot timer */
+    loop_timer_cb cb;
+    void * data;
+};
+
+static struct {
+    int epfd;
+    bool quit_asked;
+    pthread_mutex_t * lock;     /**< Held while the callbacks run (NULL if none) */
+    struct loop_fd fds[LOOP_MAX_FDS];
+    struct loop_timer timers[LOOP_MAX_TIMERS];
+} loop = {
+    .epfd = -1
+};
+
+
+/** Current time in ms */
+static long long now_ms(void){
+    struct timespec tp;
+
+    /* Fall back on the real time clock when the monotonic one is not available */
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0)
+        clock_gettime(CLOCK_REALTIME, &tp);
+    return (long long)tp.tv_sec * 1000 + tp.tv_nsec / 1000000;
+}
+
+/** Initialize the event loop
+ *
+ * \return true on success, false on failure
+ */
+bool loop_init(void){
+    int i;
+
+    loop.epfd = epoll_create(LOOP_MAX_FDS);
+    if (loop.epfd < 0){
+        log_write(LOG_ERROR, "Unable to create event loop : %s", strerror(errno));
+        return false;
+    }
+    for (i = 0; i < LOOP_MAX_FDS; i++){
+        loop.fds[i].fd = -1;
+    }
+    memset(loop.timers, 0, sizeof(loop.timers));
+    loop.quit_asked = false;
+    return true;
+}
+
+/** Release the event loop */
+void loop_release(void){
+    if (loop.epfd >= 0){
+        close(loop.epfd);
+        loop.epfd = -1;
+    }
+}
+
+/** Set the lock held by the loop while it runs the callbacks
+ *
+ * \param lock mutex released only while the loop waits for events, NULL for none
+ */
+void loop_set_lock(pthread_mutex_t * lock){
+    loop.lock = lock;
+}
+
+/** Watch a file descriptor
+ *
+ * \param cb called from the loop each time fd is readable or hung up
+ *
+ * \return true on success, false on failure
+ */
+bool loop_add_fd(int fd, loop_fd_cb cb, void * data){
+    struct epoll_event ev;
+    int i;
+
+    for (i = 0; i < LOOP_MAX_FDS; i++){
+        if (loop.fds[i].fd < 0)
+            break;
+    }
+    if (i == LOOP_MAX_FDS){
+        log_write(LOG_ERROR, "Too many fds in event loop");
+        return false;
+    }
+    loop.fds[i].gen++;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = ((uint64_t)loop.fds[i].gen << 32) | i;
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fd, &ev) != 0){
+        log_write(LOG_ERROR, "Unable to watch fd %d : %s", fd, strerror(errno));
+        return false;
+    }
+    loop.fds[i].fd = fd;
+    loop.fds[i].cb = cb;
+    loop.fds[i].data = data;
+    return true;
+}
+
+/** Stop watching a file descriptor (to be done before closing it) */
+void loop_remove_fd(int fd){
+    struct epoll_event ev;
+    int i;
+
+    for (i = 0; i < LOOP_MAX_FDS; i++){
+        if (loop.fds[i].fd == fd){
+            /* Event is ignored but must not be NULL for old kernels */
+            epoll_ctl(loop.epfd, EPOLL_CTL_DEL, fd, &ev);
+            loop.fds[i].fd = -1;
+            return;
+        }
+    }
+}
+
+/** Create a timer
+ *
+ * \param delay time before the first expiration (ms), negative to create the timer disarmed
+ * \param period time between the next expirations (ms), 0 for a one shot timer
+ * \param cb called from the loop on each expiration
+ *
+ * \return timer identifier, -1 on failure
+ */
+int loop_add_timer(int delay, int period, loop_timer_cb cb, void * data){
+    int i;
+
+    for (i = 0; i < LOOP_MAX_TIMERS; i++){
+        if (!loop.timers[i].used)
+            break;
+    }
+    if (i == LOOP_MAX_TIMERS){
+        log_write(LOG_ERROR, "Too many timers in event loop");
+        return -1;
+    }
+    loop.timers[i].used = true;
+    loop.timers[i].cb = cb;
+    loop.timers[i].data = data;
+    loop_set_timer(i, delay, period);
+    return i;
+}
+
+/** Re-arm a timer
+ *
+ * \param delay time before the next expiration (ms), negative to disarm the timer
+ * \param period time between the following expirations (ms), 0 for a one shot timer
+ */
+void loop_set_timer(int id, int delay, int period){
+    struct loop_timer * t;
+
+    if ((id < 0) || (id >= LOOP_MAX_TIMERS) || !loop.timers[id].used)
+        return;
+    t = &loop.timers[id];
+    t->armed = (delay >= 0);
+    t->deadline = now_ms() + delay;
+    t->period = period;
+}
+
+/** Destroy a timer */
+void loop_remove_timer(int id){
+    if ((id < 0) || (id >= LOOP_MAX_TIMERS))
+        return;
+    loop.timers[id].used = false;
+    loop.timers[id].armed = false;
+}
+
+/** Compute the epoll_wait() time out from the nearest timer deadline */
+static int next_timeout(void){
+    long long now = now_ms();
+    long long next = -1;
+    int i;
+
+    for (i = 0; i < LOOP_MAX_TIMERS; i++){
+        if (loop.timers[i].used && loop.timers[i].armed){
+            if ((next < 0) || (loop.timers[i].deadline < next))
+                next = loop.timers[i].deadline;
+        }
+    }
+    if (next < 0)
+        return -1;
+    if (next <= now)
+        return 0;
+    return (next - now > INT_MAX) ? INT_MAX : (int)(next - now);
+}
+
+/** Run the expired timers */
+static void run_timers(void){
+    long long now = now_ms();
+    struct loop_timer * t;
+    int i;
+
+    for (i = 0; i < LOOP_MAX_TIMERS; i++){
+        t = &loop.timers[i];
+        if (!t->used || !t->armed || (t->deadline > now))
+            continue;
+        if (t->period > 0){
+            t->deadline += t->period;
+            /* Late timer : skip the missed periods instead of running them in a burst */
+            if (t->deadline <= now)
+                t->deadline = now + t->period;
+        } else {
+            t->armed = false;
+        }
+        /* The callback may re-arm or remove its own timer */
+        t->cb(t->data);
+    }
+}
+
+/** Dispatch the events until :loop_quit() is called */
+void loop_run(void){
+    struct epoll_event events[LOOP_MAX_FDS];
+    struct loop_fd * f;
+    int nb, i;
+
+    loop.quit_asked = false;
+    if (loop.lock != NULL)
+        pthread_mutex_lock(loop.lock);
+    while (!loop.quit_asked){
+        if (loop.lock != NULL)
+            pthread_mutex_unlock(loop.lock);
+        nb = epoll_wait(loop.epfd, events, LOOP_MAX_FDS, next_timeout());
+        if (loop.lock != NULL)
+            pthread_mutex_lock(loop.lock);
+        if (nb < 0){
+            if (errno != EINTR){
+                log_write(LOG_ERROR, "Event loop failure : %s", strerror(errno));
+                break;
+            }
+            nb = 0;
+        }
+        for (i = 0; i < nb; i++){
+            f = &loop.fds[events[i].data.u64 & 0xFFFFFFFF];
+            /* A previous callback may have removed (or replaced) this fd */
+            if ((f->fd >= 0) && (f->gen == (uint32_t)(events[i].data.u64 >> 32)))
+                f->cb(f->fd, f->data);
+        }
+        if (!loop.quit_asked)
+            run_timers();
+    }
+    if (loop.lock != NULL)
+        pthread_mutex_unlock(loop.lock);
+}
+
+/** Ask the loop to return once the current callbacks are over */
+void loop_quit(void){
+    loop.quit_asked = true;
+}
@@ -0,0 +1,50 @@
+/**
+ * \file loop.h
+ * \brief Main event loop of the engine
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LOOP_H__
+#define __LOOP_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/** Called when a file descriptor is readable (or hung up) */
+typedef void (*loop_fd_cb)(int fd, void * data);
+/** Called when a timer expires */
+typedef void (*loop_timer_cb)(void * data);
+
+bool loop_init(void);
+void loop_release(void);
+void loop_set_lock(pthread_mutex_t * lock);
+bool loop_add_fd(int fd, loop_fd_cb cb, void * data);
+void loop_remove_fd(int fd);
+int  loop_add_timer(int delay, int period, loop_timer_cb cb, void * data);
+void loop_set_timer(int id, int delay, int period);
+void loop_remove_timer(int id);
+void loop_run(void);
+void loop_quit(void);
+
+#endif
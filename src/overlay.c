@@ -0,0 +1,283 @@
+/**
+ * \file overlay.c
+ * \brief Video mode OSD shared with the mplayer bmovl filter
+ *
+ * The OSD is drawn in a shared memory object mapped by the (patched) bmovl filter of mplayer.
+ * Only the dirty rectangles are then named through the menu FIFO, instead of sending their pixels.
+ *
+ * The shared memory holds two RGBA buffers used alternately : a rectangle is written in one buffer
+ * while the filter may still be reading the previous one from the other buffer.
+ * The filter acknowledges each update so that a buffer is never overwritten before it has been read.
+ *
+ * The engine never waits for the filter : the OSD is first drawn in a private copy, and the zone
+ * changed since the last update is sent as soon as a buffer is released (mplayer does not process
+ * any frame while paused). A loop timer retries until then.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "skin.h"
+#include "play_int.h"
+#include "loop.h"
+#include "overlay.h"
+
+/* Layout of the shared memory : must match the one of vf_bmovl.c */
+#define OVERLAY_MAGIC       0x4C564F42
+#define OVERLAY_HEADER_SIZE 64
+#define OVERLAY_NB_BUFFERS  2
+
+/* Delay between two tries to send the OSD changes while the filter holds the buffers (ms)
+ * The filter does not run while mplayer is paused : the changes are then sent on resume (see :overlay_flush()) */
+#define OVERLAY_RETRY_MS    40
+
+/** Header of the shared memory, followed by the RGBA buffers */
+struct overlay_header{
+    uint32_t magic;
+    uint32_t width;                 /**< Width of each buffer */
+    uint32_t height;                /**< Height of each buffer */
+    volatile uint32_t done_seq;     /**< Last update processed by the filter */
+};
+
+static struct {
+    struct overlay_header * hdr;    /**< Mapping of the shared memory (NULL if not available) */
+    size_t len;                     /**< Length of the mapping */
+    uint32_t seq;                   /**< Sequence number of the last update sent */
+    uint32_t buf_seq[OVERLAY_NB_BUFFERS]; /**< Last update sent for each buffer */
+    int next;                       /**< Buffer used for next update */
+    unsigned char * osd;            /**< Private copy of the whole OSD (RGBA) */
+    int x1, y1, x2, y2;             /**< Zone of the private copy not sent yet (empty if x1 >= x2) */
+    int retry_timer;                /**< Loop timer used to send the pending zone */
+} state;
+
+static void retry_cb(void * data);
+
+/** Create the shared OSD
+ *
+ * \param width width of the video display
+ * \param height height of the video display
+ *
+ * \return true on success, false on failure (the OSD is then sent through the FIFO)
+ */
+bool overlay_init(int width, int height){
+    int fd;
+    size_t len;
+    void * map;
+
+    len = OVERLAY_HEADER_SIZE + (size_t)OVERLAY_NB_BUFFERS * width * height * 4;
+    shm_unlink(OVERLAY_SHM_NAME);
+    fd = shm_open(OVERLAY_SHM_NAME, O_CREAT | O_RDWR, 0600);
+    if (fd < 0){
+        log_write(LOG_ERROR, "Unable to create shared OSD %s", OVERLAY_SHM_NAME);
+        return false;
+    }
+    if (ftruncate(fd, len) != 0){
+        log_write(LOG_ERROR, "Unable to size shared OSD");
+        close(fd);
+        shm_unlink(OVERLAY_SHM_NAME);
+        return false;
+    }
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED){
+        log_write(LOG_ERROR, "Unable to map shared OSD");
+        shm_unlink(OVERLAY_SHM_NAME);
+        return false;
+    }
+    memset(&state, 0, sizeof(state));
+    state.osd = calloc((size_t)width * height, 4);
+    state.retry_timer = loop_add_timer(-1, 0, retry_cb, NULL);
+    if ((state.osd == NULL) || (state.retry_timer < 0)){
+        log_write(LOG_ERROR, "Unable to allocate shared OSD copy");
+        free(state.osd);
+        state.osd = NULL;
+        if (state.retry_timer >= 0)
+            loop_remove_timer(state.retry_timer);
+        munmap(map, len);
+        shm_unlink(OVERLAY_SHM_NAME);
+        return false;
+    }
+    state.hdr = map;
+    state.len = len;
+    state.hdr->width = width;
+    state.hdr->height = height;
+    state.hdr->done_seq = 0;
+    __sync_synchronize();
+    state.hdr->magic = OVERLAY_MAGIC;
+    return true;
+}
+
+/** Release the shared OSD */
+void overlay_release(void){
+    if (state.hdr == NULL)
+        return;
+    loop_remove_timer(state.retry_timer);
+    munmap(state.hdr, state.len);
+    shm_unlink(OVERLAY_SHM_NAME);
+    free(state.osd);
+    state.osd = NULL;
+    state.hdr = NULL;
+}
+
+/** Has the filter processed the last update of a buffer */
+static bool buffer_is_free(int buf){
+    return ((int32_t)(state.hdr->done_seq - state.buf_seq[buf]) >= 0);
+}
+
+/** Send the pending zone of the OSD through a free buffer
+ *
+ * \retval true nothing is pending anymore
+ * \retval false no buffer is released by the filter yet
+ */
+static bool send_pending(void){
+    int width = state.hdr->width;
+    int height = state.hdr->height;
+    char cmd[100];
+    int buf, j;
+
+    if (state.x1 >= state.x2)
+        return true;
+    buf = state.next;
+    if (!buffer_is_free(buf)){
+        buf = (buf + 1) % OVERLAY_NB_BUFFERS;
+        if (!buffer_is_free(buf))
+            return false;
+    }
+    for (j = state.y1; j < state.y2; j++){
+        memcpy((unsigned char *)state.hdr + OVERLAY_HEADER_SIZE + (((size_t)buf * height + j) * width + state.x1) * 4,
+               &state.osd[((size_t)j * width + state.x1) * 4], (state.x2 - state.x1) * 4);
+    }
+    state.seq++;
+    state.buf_seq[buf] = state.seq;
+    state.next = (buf + 1) % OVERLAY_NB_BUFFERS;
+    /* Pixels must be visible before the filter is told about them */
+    __sync_synchronize();
+    snprintf(cmd, sizeof(cmd), "UPDATE %u %d %d %d %d %d\n", state.seq, buf,
+             state.x2 - state.x1, state.y2 - state.y1, state.x1, state.y1);
+    playint_menu_write((unsigned char *)cmd, strlen(cmd));
+    state.x1 = state.x2 = 0;
+    return true;
+}
+
+/** Send the pending zone, or try again later if mplayer is playing */
+static void send_or_retry(void){
+    if (!send_pending() && !playint_is_paused())
+        loop_set_timer(state.retry_timer, OVERLAY_RETRY_MS, 0);
+}
+
+/** Loop timer : try again to send the pending zone */
+static void retry_cb(void * data){
+    if (state.hdr != NULL)
+        send_or_retry();
+}
+
+/** Send the OSD changes kept while mplayer was paused (to be called on resume) */
+void overlay_flush(void){
+    if (state.hdr != NULL)
+        send_or_retry();
+}
+
+/** Update a zone of the video OSD
+ *
+ * \param buffer RGB or RGBA patch (w x h pixels)
+ * \param transparency true if the patch is RGBA : pixels of the skin transparent color are then made transparent
+ *
+ * \return true if the zone has been updated (it may be sent to the filter later), false if the shared OSD is not available
+ */
+bool overlay_update(const unsigned char * buffer, int x, int y, int w, int h, bool transparency){
+    const struct skin_config * conf = skin_get_config();
+    int bpp = (transparency ? 4 : 3);
+    int src_stride = w * bpp;
+    int width, height;
+    unsigned char * dst;
+    const unsigned char * src;
+    int i, j;
+
+    if (state.hdr == NULL)
+        return false;
+
+    width = state.hdr->width;
+    height = state.hdr->height;
+    if (x < 0){
+        buffer -= x * bpp;
+        w += x;
+        x = 0;
+    }
+    if (y < 0){
+        buffer -= y * src_stride;
+        h += y;
+        y = 0;
+    }
+    if (x + w > width)
+        w = width - x;
+    if (y + h > height)
+        h = height - y;
+    if ((w <= 0) || (h <= 0))
+        return true;
+
+    for (j = 0; j < h; j++){
+        src = buffer + j * src_stride;
+        dst = &state.osd[((size_t)(y + j) * width + x) * 4];
+        if (transparency){
+            for (i = 0; i < w; i++, src += 4, dst += 4){
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                if ((src[0] == conf->r) && (src[1] == conf->g) && (src[2] == conf->b))
+                    dst[3] = 0;
+                else
+                    dst[3] = src[3];
+            }
+        } else {
+            for (i = 0; i < w; i++, src += 3, dst += 4){
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+                dst[3] = 0xFF;
+            }
+        }
+    }
+    /* Merge the zone with the one not sent yet */
+    if (state.x1 >= state.x2){
+        state.x1 = x;
+        state.y1 = y;
+        state.x2 = x + w;
+        state.y2 = y + h;
+    } else {
+        if (x < state.x1) state.x1 = x;
+        if (y < state.y1) state.y1 = y;
+        if (x + w > state.x2) state.x2 = x + w;
+        if (y + h > state.y2) state.y2 = y + h;
+    }
+    send_or_retry();
+    return true;
+}
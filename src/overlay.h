@@ -0,0 +1,41 @@
+/**
+ * \file overlay.h
+ * \brief Video mode OSD shared with the mplayer bmovl filter
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __OVERLAY_H__
+#define __OVERLAY_H__
+
+#include <stdbool.h>
+
+/** Shared memory object given to the bmovl filter on mplayer command line */
+#define OVERLAY_SHM_NAME "/tomplayer-bmovl"
+
+bool overlay_init(int width, int height);
+void overlay_release(void);
+bool overlay_update(const unsigned char * buffer, int x, int y, int w, int h, bool transparency);
+void overlay_flush(void);
+
+#endif
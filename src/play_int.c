@@ -1,6 +1,10 @@
 /**
  * \file play_int.c 
  * \brief This module implements all interactions with mplayer 
+ *
+ * mplayer stdout is read from the engine event loop (see loop.c). The periodic snapshot is completed
+ * from there as its answers come. The few functions waiting for an answer read it by themselves
+ * for a short time, so they must only be called from the loop thread.
  * 
  * $URL$
  * $Rev$
@@ -26,21 +30,31 @@
  */
 
 #include <stdbool.h>
-#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "widescreen.h"
 #include "debug.h"
 #include "play_int.h"
+#include "overlay.h"
+#include "loop.h"
 
 #ifdef NATIVE
-#define MPLAYER_CMD_FMT "mplayer -quiet -vf expand=%i:%i,bmovl=1:0:/tmp/mplayer-menu.fifo%s -slave -input file=%s %s \"%s\" > %s 2> /dev/null"
+#define MPLAYER_CMD_FMT "mplayer -quiet -vf expand=%i:%i,bmovl=1:0:/tmp/mplayer-menu.fifo%s -slave -input file=%s %s \"%s\" > %s 2>&1"
 #else
 /* quiet option is mandatory to be able  to parse correctly mplayer output */
-#define MPLAYER_CMD_FMT  "./mplayer -quiet -include ./conf/mplayer.conf -vf expand=%i:%i,bmovl=1:0:/tmp/mplayer-menu.fifo%s -slave -input file=%s %s \"%s\" > %s 2> /dev/null"
+/* bmovl shares the OSD with the engine through OVERLAY_SHM_NAME */
+/* stderr goes to the output FIFO too : this is where mplayer reports the properties it failed to get */
+#define MPLAYER_CMD_FMT  "./mplayer -quiet -include ./conf/mplayer.conf -vf expand=%i:%i,bmovl=1:0:/tmp/mplayer-menu.fifo:" OVERLAY_SHM_NAME "%s -slave -input file=%s %s \"%s\" > %s 2>&1"
 #endif
 #define FIFO_COMMAND_NAME "/tmp/mplayer-cmd.fifo"
 #define FIFO_MENU_NAME "/tmp/mplayer-menu.fifo"
@@ -55,10 +69,8 @@ static int fifo_out;
 static bool is_paused = false;
 /* mplayer running state */
 static bool is_running = false;
-
-/* mutex that protects request/reply exchanges with mplayer 
-   from multiple threads (Update thread and GUI events handling thread)*/   
-static pthread_mutex_t request_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* mplayer process (the shell running its command line) */
+static pid_t mplayer_pid;
 
 static char * get_file_extension(char * file){
     return strrchr( file, '.');
@@ -75,45 +87,103 @@ static bool has_extension(char * file, char * extensions){
 }
 
 
-/** Wait for mplayer to output on its stdout
- * \param timeout timeout in ms
- * \retval  0 Data available
- * \retval -1 Timeout occured
+/* Time to wait for an answer to a get_xxx request */
+#define PROP_WAIT_TIMEOUT_MS 300
+/* Time after which a snapshot batch still not fully answered is given up */
+#define PROP_ANSWER_TIMEOUT_MS 1500
+/* Max size of a property value (path, title...) */
+#define PROP_VALUE_MAX 512
+
+/** Type of a property answered by mplayer */
+enum prop_type{
+    PROP_TYPE_INT,
+    PROP_TYPE_FLOAT,
+    PROP_TYPE_STRING
+};
+
+/** Identifier of the properties we track from mplayer answers */
+enum prop_id{
+    PROP_PATH,
+    PROP_FILENAME,
+    PROP_META_ARTIST,
+    PROP_META_TITLE,
+    PROP_LENGTH,
+    PROP_TIME_POS,
+    PROP_PERCENT_POS,
+    PROP_VOLUME,
+    PROP_CONTRAST,
+    PROP_AUDIO_DELAY,
+    PROP_NB
+};
+
+/** Last known value of a property */
+struct prop{
+    const char * name;          /**< Name as it appears in "ANS_<name>=" */
+    enum prop_type type;
+    unsigned int seq;           /**< Incremented each time an answer (or a failure) is received */
+    bool valid;                 /**< False if mplayer failed to get this property */
+    char str[PROP_VALUE_MAX];   /**< Raw value without quotes */
+    union {
+        int i;
+        float f;
+    } val;
+};
+
+static struct prop props[PROP_NB] = {
+    [PROP_PATH]        = {"path",        PROP_TYPE_STRING, 0, false, "", {0}},
+    [PROP_FILENAME]    = {"FILENAME",    PROP_TYPE_STRING, 0, false, "", {0}},
+    [PROP_META_ARTIST] = {"META_ARTIST", PROP_TYPE_STRING, 0, false, "", {0}},
+    [PROP_META_TITLE]  = {"META_TITLE",  PROP_TYPE_STRING, 0, false, "", {0}},
+    [PROP_LENGTH]      = {"length",      PROP_TYPE_INT,    0, false, "", {0}},
+    [PROP_TIME_POS]    = {"time_pos",    PROP_TYPE_INT,    0, false, "", {0}},
+    [PROP_PERCENT_POS] = {"percent_pos", PROP_TYPE_INT,    0, false, "", {0}},
+    [PROP_VOLUME]      = {"volume",      PROP_TYPE_INT,    0, false, "", {0}},
+    [PROP_CONTRAST]    = {"contrast",    PROP_TYPE_INT,    0, false, "", {0}},
+    [PROP_AUDIO_DELAY] = {"audio_delay", PROP_TYPE_FLOAT,  0, false, "", {0}},
+};
+
+/* Snapshot batch sent to mplayer and last complete answer */
+static struct {
+  bool pending;                   /**< A batch has been sent and is not fully answered yet */
+  unsigned int seq[PROP_NB];      /**< Properties sequence numbers when the batch was sent */
+  struct timespec deadline;       /**< Time at which the pending batch is given up */
+  bool valid;                     /**< last holds a complete answer */
+  struct playint_snapshot last;
+} snapshot;
+
+/* Properties requested by a snapshot batch */
+static const enum prop_id snapshot_batch[] = {PROP_PATH, PROP_TIME_POS, PROP_PERCENT_POS,
+                                              PROP_LENGTH, PROP_VOLUME};
+
+/* Partial line read from mplayer stdout */
+static struct {
+  char buffer[2048];
+  int idx;
+} output;
+
+
+/** Compute an absolute timeout
+ * \param ts[out] absolute time
+ * \param timeout relative timeout in ms
  */
-int playint_wait_output(int timeout){
-  fd_set rfds;
-  struct timeval tv;
-  long long to_us = timeout * 1000;
- 
-  FD_ZERO(&rfds);
-  FD_SET(fifo_out, &rfds);
-  tv.tv_sec  = to_us / 1000000;
-  tv.tv_usec = to_us % 1000000; 
-  if (select(fifo_out+1, &rfds, NULL, NULL, &tv) <= 0){      
-      /*perror("select stdout");
-      printf("stout is %d\n", fifo_out);*/
-      /* Time out */
-      return -1;
+static void get_abs_timeout(struct timespec * ts, int timeout){
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec  += timeout / 1000;
+  ts->tv_nsec += (timeout % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000){
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
   }
-  return 0;
 }
 
-/** Flush any data from mplayer stdout */
-void playint_flush_stdout(void){
-  char buffer[200];
-  int status;
-  /*The Flush has to lock mutex to avoid to grab an answer from another thread */
-  pthread_mutex_lock(&request_mutex);
-  if (fifo_out>0) {
-    status = fcntl(fifo_out, F_GETFL);
-    fcntl(fifo_out,F_SETFL, status | O_NONBLOCK);
-    while ( read(fifo_out, buffer, sizeof(buffer)) > 0){
-        PRINTDF("Flushing %s\n", buffer);
-    }
-    fcntl(fifo_out,F_SETFL, status & (~O_NONBLOCK));
-  }
-  pthread_mutex_unlock(&request_mutex);
-  return;
+/** Time left before an absolute timeout (ms) */
+static int get_remaining_time(const struct timespec * ts){
+  struct timespec now;
+  long long ms;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  ms = (long long)(ts->tv_sec - now.tv_sec) * 1000 + (ts->tv_nsec - now.tv_nsec) / 1000000;
+  return (ms > 0) ? (int)ms : 0;
 }
 
 static void send_raw_command( const char * cmd ){
@@ -134,225 +204,289 @@ static void send_command( const char * cmd ){
     write(fifo_command, full_cmd, len);
 }
 
-/** Read a line from mplayer stdout
-*
-*\param buffer the buffer where the line has to be stored
-*\param len the size of the buffer
-*
-*\retval >0 : line sucessfully read, the len of the line is returned
-*\retval -1 : An error occured
-*/
-static int read_line_from_stdout(char * buffer, int len){  
-  
-  int eof_idx;
-  int read_bytes;
-  bool eof_found = false;
-  static char remaining_buffer[2048];
-  static int idx = 0;
-  
-  
-  do {    
-    for (eof_idx = 0; eof_idx < idx; eof_idx++){
-        if (remaining_buffer[eof_idx] == '\n'){
-            //PRINTDF("EOF found at %d / %d\n", eof_idx+1, total_read);
-            eof_found = true;
-            break ;            
-        }
+/** Find a property given its name
+ * \param name the property name (not null terminated)
+ * \param len  the length of the name
+ */
+static struct prop * find_prop(const char * name, int len){
+  int i;
+  for (i = 0; i < PROP_NB; i++){
+    if ((strlen(props[i].name) == len) && (strncmp(props[i].name, name, len) == 0)){
+      return &props[i];
+    }
+  }
+  return NULL;
+}
+
+/** Update a property from its raw value */
+static void update_prop(struct prop * p, const char * value, bool valid){
+  int len;
+
+  p->valid = valid;
+  if (valid){
+    len = strlen(value);
+    /* Remove quotes around strings values (ANS_FILENAME='xxx') */
+    if ((len >= 2) && (value[0] == '\'') && (value[len-1] == '\'')){
+      value++;
+      len -= 2;
     }
-    if (eof_found) 
+    if (len >= sizeof(p->str))
+      len = sizeof(p->str) - 1;
+    memcpy(p->str, value, len);
+    p->str[len] = 0;
+    switch (p->type){
+      case PROP_TYPE_INT :
+        /* mplayer outputs floats for some int properties (time_pos, length...) */
+        p->val.i = (int)strtod(p->str, NULL);
+        break;
+      case PROP_TYPE_FLOAT :
+        p->val.f = strtof(p->str, NULL);
+        break;
+      default :
         break;
-    if (playint_wait_output(300) < 0){
-      /* Time out */
-      PRINTDF("Timeout on stdout\n");
-      return -1;
     }
-    read_bytes = read(fifo_out, &remaining_buffer[idx], sizeof(remaining_buffer) - idx);
-    if (read_bytes <= 0){
-        PRINTDF("Error while reading from mplayer FIFO : %d - errno : %d\n", read_bytes, errno);
-        return -1;
-    }        
-    idx += read_bytes;    
-  } while (idx < sizeof(remaining_buffer) );
-  
-  
-  
-  if (eof_found){
-    /* An EOLine has been found */
-    if ((eof_idx + 1) <= len){
-        memcpy(buffer, remaining_buffer, (eof_idx + 1));
-        buffer[eof_idx] = 0;        
-    } 
-    memmove(remaining_buffer, &remaining_buffer[eof_idx + 1], idx - eof_idx -1);
-    idx -= (eof_idx + 1);
-    if ((eof_idx + 1) <= len){
-        //PRINTDF("Read OK from mplayer : %s\n", buffer);
-        return eof_idx;
-    } else {
-        PRINTDF("Read KO from mplayer (too long) \n");
-        return -1;
+  }
+  p->seq++;
+}
+
+/** Parse a line from mplayer stdout and update the properties table accordingly
+ *
+ * Handled lines are :
+ *    \li ANS_<name>=<value>
+ *    \li Failed to get value of property '<name>'.
+ *
+ * Any other line is simply dropped.
+ */
+static void parse_line(char * line){
+  #define ANS_PATTERN "ANS_"
+  #define FAILED_PATTERN "Failed to get value of property '"
+  struct prop * p = NULL;
+  char * value;
+  char * end;
+
+  if (strncmp(line, ANS_PATTERN, strlen(ANS_PATTERN)) == 0){
+    line += strlen(ANS_PATTERN);
+    value = strchr(line, '=');
+    if (value != NULL){
+      p = find_prop(line, value - line);
+      if (p != NULL){
+        update_prop(p, value + 1, true);
+      }
+    }
+  } else if (strncmp(line, FAILED_PATTERN, strlen(FAILED_PATTERN)) == 0){
+    line += strlen(FAILED_PATTERN);
+    end = strchr(line, '\'');
+    if (end != NULL){
+      p = find_prop(line, end - line);
+      if (p != NULL){
+        update_prop(p, NULL, false);
+      }
     }
   }
-  
-  if (idx >= sizeof(remaining_buffer)){
-      /* Abnormal case ; we have filled the whole buffer and not found an EOL - Flush everything */
-      idx = 0;   
+  if (p == NULL){
+    PRINTDF("Dropped line from mplayer : %s\n", line);
   }
-  PRINTDF(" Fatal error on read_line_from_stdout exit\n");
-  return -1;
 }
 
-/** retrieve an int value from mplayer stdout
-*
-* \param val[out]
-*\retval 0 : OK
-*\retval -1 : KO
-*/
-static int get_int_from_stdout(int *val){
-  char * value_pos=NULL;
-  char buffer[200];
-
-  if (read_line_from_stdout(buffer, sizeof(buffer)) > 0){
-    PRINTDF("Reading : %s", buffer);
-    value_pos=strrchr(buffer,'=');
-    if (value_pos == NULL){
-      /*FIXME*/
-      fprintf(stderr, "error parsing output : %s\n", buffer);
-      return -1;
+/** Fill a snapshot from the properties table */
+static void fill_snapshot(struct playint_snapshot * snap, const unsigned int * seq){
+  #define SNAP_INT(id) (((seq == NULL) || (props[id].seq != seq[id])) && props[id].valid ? props[id].val.i : -1)
+
+  if (((seq == NULL) || (props[PROP_PATH].seq != seq[PROP_PATH])) && props[PROP_PATH].valid){
+    strncpy(snap->path, props[PROP_PATH].str, sizeof(snap->path));
+    snap->path[sizeof(snap->path) - 1] = 0;
+  } else {
+    snap->path[0] = 0;
+  }
+  snap->time_pos    = SNAP_INT(PROP_TIME_POS);
+  snap->percent_pos = SNAP_INT(PROP_PERCENT_POS);
+  snap->length      = SNAP_INT(PROP_LENGTH);
+  snap->volume      = SNAP_INT(PROP_VOLUME);
+  /* mplayer has no pause property : the engine is the one pausing it */
+  snap->paused      = is_paused;
+}
+
+/** Complete the pending snapshot once all the answers to its batch have come */
+static void snapshot_update(void){
+  int i;
+
+  if (!snapshot.pending)
+    return;
+  for (i = 0; i < sizeof(snapshot_batch)/sizeof(snapshot_batch[0]); i++){
+    if (props[snapshot_batch[i]].seq == snapshot.seq[snapshot_batch[i]])
+      return;
+  }
+  fill_snapshot(&snapshot.last, snapshot.seq);
+  snapshot.valid = true;
+  snapshot.pending = false;
+}
+
+/** Read what is available on mplayer stdout and dispatch every complete answer in the properties table
+ *
+ * \retval true data have been read
+ * \retval false nothing to read
+ */
+static bool read_output(void){
+  int read_bytes;
+  int eol_idx;
+  int start;
+
+  read_bytes = read(fifo_out, &output.buffer[output.idx], sizeof(output.buffer) - 1 - output.idx);
+  if (read_bytes <= 0){
+    if ((read_bytes < 0) && (errno != EAGAIN) && (errno != EINTR)){
+      PRINTDF("Error while reading from mplayer FIFO : %d - errno : %d\n", read_bytes, errno);
     }
-    if (sscanf(value_pos+1, "%i", val) == 1){
-      return 0;
-    } else {      
-      return -1;
+    return false;
+  }
+  output.idx += read_bytes;
+
+  /* Dispatch every complete line */
+  start = 0;
+  for (eol_idx = 0; eol_idx < output.idx; eol_idx++){
+    if (output.buffer[eol_idx] == '\n'){
+      output.buffer[eol_idx] = 0;
+      if ((eol_idx > start) && (output.buffer[eol_idx - 1] == '\r'))
+        output.buffer[eol_idx - 1] = 0;
+      parse_line(&output.buffer[start]);
+      start = eol_idx + 1;
     }
-  } else {      
-    return -1;
   }
+  memmove(output.buffer, &output.buffer[start], output.idx - start);
+  output.idx -= start;
+
+  if (output.idx >= sizeof(output.buffer) - 1){
+    /* Abnormal case ; we have filled the whole buffer and not found an EOL - Flush everything */
+    PRINTDF("Line too long from mplayer - flushed\n");
+    output.idx = 0;
+  }
+  snapshot_update();
+  return true;
 }
 
+/** Wait for mplayer to output something and dispatch it
+ *
+ * \param ts absolute timeout
+ *
+ * \retval true something has been output
+ * \retval false time out
+ */
+static bool wait_output(const struct timespec * ts){
+  struct pollfd pfd;
+  int res;
 
-/** retrieve any RAW string from mplayer stdout
-*
-* \param val[out]
-*\retval >0 : OK, string length
-*\retval -1 : KO
-*/
-static int get_string_from_stdout(char *val, size_t len){
-    int nb_chars;
-    
-    nb_chars = read_line_from_stdout(val, len);
-    //PRINTDF("get_string_from_stdout : %d\n", nb_chars);
-    if (nb_chars > 0){
-        PRINTDF( "Line read from mplayer : %s\n", val);
-        return nb_chars;
-    }
-    return -1;
+  do {
+    pfd.fd = fifo_out;
+    pfd.events = POLLIN;
+    res = poll(&pfd, 1, get_remaining_time(ts));
+  } while ((res < 0) && (errno == EINTR));
+  if (res <= 0)
+    return false;
+  read_output();
+  return true;
+}
+
+/** Event loop callback : mplayer stdout is readable */
+static void output_cb(int fd, void * data){
+  read_output();
 }
 
-/** retrieve an float value from mplayer stdout
+/** Send a request to mplayer and wait for the matching answer
+*
+* \param[in]  cmd the command to send
+* \param[in]  id the property answered by this command
+* \param[out] p a copy of the property as answered (can be NULL)
+*
+* \reval 0 : OK
+* \reval -1 : Time out or mplayer failed to get the property
 *
-* \param[out] val
-*\retval 0 : OK
-*\retval -1 : KO
 */
-static int get_float_from_stdout(float *val){
-  char * value_pos=NULL;
-  char buffer[200];
-
-  if (read_line_from_stdout(buffer, sizeof(buffer)) > 0){
-    value_pos=strrchr(buffer,'=');
-    if (value_pos == NULL){
-      /*FIXME*/
-      fprintf(stderr, "error parsing output : %s", buffer);
-      return -1;
-    }
-    if (sscanf(value_pos+1, "%f", val) == 1){
-      return 0;
-    } else {
-      return -1;
-    }
+static int send_command_wait_prop(const char * cmd, enum prop_id id, struct prop * p){
+  struct timespec ts;
+  unsigned int seq;
+  int res = 0;
+
+  get_abs_timeout(&ts, PROP_WAIT_TIMEOUT_MS);
+  seq = props[id].seq;
+  send_command(cmd);
+  while ((seq == props[id].seq) && is_running){
+    if (!wait_output(&ts))
+      break;
+  }
+  if ((seq != props[id].seq) && props[id].valid){
+    if (p != NULL)
+      memcpy(p, &props[id], sizeof(*p));
+    res = 0;
   } else {
-    return -1;
+    PRINTDF("No answer from mplayer for %s", cmd);
+    res = -1;
   }
+  return res;
 }
 
-/** Send a command to mplayer and return any line from stdout
+/** Send a command to mplayer and wait for a string answer
 *
 * \param[in]  cmd the command to send
-* \param[out] val the string returned by mplayer
+* \param[in]  id the property answered by this command
+* \param[out] val the string returned by mplayer (without any quote)
 *
 * \reval >0 : OK, string length
 * \reval -1 : An error occured
 *
 */
-static int send_command_wait_string(const char * cmd, char *val, size_t len, const char *pattern){
-  int nb_try = 0;
-  int res = 0;
-  PRINTDF("send_command_wait_string : %s \n", cmd);
-  pthread_mutex_lock(&request_mutex);
-  send_command(cmd);
-  do {
-    res = get_string_from_stdout(val, len);
-    if (strstr(val, pattern) == NULL)
-        res = -1;
-    nb_try++;
-  }while ((res == -1) && (nb_try < 30) && (is_running));
-  PRINTDF("send_command_wait_string : %d - %s\n", res, val);
-  pthread_mutex_unlock(&request_mutex);
-  return res;
+static int send_command_wait_string(const char * cmd, enum prop_id id, char *val, size_t len){
+  struct prop p;
+
+  if ((len == 0) || (send_command_wait_prop(cmd, id, &p) != 0))
+    return -1;
+  strncpy(val, p.str, len);
+  val[len - 1] = 0;
+  return strlen(val);
 }
 
 /** Send a command to mplayer and wait for an int answer
 *
 * \param[in]  cmd the command to send
+* \param[in]  id the property answered by this command
 * \param[out] val the int value returned by mplayer
 *
 * \reval 0 : OK
 * \reval -1 : An error occured
 *
 */
-static int send_command_wait_int(const char * cmd, int *val ){
-  int nb_try = 0;
-  int res = 0;
+static int send_command_wait_int(const char * cmd, enum prop_id id, int *val ){
+  struct prop p;
 
-  pthread_mutex_lock(&request_mutex);
-  send_command(cmd);
-  do {
-    res = get_int_from_stdout(val);
-    nb_try++;
-  } while ((res == -1) && (nb_try < 5) && (is_running));
-  pthread_mutex_unlock(&request_mutex);
-  return res;
+  if (send_command_wait_prop(cmd, id, &p) != 0)
+    return -1;
+  *val = p.val.i;
+  return 0;
 }
 
 
 /** Send a command to mplayer and wait for a float answer
 *
 * \param[in]  cmd the command to send
+* \param[in]  id the property answered by this command
 * \param[out] val the float value returned by mplayer
 *
 * \reval 0 : OK
 * \reval -1 : An error occured
 *
 */
-static int send_command_wait_float(const char * cmd, float *val ){
-  int nb_try = 0;
-  int res = 0;
+static int send_command_wait_float(const char * cmd, enum prop_id id, float *val ){
+  struct prop p;
 
-  pthread_mutex_lock(&request_mutex);
-  send_command(cmd);
-  do {
-    res = get_float_from_stdout(val);
-    nb_try++;
-  }while (( res == -1) && (nb_try < 5) && (is_running));
-  pthread_mutex_unlock(&request_mutex);
-  return res;
+  if (send_command_wait_prop(cmd, id, &p) != 0)
+    return -1;
+  *val = p.val.f;
+  return 0;
 }
 
 int playint_get_file_length(void){
   int val = 0;
     if (is_paused)
-        return -1;  
-    if (send_command_wait_int(" get_property length\n", &val) == 0){
+        return -1;
+    if (send_command_wait_int(" get_property length\n", PROP_LENGTH, &val) == 0){
       return val;
     } else {
       /* Return 0 if command failed */
@@ -360,77 +494,32 @@ int playint_get_file_length(void){
     }
 }
 
-static int extract_mplayer_answer(char *buffer, int len, const char* pattern, bool quote){
-    int extract_len = -1;
-    int pattern_len = strlen(pattern);
-        
-    if(!strncmp(pattern, buffer, pattern_len)){
-        /* Remove ANS pattern and final quote */   
-        extract_len = len - pattern_len;
-        if (quote)
-           extract_len -= 1;
-        memmove(buffer, buffer + pattern_len, extract_len);
-        buffer[extract_len] = 0;
-        //PRINTDF("Extracted name : %s\n", buffer);        
-    } 
-    return extract_len;
-}
-
 /** Return the current file been playing */
 int playint_get_filename(char *buffer, size_t len){
-    #define FILENAME_ANS_PATTERN "ANS_FILENAME='"
-  
-    int nb_chars;   
-    
-    nb_chars = send_command_wait_string(" get_file_name\n", buffer, len, FILENAME_ANS_PATTERN);    
-    if (nb_chars > 0){
-        return extract_mplayer_answer(buffer, nb_chars, FILENAME_ANS_PATTERN, true);        
-    }      
-    return -1;
+    return send_command_wait_string(" get_file_name\n", PROP_FILENAME, buffer, len);
 }
 
 int playint_get_path(char *buffer, size_t len){
-    #define PATH_ANS_PATTERN "ANS_path="
-  
-    int nb_chars;   
-    
-    nb_chars = send_command_wait_string("get_property path\n", buffer, len, PATH_ANS_PATTERN);    
-    if (nb_chars > 0){
-        return extract_mplayer_answer(buffer, nb_chars, PATH_ANS_PATTERN, false);        
-    }      
-    return -1;
+    return send_command_wait_string("get_property path\n", PROP_PATH, buffer, len);
 }
 
 /** Return the artist from the current file (from ID tag) */
 int playint_get_artist(char *buffer, size_t len){
-    #define ARTIST_ANS_PATTERN "ANS_META_ARTIST='"
-  
-    int nb_chars;   
-    nb_chars = send_command_wait_string(" get_meta_artist\n", buffer, len, ARTIST_ANS_PATTERN);    
-    if (nb_chars > 0){
-        return extract_mplayer_answer(buffer, nb_chars, ARTIST_ANS_PATTERN, true);        
-    }
-    return -1;
+    return send_command_wait_string(" get_meta_artist\n", PROP_META_ARTIST, buffer, len);
 }
 
 /** Return the title from the current file (from ID tag) */
 int playint_get_title(char *buffer, size_t len){
-    #define ALBUM_ANS_PATTERN "ANS_META_TITLE='"
-    int nb_chars;   
-    nb_chars = send_command_wait_string(" get_meta_title\n", buffer, len, ALBUM_ANS_PATTERN);    
-    if (nb_chars > 0){
-        return extract_mplayer_answer(buffer, nb_chars, ALBUM_ANS_PATTERN, true);        
-    }
-    return -1;
+    return send_command_wait_string(" get_meta_title\n", PROP_META_TITLE, buffer, len);
 }
 
 /** Return the current file position in seconds
 */
-int playint_get_file_position_seconds(void){  
+int playint_get_file_position_seconds(void){
   int val = 0;
   if (is_paused)
-    return -1;  
-  if (send_command_wait_int(" get_property time_pos\n",&val) == 0){
+    return -1;
+  if (send_command_wait_int(" get_property time_pos\n", PROP_TIME_POS, &val) == 0){
     return val;
   } else {
     /* Return 0 if command failed */
@@ -440,11 +529,11 @@ int playint_get_file_position_seconds(void){
 
 /** Return the current file position in percent
 */
-int playint_get_file_position_percent(void){  
+int playint_get_file_position_percent(void){
   int val = 0;
   if (is_paused)
-    return -1;  
-  if (send_command_wait_int(" get_property percent_pos\n",&val) == 0){
+    return -1;
+  if (send_command_wait_int(" get_property percent_pos\n", PROP_PERCENT_POS, &val) == 0){
     return val;
   } else {
     /* Return 0 if command failed */
@@ -452,22 +541,72 @@ int playint_get_file_position_percent(void){
   }
 }
 
-/** Ask mplayer for the curent video settings */ 
+/** Retrieve the main mplayer properties with only one FIFO write
+ *
+ * All get_property requests are pipelined in one write and the answers are
+ * collected by the event loop as they come : this function never waits.
+ * A new batch is only sent once the previous one is answered (or given up).
+ *
+ * \param[out] snap the last complete snapshot (with the current pause state)
+ *
+ * \retval 0 snap has been filled
+ * \retval -1 no batch has been fully answered yet (snap is empty)
+ */
+int playint_get_snapshot(struct playint_snapshot * snap){
+  char cmd[256];
+  int len = 0;
+  int i;
+  const char * prefix = (is_paused ? "pausing_keep " : "");
+
+  if (snapshot.pending && (get_remaining_time(&snapshot.deadline) == 0)){
+    PRINTDF("Snapshot batch not fully answered - given up\n");
+    snapshot.pending = false;
+  }
+  if (!snapshot.pending){
+    for (i = 0; i < sizeof(snapshot_batch)/sizeof(snapshot_batch[0]); i++){
+      len += snprintf(&cmd[len], sizeof(cmd) - len, "%sget_property %s\n", prefix, props[snapshot_batch[i]].name);
+    }
+    for (i = 0; i < PROP_NB; i++){
+      snapshot.seq[i] = props[i].seq;
+    }
+    get_abs_timeout(&snapshot.deadline, PROP_ANSWER_TIMEOUT_MS);
+    snapshot.pending = true;
+    PRINTDF("Snapshot batch : %s", cmd);
+    write(fifo_command, cmd, len);
+  }
+
+  if (!snapshot.valid){
+    snap->path[0] = 0;
+    snap->time_pos = snap->percent_pos = snap->length = snap->volume = -1;
+    snap->paused = is_paused;
+    return -1;
+  }
+  memcpy(snap, &snapshot.last, sizeof(*snap));
+  snap->paused = is_paused;
+  return 0;
+}
+
+/** Return the last values received from mplayer without any request
+ *
+ * \param[out] snap the snapshot to fill
+ */
+void playint_get_last_snapshot(struct playint_snapshot * snap){
+  fill_snapshot(snap, NULL);
+}
+
+/** Ask mplayer for the curent video settings */
 int playint_get_audio_settings(struct audio_settings * settings){
-  return send_command_wait_int(" get_property volume\n", &settings->volume);
+  return send_command_wait_int(" get_property volume\n", PROP_VOLUME, &settings->volume);
 }
 
 /** Ask mplayer for the curent audio settings
  */
 int playint_get_video_settings( struct video_settings * settings){
   int res = 0;
-  
-  res = send_command_wait_int(" get_property contrast\n", &settings->contrast);
-  //fprintf(stderr,"contrast : %i\n res :%i\n",settings->contrast,res);
-  res |= send_command_wait_float(" get_property audio_delay\n", &settings->audio_delay);
-  //fprintf(stderr,"delay : %f\n res :%i\n",settings->audio_delay,res);
-  res |= send_command_wait_int(" get_property volume\n", &settings->volume);
-  //fprintf(stderr,"volume  : %i\n res :%i\n",settings->volume,res);
+
+  res = send_command_wait_int(" get_property contrast\n", PROP_CONTRAST, &settings->contrast);
+  res |= send_command_wait_float(" get_property audio_delay\n", PROP_AUDIO_DELAY, &settings->audio_delay);
+  res |= send_command_wait_int(" get_property volume\n", PROP_VOLUME, &settings->volume);
 
   return res;
 }
@@ -597,11 +736,34 @@ void playint_delay(double step){
     send_command(buffer);     
 }
 
-/** \note This function blocks and returns only when mplayer is dead */
-void playint_run(char * filename){
+/** Event loop callback : mplayer has exited
+ *
+ * mplayer inherits the write end of a pipe : the read end is hung up once mplayer is dead.
+ */
+static void exit_cb(int fd, void * data){
+    int status;
+
+    while ((waitpid(mplayer_pid, &status, 0) < 0) && (errno == EINTR));
+    is_running = false;
+    loop_remove_fd(fd);
+    close(fd);
+    loop_remove_fd(fifo_out);
+    /* Nothing left to do for the engine */
+    loop_quit();
+}
+
+/** Launch mplayer
+ *
+ * The event loop is left when mplayer exits.
+ *
+ * \retval true mplayer has been launched
+ * \retval false failure
+ */
+bool playint_start(char * filename){
     char cmd[500]; 
     char rotated_param[10];
     char playlist_param[10];
+    int fds[2];
 
     if(ws_are_axes_inverted() != 0){
       strcpy(rotated_param, ",rotate=1" );
@@ -618,10 +780,29 @@ void playint_run(char * filename){
             FIFO_COMMAND_NAME, playlist_param, filename, FIFO_STDOUT_NAME);
     cmd[sizeof(cmd)-1] = 0;
     PRINTDF("Mplayer command line : %s \n", cmd);      
-    system((char *)cmd);    
-    is_running = false;
+    if (pipe(fds) != 0){
+        is_running = false;
+        return false;
+    }
+    mplayer_pid = fork();
+    if (mplayer_pid == 0){
+        /* mplayer keeps the write end of the pipe opened until it exits */
+        close(fds[0]);
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    if ((mplayer_pid < 0) || !loop_add_fd(fds[0], exit_cb, NULL)){
+        if (mplayer_pid > 0)
+            kill(mplayer_pid, SIGTERM);
+        close(fds[0]);
+        is_running = false;
+        return false;
+    }
+    return true;
 }
 
+
 bool playint_is_running(void){
     return is_running;
 }
@@ -636,11 +817,17 @@ void playint_init(void){
     mkfifo(FIFO_STDOUT_NAME, 0700);
     fifo_command = open(FIFO_COMMAND_NAME, O_RDWR);
     fifo_menu = open(FIFO_MENU_NAME, O_RDWR);
-    fifo_out = open(FIFO_STDOUT_NAME, O_RDWR);
+    fifo_out = open(FIFO_STDOUT_NAME, O_RDWR | O_NONBLOCK);
     is_paused = false;
     /* is_running is set to true before real launch of mplayer 
        coz only the value false is meaningfull for callers 
        to playint_is_running and default value must be true 
        to avoid premature exits*/
     is_running = true;
+    output.idx = 0;
+    memset(&snapshot, 0, sizeof(snapshot));
+    /* mplayer answers are dispatched from the event loop */
+    if (!loop_add_fd(fifo_out, output_cb, NULL)){
+        PRINTDF("Unable to watch mplayer stdout\n");
+    }
 }
@@ -41,13 +41,26 @@ enum playint_vol{
     PLAYINT_VOL_ABS,
 };    
 
+#define PLAYINT_PATH_MAX 256
+
+/** Snapshot of mplayer state retrieved with only one batch of requests
+ *
+ * Integer fields are set to -1 and path is empty when the value is not available
+ */
+struct playint_snapshot{
+    char path[PLAYINT_PATH_MAX];  /**< Current file path */
+    int  time_pos;                /**< Position in seconds */
+    int  percent_pos;             /**< Position in percent */
+    int  length;                  /**< File length in seconds */
+    int  volume;                  /**< Current volume */
+    bool paused;                  /**< Pause state */
+};
+
 
 void playint_init(void);
-void playint_run(char *);
+bool playint_start(char *);
 bool playint_is_running(void);
 void playint_quit(void);
-int  playint_wait_output(int timeout);
-void playint_flush_stdout(void);
 void playint_seek(int val, enum playint_seek type);
 int  playint_get_artist(char *buffer, size_t len);
 int  playint_get_title(char *buffer, size_t len);
@@ -60,6 +73,8 @@ int  playint_get_video_settings( struct video_settings * settings);
 int  playint_get_file_length(void);
 int  playint_get_filename(char *buffer, size_t len);
 int  playint_get_path(char *buffer, size_t len);
+int  playint_get_snapshot(struct playint_snapshot * snap);
+void playint_get_last_snapshot(struct playint_snapshot * snap);
 void playint_mute(void);
 void playint_pause(void);
 bool playint_is_paused(void);
@@ -6,6 +6,11 @@
  * Power related functions to :
  *  \li Probe power Off button
  *  \li	Get Battery informations 
+ *  \li Get the model of the device
+ *
+ * Devices are opened once and sampled at the pace chosen by the caller (see :power_sample_button()
+ * and :power_sample_battery()). Their state is cached so that it can be read at no cost,
+ * and any change is published through the callback given to :power_init().
  * 
  * $URL:$
  * $Rev:$
@@ -47,85 +52,192 @@
 
 #define BAT_DEV_NAME "/dev/battery"
 #define BUTTON_NAME "/proc/barcelona/onoff"
-#define DEVICE_NOT_OPENED -2
+#define MODELNAME_PATH "/proc/barcelona/modelname"
 #define BUTTON_PUSHED_MASK 1
 
-static int bat_fd = DEVICE_NOT_OPENED;
+/* A better battery level is only reported once the voltage is this much (mV) above its threshold */
+#define BAT_HYSTERESIS_MV 50
 
 static uint16_t power_step[]= {3900, 3800, 3700};
 
-/** Check whether the power button has been pushed
+static struct {
+	int bat_fd;                       /**< Battery device (-1 if not available) */
+	int button_fd;                    /**< Power button proc entry (-1 if not available) */
+	enum E_POWER_LEVEL bat_state;     /**< Last battery state */
+	bool off_pushed;                  /**< Power button pushed and not yet acknowledged */
+	char model[64];                   /**< Model name (probed once) */
+	power_event_cb cb;
+	void * cb_data;
+} power = {
+	.bat_fd = -1,
+	.button_fd = -1,
+	.bat_state = POWER_BAT_UNKNOWN
+};
+
+
+/** Open the power devices and probe the model
  *
- * \return true if the power button is pushed, else false
+ * \param cb called on each state change (can be NULL)
+ * \param data given back to cb
+ *
+ * \return true on success, false if no power device is available
  */
-bool power_is_off_button_pushed(void){
-	bool is_power_off_pushed;
-	char buffer[128];
-	unsigned int val;
-	int input_fd = DEVICE_NOT_OPENED;
-
-	/* Check whether power button has been pushed */
-	is_power_off_pushed = false;
+bool power_init(power_event_cb cb, void * data){
+	int fd;
+	int len;
 
-	/* Proc entry has to be open each time it is used ...*/
-	input_fd = open(BUTTON_NAME, O_RDWR );
-	if (input_fd < 0){
-	    //perror("Error while trying to open button device : ");
+	power.cb = cb;
+	power.cb_data = data;
+	if (power.button_fd < 0){
+		power.button_fd = open(BUTTON_NAME, O_RDWR);
 	}
-
-	if (input_fd >= 0){
-		if (read(input_fd,buffer,sizeof(buffer)) <= 0){
-				perror("Error while reading proc onoff entry");
-		} else {
-			val = strtol(buffer,NULL,10);
-			if (val & BUTTON_PUSHED_MASK){
-				is_power_off_pushed = true;
-				write(input_fd,"0",1);
+	if (power.bat_fd < 0){
+		power.bat_fd = open(BAT_DEV_NAME, O_RDWR);
+		if (power.bat_fd < 0){
+		    perror("Error while trying to open battery device : ");
+		}
+	}
+	if (power.model[0] == 0){
+		fd = open(MODELNAME_PATH, O_RDONLY);
+		if (fd >= 0){
+			len = read(fd, power.model, sizeof(power.model) - 1);
+			if (len > 0){
+				power.model[len] = 0;
+				/* Remove trailing end of line */
+				power.model[strcspn(power.model, "\r\n")] = 0;
+			} else {
+				power.model[0] = 0;
 			}
+			close(fd);
+		} else {
+			perror("Error while trying to open " MODELNAME_PATH);
 		}
-                close (input_fd);
 	}
-	
+	/* Battery state is known as soon as the module is initialized */
+	power_sample_battery();
+	return ((power.button_fd >= 0) || (power.bat_fd >= 0));
+}
+
+/** Close the power devices */
+void power_release(void){
+	if (power.button_fd >= 0){
+		close(power.button_fd);
+		power.button_fd = -1;
+	}
+	if (power.bat_fd >= 0){
+		close(power.bat_fd);
+		power.bat_fd = -1;
+	}
+	power.cb = NULL;
+}
+
+static void publish(enum power_event event){
+	if (power.cb != NULL){
+		power.cb(event, power.cb_data);
+	}
+}
+
+/** Sample the power button
+ *
+ * \note To be called periodically (the proc entry can not be waited for)
+ */
+void power_sample_button(void){
+	char buffer[128];
+	unsigned int val;
+	int len;
+
+	if (power.button_fd < 0){
+		return;
+	}
+	/* The proc entry is generated again on each read from its beginning */
+	len = pread(power.button_fd, buffer, sizeof(buffer) - 1, 0);
+	if (len <= 0){
+		perror("Error while reading proc onoff entry");
+		return;
+	}
+	buffer[len] = 0;
+	val = strtol(buffer,NULL,10);
+	if (val & BUTTON_PUSHED_MASK){
+		/* Acknowledge the push */
+		pwrite(power.button_fd, "0", 1, 0);
+		power.off_pushed = true;
+		publish(POWER_EVENT_OFF_BUTTON);
+	}
+}
+
+/** Check whether the power button has been pushed
+ *
+ * \return true if the power button is pushed, else false
+ * \note The push is acknowledged : next calls return false until the button is pushed again.
+ * No device access : the button is read by :power_sample_button().
+ */
+bool power_is_off_button_pushed(void){
+	bool is_power_off_pushed = power.off_pushed;
+
+	power.off_pushed = false;
 	return is_power_off_pushed;
 }
 
 
-/** Get current battery state
+/** Battery level for a given voltage */
+static enum E_POWER_LEVEL bat_level(int voltage){
+	enum E_POWER_LEVEL state = POWER_BAT_100;
+	int i = 0;
+
+	while ((state < POWER_BAT_WARN) && (power_step[i] > voltage)){
+		i++;
+		state++;
+	}
+	return state;
+}
+
+/** Sample the battery state
+ *
+ * A raising voltage has to exceed the threshold of the better level by BAT_HYSTERESIS_MV
+ * so that a voltage around a threshold does not make the level blink.
  *
- * \return the power level
+ * \note To be called periodically at a low rate
  */
-enum E_POWER_LEVEL power_get_bat_state(void){
+void power_sample_battery(void){
 	enum E_POWER_LEVEL state;
 	BATTERY_STATUS bat_status;
-	int i;
-
-	/* Get battery state */
-	state = POWER_BAT_UNKNOWN;
-	if (bat_fd == DEVICE_NOT_OPENED){
-		/* If device not yet opened, then try to */
-		bat_fd = open(BAT_DEV_NAME, O_RDWR);
-		if (bat_fd < 0){
-		    perror("Error while trying to open battery device : ");
+
+	if (power.bat_fd < 0){
+		return;
+	}
+	if (ioctl (power.bat_fd, IOR_BATTERY_STATUS, &bat_status) != 0){
+		perror ("Error while trying to get battery status ");
+		state = POWER_BAT_UNKNOWN;
+	} else if (bat_status.u8ChargeStatus != 0){
+		state = POWER_BAT_PLUG;
+	} else {
+		state = bat_level(bat_status.u16BatteryVoltage);
+		if ((power.bat_state >= POWER_BAT_100) && (power.bat_state <= POWER_BAT_WARN) &&
+		    (state < power.bat_state)){
+			state = bat_level(bat_status.u16BatteryVoltage - BAT_HYSTERESIS_MV);
+			if (state > power.bat_state){
+				state = power.bat_state;
+			}
 		}
 	}
-	if (bat_fd >= 0){
-		 if (ioctl (bat_fd, IOR_BATTERY_STATUS, &bat_status) == 0){
-			 if (bat_status.u8ChargeStatus != 0){
-				 state = POWER_BAT_PLUG;
-			 } else {
-				 state = POWER_BAT_100;
-				 i = 0;
-				 while ((power_step[i] > bat_status.u16BatteryVoltage) &&
-						 (state < POWER_BAT_WARN))
-				 {
-					 i++;
-					 state++;
-				 }
-			 }
-		 } else {
-			 perror ("Error while trying to get battery status ");
-		 }
+	if (state != power.bat_state){
+		power.bat_state = state;
+		publish(POWER_EVENT_BATTERY);
 	}
+}
 
-	return state;
+/** Get current battery state
+ *
+ * \return the power level as of the last :power_sample_battery()
+ */
+enum E_POWER_LEVEL power_get_bat_state(void){
+	return power.bat_state;
+}
+
+/** Get the model name of the device
+ *
+ * \return the model name (empty if unknown)
+ */
+const char * power_get_model_name(void){
+	return power.model;
 }
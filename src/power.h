@@ -49,7 +49,20 @@ enum E_POWER_LEVEL {
 	  POWER_BAT_UNKNOWN /*!<unknown state */
 } ;
 
+/** State changes published by the power module */
+enum power_event {
+	POWER_EVENT_OFF_BUTTON,   /*!< Power button has been pushed */
+	POWER_EVENT_BATTERY       /*!< Battery state has changed */
+};
+
+typedef void (*power_event_cb)(enum power_event event, void * data);
+
+bool power_init(power_event_cb cb, void * data);
+void power_release(void);
+void power_sample_button(void);
+void power_sample_battery(void);
 bool power_is_off_button_pushed(void);
 enum E_POWER_LEVEL power_get_bat_state(void);
+const char * power_get_model_name(void);
 
 #endif /*POWER_H_*/
@@ -50,6 +50,8 @@
 
 #define PWM_DEFAULT_LIGHT (PWM_BACKLIGHT_MAX - 20)
 static  int previous_setting =  PWM_DEFAULT_LIGHT;
+/* Backlight has been turned off through this module */
+static  bool backlight_off = false;
 
 
 int pwm_get_brightness(int *val){
@@ -143,6 +145,9 @@ int pwm_set_brightness(int val){
 
 out_set_pwm :
     close(fd);
+    if (res == 0){
+        backlight_off = (val == 0);
+    }
     return res;
 }
 
@@ -230,9 +235,20 @@ int pwm_resume(void) {
 
 out_pwm_resume:
 	close(fd);
+	if (res == 0){
+		backlight_off = false;
+	}
 	return res;
 }
 
+/** Tell whether the backlight is currently turned off
+ *
+ * \note No device access : only the state set through this module is known
+ */
+bool pwm_is_off(void){
+    return backlight_off;
+}
+
 /** Change the current brightness by a delta value */
 int pwm_modify_brightness(int delta){
     int val;
@@ -33,10 +33,13 @@
 #ifndef __TOMPLAYER_PWM_H__
 #define __TOMPLAYER_PWM_H__
 
+#include <stdbool.h>
+
 int pwm_off(void);
 int pwm_resume(void);
 int pwm_set_brightness(int val);
 int pwm_get_brightness(int *val);
 int pwm_modify_brightness(int delta);
+bool pwm_is_off(void);
 
 #endif
@@ -0,0 +1,388 @@
+/**
+ * \file res_cache.c
+ * \brief Cache of the decoded images and of the fonts shared by the GUI objects
+ *
+ * Images are kept decoded per (file, size) and fonts per (file, height, encoding), so that
+ * going back to an already displayed screen only costs blits.
+ *
+ * Users get a reference with res_get_image() / res_get_font() and give it back with
+ * res_put_image() / res_put_font() : the objects must not be released directly nor modified.
+ * Objects no longer referenced stay in the cache until the memory they use exceeds RES_CACHE_BUDGET,
+ * the least recently used ones being released first. res_cache_purge() releases all of them at once
+ * when memory is needed elsewhere : it is also done when DirectFB fails to allocate a surface.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "debug.h"
+#include "res_cache.h"
+
+/* Max number of cached objects */
+#define RES_CACHE_MAX_ENTRIES 128
+/* Glyphs accounted for the memory used by a font */
+#define RES_FONT_GLYPHS 256
+
+enum res_type{
+    RES_IMAGE,
+    RES_FONT
+};
+
+/** Cached object : the cache holds the only DirectFB reference */
+struct res_entry{
+    enum res_type type;
+    char * filename;              /**< Image or font filename (NULL if entry is free) */
+    int width;                    /**< Requested size of an image (-1 for the size of the bitmap) */
+    int height;                   /**< Requested height of an image or height of a font */
+    DFBTextEncodingID encoding;   /**< Encoding of a font */
+    IDirectFBSurface * surf;
+    IDirectFBFont * font;
+    size_t size;                  /**< Estimation of the memory used */
+    int refs;                     /**< Number of users */
+    bool stale;                   /**< File modified : released as soon as it is no longer used */
+    unsigned int last_use;
+};
+
+/* state module variables */
+static struct {
+    struct res_entry entries[RES_CACHE_MAX_ENTRIES];
+    size_t total;                 /**< Memory used by the cached objects */
+    unsigned int use_counter;
+} cache;
+
+/* Protects the cache */
+static pthread_mutex_t res_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void free_entry(struct res_entry * e){
+    if (e->surf != NULL)
+        e->surf->Release(e->surf);
+    if (e->font != NULL)
+        e->font->Release(e->font);
+    cache.total -= e->size;
+    free(e->filename);
+    memset(e, 0, sizeof(*e));
+}
+
+/** Least recently used object that is no longer referenced */
+static struct res_entry * find_lru(void){
+    struct res_entry * lru = NULL;
+    struct res_entry * e;
+    int i;
+
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        e = &cache.entries[i];
+        if ((e->filename != NULL) && (e->refs == 0) &&
+            ((lru == NULL) || (e->last_use < lru->last_use)))
+            lru = e;
+    }
+    return lru;
+}
+
+/** Release the unused objects until the memory used fits in budget */
+static void trim(size_t budget){
+    struct res_entry * e;
+
+    while (cache.total > budget){
+        e = find_lru();
+        if (e == NULL)
+            break;
+        PRINTDF("Releasing cached %s (%u bytes)\n", e->filename, (unsigned int)e->size);
+        free_entry(e);
+    }
+}
+
+static struct res_entry * find(enum res_type type, const char * filename, int width, int height, DFBTextEncodingID encoding){
+    struct res_entry * e;
+    int i;
+
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        e = &cache.entries[i];
+        if ((e->filename != NULL) && !e->stale && (e->type == type) &&
+            (e->width == width) && (e->height == height) && (e->encoding == encoding) &&
+            (strcmp(e->filename, filename) == 0)){
+            e->last_use = ++cache.use_counter;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct res_entry * find_object(const void * obj){
+    int i;
+
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        if ((cache.entries[i].filename != NULL) &&
+            ((cache.entries[i].surf == obj) || (cache.entries[i].font == obj)))
+            return &cache.entries[i];
+    }
+    return NULL;
+}
+
+/** Add an object referenced once to the cache
+ *
+ * \return the entry, NULL if the cache is full of used objects (the object is then not cached)
+ */
+static struct res_entry * store(enum res_type type, const char * filename, int width, int height, DFBTextEncodingID encoding, size_t size){
+    struct res_entry * e = NULL;
+    int i;
+
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        if (cache.entries[i].filename == NULL){
+            e = &cache.entries[i];
+            break;
+        }
+    }
+    if (e == NULL){
+        e = find_lru();
+        if (e == NULL)
+            return NULL;
+        free_entry(e);
+    }
+    e->filename = strdup(filename);
+    if (e->filename == NULL)
+        return NULL;
+    e->type = type;
+    e->width = width;
+    e->height = height;
+    e->encoding = encoding;
+    e->size = size;
+    e->refs = 1;
+    e->last_use = ++cache.use_counter;
+    cache.total += size;
+    return e;
+}
+
+/** Create a surface, releasing the unused objects if DirectFB is short of memory */
+static DFBResult create_surface(IDirectFB * dfb, const DFBSurfaceDescription * dsc, IDirectFBSurface ** surf){
+    DFBResult ret;
+
+    ret = dfb->CreateSurface(dfb, dsc, surf);
+    if ((ret == DFB_NOVIDEOMEMORY) || (ret == DFB_NOSYSTEMMEMORY)){
+        log_write(LOG_INFO, "GUI cache - Out of memory : releasing %u bytes", (unsigned int)cache.total);
+        trim(0);
+        ret = dfb->CreateSurface(dfb, dsc, surf);
+    }
+    return ret;
+}
+
+/** Decode an image
+ *
+ * An image already decoded at its own size is scaled from the cached surface instead of being decoded again.
+ */
+static IDirectFBSurface * load_image(IDirectFB * dfb, const char * filename, int width, int height){
+    IDirectFBImageProvider * provider;
+    IDirectFBSurface * surf = NULL;
+    DFBSurfaceDescription dsc;
+    struct res_entry * native;
+
+    native = ((width > 0) && (height > 0)) ? find(RES_IMAGE, filename, -1, -1, 0) : NULL;
+    if (native != NULL){
+        dsc.flags = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+        dsc.width = width;
+        dsc.height = height;
+        native->surf->GetPixelFormat(native->surf, &dsc.pixelformat);
+        if (create_surface(dfb, &dsc, &surf) != DFB_OK)
+            return NULL;
+        surf->StretchBlit(surf, native->surf, NULL, NULL);
+        return surf;
+    }
+
+    PRINTDF("Decoding image <%s>\n", filename);
+    if (dfb->CreateImageProvider(dfb, filename, &provider) != DFB_OK)
+        return NULL;
+    if (provider->GetSurfaceDescription(provider, &dsc) == DFB_OK){
+        if ((width > 0) && (height > 0)){
+            dsc.width = width;
+            dsc.height = height;
+        }
+        if (create_surface(dfb, &dsc, &surf) == DFB_OK){
+            provider->RenderTo(provider, surf, NULL);
+        } else {
+            surf = NULL;
+        }
+    }
+    provider->Release(provider);
+    return surf;
+}
+
+/** Get an image decoded at a given size
+ *
+ * \param width width of the surface (-1 to use the size of the bitmap)
+ * \param height height of the surface (-1 to use the size of the bitmap)
+ *
+ * \return DirectFB surface to be given back with res_put_image(), NULL if error
+ */
+IDirectFBSurface * res_get_image(IDirectFB * dfb, const char * filename, int width, int height){
+    DFBSurfacePixelFormat format;
+    IDirectFBSurface * surf;
+    struct res_entry * e;
+    int w, h;
+
+    if ((width <= 0) || (height <= 0)){
+        width = -1;
+        height = -1;
+    }
+    pthread_mutex_lock(&res_mutex);
+    e = find(RES_IMAGE, filename, width, height, 0);
+    if (e != NULL){
+        e->refs++;
+        surf = e->surf;
+        goto end;
+    }
+    surf = load_image(dfb, filename, width, height);
+    if (surf == NULL)
+        goto end;
+    surf->GetSize(surf, &w, &h);
+    surf->GetPixelFormat(surf, &format);
+    e = store(RES_IMAGE, filename, width, height, 0, (size_t)w * h * DFB_BYTES_PER_PIXEL(format));
+    if (e != NULL){
+        e->surf = surf;
+        trim(RES_CACHE_BUDGET);
+    }
+end:
+    pthread_mutex_unlock(&res_mutex);
+    return surf;
+}
+
+/** Give back an image obtained with res_get_image() */
+void res_put_image(IDirectFBSurface * surf){
+    struct res_entry * e;
+
+    if (surf == NULL)
+        return;
+    pthread_mutex_lock(&res_mutex);
+    e = find_object(surf);
+    if (e == NULL){
+        /* Not cached */
+        surf->Release(surf);
+    } else if (--e->refs == 0){
+        if (e->stale)
+            free_entry(e);
+        else
+            trim(RES_CACHE_BUDGET);
+    }
+    pthread_mutex_unlock(&res_mutex);
+}
+
+/** Get a font
+ *
+ * \param height height of the font
+ * \param encoding text encoding of the strings drawn with the font
+ *
+ * \return DirectFB font to be given back with res_put_font(), NULL if error
+ */
+IDirectFBFont * res_get_font(IDirectFB * dfb, const char * filename, int height, DFBTextEncodingID encoding){
+    DFBFontDescription desc;
+    IDirectFBFont * font;
+    struct res_entry * e;
+
+    pthread_mutex_lock(&res_mutex);
+    e = find(RES_FONT, filename, -1, height, encoding);
+    if (e != NULL){
+        e->refs++;
+        font = e->font;
+        goto end;
+    }
+    PRINTDF("Loading font <%s> <%d>\n", filename, height);
+    desc.flags = DFDESC_HEIGHT;
+    desc.height = height;
+    if (dfb->CreateFont(dfb, filename, &desc, &font) != DFB_OK){
+        font = NULL;
+        goto end;
+    }
+    if (encoding != DTEID_UTF8){
+        font->SetEncoding(font, encoding);
+    }
+    /* Rough size of the glyphs cache of the font */
+    e = store(RES_FONT, filename, -1, height, encoding, (size_t)RES_FONT_GLYPHS * height * height);
+    if (e != NULL){
+        e->font = font;
+        trim(RES_CACHE_BUDGET);
+    }
+end:
+    pthread_mutex_unlock(&res_mutex);
+    return font;
+}
+
+/** Give back a font obtained with res_get_font() */
+void res_put_font(IDirectFBFont * font){
+    struct res_entry * e;
+
+    if (font == NULL)
+        return;
+    pthread_mutex_lock(&res_mutex);
+    e = find_object(font);
+    if (e == NULL){
+        /* Not cached */
+        font->Release(font);
+    } else if (--e->refs == 0){
+        if (e->stale)
+            free_entry(e);
+        else
+            trim(RES_CACHE_BUDGET);
+    }
+    pthread_mutex_unlock(&res_mutex);
+}
+
+/** Forget the cached objects of a file which has been modified */
+void res_forget(const char * filename){
+    struct res_entry * e;
+    int i;
+
+    pthread_mutex_lock(&res_mutex);
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        e = &cache.entries[i];
+        if ((e->filename != NULL) && (strcmp(e->filename, filename) == 0)){
+            if (e->refs == 0)
+                free_entry(e);
+            else
+                e->stale = true;
+        }
+    }
+    pthread_mutex_unlock(&res_mutex);
+}
+
+/** Release all the objects no longer used (to be called when memory is needed) */
+void res_cache_purge(void){
+    pthread_mutex_lock(&res_mutex);
+    trim(0);
+    pthread_mutex_unlock(&res_mutex);
+}
+
+/** Release all the cached objects, even the ones still referenced */
+void res_cache_release(void){
+    int i;
+
+    pthread_mutex_lock(&res_mutex);
+    for (i = 0; i < RES_CACHE_MAX_ENTRIES; i++){
+        if (cache.entries[i].filename != NULL)
+            free_entry(&cache.entries[i]);
+    }
+    cache.use_counter = 0;
+    pthread_mutex_unlock(&res_mutex);
+}
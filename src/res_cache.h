@@ -0,0 +1,45 @@
+/**
+ * \file res_cache.h
+ * \brief Cache of the decoded images and of the fonts shared by the GUI objects
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __RES_CACHE_H__
+#define __RES_CACHE_H__
+
+#include <stdbool.h>
+#include <directfb.h>
+
+/* Memory kept for the images and fonts no longer used (bytes) */
+#define RES_CACHE_BUDGET (4 * 1024 * 1024)
+
+IDirectFBSurface * res_get_image(IDirectFB * dfb, const char * filename, int width, int height);
+void res_put_image(IDirectFBSurface * surf);
+IDirectFBFont * res_get_font(IDirectFB * dfb, const char * filename, int height, DFBTextEncodingID encoding);
+void res_put_font(IDirectFBFont * font);
+void res_forget(const char * filename);
+void res_cache_purge(void);
+void res_cache_release(void);
+
+#endif
@@ -30,6 +30,13 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <dictionary.h>
 #include <iniparser.h>
 #include <linux/limits.h>
@@ -42,6 +49,10 @@ extern int iniparser_set(dictionary * ini, char * entry, char * val);
 #define iniparser_setstring iniparser_set
 
 #define RESUME_FILENAME "./conf/resume.ini"
+#define RESUME_TMP_FILENAME RESUME_FILENAME ".tmp"
+
+/* Minimum delay in seconds between the last change and the write by :resume_sync() */
+#define RESUME_DEBOUNCE_S 2
 
 #define RESUME_SECTION_KEY "RESUME"
 #define RESUME_VIDEO_SECTION_KEY "RESUME VIDEO"
@@ -55,6 +66,30 @@ extern int iniparser_set(dictionary * ini, char * entry, char * val);
 #define RESUME_BRIGHTNESS_KEY "brightness"
 #define RESUME_VOLUME_KEY "volume"
 #define RESUME_AUDIO_DELAY_KEY "audio_delay"
+#define RESUME_TRACK_KEY "track"
+#define RESUME_INDEX_KEY "index"
+#define RESUME_OFFSET_KEY "offset"
+#define RESUME_BASE_INDEX_KEY "base_index"
+#define RESUME_BASE_OFFSET_KEY "base_offset"
+
+/* In memory copy of the resume file */
+static struct {
+    dictionary * ini;
+    bool dirty;              /**< ini has changes not written yet */
+    time_t change_time;      /**< time of the last change */
+    struct stat file_st;     /**< status of the file when loaded or written */
+} store;
+
+/* Entry of the volatile playlist being played */
+static struct {
+    off_t base_offset;       /**< Offset of the volatile playlist in the full playlist */
+    int base_index;          /**< Index of the first volatile playlist entry in the full playlist */
+    off_t offset;            /**< Offset of the current entry in the volatile playlist */
+    int index;               /**< Index of the current entry in the volatile playlist */
+} cursor;
+
+/* Resume functions are called from several threads in engine */
+static pthread_mutex_t resume_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static inline char * RESUME_SECTION_KEY_GET(enum eng_mode x){
     switch (x){
@@ -69,156 +104,164 @@ static inline char * RESUME_SECTION_KEY_GET(enum eng_mode x){
     }
 }
 
-/**
- * Reinit the resume file
+/** Get the resume dictionary
  *
- * \return 0  on success, -1 on failure
+ * The file is only loaded on first call or if another process (GUI / engine) replaced it.
+ * \note resume_mutex has to be held
  */
-int resume_file_init(enum eng_mode mode){  
-	dictionary * ini ;
-        char ini_path[100];
-	FILE * fp;
-	int ret = 0;  
-  
-	ini = iniparser_load(RESUME_FILENAME);
-	if( ini == NULL ){
-		PRINTD( "resume file doesn't exist\n" );
-		ini = dictionary_new( 0 );
-	}
+static dictionary * get_ini(void){
+    struct stat st;
+    bool exists;
+
+    exists = (stat(RESUME_FILENAME, &st) == 0);
+    if ((store.ini != NULL) && !store.dirty){
+        if (!exists ||
+            ((st.st_ino == store.file_st.st_ino) && (st.st_mtime == store.file_st.st_mtime) &&
+             (st.st_size == store.file_st.st_size)))
+            return store.ini;
+        /* File has been written by the other process */
+        iniparser_freedict(store.ini);
+        store.ini = NULL;
+    }
+    if (store.ini == NULL){
+        if (exists)
+            store.ini = iniparser_load(RESUME_FILENAME);
+        if (store.ini == NULL){
+            PRINTD( "resume file doesn't exist\n" );
+            store.ini = dictionary_new( 0 );
+        } else {
+            store.file_st = st;
+        }
+    }
+    return store.ini;
+}
 
-	fp = fopen( RESUME_FILENAME, "w+" );
-	if( fp == NULL ){
-		PRINTDF( "Unable to create resume file <%s>\n", RESUME_FILENAME );
-		ret = -1;
-		goto error;
-	}  
-	iniparser_setstring(ini, RESUME_SECTION_KEY_GET(mode), NULL);
-  
-        snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_FILENAME_KEY);
-        ini_path[sizeof(ini_path)-1] = 0;
-        iniparser_setstring(ini, ini_path, RESUME_PLAYLIST_FILENAME(mode));
-        
-        snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY);
-        ini_path[sizeof(ini_path)-1] = 0;
-        iniparser_setstring(ini, ini_path, "-1");
+/** Set a value in the resume dictionary (the section is created if needed)
+ * \note resume_mutex has to be held
+ */
+static void set_value(const char * section, const char * key, const char * value){
+    dictionary * ini = get_ini();
+    char ini_path[100];
+    char * old;
+
+    if (ini == NULL)
+        return;
+    if (!iniparser_find_entry(ini, (char *)section)){
+        iniparser_setstring(ini, (char *)section, NULL);
+        store.dirty = true;
+        store.change_time = time(NULL);
+    }
+    snprintf(ini_path, sizeof(ini_path), "%s:%s", section, key);
+    ini_path[sizeof(ini_path)-1] = 0;
+    old = iniparser_getstring(ini, ini_path, NULL);
+    if ((old != NULL) && (strcmp(old, value) == 0))
+        return;
+    iniparser_setstring(ini, ini_path, (char *)value);
+    store.dirty = true;
+    store.change_time = time(NULL);
+}
+
+static void set_int_value(const char * section, const char * key, int value){
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%i", value);
+    set_value(section, key, buffer);
+}
 
-        iniparser_dump_ini( ini, fp );
-        fclose( fp );
+/** Write the resume dictionary in a temporary file then rename it
+ * \note resume_mutex has to be held
+ */
+static int write_file(void){
+    FILE * fp;
+
+    fp = fopen(RESUME_TMP_FILENAME, "w");
+    if (fp == NULL){
+        PRINTDF( "Unable to create resume file <%s>\n", RESUME_TMP_FILENAME );
+        return -1;
+    }
+    iniparser_dump_ini(store.ini, fp);
+    if ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0)){
+        fclose(fp);
+        goto error;
+    }
+    if ((fclose(fp) != 0) || (rename(RESUME_TMP_FILENAME, RESUME_FILENAME) != 0))
+        goto error;
+    stat(RESUME_FILENAME, &store.file_st);
+    store.dirty = false;
+    return 0;
 
 error:
-	iniparser_freedict(ini);
-	return ret;
+    PRINTDF( "Unable to write resume file <%s>\n", RESUME_FILENAME );
+    unlink(RESUME_TMP_FILENAME);
+    return -1;
 }
 
-/** Write position entry in resume file
- *
- * \param value The current position in seconds
+/** Write the pending changes on disk
  *
  * \return 0  on success, -1 on failure
  */
-int resume_write_pos(enum eng_mode mode, int value){
-  char buffer[100];
-  char ini_path[100];
-  dictionary * ini ;
-  FILE * fp;
-  int ret = 0;
-
-  ini = iniparser_load(RESUME_FILENAME);
-  if( ini == NULL ){
-  	PRINTDF( "Unable to load resume file <%s>\n", RESUME_FILENAME );
-  	return -1;
-  }
-
-  /* Write pos in "resume audio" or "resume video" */
-  snprintf(buffer, sizeof(buffer),"%i", value);
-  iniparser_setstring( ini, RESUME_SECTION_KEY_GET(mode), NULL );
-  snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY);
-  ini_path[sizeof(ini_path)-1] = 0;
-  iniparser_setstring( ini, ini_path, buffer );  
-    
-  /* Keep last resume info in resume section */
-  iniparser_setstring( ini, RESUME_SECTION_KEY, NULL );
-  snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY, RESUME_POS_KEY);
-  ini_path[sizeof(ini_path)-1] = 0;
-  iniparser_setstring( ini, ini_path, buffer );  
-  snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY, RESUME_FILENAME_KEY);
-  ini_path[sizeof(ini_path)-1] = 0;
-  iniparser_setstring( ini, ini_path, RESUME_PLAYLIST_FILENAME(mode));
-
-  
-  fp = fopen( RESUME_FILENAME, "w+" );
-  if( fp == NULL ){
-  	PRINTDF( "Unable to create resume file <%s>\n", RESUME_FILENAME );
-  	ret = -1;
-  	goto error;
-  }
-
-  iniparser_dump_ini( ini, fp );
-  fclose( fp );
+int resume_flush(void){
+    int ret = 0;
 
-error:
-  iniparser_freedict(ini);
-  return ret;
+    pthread_mutex_lock(&resume_mutex);
+    if (store.dirty)
+        ret = write_file();
+    pthread_mutex_unlock(&resume_mutex);
+    return ret;
 }
 
-
-/** Get media file and position entry in resume file
+/** Write the pending changes on disk if there was no change for a while
  *
- * \param mode audio or video mode
- * \param filename Buffer where the media filename has to be stored
- * \param len Length of the buffer where thefilename has to be copied
- * \param pos Last position in seconds
+ * \note To be called periodically : it coalesces the changes made in a row in one write
  *
  * \return 0  on success, -1 on failure
  */
-int resume_get_file_infos(enum eng_mode mode, char * filename, int len , int * pos){
-  dictionary * ini ;
-  char ini_path[100];
-  char *s;
-  int ret = 0;
+int resume_sync(void){
+    int ret = 0;
 
+    pthread_mutex_lock(&resume_mutex);
+    if (store.dirty && (time(NULL) - store.change_time >= RESUME_DEBOUNCE_S))
+        ret = write_file();
+    pthread_mutex_unlock(&resume_mutex);
+    return ret;
+}
 
-  *pos = 0;
-  if (len <= 0){
-    return -1;
-  }
-  memset( filename, 0, len );
-
-  ini = iniparser_load(RESUME_FILENAME);
-  if( ini == NULL ){
-  	PRINTDF( "Unable to load resume file <%s>\n", RESUME_FILENAME );
-  	return -1;
-  }
-
-  snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_FILENAME_KEY);
-  ini_path[sizeof(ini_path)-1] = 0;
-  s = iniparser_getstring(ini, ini_path, NULL);
-  if( s != NULL ) strncpy( filename, s, len-1 );
-  else{
-  	ret = -1;
-  	PRINTDF( "Error while getting media filename in : %s \n ", RESUME_FILENAME);
-  	goto error;
-  }
-  
-  snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY);
-  ini_path[sizeof(ini_path)-1] = 0;
-  s = iniparser_getstring(ini, ini_path, NULL);
-  if( s != NULL ){
-  	if (sscanf(s ,"%i", pos) != 1){
-  		ret = -1;
-  		PRINTDF("Error while parsing position value : %s \n ", s);
-  		goto error;
-  	}
-  }
-  else{
-  	ret = -1;
-  	PRINTDF("Error while getting position value in resume file : %s \n ", RESUME_FILENAME);
-  	goto error;
-  }
+/**
+ * Initialize the resume state of the engine
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_file_init(enum eng_mode mode){  
+    char ini_path[100];
+    dictionary * ini;
+
+    pthread_mutex_lock(&resume_mutex);
+    ini = get_ini();
+    /* Position of the volatile playlist in the full one */
+    snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_BASE_OFFSET_KEY);
+    cursor.base_offset = strtoll(iniparser_getstring(ini, ini_path, "0"), NULL, 10);
+    snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_BASE_INDEX_KEY);
+    cursor.base_index = iniparser_getint(ini, ini_path, 0);
+    cursor.offset = 0;
+    cursor.index = 0;
+    set_value(RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY, "-1");
+    pthread_mutex_unlock(&resume_mutex);
+    return 0;
+}
 
-error:
-  iniparser_freedict(ini);
-  return ret;
+/** Write position entry in resume file
+ *
+ * \param value The current position in seconds
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_write_pos(enum eng_mode mode, int value){
+  pthread_mutex_lock(&resume_mutex);
+  /* Write pos in "resume audio" or "resume video" */
+  set_int_value(RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY, value);
+  /* Keep last resume info in resume section */
+  set_int_value(RESUME_SECTION_KEY, RESUME_POS_KEY, value);
+  pthread_mutex_unlock(&resume_mutex);
+  return 0;
 }
 
 
@@ -227,12 +270,8 @@ int resume_get_general_settings(struct general_settings * settings) {
     int res = 0;
     int i;
 
-    ini = iniparser_load(RESUME_FILENAME);
-    if( ini == NULL ){
-            PRINTDF( "Warning : Unable to load resume file <%s>\n", RESUME_FILENAME );
-            return -1;
-    }
-
+    pthread_mutex_lock(&resume_mutex);
+    ini = get_ini();
     i = iniparser_getint(ini, RESUME_GENERAL_SETTINGS_SECTION_KEY":"RESUME_BRIGHTNESS_KEY, -1);
     if (i < 0) {
         PRINTD( "Warning : Unable to get brightness from resume file - Setting to max\n");
@@ -240,7 +279,7 @@ int resume_get_general_settings(struct general_settings * settings) {
     } else 
         settings->brightness = i;
 
-    iniparser_freedict(ini);
+    pthread_mutex_unlock(&resume_mutex);
     return res;
 }
 
@@ -255,12 +294,8 @@ int resume_get_audio_settings(struct audio_settings * settings){
     int res = 0;
     int i;
 
-    ini = iniparser_load(RESUME_FILENAME);
-    if( ini == NULL ){
-            PRINTDF( "Warning : Unable to load resume file <%s>\n", RESUME_FILENAME );
-            return -1;
-    }
-
+    pthread_mutex_lock(&resume_mutex);
+    ini = get_ini();
     i = iniparser_getint(ini, RESUME_AUDIO_SETTINGS_SECTION_KEY":"RESUME_VOLUME_KEY, -1);
     if (i < 0) {
             PRINTD( "Warning : Unable to get volume from resume file\n");
@@ -268,7 +303,7 @@ int resume_get_audio_settings(struct audio_settings * settings){
     } else 
             settings->volume = i;
 
-    iniparser_freedict(ini);
+    pthread_mutex_unlock(&resume_mutex);
     return res;
 }
 
@@ -284,12 +319,8 @@ int resume_get_video_settings(struct video_settings * settings) {
 	int i;
 	char *s;
 
-	ini = iniparser_load(RESUME_FILENAME);
-	if( ini == NULL ){
-		PRINTDF( "Warning : Unable to load resume file <%s>\n", RESUME_FILENAME );
-		return -1;
-	}
-
+	pthread_mutex_lock(&resume_mutex);
+	ini = get_ini();
 
 	i = iniparser_getint(ini, RESUME_VIDEO_SETTINGS_SECTION_KEY":"RESUME_CONTRAST_KEY, -1000);
 	if( i == -1000) {
@@ -328,41 +359,17 @@ int resume_get_video_settings(struct video_settings * settings) {
 	}
 
 out_video_settings:
-	iniparser_freedict(ini);
+	pthread_mutex_unlock(&resume_mutex);
 	return res;
 }
 
 
 
 int resume_set_general_settings(const struct general_settings * settings){
-    char buffer[256];
-    dictionary * ini ;
-    FILE * fp;
-    int ret = 0;
-
-    ini = iniparser_load(RESUME_FILENAME);
-    if( ini == NULL ){
-            PRINTDF( "Unable to load resume file <%s>\n", RESUME_FILENAME );
-            return -1;
-    }
-
-    iniparser_setstring( ini, RESUME_GENERAL_SETTINGS_SECTION_KEY, NULL );
-    snprintf(buffer,sizeof(buffer),"%i",settings->brightness);
-    iniparser_setstring( ini, RESUME_GENERAL_SETTINGS_SECTION_KEY":"RESUME_BRIGHTNESS_KEY, buffer );
-
-    fp = fopen(RESUME_FILENAME, "w+");
-    if (fp == NULL) {
-        PRINTDF("Unable to create resume file <%s>\n", RESUME_FILENAME);
-        ret = -1;
-        goto error;
-    }
-
-    iniparser_dump_ini( ini, fp );
-    fclose( fp );
-
- error:
-    iniparser_freedict(ini);
-    return ret;
+    pthread_mutex_lock(&resume_mutex);
+    set_int_value(RESUME_GENERAL_SETTINGS_SECTION_KEY, RESUME_BRIGHTNESS_KEY, settings->brightness);
+    pthread_mutex_unlock(&resume_mutex);
+    return 0;
 }
 
 
@@ -375,37 +382,10 @@ int resume_set_general_settings(const struct general_settings * settings){
  * \return 0  on success, -1 on failure
  */
 int resume_set_audio_settings(const struct audio_settings * settings){
-	char buffer[256];
-	dictionary * ini ;
-	FILE * fp;
-	int ret = 0;
-
-	ini = iniparser_load(RESUME_FILENAME);
-	if( ini == NULL ){
-		PRINTDF( "Unable to load resume file <%s>\n", RESUME_FILENAME );
-		return -1;
-	}
-
-	iniparser_setstring( ini, RESUME_AUDIO_SETTINGS_SECTION_KEY, NULL );
-    snprintf(buffer,sizeof(buffer),"%i",settings->volume);
-    iniparser_setstring( ini, RESUME_AUDIO_SETTINGS_SECTION_KEY":"RESUME_VOLUME_KEY, buffer );
-
-    fp = fopen( RESUME_FILENAME, "w+" );
-    if( fp == NULL ){
-    	PRINTDF( "Unable to create resume file <%s>\n", RESUME_FILENAME );
-    	ret = -1;
-    	goto error;
-    }
-
-    iniparser_dump_ini( ini, fp );
-    fclose( fp );
-
- error:
-    iniparser_freedict(ini);
-    return ret;
-
-
-
+    pthread_mutex_lock(&resume_mutex);
+    set_int_value(RESUME_AUDIO_SETTINGS_SECTION_KEY, RESUME_VOLUME_KEY, settings->volume);
+    pthread_mutex_unlock(&resume_mutex);
+    return 0;
 }
 
 
@@ -417,87 +397,273 @@ int resume_set_audio_settings(const struct audio_settings * settings){
  */
 int resume_set_video_settings(const struct video_settings * settings) {
 	char buffer[256];
-	dictionary * ini ;
-	FILE * fp;
-	int ret = 0;
 
-	ini = iniparser_load(RESUME_FILENAME);
-	if( ini == NULL ){
-		PRINTDF( "Unable to load resume file <%s>\n", RESUME_FILENAME );
-		return false;
-	}
+	pthread_mutex_lock(&resume_mutex);
+	set_int_value(RESUME_VIDEO_SETTINGS_SECTION_KEY, RESUME_CONTRAST_KEY, settings->contrast);
+	set_int_value(RESUME_VIDEO_SETTINGS_SECTION_KEY, RESUME_VOLUME_KEY, settings->volume);
+	snprintf(buffer,sizeof(buffer),"%f",settings->audio_delay);
+	set_value(RESUME_VIDEO_SETTINGS_SECTION_KEY, RESUME_AUDIO_DELAY_KEY, buffer);
+	pthread_mutex_unlock(&resume_mutex);
+	return 0;
+}
 
-	iniparser_setstring( ini, 	RESUME_VIDEO_SETTINGS_SECTION_KEY, NULL );
-	snprintf(buffer,sizeof(buffer),"%i",settings->contrast);
-	iniparser_setstring( ini, 	RESUME_VIDEO_SETTINGS_SECTION_KEY":"RESUME_CONTRAST_KEY, buffer );
 
-/*    snprintf(buffer,sizeof(buffer),"%i",settings->brightness);
-	iniparser_setstring( ini, 	RESUME_VIDEO_SETTINGS_SECTION_KEY":"RESUME_BRIGHTNESS_KEY, buffer );
-*/
-	snprintf(buffer,sizeof(buffer),"%i",settings->volume);
-	iniparser_setstring( ini, 	RESUME_VIDEO_SETTINGS_SECTION_KEY":"RESUME_VOLUME_KEY, buffer );
+/** Read the next entry of a playlist (comments and empty lines are skipped)
+ *
+ * \return offset of the entry in playlist or -1 at the end of the playlist
+ */
+static off_t read_entry(FILE * fp, char * buffer, size_t len){
+    off_t offset;
+    size_t l;
 
-    snprintf(buffer,sizeof(buffer),"%f",settings->audio_delay);
-	iniparser_setstring( ini, 	RESUME_VIDEO_SETTINGS_SECTION_KEY":"RESUME_AUDIO_DELAY_KEY, buffer );
+    for (;;){
+        offset = ftello(fp);
+        if (fgets(buffer, len, fp) == NULL)
+            return -1;
+        l = strlen(buffer);
+        while ((l > 0) && ((buffer[l - 1] == '\n') || (buffer[l - 1] == '\r'))){
+            buffer[--l] = 0;
+        }
+        if ((l > 0) && (buffer[0] != '#'))
+            return offset;
+    }
+}
 
-	fp = fopen( RESUME_FILENAME, "w+" );
-	if( fp == NULL ){
-		PRINTDF( "Unable to create resume file <%s>\n", RESUME_FILENAME );
-		ret = -1;
-		goto error;
-	}
+/** Look for an entry in a playlist starting from a given entry
+ *
+ * \param fp playlist
+ * \param path entry to look for
+ * \param from_offset offset of the first entry to test
+ * \param from_index index of the first entry to test
+ * \param offset [out] offset of the entry found
+ * \param index [out] index of the entry found
+ */
+static bool find_entry(FILE * fp, const char * path, off_t from_offset, int from_index,
+                       off_t * offset, int * index){
+    char buffer[PATH_MAX];
+    off_t entry_offset;
+
+    if (fseeko(fp, from_offset, SEEK_SET) != 0)
+        return false;
+    *index = from_index;
+    while ((entry_offset = read_entry(fp, buffer, sizeof(buffer))) >= 0){
+        if (strcmp(buffer, path) == 0){
+            *offset = entry_offset;
+            return true;
+        }
+        (*index)++;
+    }
+    return false;
+}
 
-	iniparser_dump_ini( ini, fp );
-	fclose( fp );
+/** Copy a file from a given offset (the destination is written through a temporary file) */
+static int copy_file(const char * src, off_t offset, const char * dst){
+    char tmp_filename[PATH_MAX];
+    char buffer[4096];
+    int in, out = -1;
+    ssize_t n;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", dst);
+    tmp_filename[sizeof(tmp_filename)-1] = 0;
+    in = open(src, O_RDONLY);
+    if (in < 0)
+        return -1;
+    if (lseek(in, offset, SEEK_SET) != offset)
+        goto error;
+    out = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0)
+        goto error;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0){
+        if (write(out, buffer, n) != n)
+            goto error;
+    }
+    if ((n < 0) || (fsync(out) != 0))
+        goto error;
+    close(in);
+    if ((close(out) != 0) || (rename(tmp_filename, dst) != 0)){
+        unlink(tmp_filename);
+        return -1;
+    }
+    return 0;
 
 error:
-	iniparser_freedict(ini);
-    return 0;
+    PRINTDF("Error while copying %s to %s\n", src, dst);
+    close(in);
+    if (out >= 0){
+        close(out);
+        unlink(tmp_filename);
+    }
+    return -1;
 }
 
+/** Set the current entry of the playlist (offset and index are relative to the full playlist)
+ * \note resume_mutex has to be held
+ */
+static void set_entry(enum eng_mode mode, const char * path, off_t offset, int index){
+    const char * sections[2] = {RESUME_SECTION_KEY_GET(mode), RESUME_SECTION_KEY};
+    char buffer[32];
+    int i;
 
-int resume_save_playslist(enum eng_mode mode, const char * current_filename){    
-  char buffer[PATH_MAX];
-  FILE * in_pl = NULL;
-  FILE * out_pl = NULL;
-  bool found = false;
+    snprintf(buffer, sizeof(buffer), "%lld", (long long)offset);
+    for (i = 0; i < 2; i++){
+        set_value(sections[i], RESUME_FILENAME_KEY, RESUME_FULL_PLAYLIST_FILENAME(mode));
+        set_value(sections[i], RESUME_TRACK_KEY, path);
+        set_value(sections[i], RESUME_OFFSET_KEY, buffer);
+        set_int_value(sections[i], RESUME_INDEX_KEY, index);
+    }
+}
 
-  in_pl = fopen(RESUME_VOLATILE_PLAYLIST, "r");
-  if (in_pl == NULL){
-    return -1;
-  }
-
-  while (fgets(buffer, PATH_MAX-1,in_pl) != NULL){
-    if (!found){
-      if (strstr(buffer, current_filename) != NULL){
-        out_pl = fopen(RESUME_PLAYLIST_FILENAME(mode),"w+");
-        if (out_pl == NULL){
-          break;
-        }
-        found = true;
-        fwrite(buffer, strlen(buffer),1, out_pl);
-      }
+/** Start a new playlist : the volatile playlist is saved as the full playlist of the mode
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_new_playlist(enum eng_mode mode){
+    if (copy_file(RESUME_VOLATILE_PLAYLIST, 0, RESUME_FULL_PLAYLIST_FILENAME(mode)) != 0)
+        return -1;
+    pthread_mutex_lock(&resume_mutex);
+    set_int_value(RESUME_SECTION_KEY_GET(mode), RESUME_BASE_OFFSET_KEY, 0);
+    set_int_value(RESUME_SECTION_KEY_GET(mode), RESUME_BASE_INDEX_KEY, 0);
+    write_file();
+    pthread_mutex_unlock(&resume_mutex);
+    return 0;
+}
+
+/** Prepare the volatile playlist to resume the last saved playlist
+ *
+ * The volatile playlist is the full playlist from the saved entry on. The saved entry is found
+ * at once with its offset, it is only looked for if the full playlist changed meanwhile.
+ *
+ * \param mode audio or video mode (MODE_UNKNOWN for the last resumed mode)
+ * \param pos [out] position in seconds in the saved entry
+ * \param is_video [out] true if the resumed playlist is a video one
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_start_playlist(enum eng_mode mode, int * pos, bool * is_video){
+    dictionary * ini;
+    char buffer[PATH_MAX];
+    char ini_path[100];
+    char * track;
+    char * s;
+    off_t offset = 0;
+    int index = 0;
+    FILE * fp;
+    int ret = -1;
+
+    *pos = 0;
+    pthread_mutex_lock(&resume_mutex);
+    ini = get_ini();
+    snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_FILENAME_KEY);
+    s = iniparser_getstring(ini, ini_path, NULL);
+    if (s == NULL){
+        PRINTDF( "Error while getting playlist in : %s \n ", RESUME_FILENAME);
+        goto out;
+    }
+    if (strcmp(s, RESUME_FULL_PLAYLIST_FILENAME(MODE_VIDEO)) == 0){
+        *is_video = true;
+    } else if (strcmp(s, RESUME_FULL_PLAYLIST_FILENAME(MODE_AUDIO)) == 0){
+        *is_video = false;
     } else {
-      fwrite(buffer, strlen(buffer),1, out_pl);
+        PRINTDF( "Unknown resume playlist : %s \n ", s);
+        goto out;
+    }
+    if (mode == MODE_UNKNOWN)
+        mode = (*is_video ? MODE_VIDEO : MODE_AUDIO);
+
+    snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_TRACK_KEY);
+    track = iniparser_getstring(ini, ini_path, NULL);
+    fp = fopen(RESUME_FULL_PLAYLIST_FILENAME(mode), "r");
+    if (fp == NULL)
+        goto out;
+    if (track != NULL){
+        snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_OFFSET_KEY);
+        s = iniparser_getstring(ini, ini_path, "0");
+        offset = strtoll(s, NULL, 10);
+        snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_INDEX_KEY);
+        index = iniparser_getint(ini, ini_path, 0);
+        /* Check that the saved entry is still at the same place */
+        if ((fseeko(fp, offset, SEEK_SET) != 0) ||
+            (read_entry(fp, buffer, sizeof(buffer)) != offset) ||
+            (strcmp(buffer, track) != 0)){
+            PRINTD("Playlist has changed since the resume data was saved\n");
+            if (!find_entry(fp, track, 0, 0, &offset, &index)){
+                offset = 0;
+                index = 0;
+                track = NULL;
+            }
+        }
     }
-  }
+    fclose(fp);
 
-  fclose(in_pl);
-  if (out_pl)
-    fclose(out_pl);
-  if (found){
-    return 0;
-  } else {
-    return -1;
-  }
+    if (copy_file(RESUME_FULL_PLAYLIST_FILENAME(mode), offset, RESUME_VOLATILE_PLAYLIST) != 0)
+        goto out;
+    if (track != NULL){
+        snprintf(ini_path, sizeof(ini_path), "%s:%s", RESUME_SECTION_KEY_GET(mode), RESUME_POS_KEY);
+        *pos = iniparser_getint(ini, ini_path, 0);
+    }
+    /* Engine offsets and indexes are relative to the volatile playlist */
+    set_int_value(RESUME_SECTION_KEY_GET(mode), RESUME_BASE_INDEX_KEY, index);
+    snprintf(buffer, sizeof(buffer), "%lld", (long long)offset);
+    set_value(RESUME_SECTION_KEY_GET(mode), RESUME_BASE_OFFSET_KEY, buffer);
+    write_file();
+    ret = 0;
+
+out:
+    pthread_mutex_unlock(&resume_mutex);
+    return ret;
+}
+
+/** Record the entry of the volatile playlist being played
+ *
+ * Entries are usually played in sequence : the entry is first looked for from the previous one.
+ *
+ * \param mode audio or video mode
+ * \param path entry being played
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_track_changed(enum eng_mode mode, const char * path){
+    off_t offset;
+    int index;
+    bool found;
+    FILE * fp;
+
+    fp = fopen(RESUME_VOLATILE_PLAYLIST, "r");
+    if (fp == NULL)
+        return -1;
+    pthread_mutex_lock(&resume_mutex);
+    found = find_entry(fp, path, cursor.offset, cursor.index, &offset, &index);
+    if (!found && (cursor.offset != 0)){
+        found = find_entry(fp, path, 0, 0, &offset, &index);
+    }
+    if (found){
+        cursor.offset = offset;
+        cursor.index = index;
+        set_entry(mode, path, cursor.base_offset + offset, cursor.base_index + index);
+    }
+    pthread_mutex_unlock(&resume_mutex);
+    fclose(fp);
+    return (found ? 0 : -1);
 }
 
-int resume_restore_playslist(enum eng_mode mode) {
-    char buffer[256];
-    int res ;
-    
-    res = snprintf(buffer, sizeof(buffer), "cp -f %s %s", RESUME_FULL_PLAYLIST_FILENAME(mode), RESUME_PLAYLIST_FILENAME(mode));
-    if ((res > 0) && (res < sizeof(buffer)))
-        return system(buffer);
-    return -1;        
+/** Rewind the saved playlist (end of playlist reached)
+ *
+ * \return 0  on success, -1 on failure
+ */
+int resume_rewind_playlist(enum eng_mode mode){
+    char buffer[PATH_MAX];
+    off_t offset;
+    FILE * fp;
+
+    fp = fopen(RESUME_FULL_PLAYLIST_FILENAME(mode), "r");
+    if (fp == NULL)
+        return -1;
+    offset = read_entry(fp, buffer, sizeof(buffer));
+    fclose(fp);
+    if (offset < 0)
+        return -1;
+    pthread_mutex_lock(&resume_mutex);
+    set_entry(mode, buffer, offset, 0);
+    pthread_mutex_unlock(&resume_mutex);
+    return resume_write_pos(mode, 0);
 }
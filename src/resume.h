@@ -34,7 +34,6 @@
 #define __TOMPLAYER_RESUME_H__
 #include "engine.h"
 
-#define RESUME_PLAYLIST_FILENAME(x) (x == MODE_AUDIO)?"./conf/sav_apl.m3u":"./conf/sav_vpl.m3u"
 #define RESUME_VOLATILE_PLAYLIST "/tmp/playlist.m3u"
 #define RESUME_FULL_PLAYLIST_FILENAME(x) (x == MODE_AUDIO)?"./conf/ori_apl.m3u":"./conf/ori_vpl.m3u"
 
@@ -59,9 +58,10 @@ struct audio_settings {
 
 
 int resume_file_init(enum eng_mode);
+int resume_flush(void);
+int resume_sync(void);
 
 int resume_write_pos(enum eng_mode mode, int value);
-int resume_get_file_infos(enum eng_mode mode, char * filename, int len , int * pos);
 
 int resume_get_general_settings(struct general_settings * settings);
 int resume_get_audio_settings(struct audio_settings * settings);
@@ -71,7 +71,9 @@ int resume_set_general_settings(const struct general_settings * settings);
 int resume_set_audio_settings(const struct audio_settings * settings);
 int resume_set_video_settings(const struct video_settings * settings);
 
-int resume_save_playslist(enum eng_mode mode, const char * current_filename);
-int resume_restore_playslist(enum eng_mode mode);
+int resume_new_playlist(enum eng_mode mode);
+int resume_start_playlist(enum eng_mode mode, int * pos, bool * is_video);
+int resume_track_changed(enum eng_mode mode, const char * path);
+int resume_rewind_playlist(enum eng_mode mode);
     
 #endif
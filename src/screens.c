@@ -47,6 +47,8 @@
 #include "viewmeter.h"
 #include "label.h"
 #include "diapo.h"
+#include "thumb.h"
+#include "res_cache.h"
 
 enum gui_screens_type {
   GUI_SCREEN_MAIN,
@@ -87,6 +89,9 @@ struct time_params{
 
 #define CFG_FOLDER "./conf"
 
+/* Number of videos before and after the selected one whose thumbnails are generated in advance */
+#define VIDEO_THUMB_NEIGHBOURS 2
+
 static const char * graphic_conf_files[GUI_SCREEN_MAX] = {"main.cfg",
                                                           "settings.cfg",
                                                           "skin_audio.cfg",
@@ -193,6 +198,10 @@ static void dispatch_fs_event(struct gui_control *ctrl, enum gui_event_type type
   if (evt)  {
     if (type == GUI_EVT_TS)
         fs_handle_click(fs, evt->ts.x , evt->ts.y );
+    else if (type == GUI_EVT_TS_MOVE)
+        fs_handle_motion(fs, evt->ts.x , evt->ts.y );
+    else if (type == GUI_EVT_TS_RELEASE)
+        fs_handle_release(fs, evt->ts.x , evt->ts.y );
     else {      
         fs_handle_key(fs, evt->key);
     }
@@ -204,62 +213,47 @@ static void dispatch_fs_event(struct gui_control *ctrl, enum gui_event_type type
 
 /** Display a message box */
 static gui_window message_box(const char *msg, int height, const DFBColor * color, const char * font_name){
-
-const char * text_win_tpl="\
-[general]\n\
-opacity=160\n\
-x=%i\n\
-y=%i\n\
-w=%i\n\
-h=%i\n\
-[control_00]\n\
-type=1\n\
-msg=%s\n\
-x=15\n\
-y=3\n\
-font_height=%i\n\
-font=%s\n\
-r=%i\n\
-g=%i\n\
-b=%i\n\
-a=%i\n\
-[control_01]\n\
-type=3\n\
-x=0\n\
-y=0\n\
-w=%i\n\
-h=%i\n\
-name=any_part\n\
-";
-
-  int fd, i, w;
-  char buffer[512];
-  DFBFontDescription desc;
+  struct gui_control_desc controls[2];
+  struct gui_window_desc wdesc;
   IDirectFBFont * font;	
   gui_window win;
+  int w;
 
-  desc.flags = DFDESC_HEIGHT;
-  desc.height = height;
-  if (dfb->CreateFont(dfb, font_name, &desc, &font ) != DFB_OK){
+  /* Same font as the label of the message box */
+  font = res_get_font(dfb, font_name, height, DTEID_UTF8);
+  if (font == NULL){
     return NULL;
   } 
   font->GetStringWidth (font, msg, -1, &w);
-  font->Release(font);
-  fd = open("/tmp/tmp.cfg", O_CREAT | O_WRONLY | O_TRUNC, S_IRWXU);
-  
-  if (fd >= 0) {
-    
-    i = snprintf(buffer, sizeof(buffer) -1, text_win_tpl, (screen_width-w-30)/2, (screen_height - height -10)/2,
-                                                           w+30, height+10,msg,height,font_name,
-                                                           color->r,color->g,color->b,color->a,
-                                                           w+30, height+10 );
-    if (i>= 0){
-      buffer[i] = '\0';
-      write(fd,buffer, i);
-      win = gui_window_load(dfb, layer, "/tmp/tmp.cfg");
-      gui_window_attach_cb(win, "any_part", quit_current_window);   
-    }
-    close(fd);
+  res_put_font(font);
+
+  memset(controls, 0, sizeof(controls));
+  controls[0].type = GUI_TYPE_CTRL_TEXT;
+  controls[0].zone.x = 15;
+  controls[0].zone.y = 3;
+  controls[0].zone.w = -1;
+  controls[0].zone.h = -1;
+  controls[0].msg = msg;
+  controls[0].font = font_name;
+  controls[0].font_height = height;
+  controls[0].color = *color;
+  controls[1].type = GUI_TYPE_CTRL_CLICKABLE_ZONE;
+  controls[1].name = "any_part";
+  controls[1].zone.w = w + 30;
+  controls[1].zone.h = height + 10;
+
+  memset(&wdesc, 0, sizeof(wdesc));
+  wdesc.zone.x = (screen_width - w - 30) / 2;
+  wdesc.zone.y = (screen_height - height - 10) / 2;
+  wdesc.zone.w = w + 30;
+  wdesc.zone.h = height + 10;
+  wdesc.color.a = 0xFF;
+  wdesc.opacity = 160;
+  wdesc.nb_controls = 2;
+  wdesc.controls = controls;
+  win = gui_window_create(dfb, layer, &wdesc);
+  if (win != NULL){
+    gui_window_attach_cb(win, "any_part", quit_current_window);   
   }
   return win;
 }
@@ -360,62 +354,44 @@ static void enter_about(struct gui_control *ctrl, enum gui_event_type type, unio
 
 /** Display an opaque preview window at pos from an image */
 static gui_window create_preview_window(const char * img_filename, const DFBRectangle * pos){
-const char * img_win_tpl="\
-[general]\n\
-opacity=255\n\
-x=%i\n\
-y=%i\n\
-w=%i\n\
-h=%i\n\
-detached=1\n\
-[control_00]\n\
-type=2\n\
-x=0\n\
-y=0\n\
-w=%i\n\
-h=%i\n\
-image=%s\n\
-";
-  gui_window win;
-  DFBSurfaceDescription idsc;
-  IDirectFBImageProvider *provider;
-  win = NULL;
+  struct gui_control_desc control;
+  struct gui_window_desc wdesc;
   DFBRectangle rect;
-  double iratio, sratio;
-  char buffer[512];
-  int fd, i;
-
-  if (dfb->CreateImageProvider (dfb,  img_filename, &provider) ==DFB_OK ) {
-    provider->GetSurfaceDescription (provider, &idsc);
-    iratio = idsc.width / idsc.height;
-    sratio = pos->w/pos->h;
-    if (iratio > sratio) {
-      rect.w = pos->w - 2 ;
-      rect.h = rect.w/iratio;
-      rect.x = 0 + 2  ;
-      rect.y = (pos->h - rect.h) / 2;
-    } else {
-      rect.h = pos->h;
-      rect.w = rect.h*iratio;
-      rect.y = 0;
-      rect.x = ( pos->w - rect.w) /2;
-    }
-    provider->Release (provider);
-  } else {
+  int w, h;
+
+  if (!gui_window_get_image_size(dfb, img_filename, &w, &h) || (w <= 0) || (h <= 0)){
     return NULL;
   }
-
-  fd = open("/tmp/tmp.cfg", O_CREAT | O_WRONLY | O_TRUNC, S_IRWXU);
-  if (fd >= 0){
-    i = snprintf(buffer, sizeof(buffer) -1, img_win_tpl,rect.x + pos->x, rect.y + pos->y ,rect.w,rect.h,rect.w,rect.h,img_filename);
-    if (i>= 0){
-      buffer[i] = '\0';
-      write(fd,buffer, i);
-      win = gui_window_load(dfb, layer, "/tmp/tmp.cfg");
-    }
-    close(fd);
+  /* Keep the aspect ratio of the image */
+  if (w * pos->h > h * pos->w) {
+    rect.w = pos->w - 2 ;
+    rect.h = rect.w * h / w;
+    rect.x = 0 + 2  ;
+    rect.y = (pos->h - rect.h) / 2;
+  } else {
+    rect.h = pos->h;
+    rect.w = rect.h * w / h;
+    rect.y = 0;
+    rect.x = ( pos->w - rect.w) /2;
   }
-  return win ;
+
+  memset(&control, 0, sizeof(control));
+  control.type = GUI_TYPE_CTRL_BUTTON;
+  control.zone.w = rect.w;
+  control.zone.h = rect.h;
+  control.image = img_filename;
+
+  memset(&wdesc, 0, sizeof(wdesc));
+  wdesc.zone.x = rect.x + pos->x;
+  wdesc.zone.y = rect.y + pos->y;
+  wdesc.zone.w = rect.w;
+  wdesc.zone.h = rect.h;
+  wdesc.color.a = 0xFF;
+  wdesc.opacity = 255;
+  wdesc.detached = true;
+  wdesc.nb_controls = 1;
+  wdesc.controls = &control;
+  return gui_window_create(dfb, layer, &wdesc);
 }
 
 
@@ -449,24 +425,39 @@ static void create_preview(fs_handle hdl,  enum  fs_events_type evt, const char
 }
 
 
+/** Called by the thumbnail worker : display the preview if the video is still selected */
+static void video_thumb_ready(const char * filename, void * param){
+  fs_refresh_preview(param, filename);
+}
+
 /** Callback of video file selector 
   * Handle movie preview
   */
 static void video_select_cb(fs_handle hdl, const char * c, enum  fs_events_type evt){
-  static const char * cmd_mplayer_thumbnail = "DIR=`pwd` && cd /tmp && rm -f 00000001.png && $DIR/mplayer -ao null -vo png:z=0 -ss 5 -frames 1 \"%s\" 2> /dev/null ";
-  int i ;
-  char buffer[256];
+  char neighbour[PATH_MAX];
+  IDirectFBSurface * s;
+  int i;
 
-  if (evt == FS_EVT_SELECT){
-      i = snprintf( buffer, sizeof(buffer)-1,cmd_mplayer_thumbnail, c );
-      if (i < 0){
-        return;
-      }
-      buffer[i] = '\0';
-      system(buffer) ;    
+  if (evt == FS_EVT_RELEASE){
+    thumb_release();
+    return;
+  }
+  s = fs_get_preview_surface(hdl);
+  if ((evt != FS_EVT_SELECT) || (s == NULL)){
+    return;
+  }
+  if (thumb_draw(c, s) == THUMB_PENDING){
+    thumb_request(c);
+  }
+  /* Generate in advance the thumbnails of the videos the user is likely to select next */
+  for (i = 1; i <= VIDEO_THUMB_NEIGHBOURS; i++){
+    if (fs_get_preview_neighbour(hdl, i, neighbour, sizeof(neighbour))){
+      thumb_prefetch(neighbour);
+    }
+    if (fs_get_preview_neighbour(hdl, -i, neighbour, sizeof(neighbour))){
+      thumb_prefetch(neighbour);
+    }
   }
-  create_preview(hdl, evt, "/tmp/00000001.png");
-
 }
 
 /** Callback that displays video selection screen */
@@ -487,8 +478,17 @@ static void select_video(struct gui_control *ctrl, enum gui_event_type type, uni
         fs_ctrl =  gui_window_get_control(win, "file_selector");
         if (fs_ctrl != NULL){
         const struct fs_config * conf;
+        IDirectFBSurface * preview;
+        DFBSurfacePixelFormat format;
+        int w, h;
 
         fs = fs_ctrl->obj;
+        preview = fs_get_preview_surface(fs);
+        if (preview != NULL){
+          preview->GetSize(preview, &w, &h);
+          preview->GetPixelFormat(preview, &format);
+          thumb_init(dfb, w, h, format, video_thumb_ready, fs);
+        }
         fs_set_select_cb(fs, video_select_cb);
         fs_new_path(fs, config_get_folder(CONFIG_VIDEO), config_get_ext(CONFIG_VIDEO));
         conf = fs_get_config(fs);
@@ -540,8 +540,9 @@ static bool update_skin( enum gui_screens_type type , const char * skin_filename
 /** Callback of skin preview */
 static void skin_select_cb(fs_handle hdl, const char * c, enum  fs_events_type evt){  
   if (evt == FS_EVT_SELECT){
-      skin_init(c, false);
-      skin_release();
+      skin_extract_background(c, ZIP_SKIN_BITMAP_FILENAME);
+      /* Same filename for every skin */
+      gui_window_forget_image(ZIP_SKIN_BITMAP_FILENAME);
   }
   create_preview(hdl, evt,  ZIP_SKIN_BITMAP_FILENAME);
 }
@@ -1306,11 +1307,7 @@ static void play_audio_video(struct gui_control *ctrl, enum gui_event_type type,
             DFBColor color = {255,255,50,50};
             message_box("No file selected !", 24, &color, "./res/font/decker.ttf");
         } else {
-            char buffer[256];
-            int res;
-            res = snprintf(buffer, sizeof(buffer), "cp -f %s %s", RESUME_VOLATILE_PLAYLIST, RESUME_FULL_PLAYLIST_FILENAME(ctrl->cb_param?MODE_VIDEO:MODE_AUDIO));
-            if ((res > 0) && (res < sizeof(buffer)))
-                system(buffer);
+            resume_new_playlist(ctrl->cb_param?MODE_VIDEO:MODE_AUDIO);
             setup_engine(RESUME_VOLATILE_PLAYLIST, 0, ctrl->cb_param);
             quit = true;
         }
@@ -1323,24 +1320,14 @@ static void play_audio_video(struct gui_control *ctrl, enum gui_event_type type,
 /** Callback on resume audio and video buttons */
 static void resume_audio_video(struct gui_control *ctrl, enum gui_event_type type, union gui_event* evt){
     int pos = 0;
-    struct stat ftype;
-    char filename[PATH_MAX - 32];    
-    char mv_command[PATH_MAX];  
     
     if (evt){
         bool is_video = ctrl->cb_param;
         gui_window_release(ctrl->win);
-        if (resume_get_file_infos(is_video?MODE_VIDEO:MODE_AUDIO, filename, PATH_MAX, &pos) != 0){
+        if (resume_start_playlist(is_video?MODE_VIDEO:MODE_AUDIO, &pos, &is_video) != 0){
             DFBColor color = {255,255,50,50};
             message_box("No resume data...", 24, &color, "./res/font/decker.ttf");    	
-            return;
-        }  
-        if( stat(filename, &ftype) != 0){
-            DFBColor color = {255,255,50,50};
-            message_box("Error no saved playlist...", 24, &color, "./res/font/decker.ttf");    
         }  else {
-            snprintf(mv_command, sizeof(mv_command), "mv %s " RESUME_VOLATILE_PLAYLIST, filename);
-            system(mv_command);	
             setup_engine(RESUME_VOLATILE_PLAYLIST, pos, is_video);  	
             quit = true;
         }
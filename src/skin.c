@@ -28,6 +28,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <zip.h>
 #include <math.h>
 #include <iniparser.h>
@@ -37,10 +42,26 @@
 #include "skin.h"
 
 #define SKIN_MAX 2
-#define CONF_FILENAME "/tmp/skin.conf"
 #define SKIN_CONFIG_NAME "skin.conf"
 #define WS_SKIN_CONFIG_NAME "ws_skin.conf"
 
+/* Precompiled skins : one file per skin archive */
+#define SKIN_CACHE_FMT     "./conf/skin_%08x.cache"
+#define SKIN_CACHE_MAGIC   "TPSC"
+#define SKIN_CACHE_VERSION 3
+/* Background + one bitmap per control */
+#define SKIN_CACHE_IMAGES  (MAX_SKIN_CONTROLS + 1)
+
+/* Max number of points of the hit map (one byte each) */
+#define SKIN_HIT_MAP_MAX   (1024 * 1024)
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
 /* Definition of section in the skin config file */
 #define SECTION_GENERAL             "general"
 #define SECTION_CONTROL_FMT_STR     "CONTROL_%d:%s"
@@ -85,8 +106,72 @@ struct skin_t{
     ILuint bitmap;                  /*!< DevIL background bitmap */
     int progress_bar_index;         /*!< index of progress bar object in controls table*/    
     ILuint bitmaps[MAX_SKIN_CONTROLS]; /*!< DevIL imgs associated to the controls */
+    struct stat archive_st;         /*!< Status of the skin archive when loaded */
+    char * archive;                 /*!< Skin archive filename (NULL if the skin cannot be cached) */
+    void * cache_map;               /*!< Mapping of the precompiled skin (NULL if loaded from archive) */
+    size_t cache_len;               /*!< Length of the mapping */
+    const void * fb_background;     /*!< Background in frame buffer format (in the mapping) */
+    size_t fb_background_len;       /*!< Length of the frame buffer background */
+    signed char * hit_map;          /*!< Control index of each point of the controls zone (-1 if none) */
+    int hit_x, hit_y;               /*!< Upper left corner of the hit map */
+    int hit_w, hit_h;               /*!< Size of the hit map */
+    int nav[MAX_SKIN_CONTROLS][SKIN_NAV_NB]; /*!< Neighbour of each control for keys navigation (-1 if none) */
+    int nav_first;                  /*!< First selectable control (-1 if none) */
 } ;
 
+#ifdef WITH_DEVIL
+/** Header of a precompiled skin file
+ *
+ * It is followed by :
+ *    \li the skin_config structure (pointers are meaningless)
+ *    \li the command to control index table and the progress bar index
+ *    \li an image descriptor for the background and each control
+ *    \li the frame descriptors
+ *    \li the bitmaps filenames (NUL terminated strings)
+ *    \li the background in frame buffer format
+ *    \li the RGBA pixels of every frame
+ * All offsets are relative to the beginning of the file.
+ */
+struct skin_cache_header{
+    char magic[4];
+    uint32_t version;
+    uint32_t config_size;        /**< sizeof(struct skin_config) when written */
+    char archive[256];           /**< Skin archive filename */
+    int64_t mtime;               /**< Modification time of the archive */
+    int64_t size;                /**< Size of the archive */
+    int32_t screen_width;
+    int32_t screen_height;
+    int32_t axes_inverted;
+    uint32_t nb_frames;          /**< Number of frames descriptors */
+    uint32_t fb_background_off;  /**< Offset of the frame buffer background (0 if none) */
+    uint32_t fb_background_len;
+    uint32_t total_size;         /**< Size of the whole file */
+};
+
+/** Precompiled image : a list of frames (several frames for animations) */
+struct skin_cache_image{
+    int32_t nb_frames;           /**< 0 if no image */
+    int32_t first_frame;         /**< Index of the first frame descriptor */
+    uint32_t filename_off;       /**< Offset of the bitmap filename (0 if none) */
+};
+
+/** Precompiled frame : RGBA pixels, upper left origin */
+struct skin_cache_frame{
+    int32_t width;
+    int32_t height;
+    int32_t duration;            /**< Display delay of an animation frame (ms) */
+    uint32_t pixels_off;
+};
+
+/** Layout of the fixed part following the header */
+struct skin_cache_tables{
+    struct skin_config config;
+    int32_t cmd2idx[SKIN_CMD_MAX_NB];
+    int32_t progress_bar_index;
+    struct skin_cache_image images[SKIN_CACHE_IMAGES];
+};
+#endif
+
 /* Current skin configuration */
 static struct skin_t skins[SKIN_MAX];
 static struct skin_t *current_skin;
@@ -111,39 +196,197 @@ static const char * cmd_labels[SKIN_CMD_MAX_NB] = { "EXIT      ",
                                                     "          "
                                                   };
                                                 
-static int control_compare(const struct skin_control *c1, const struct skin_control * c2){
-    struct skin_rectangular_shape zone1, zone2;
-    
-    zone1 = skin_ctrl_get_zone(c1);
-    zone2 = skin_ctrl_get_zone(c2);    
-    if ((zone1.y1  <= zone2.y2) &&
-        (zone2.y1  <= zone1.y2)){
-        /* If the two controls intersect horizontally the lefter is the lesser*/        
-        return (zone1.x1 - zone2.x1);
-    } else {
-        /* Otherwise the upper the lesser */
-        return (zone1.y1 - zone2.y1);        
+/** Can the control be selected with the keys navigation */
+static bool ctrl_is_selectable(const struct skin_control * ctrl){
+    if (ctrl->type >= SKIN_CONTROL_PROGRESS_X)
+        return false;
+    return ((ctrl->cmd >= SKIN_CMD_PAUSE) && (ctrl->cmd <= SKIN_CMD_PREVIOUS));
+}
+
+/** Is a point inside a control
+ *
+ * \note Bounds are excluded for rectangular controls
+ */
+static bool ctrl_contains(const struct skin_control * ctrl, int x, int y){
+    int dx, dy;
+
+    switch (ctrl->type){
+        case SKIN_CONTROL_CIRCULAR:
+            dx = x - ctrl->params.circ_icon.x;
+            dy = y - ctrl->params.circ_icon.y;
+            return ((dx * dx + dy * dy) < (ctrl->params.circ_icon.r * ctrl->params.circ_icon.r));
+        case SKIN_CONTROL_RECTANGULAR:
+        case SKIN_CONTROL_PROGRESS_X:
+        case SKIN_CONTROL_PROGRESS_Y:
+            return ((ctrl->params.rect_icon.x1 < x) && (ctrl->params.rect_icon.x2 > x) &&
+                    (ctrl->params.rect_icon.y1 < y) && (ctrl->params.rect_icon.y2 > y));
+        default:
+            return false;
+    }
+}
+
+/** Build the hit map of the current skin
+ *
+ * Each point of the zone covered by controls holds the index of the control it belongs to.
+ * Controls are painted in description order so that the last one wins when they overlap.
+ */
+static void build_hit_map(void){
+    const struct skin_config * conf = &current_skin->config;
+    struct skin_rectangular_shape zone, bbox;
+    signed char * map;
+    int i, x, y;
+    bool empty = true;
+
+    for (i = 0; i < conf->nb; i++){
+        if (conf->controls[i].type == SKIN_CONTROL_TEXT)
+            continue;
+        zone = skin_ctrl_get_zone(&conf->controls[i]);
+        if (empty){
+            bbox = zone;
+            empty = false;
+        } else {
+            if (zone.x1 < bbox.x1) bbox.x1 = zone.x1;
+            if (zone.y1 < bbox.y1) bbox.y1 = zone.y1;
+            if (zone.x2 > bbox.x2) bbox.x2 = zone.x2;
+            if (zone.y2 > bbox.y2) bbox.y2 = zone.y2;
+        }
+    }
+    if (empty)
+        return;
+    if (bbox.x1 < 0) bbox.x1 = 0;
+    if (bbox.y1 < 0) bbox.y1 = 0;
+    if ((bbox.x2 < bbox.x1) || (bbox.y2 < bbox.y1) ||
+        ((bbox.x2 - bbox.x1 + 1) * (bbox.y2 - bbox.y1 + 1) > SKIN_HIT_MAP_MAX))
+        return;
+    map = malloc((bbox.x2 - bbox.x1 + 1) * (bbox.y2 - bbox.y1 + 1));
+    if (map == NULL){
+        fprintf(stderr, "Allocation error\n");
+        return;
+    }
+    current_skin->hit_x = bbox.x1;
+    current_skin->hit_y = bbox.y1;
+    current_skin->hit_w = bbox.x2 - bbox.x1 + 1;
+    current_skin->hit_h = bbox.y2 - bbox.y1 + 1;
+    memset(map, -1, current_skin->hit_w * current_skin->hit_h);
+    for (i = 0; i < conf->nb; i++){
+        if (conf->controls[i].type == SKIN_CONTROL_TEXT)
+            continue;
+        zone = skin_ctrl_get_zone(&conf->controls[i]);
+        for (y = MAX(zone.y1, bbox.y1); y <= MIN(zone.y2, bbox.y2); y++){
+            for (x = MAX(zone.x1, bbox.x1); x <= MIN(zone.x2, bbox.x2); x++){
+                if (ctrl_contains(&conf->controls[i], x, y))
+                    map[(y - bbox.y1) * current_skin->hit_w + (x - bbox.x1)] = i;
+            }
+        }
+    }
+    current_skin->hit_map = map;
+}
+
+/* Zones of the controls used to compute the navigation order */
+static struct skin_rectangular_shape nav_zones[MAX_SKIN_CONTROLS];
+static int nav_rows[MAX_SKIN_CONTROLS];
+
+/** Order controls from top to bottom */
+static int nav_compare_y(const void * p1, const void * p2){
+    int i1 = *(const int *)p1, i2 = *(const int *)p2;
+
+    if (nav_zones[i1].y1 != nav_zones[i2].y1)
+        return nav_zones[i1].y1 - nav_zones[i2].y1;
+    if (nav_zones[i1].x1 != nav_zones[i2].x1)
+        return nav_zones[i1].x1 - nav_zones[i2].x1;
+    return i1 - i2;
+}
+
+/** Order controls in reading order : by row then from left to right */
+static int nav_compare_rows(const void * p1, const void * p2){
+    int i1 = *(const int *)p1, i2 = *(const int *)p2;
+
+    if (nav_rows[i1] != nav_rows[i2])
+        return nav_rows[i1] - nav_rows[i2];
+    if (nav_zones[i1].x1 != nav_zones[i2].x1)
+        return nav_zones[i1].x1 - nav_zones[i2].x1;
+    return i1 - i2;
+}
+
+/** Find the nearest selectable control in a vertical direction
+ *
+ * \param order selectable controls in navigation order
+ * \param nb number of selectable controls
+ * \param idx index of the control to start from
+ * \param dir -1 for up, +1 for down
+ *
+ * \return control index, -1 if there is none
+ */
+static int nav_vertical(const int * order, int nb, int idx, int dir){
+    int cx, cy, dx, dy;
+    int i, j, cost, best = -1, best_cost = 0;
+
+    cx = (nav_zones[idx].x1 + nav_zones[idx].x2) / 2;
+    cy = (nav_zones[idx].y1 + nav_zones[idx].y2) / 2;
+    for (i = 0; i < nb; i++){
+        j = order[i];
+        dx = (nav_zones[j].x1 + nav_zones[j].x2) / 2 - cx;
+        dy = ((nav_zones[j].y1 + nav_zones[j].y2) / 2 - cy) * dir;
+        if ((j == idx) || (dy <= 0))
+            continue;
+        /* Prefer controls in the same column */
+        cost = dy + 2 * abs(dx);
+        if ((best == -1) || (cost < best_cost)){
+            best = j;
+            best_cost = cost;
+        }
     }
+    return best;
 }
 
-static void control_sort(struct skin_control *array, int length)  { 
-    int i, j;  
-    struct skin_control temp;
-    int test; 
+/** Build the navigation graph of the current skin
+ *
+ * Left and right follow the reading order of the selectable controls
+ * (or their description order if the skin asks for it) and cycle.
+ * Up and down go to the nearest selectable control in that direction.
+ */
+static void build_nav_graph(void){
+    const struct skin_config * conf = &current_skin->config;
+    int order[MAX_SKIN_CONTROLS];
+    int i, nb = 0, row = 0, row_bottom = 0;
 
-    for(i = length - 1; i > 0; i--){  
-        test=0;  
-        for(j = 0; j < i; j++){            
-            if (control_compare(&array[j], &array[j+1]) > 0){
-                temp = array[j];   
-                array[j] = array[j+1];  
-                array[j+1] = temp;  
-                test=1;  
-            }  
+    for (i = 0; i < MAX_SKIN_CONTROLS; i++){
+        current_skin->nav[i][SKIN_NAV_LEFT] = -1;
+        current_skin->nav[i][SKIN_NAV_RIGHT] = -1;
+        current_skin->nav[i][SKIN_NAV_UP] = -1;
+        current_skin->nav[i][SKIN_NAV_DOWN] = -1;
+    }
+    current_skin->nav_first = -1;
+    for (i = 0; i < conf->nb; i++){
+        if (ctrl_is_selectable(&conf->controls[i])){
+            nav_zones[i] = skin_ctrl_get_zone(&conf->controls[i]);
+            order[nb++] = i;
         }
-        if(test==0) break; 
     }
-} 
+    if (nb == 0)
+        return;
+
+    if (!conf->selection_order){
+        /* Controls which intersect vertically are on the same row */
+        qsort(order, nb, sizeof(order[0]), nav_compare_y);
+        for (i = 0; i < nb; i++){
+            if ((i > 0) && (nav_zones[order[i]].y1 > row_bottom))
+                row++;
+            if ((i == 0) || (nav_zones[order[i]].y2 > row_bottom))
+                row_bottom = nav_zones[order[i]].y2;
+            nav_rows[order[i]] = row;
+        }
+        qsort(order, nb, sizeof(order[0]), nav_compare_rows);
+    }
+
+    current_skin->nav_first = order[0];
+    for (i = 0; i < nb; i++){
+        current_skin->nav[order[i]][SKIN_NAV_LEFT]  = order[(i + nb - 1) % nb];
+        current_skin->nav[order[i]][SKIN_NAV_RIGHT] = order[(i + 1) % nb];
+        current_skin->nav[order[i]][SKIN_NAV_UP]    = nav_vertical(order, nb, order[i], -1);
+        current_skin->nav[order[i]][SKIN_NAV_DOWN]  = nav_vertical(order, nb, order[i], +1);
+    }
+}
 
 static void resize_bitmaps(const struct skin_config * skin_conf){
 #ifdef WITH_DEVIL
@@ -213,42 +456,47 @@ static void resize_config(struct skin_config * conf) {
 	}
 }
 
-/** Unzip a file of an archive
+/** Decompress a file of an archive in memory
  *
  * \param fp_zip handle to the opened zip file
  * \param filename_in filename in the archive
- * \param filename_out unzipped file
+ * \param len [out] length of the decompressed data
  *
- * \return true on succes, false on failure
+ * \return a NUL terminated buffer to be freed by the caller, NULL on failure
  */
-static bool unzip_file( struct zip * fp_zip, char * filename_in, char * filename_out ){
+static char * unzip_to_buffer( struct zip * fp_zip, const char * filename_in, size_t * len ){
+	struct zip_stat st;
 	struct zip_file * fp_zip_file;
-	FILE * fp;
-	unsigned char data[1000];
-	int len;
-
-	fp = fopen( filename_out, "wb" );
-	if( fp == NULL ){
-	    fprintf( stderr, "Unable to create file <%s>\n" , filename_out );
-	    return false;
-	}
+	char * data;
+	size_t done = 0;
+	int n;
 
+	if( zip_stat( fp_zip, filename_in, 0, &st ) != 0 ){
+	    fprintf( stderr, "Unable to find <%s> in archive\n" , filename_in );
+	    return NULL;
+	}
+	data = malloc( st.size + 1 );
+	if( data == NULL ){
+	    return NULL;
+	}
 	fp_zip_file = zip_fopen( fp_zip, filename_in, 0 );
-
 	if( fp_zip_file == NULL ){
-	    fprintf( stderr, "Unable to find <%s> in archive\n" , filename_in );
-		fclose( fp );
-		return false;
+	    fprintf( stderr, "Unable to open <%s> in archive\n" , filename_in );
+	    free( data );
+	    return NULL;
+	}
+	while( (done < st.size) && ((n = zip_fread( fp_zip_file, data + done, st.size - done )) > 0) ){
+	    done += n;
 	}
-
-
-	while( (len = zip_fread( fp_zip_file, data, sizeof( data ) ) ) )
-		fwrite( data, sizeof( unsigned char ), len, fp );
-
 	zip_fclose( fp_zip_file );
-	fclose( fp );
-
-	return true;
+	if( done != st.size ){
+	    fprintf( stderr, "Truncated file <%s> in archive\n" , filename_in );
+	    free( data );
+	    return NULL;
+	}
+	data[done] = 0;
+	*len = done;
+	return data;
 }
 
 
@@ -269,12 +517,12 @@ static void reset_skin_conf (void){
 
 /** Load a skin configuration
  *
- * \param filename fullpath to the skin configuration file
- * \param conf skin configuration structure
+ * \param buffer content of the skin configuration file
+ * \param len length of the content
  *
  * \return true on succes, false on failure
  */
-static bool load_skin_config(char * filename){
+static bool load_skin_config(const char * buffer, size_t len){
     dictionary * ini ;
     int screen_width, screen_height;
     char section_control[512];
@@ -285,9 +533,9 @@ static bool load_skin_config(char * filename){
     
 
   
-    ini = iniparser_load(filename);
+    ini = iniparser_load_buffer(buffer, len);
     if (ini == NULL) {
-        PRINTDF( "Unable to load config file %s\n", filename);
+        PRINTD( "Unable to parse skin config\n");
         return false ;
     }
     i = iniparser_getint(ini, SECTION_GENERAL":"KEY_TEXT_COLOR, 0xFF0000);
@@ -397,11 +645,6 @@ static bool load_skin_config(char * filename){
         skin_conf->first_selection = -1;
     }
     
-    /* Sort the controls */
-    if (!skin_conf->selection_order){
-        control_sort(skin_conf->controls, skin_conf->nb); 
-    }
-    
     /* Fill in the indexes fields */
     for (i = 0; i < skin_conf->nb; i++){
         /* Special case of progress bar for now - FIXME : generic handling - */
@@ -446,18 +689,441 @@ bool skin_release(void){
         free(skin_conf->controls[i].bitmap_filename);
     }
     free(skin_conf->bitmap_filename);
+    free(current_skin->archive);
+    free(current_skin->hit_map);
+    if (current_skin->cache_map != NULL)
+        munmap(current_skin->cache_map, current_skin->cache_len);
     reset_skin_conf();
     
     return true;
 }
 
 
+#ifdef WITH_DEVIL
+/** Name of the precompiled skin file associated with a skin archive */
+static void cache_filename(const char * archive, char * filename, size_t len){
+    uint32_t hash = 2166136261U;
+
+    /* FNV-1a */
+    while (*archive){
+        hash ^= (unsigned char)*archive++;
+        hash *= 16777619U;
+    }
+    snprintf(filename, len, SKIN_CACHE_FMT, hash);
+}
+
+/** Fill the key part of a precompiled skin header */
+static void cache_fill_key(struct skin_cache_header * hdr, const char * archive, const struct stat * st){
+    int w, h;
+
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SKIN_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = SKIN_CACHE_VERSION;
+    hdr->config_size = sizeof(struct skin_config);
+    strncpy(hdr->archive, archive, sizeof(hdr->archive) - 1);
+    hdr->mtime = st->st_mtime;
+    hdr->size = st->st_size;
+    ws_get_size(&w, &h);
+    hdr->screen_width = w;
+    hdr->screen_height = h;
+    hdr->axes_inverted = ws_are_axes_inverted();
+}
+
+/** Check that a zone of the precompiled skin lies inside its mapping */
+static bool cache_check_zone(uint64_t off, uint64_t len){
+    return (off <= current_skin->cache_len) && (len <= current_skin->cache_len - off);
+}
+
+/** Check that a string of the precompiled skin is NUL terminated inside its mapping (0 means no string) */
+static bool cache_check_string(const char * map, uint32_t off){
+    if (off == 0)
+        return true;
+    return (off < current_skin->cache_len) &&
+           (memchr(map + off, 0, current_skin->cache_len - off) != NULL);
+}
+
+/** Check that the frames of a precompiled image lie inside the mapping */
+static bool cache_check_image(const char * map, const struct skin_cache_header * hdr,
+                              const struct skin_cache_image * desc){
+    const struct skin_cache_frame * frames;
+    int i;
+
+    if (!cache_check_string(map, desc->filename_off))
+        return false;
+    if ((desc->nb_frames < 0) || (desc->first_frame < 0) ||
+        ((uint64_t)desc->first_frame + desc->nb_frames > hdr->nb_frames))
+        return false;
+    frames = (const struct skin_cache_frame *)(map + sizeof(struct skin_cache_header) + sizeof(struct skin_cache_tables));
+    frames += desc->first_frame;
+    for (i = 0; i < desc->nb_frames; i++){
+        if ((frames[i].width <= 0) || (frames[i].height <= 0) ||
+            !cache_check_zone(frames[i].pixels_off, (uint64_t)frames[i].width * frames[i].height * 4))
+            return false;
+    }
+    return true;
+}
+
+/** Create a DevIL image from precompiled frames
+ *
+ * \return the DevIL image, 0 on failure
+ */
+static ILuint cache_make_image(const char * map, const struct skin_cache_image * desc){
+    const struct skin_cache_frame * frames;
+    ILuint img;
+    int i;
+
+    frames = (const struct skin_cache_frame *)(map + sizeof(struct skin_cache_header) + sizeof(struct skin_cache_tables));
+    frames += desc->first_frame;
+    ilGenImages(1, &img);
+    ilBindImage(img);
+    for (i = 0; i < desc->nb_frames; i++){
+        if (i > 0){
+            /* Chain a new frame after the current one and make it active */
+            if ((ilCreateSubImage(IL_SUB_NEXT, 1) == 0) || !ilActiveImage(1))
+                goto error;
+        }
+        if (!ilTexImage(frames[i].width, frames[i].height, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE,
+                        (void *)(map + frames[i].pixels_off)))
+            goto error;
+        /* Pixels have been saved with an upper left origin : no need to flip them */
+        ilRegisterOrigin(IL_ORIGIN_UPPER_LEFT);
+        ilSetInteger(IL_IMAGE_DURATION, frames[i].duration);
+    }
+    ilBindImage(img);
+    return img;
+
+error:
+    ilDeleteImages(1, &img);
+    return 0;
+}
+
+/** Load a precompiled skin
+ *
+ * \param archive skin archive filename
+ * \param st status of the skin archive
+ *
+ * \return true on success, false if there is no valid precompiled skin
+ */
+static bool cache_load(const char * archive, const struct stat * st){
+    char filename[64];
+    struct skin_cache_header key;
+    const struct skin_cache_header * hdr;
+    const struct skin_cache_tables * tables;
+    const struct skin_cache_image * images;
+    struct stat cache_st;
+    struct skin_config * skin_conf = &current_skin->config;
+    const char * map;
+    int fd;
+    int i;
+
+    cache_filename(archive, filename, sizeof(filename));
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if ((fstat(fd, &cache_st) != 0) ||
+        (cache_st.st_size < (off_t)(sizeof(*hdr) + sizeof(*tables)))){
+        close(fd);
+        return false;
+    }
+    map = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    current_skin->cache_map = (void *)map;
+    current_skin->cache_len = cache_st.st_size;
+
+    /* The key fields are compared as a whole */
+    hdr = (const struct skin_cache_header *)map;
+    cache_fill_key(&key, archive, st);
+    if ((memcmp(hdr, &key, offsetof(struct skin_cache_header, nb_frames)) != 0) ||
+        (hdr->total_size != cache_st.st_size)){
+        log_write(LOG_INFO, "Precompiled skin %s is out of date\n", filename);
+        goto error;
+    }
+    tables = (const struct skin_cache_tables *)(map + sizeof(*hdr));
+    images = tables->images;
+
+    /* A corrupted file must not make us read outside of the mapping */
+    if (!cache_check_zone(sizeof(*hdr) + sizeof(*tables), (uint64_t)hdr->nb_frames * sizeof(struct skin_cache_frame)) ||
+        ((hdr->fb_background_off != 0) && !cache_check_zone(hdr->fb_background_off, hdr->fb_background_len)) ||
+        (tables->config.nb < 0) || (tables->config.nb > MAX_SKIN_CONTROLS) ||
+        (tables->progress_bar_index < -1) || (tables->progress_bar_index >= tables->config.nb))
+        goto corrupted;
+    for (i = 0; i < SKIN_CMD_MAX_NB; i++){
+        if ((tables->cmd2idx[i] < -1) || (tables->cmd2idx[i] >= tables->config.nb))
+            goto corrupted;
+    }
+    for (i = 0; i <= tables->config.nb; i++){
+        if (!cache_check_image(map, hdr, &images[i]))
+            goto corrupted;
+        if ((i < tables->config.nb) &&
+            (((unsigned int)tables->config.controls[i].cmd >= SKIN_CMD_MAX_NB)))
+            goto corrupted;
+    }
+
+    *skin_conf = tables->config;
+    skin_conf->bitmap_filename = NULL;
+    for (i = 0; i < MAX_SKIN_CONTROLS; i++){
+        skin_conf->controls[i].bitmap_filename = NULL;
+    }
+    for (i = 0; i < SKIN_CMD_MAX_NB; i++){
+        current_skin->cmd2idx[i] = tables->cmd2idx[i];
+    }
+    current_skin->progress_bar_index = tables->progress_bar_index;
+
+    if (images[0].filename_off != 0)
+        skin_conf->bitmap_filename = strdup(map + images[0].filename_off);
+    current_skin->bitmap = cache_make_image(map, &images[0]);
+    if (current_skin->bitmap == 0)
+        goto error;
+    for (i = 0; i < skin_conf->nb; i++){
+        if (images[i + 1].filename_off != 0)
+            skin_conf->controls[i].bitmap_filename = strdup(map + images[i + 1].filename_off);
+        if (images[i + 1].nb_frames > 0){
+            current_skin->bitmaps[i] = cache_make_image(map, &images[i + 1]);
+            if (current_skin->bitmaps[i] == 0)
+                goto error;
+        }
+    }
+    if (hdr->fb_background_off != 0){
+        current_skin->fb_background = map + hdr->fb_background_off;
+        current_skin->fb_background_len = hdr->fb_background_len;
+    }
+    log_write(LOG_INFO, "Skin loaded from %s\n", filename);
+    return true;
+
+corrupted:
+    log_write(LOG_WARNING, "Precompiled skin %s is corrupted\n", filename);
+error:
+    /* Release whatever has been loaded and restart from the archive */
+    skin_release();
+    return false;
+}
+
+/** Describe the frames of an image to be precompiled */
+static void cache_describe_image(ILuint img, const char * bitmap_filename, struct skin_cache_image * desc,
+                                 struct skin_cache_frame * frames, uint32_t * nb_frames,
+                                 uint32_t * strings_off){
+    struct skin_cache_frame * frame;
+    int nb, i;
+
+    desc->nb_frames = 0;
+    desc->first_frame = *nb_frames;
+    desc->filename_off = 0;
+    if (bitmap_filename != NULL){
+        desc->filename_off = *strings_off;
+        *strings_off += strlen(bitmap_filename) + 1;
+    }
+    if (img == 0)
+        return;
+    ilBindImage(img);
+    /* IL_NUM_IMAGES does not count the parent image */
+    nb = ilGetInteger(IL_NUM_IMAGES) + 1;
+    for (i = 0; i < nb; i++){
+        ilBindImage(img);
+        ilActiveImage(i);
+        frame = &frames[*nb_frames];
+        frame->width = ilGetInteger(IL_IMAGE_WIDTH);
+        frame->height = ilGetInteger(IL_IMAGE_HEIGHT);
+        frame->duration = ilGetInteger(IL_IMAGE_DURATION);
+        (*nb_frames)++;
+        desc->nb_frames++;
+    }
+    ilBindImage(img);
+}
+
+/** Write the RGBA pixels of every frame of an image */
+static bool cache_write_pixels(FILE * fp, ILuint img, const struct skin_cache_image * desc,
+                               const struct skin_cache_frame * frames){
+    unsigned char * buffer;
+    const struct skin_cache_frame * frame;
+    size_t len;
+    int i;
+
+    for (i = 0; i < desc->nb_frames; i++){
+        frame = &frames[desc->first_frame + i];
+        len = frame->width * frame->height * 4;
+        buffer = malloc(len);
+        if (buffer == NULL)
+            return false;
+        ilBindImage(img);
+        ilActiveImage(i);
+        ilCopyPixels(0, 0, 0, frame->width, frame->height, 1, IL_RGBA, IL_UNSIGNED_BYTE, buffer);
+        if ((fseek(fp, frame->pixels_off, SEEK_SET) != 0) ||
+            (fwrite(buffer, 1, len, fp) != len)){
+            free(buffer);
+            return false;
+        }
+        free(buffer);
+    }
+    ilBindImage(img);
+    return true;
+}
+
+/** Save the current skin as a precompiled skin
+ *
+ * Config is saved once resized and bitmaps once scaled and converted in RGBA,
+ * so that next engine launches do not have to decode anything.
+ *
+ * \param fb_background Background already converted in the frame buffer format (NULL if none)
+ * \param fb_background_len Length of the frame buffer background
+ *
+ * \return true on success (or if there is nothing to save), false on failure
+ */
+bool skin_cache_save(const void * fb_background, size_t fb_background_len){
+    char filename[64];
+    char tmp_filename[80];
+    struct skin_cache_header hdr;
+    struct skin_cache_tables * tables;
+    struct skin_cache_frame * frames;
+    const struct skin_config * skin_conf = &current_skin->config;
+    uint32_t nb_frames = 0, max_frames = 0;
+    uint32_t strings_off, pixels_off;
+    ILuint imgs[SKIN_CACHE_IMAGES];
+    const char * names[SKIN_CACHE_IMAGES];
+    FILE * fp = NULL;
+    bool ret = false;
+    int i;
+
+    if ((current_skin->cache_map != NULL) || (current_skin->archive == NULL))
+        return true;
+
+    imgs[0] = current_skin->bitmap;
+    names[0] = skin_conf->bitmap_filename;
+    for (i = 0; i < MAX_SKIN_CONTROLS; i++){
+        imgs[i + 1] = (i < skin_conf->nb) ? current_skin->bitmaps[i] : 0;
+        names[i + 1] = (i < skin_conf->nb) ? skin_conf->controls[i].bitmap_filename : NULL;
+    }
+    for (i = 0; i < SKIN_CACHE_IMAGES; i++){
+        if (imgs[i] != 0){
+            ilBindImage(imgs[i]);
+            max_frames += ilGetInteger(IL_NUM_IMAGES) + 1;
+        }
+    }
+    tables = calloc(1, sizeof(*tables));
+    frames = calloc(max_frames + 1, sizeof(*frames));
+    if ((tables == NULL) || (frames == NULL))
+        goto error;
+
+    /* Compute the layout of the file */
+    cache_fill_key(&hdr, current_skin->archive, &current_skin->archive_st);
+    strings_off = sizeof(hdr) + sizeof(*tables) + max_frames * sizeof(*frames);
+    for (i = 0; i < SKIN_CACHE_IMAGES; i++){
+        cache_describe_image(imgs[i], names[i], &tables->images[i], frames, &nb_frames, &strings_off);
+    }
+    hdr.nb_frames = nb_frames;
+    pixels_off = (strings_off + 3) & ~3;
+    if (fb_background != NULL){
+        hdr.fb_background_off = pixels_off;
+        hdr.fb_background_len = fb_background_len;
+        pixels_off = (pixels_off + fb_background_len + 3) & ~3;
+    }
+    for (i = 0; i < (int)nb_frames; i++){
+        frames[i].pixels_off = pixels_off;
+        pixels_off += frames[i].width * frames[i].height * 4;
+    }
+    hdr.total_size = pixels_off;
+
+    tables->config = *skin_conf;
+    for (i = 0; i < SKIN_CMD_MAX_NB; i++){
+        tables->cmd2idx[i] = current_skin->cmd2idx[i];
+    }
+    tables->progress_bar_index = current_skin->progress_bar_index;
+
+    /* Write a temporary file and rename it so that a precompiled skin is always complete */
+    cache_filename(current_skin->archive, filename, sizeof(filename));
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    fp = fopen(tmp_filename, "wb");
+    if (fp == NULL){
+        log_write(LOG_ERROR, "Unable to create %s\n", tmp_filename);
+        goto error;
+    }
+    if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+        (fwrite(tables, sizeof(*tables), 1, fp) != 1) ||
+        (fwrite(frames, sizeof(*frames), max_frames, fp) != max_frames))
+        goto error;
+    for (i = 0; i < SKIN_CACHE_IMAGES; i++){
+        if ((names[i] != NULL) &&
+            ((fseek(fp, tables->images[i].filename_off, SEEK_SET) != 0) ||
+             (fwrite(names[i], strlen(names[i]) + 1, 1, fp) != 1)))
+            goto error;
+    }
+    if ((fb_background != NULL) &&
+        ((fseek(fp, hdr.fb_background_off, SEEK_SET) != 0) ||
+         (fwrite(fb_background, fb_background_len, 1, fp) != 1)))
+        goto error;
+    for (i = 0; i < SKIN_CACHE_IMAGES; i++){
+        if (!cache_write_pixels(fp, imgs[i], &tables->images[i], frames))
+            goto error;
+    }
+    /* Make sure the file has its full size even if the last frame is empty */
+    if ((fflush(fp) != 0) || (ftruncate(fileno(fp), hdr.total_size) != 0) ||
+        (fsync(fileno(fp)) != 0))
+        goto error;
+    if (fclose(fp) != 0){
+        fp = NULL;
+        goto error;
+    }
+    fp = NULL;
+    if (rename(tmp_filename, filename) != 0)
+        goto error;
+    log_write(LOG_INFO, "Skin precompiled in %s (%u bytes)\n", filename, hdr.total_size);
+    ret = true;
+
+error:
+    if (fp != NULL){
+        fclose(fp);
+    }
+    if (!ret){
+        log_write(LOG_ERROR, "Unable to precompile skin %s\n", current_skin->archive);
+        unlink(tmp_filename);
+    }
+    free(frames);
+    free(tables);
+    return ret;
+}
+#endif
+
+/** Get the skin background already converted in the frame buffer format
+ *
+ * \param len [out] length of the background
+ *
+ * \return the background, NULL if the skin has not been loaded from a precompiled skin
+ */
+const void * skin_get_fb_background(size_t * len){
+    *len = current_skin->fb_background_len;
+    return current_skin->fb_background;
+}
+
+/** Load a skin bitmap straight from the archive
+ *
+ * \param fp_zip handle to the opened zip file
+ * \param filename_in filename in the archive
+ * \param bitmap_obj DevIL bitmap object
+ *
+ * \return true on succes, false on failure
+ */
+static bool load_zip_bitmap( struct zip * fp_zip, const char * filename_in, ILuint * bitmap_obj ){
+  char * data;
+  size_t len;
+  bool ret;
+
+  data = unzip_to_buffer( fp_zip, filename_in, &len );
+  if( data == NULL ){
+    return false;
+  }
+  ret = skin_load_bitmap_from_buffer( bitmap_obj, data, len );
+  free( data );
+  return ret;
+}
+
 /** Initialize skin object from a zip skin file 
  *
  * \param filename      fullpath to the archive filename
  * \param load_bitmaps  Have bitmaps filename to be loaded as devil image 
  *
  * \return true on succes, false on failure
+ * \note Nothing is extracted on disk : config and bitmaps are decompressed in memory
  */
 bool skin_init(const char * filename, bool load_bitmaps ){
   int ws;
@@ -466,7 +1132,8 @@ bool skin_init(const char * filename, bool load_bitmaps ){
   struct zip * fp_zip;
   int return_code = false;
   int i;
-  char cmd[200];
+  char * conf = NULL;
+  size_t conf_len;
   struct skin_config * skin_conf;
   
   error = 0;
@@ -476,8 +1143,20 @@ bool skin_init(const char * filename, bool load_bitmaps ){
   ws = ws_probe();
   reset_skin_conf();  
   
-  /* Remove any residual bitmap temp file */
-  unlink( ZIP_SKIN_BITMAP_FILENAME );
+#ifdef WITH_DEVIL
+  if (load_bitmaps){
+    struct stat st;
+    /* Use the precompiled skin if it is up to date */
+    if (stat(filename, &st) == 0){
+      if (cache_load(filename, &st)){
+        build_hit_map();
+        build_nav_graph();
+        return true;
+      }
+      current_skin->archive_st = st;
+    }
+  }
+#endif
   fp_zip = zip_open( filename, ZIP_CHECKCONS, &error );
 
   if( error != 0 || fp_zip == NULL ){
@@ -487,9 +1166,11 @@ bool skin_init(const char * filename, bool load_bitmaps ){
 
   /* Loading of config file */
   if( ws ){
-    if( unzip_file( fp_zip, WS_SKIN_CONFIG_NAME, CONF_FILENAME ) == false ){
+    conf = unzip_to_buffer( fp_zip, WS_SKIN_CONFIG_NAME, &conf_len );
+    if( conf == NULL ){
       log_write(LOG_ERROR, "No widescreen config in zip file <%s>", filename );
-      if( unzip_file( fp_zip, SKIN_CONFIG_NAME, CONF_FILENAME ) == false ){
+      conf = unzip_to_buffer( fp_zip, SKIN_CONFIG_NAME, &conf_len );
+      if( conf == NULL ){
         log_write(LOG_ERROR, "Error while unzipping <%s>", SKIN_CONFIG_NAME );
         goto error;
       }
@@ -497,40 +1178,37 @@ bool skin_init(const char * filename, bool load_bitmaps ){
     }
   }
   else{
-    if (unzip_file(fp_zip, SKIN_CONFIG_NAME, CONF_FILENAME ) == false) {
+    conf = unzip_to_buffer( fp_zip, SKIN_CONFIG_NAME, &conf_len );
+    if (conf == NULL) {
       log_write(LOG_WARNING, "No small screen config in zip file <%s>", filename);
-      if (unzip_file(fp_zip, WS_SKIN_CONFIG_NAME, CONF_FILENAME ) == false) {
+      conf = unzip_to_buffer( fp_zip, WS_SKIN_CONFIG_NAME, &conf_len );
+      if (conf == NULL) {
         log_write(LOG_ERROR,"Error while unzipping <%s>\n", SKIN_CONFIG_NAME);        
         goto error;
       }
       resize_conf = true;
     }
   }
-  sprintf( cmd, "dos2unix %s", CONF_FILENAME );
-  system( cmd );
   
-  if (load_skin_config(CONF_FILENAME) == false) {
-    fprintf( stderr, "Error while loading config file <%s>\n", CONF_FILENAME );
+  if (load_skin_config(conf, conf_len) == false) {
+    fprintf( stderr, "Error while loading config of <%s>\n", filename );
     goto error;
   }
 
   if (resize_conf == true) resize_config(skin_conf);
   
-        if( unzip_file( fp_zip, skin_conf->bitmap_filename, ZIP_SKIN_BITMAP_FILENAME ) == false ){
-                fprintf( stderr, "Error while unzipping <%s>\n", skin_conf->bitmap_filename );
-                goto error;
-        }
-
         if (load_bitmaps){  
           /* Loading of different bitmap of the skin */
-          skin_load_bitmap(&current_skin->bitmap, ZIP_SKIN_BITMAP_FILENAME);
+          if (load_zip_bitmap(fp_zip, skin_conf->bitmap_filename, &current_skin->bitmap) == false){
+                  fprintf( stderr, "Error while loading <%s>\n", skin_conf->bitmap_filename );
+                  goto error;
+          }
           for( i = 0; i < skin_conf->nb; i++ ){
               if(skin_conf->controls[i].bitmap_filename != NULL){
-                  if (unzip_file(fp_zip, skin_conf->controls[i].bitmap_filename, ZIP_SKIN_BITMAP_FILENAME) == false){
-                          fprintf(stderr, "Error while unzipping <%s>\n", skin_conf->controls[i].bitmap_filename);
+                  if (load_zip_bitmap(fp_zip, skin_conf->controls[i].bitmap_filename, &current_skin->bitmaps[i]) == false){
+                          fprintf(stderr, "Error while loading <%s>\n", skin_conf->controls[i].bitmap_filename);
                           goto error;
                   }
-                  skin_load_bitmap(&current_skin->bitmaps[i], ZIP_SKIN_BITMAP_FILENAME);
                   PRINTDF("Loading %s - Image id :%i\n",skin_conf->controls[i].bitmap_filename, current_skin->bitmaps[i]);
               } else{
                   current_skin->bitmaps[i] = 0;
@@ -541,12 +1219,19 @@ bool skin_init(const char * filename, bool load_bitmaps ){
           }
         }
 
+  build_hit_map();
+  build_nav_graph();
+
+#ifdef WITH_DEVIL
+        /* Skin can be precompiled by skin_cache_save() */
+        if (load_bitmaps && (current_skin->archive_st.st_mtime != 0)){
+          current_skin->archive = strdup(filename);
+        }
+#endif
   return_code = true;
 
 error:
-    unlink( CONF_FILENAME );
-    /* let the bitmap file to be able to use it after this call 
-    unlink( ZIP_SKIN_BITMAP_FILENAME );*/
+    free( conf );
     zip_close( fp_zip );
     if (!return_code){
         skin_release(); 
@@ -554,6 +1239,52 @@ error:
     return return_code;
 }
 
+/** Extract the background bitmap of a skin to a file
+ *
+ * \param filename      fullpath to the archive filename
+ * \param filename_out  file to be written with the background bitmap
+ *
+ * \return true on succes, false on failure
+ * \note Used for skin previews by GUI which does not load bitmaps from memory 
+ */
+bool skin_extract_background(const char * filename, const char * filename_out){
+  struct zip * fp_zip;
+  int error = 0;
+  char * data = NULL;
+  size_t len;
+  FILE * fp;
+  bool ret = false;
+
+  unlink( filename_out );
+  if (skin_init(filename, false) == false){
+    return false;
+  }
+  fp_zip = zip_open( filename, 0, &error );
+  if( error != 0 || fp_zip == NULL ){
+    log_write(LOG_ERROR, "Unable to load zip file <%s> (%d)\n" , filename, error );
+    goto error;
+  }
+  data = unzip_to_buffer( fp_zip, current_skin->config.bitmap_filename, &len );
+  zip_close( fp_zip );
+  if (data == NULL){
+    goto error;
+  }
+  fp = fopen( filename_out, "wb" );
+  if( fp == NULL ){
+    fprintf( stderr, "Unable to create file <%s>\n" , filename_out );
+    goto error;
+  }
+  ret = (fwrite( data, 1, len, fp ) == len);
+  if (fclose( fp ) != 0){
+    ret = false;
+  }
+
+error:
+  free( data );
+  skin_release();
+  return ret;
+}
+
 const char * skin_cmd_2_txt(enum skin_cmd cmd){
     return cmd_labels[cmd];
 }
@@ -609,48 +1340,91 @@ const struct skin_control *skin_get_pb(void){
 }
 
 enum skin_cmd skin_get_cmd_from_xy(int x, int y, int * p){
-    enum skin_cmd cmd;
-    int i, distance;
     const struct skin_config * c = &current_skin->config;
+    const struct skin_control * ctrl;
+    int i, idx = -1;
 
     *p = -1;
-   
-    /* Init cmd !! */
-    cmd = SKIN_CMD_EXIT_MENU;
-    for( i = 0; i < c->nb; i++ ){
-        switch( c->controls[i].type ){
-            case SKIN_CONTROL_CIRCULAR:
-                distance = sqrt( (x - c->controls[i].params.circ_icon.x ) * (x - c->controls[i].params.circ_icon.x ) + (y - c->controls[i].params.circ_icon.y ) * (y - c->controls[i].params.circ_icon.y ) );
-                if( distance < c->controls[i].params.circ_icon.r ) cmd = c->controls[i].cmd;
-                break;
-            case SKIN_CONTROL_RECTANGULAR:
-                if( c->controls[i].params.rect_icon.x1 < x && c->controls[i].params.rect_icon.x2 > x && c->controls[i].params.rect_icon.y1 < y && c->controls[i].params.rect_icon.y2 > y )
-                    cmd = c->controls[i].cmd;
-                break;
-            case SKIN_CONTROL_PROGRESS_X:
-                if( c->controls[i].params.rect_icon.x1 < x && c->controls[i].params.rect_icon.x2 > x && c->controls[i].params.rect_icon.y1 < y && c->controls[i].params.rect_icon.y2 > y ){
-                    *p = ( 100 * ( x - c->controls[i].params.rect_icon.x1 ) )/( c->controls[i].params.rect_icon.x2 - c->controls[i].params.rect_icon.x1 );
-                    if( *p >=100 ) *p=99;
-                    cmd = c->controls[i].cmd;   
-                }
-                break;
-            case SKIN_CONTROL_PROGRESS_Y:
-                if( c->controls[i].params.rect_icon.x1 < x && c->controls[i].params.rect_icon.x2 > x && c->controls[i].params.rect_icon.y1 < y && c->controls[i].params.rect_icon.y2 > y ){
-                    *p = ( 100 * ( y - c->controls[i].params.rect_icon.y1 ) )/( c->controls[i].params.rect_icon.y2 - c->controls[i].params.rect_icon.y1 );
-                    if( *p >=100 ) *p=99;
-                    cmd = c->controls[i].cmd;                    
-                }
-                break;
-            case SKIN_CONTROL_TEXT:
-                break;
-            default:                    
-                break;
+    if (current_skin->hit_map != NULL){
+        if ((x >= current_skin->hit_x) && (x < current_skin->hit_x + current_skin->hit_w) &&
+            (y >= current_skin->hit_y) && (y < current_skin->hit_y + current_skin->hit_h)){
+            idx = current_skin->hit_map[(y - current_skin->hit_y) * current_skin->hit_w + (x - current_skin->hit_x)];
+        }
+    } else {
+        /* No hit map (too big) : the last matching control wins */
+        for (i = 0; i < c->nb; i++){
+            if (ctrl_contains(&c->controls[i], x, y))
+                idx = i;
         }
     }
+    if (idx < 0)
+        return SKIN_CMD_EXIT_MENU;
+
+    ctrl = &c->controls[idx];
+    switch (ctrl->type){
+        case SKIN_CONTROL_PROGRESS_X:
+            *p = ( 100 * ( x - ctrl->params.rect_icon.x1 ) )/( ctrl->params.rect_icon.x2 - ctrl->params.rect_icon.x1 );
+            if( *p >=100 ) *p=99;
+            break;
+        case SKIN_CONTROL_PROGRESS_Y:
+            *p = ( 100 * ( y - ctrl->params.rect_icon.y1 ) )/( ctrl->params.rect_icon.y2 - ctrl->params.rect_icon.y1 );
+            if( *p >=100 ) *p=99;
+            break;
+        default:
+            break;
+    }
+    return ctrl->cmd;
+}
 
-    return cmd;
+/** Get the neighbour of a control for keys navigation
+ *
+ * \param idx index of the current control (-1 if none)
+ * \param dir direction of the move
+ *
+ * \return index of the control to select, -1 if there is none
+ */
+int skin_get_neighbour(int idx, enum skin_nav_dir dir){
+    if ((idx < 0) || (idx >= current_skin->config.nb) ||
+        !ctrl_is_selectable(&current_skin->config.controls[idx]))
+        return current_skin->nav_first;
+    return current_skin->nav[idx][dir];
 }
 
+/** Get the control to be selected first with the keys navigation
+ *
+ * \return control index, -1 if there is no selectable control
+ */
+int skin_get_first_selection(void){
+    const struct skin_config * c = &current_skin->config;
+
+    if ((c->first_selection >= 0) && (c->first_selection < c->nb))
+        return c->first_selection;
+    return current_skin->nav_first;
+}
+
+#ifdef WITH_DEVIL
+/** Check the size of the current DevIL image and convert it to RGBA
+ *
+ * \param bitmap_obj DevIL bitmap object
+ *
+ * \return true on success, false on failure (image is deleted)
+ */
+static bool check_and_convert_bitmap(ILuint * bitmap_obj){
+    ILint height, width;
+
+    /* Check that image is not too big - max about 1280x1024 - (otherwise ilConvertImage will kill the process!) */
+    height = ilGetInteger(IL_IMAGE_HEIGHT);
+    width =  ilGetInteger(IL_IMAGE_WIDTH);
+    if ((height*width)> 5500000){
+      PRINTDF("Image too big h*w = %ix%i\n", height,width);
+      ilDeleteImages( 1, bitmap_obj);
+      return false;
+    }
+    ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
+    return true;
+}
+#endif
+
 /** Load image in a DevIL bitmap
  *
  * \param bitmap_obj DevIL bitmap object
@@ -662,27 +1436,40 @@ enum skin_cmd skin_get_cmd_from_xy(int x, int y, int * p){
  */
 bool skin_load_bitmap(ILuint * bitmap_obj, const char * filename){
 #ifdef WITH_DEVIL
-    ILint height, width;
-
     ilGenImages(1, bitmap_obj);
     ilBindImage(*bitmap_obj);
     if (!ilLoadImage(filename)) {
         fprintf(stderr, "Could not load image file %s.\nError : %s\n", filename, iluErrorString(ilGetError()));
+        ilDeleteImages( 1, bitmap_obj);
         return false;
     }
     else{
       PRINTDF("Loading bitmap <%s>\n", filename);
     }
-    /* Check that image is not too big - max about 1280x1024 - (otherwise ilConvertImage will kill the process!) */
-    height = ilGetInteger(IL_IMAGE_HEIGHT);
-    width =  ilGetInteger(IL_IMAGE_WIDTH);
-    if ((height*width)> 5500000){
-      PRINTDF("Image too big h*w = %ix%i\n", height,width);
-      ilDeleteImages( 1, bitmap_obj);
-      return false;
+    return check_and_convert_bitmap(bitmap_obj);
+#else
+  return false;
+#endif
+}
+
+/** Load image held in memory in a DevIL bitmap
+ *
+ * \param bitmap_obj DevIL bitmap object
+ * \param data encoded image
+ * \param len length of the encoded image
+ *
+ * \return true on success, false on failure
+ */
+bool skin_load_bitmap_from_buffer(ILuint * bitmap_obj, const void * data, size_t len){
+#ifdef WITH_DEVIL
+    ilGenImages(1, bitmap_obj);
+    ilBindImage(*bitmap_obj);
+    if (!ilLoadL(IL_TYPE_UNKNOWN, data, len)) {
+        fprintf(stderr, "Could not load image from memory.\nError : %s\n", iluErrorString(ilGetError()));
+        ilDeleteImages( 1, bitmap_obj);
+        return false;
     }
-    ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
-    return true;
+    return check_and_convert_bitmap(bitmap_obj);
 #else
   return false;
 #endif
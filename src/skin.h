@@ -26,6 +26,7 @@
 
 #ifndef __SKIN_H__
 #define __SKIN_H__
+#include <stddef.h>
 #include <IL/ilu.h>
 
 #define ZIP_SKIN_BITMAP_FILENAME "/tmp/bitmap"
@@ -106,6 +107,15 @@ enum skin_text_align_type {
     SKIN_TEXT_RIGHT,
 };
 
+/** Directions of the keys navigation between controls */
+enum skin_nav_dir {
+    SKIN_NAV_LEFT = 0,
+    SKIN_NAV_RIGHT,
+    SKIN_NAV_UP,
+    SKIN_NAV_DOWN,
+    SKIN_NAV_NB
+};
+
 /** Test skin descriptor */
 struct skin_text_control {
     int x;                 /*!<x upper left coordinate of the text */
@@ -178,6 +188,13 @@ const struct skin_control *skin_get_pb(void);
 const char * skin_cmd_2_txt(enum skin_cmd);
 struct skin_rectangular_shape skin_ctrl_get_zone(const struct skin_control *ctrl);
 enum skin_cmd skin_get_cmd_from_xy(int x, int y, int *p);
+int skin_get_neighbour(int idx, enum skin_nav_dir dir);
+int skin_get_first_selection(void);
+
+bool skin_extract_background(const char * filename, const char * filename_out);
+bool skin_cache_save(const void * fb_background, size_t fb_background_len);
+const void * skin_get_fb_background(size_t * len);
 
 bool skin_load_bitmap(ILuint * bitmap_obj, const char * filename);
+bool skin_load_bitmap_from_buffer(ILuint * bitmap_obj, const void * data, size_t len);
 #endif
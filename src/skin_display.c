@@ -35,9 +35,11 @@
 #include "power.h"
 #include "skin.h"
 #include "track.h"
+#include "cover.h"
 #include "font.h"
 #include "play_int.h"
 #include "debug.h"
+#include "log.h"
 #include "draw.h"
 #include "gps.h"
 #include "skin_display.h"
@@ -58,6 +60,164 @@ static struct{
     bool new;    
 }osd_request;
 
+/* Max number of rendered texts kept in cache */
+#define TEXT_CACHE_SIZE 40
+/* Number of lookups between two logs of the text cache statistics */
+#define TEXT_CACHE_LOG_PERIOD 1000
+
+/** A rendered text : the text composited over the skin background */
+struct text_cache_entry{
+    const void * key;           /**< Control displaying the text (NULL if entry is free) */
+    char * string;
+    int size;
+    struct font_color color;
+    int x, y, w, h;             /**< Zone of the patch on screen */
+    unsigned char * patch;      /**< RGBA patch (text over background) */
+    bool displayed;             /**< False if the background has been redrawn since the patch display */
+    unsigned int last_use;
+};
+
+static struct{
+    struct text_cache_entry entries[TEXT_CACHE_SIZE];
+    unsigned int tick;
+    unsigned long hits;
+    unsigned long misses;
+}text_cache;
+
+static struct text_cache_entry * text_cache_find(const void * key){
+    int i;
+    for (i = 0; i < TEXT_CACHE_SIZE; i++){
+        if (text_cache.entries[i].key == key)
+            return &text_cache.entries[i];
+    }
+    return NULL;
+}
+
+static void text_cache_stats(bool hit){
+    if (hit)
+        text_cache.hits++;
+    else
+        text_cache.misses++;
+    if (((text_cache.hits + text_cache.misses) % TEXT_CACHE_LOG_PERIOD) == 0){
+        log_write(LOG_DEBUG, "Text cache : %lu hits - %lu misses", text_cache.hits, text_cache.misses);
+    }
+}
+
+/** Look for an already rendered text
+ *
+ * On hit, the patch is displayed again only if the background has been redrawn in between.
+ *
+ * \retval true the text is on screen
+ * \retval false the text has to be rendered, see :text_cache_store()
+ */
+static bool text_cache_lookup(const void * key, const char * string, int size, const struct font_color * color){
+    struct text_cache_entry * entry;
+
+    text_cache.tick++;
+    entry = text_cache_find(key);
+    if ((entry == NULL) || (entry->size != size) ||
+        (memcmp(&entry->color, color, sizeof(*color)) != 0) ||
+        (strcmp(entry->string, string) != 0)){
+        text_cache_stats(false);
+        return false;
+    }
+    text_cache_stats(true);
+    entry->last_use = text_cache.tick;
+    if (!entry->displayed){
+        draw_RGB_buffer(entry->patch, entry->x, entry->y, entry->w, entry->h, true);
+        entry->displayed = true;
+    }
+    return true;
+}
+
+/** Render a text, display it and keep it in cache
+ *
+ * If the control previously displayed a different text, its zone is erased first.
+ */
+static void text_cache_store(const void * key, const char * string, int size, const struct font_color * color,
+                             int x, int y, int w, int h){
+    struct text_cache_entry * entry;
+    unsigned char * patch;
+    int i;
+
+    if ((w <= 0) || (h <= 0))
+        return;
+    patch = draw_text_patch(string, x, y, w, h, color, (size != -1) ? size : 0);
+    if (patch == NULL)
+        return;
+
+    entry = text_cache_find(key);
+    if (entry != NULL){
+        if (entry->displayed && 
+            ((entry->x != x) || (entry->y != y) || (entry->w != w) || (entry->h != h))){
+            /* The old text must not be put back by the background restoration */
+            entry->displayed = false;
+            draw_background_zone(entry->x, entry->y, entry->w, entry->h);
+        }
+    } else {
+        /* Take a free entry or evict the least recently used one */
+        entry = &text_cache.entries[0];
+        for (i = 0; i < TEXT_CACHE_SIZE; i++){
+            if (text_cache.entries[i].key == NULL){
+                entry = &text_cache.entries[i];
+                break;
+            }
+            if (text_cache.entries[i].last_use < entry->last_use)
+                entry = &text_cache.entries[i];
+        }
+    }
+    free(entry->string);
+    free(entry->patch);
+    entry->key = key;
+    entry->string = strdup(string);
+    entry->size = size;
+    entry->color = *color;
+    entry->x = x;
+    entry->y = y;
+    entry->w = w;
+    entry->h = h;
+    entry->patch = patch;
+    entry->last_use = text_cache.tick;
+    draw_RGB_buffer(patch, x, y, w, h, true);
+    entry->displayed = true;
+    if (entry->string == NULL){
+        /* Cannot be matched anymore */
+        free(entry->patch);
+        memset(entry, 0, sizeof(*entry));
+    }
+}
+
+/** The background has been redrawn : every cached text has to be displayed again */
+static void text_cache_invalidate_display(void){
+    int i;
+    for (i = 0; i < TEXT_CACHE_SIZE; i++){
+        text_cache.entries[i].displayed = false;
+    }
+}
+
+/** Part of the background has been restored : display again the cached texts it has erased
+ *
+ * Registered in the drawing layer by :skin_display_init(), so that the texts stay below what is
+ * then drawn over the restored zone.
+ */
+static void background_restored(int x, int y, int w, int h){
+    struct text_cache_entry * entry;
+    int x1, y1, x2, y2;
+    int i;
+
+    for (i = 0; i < TEXT_CACHE_SIZE; i++){
+        entry = &text_cache.entries[i];
+        if ((entry->key == NULL) || !entry->displayed)
+            continue;
+        x1 = (entry->x > x) ? entry->x : x;
+        y1 = (entry->y > y) ? entry->y : y;
+        x2 = (entry->x + entry->w < x + w) ? entry->x + entry->w : x + w;
+        y2 = (entry->y + entry->h < y + h) ? entry->y + entry->h : y + h;
+        if ((x1 < x2) && (y1 < y2))
+            draw_RGBA_part(entry->patch, entry->x, entry->y, entry->w, x1, y1, x2 - x1, y2 - y1);
+    }
+}
+
 static void osd_clear(void){    
     free(osd.buffer);       
     memset(&osd, 0, sizeof(osd));   
@@ -131,7 +291,10 @@ static void draw_track_text(const char * text) {
     color.r = COLOR_R(skin_conf->text_color);
     color.g = COLOR_G(skin_conf->text_color);
     color.b = COLOR_B(skin_conf->text_color);
-    draw_text(text, skin_conf->text_x1, skin_conf->text_y1, img_width, img_height, &color, 0);
+    if (!text_cache_lookup(skin_conf, text, -1, &color)){
+        text_cache_store(skin_conf, text, -1, &color, 
+                         skin_conf->text_x1, skin_conf->text_y1, img_width, img_height);
+    }
 }
 
 static void refresh_filename(void){  
@@ -201,11 +364,6 @@ static void display_txt_ctrl(const struct skin_control *ctrl, const char* string
     }
     
     if (ctrl != NULL){
-        if (ctrl->params.text.size != -1)
-            font_change_size(ctrl->params.text.size);
-        font_get_size(string, &text_width, &text_height, &orig);
-        if (ctrl->params.text.size != -1)
-            font_restore_default_size();  
         if (ctrl->params.text.color == -1){
             color.r = 0xFF;
             color.g = 0xFF;
@@ -215,6 +373,14 @@ static void display_txt_ctrl(const struct skin_control *ctrl, const char* string
             color.g = COLOR_G(ctrl->params.text.color);
             color.b = COLOR_B(ctrl->params.text.color);
         }
+        /* Nothing to do if the string did not change */
+        if (text_cache_lookup(ctrl, string, ctrl->params.text.size, &color))
+            return;
+        if (ctrl->params.text.size != -1)
+            font_change_size(ctrl->params.text.size);
+        font_get_size(string, &text_width, &text_height, &orig);
+        if (ctrl->params.text.size != -1)
+            font_restore_default_size();  
         ws_get_size(&screen_width, &screen_height);
         
         switch (ctrl->params.text.align){
@@ -238,14 +404,40 @@ static void display_txt_ctrl(const struct skin_control *ctrl, const char* string
             text_height = screen_height - ctrl->params.text.y -1;
         }
 //        log_write(LOG_VERBOSE, "display_txt_ctrl : x %d - y %d - w : %d - h %d - text_size : %d - string : %s", x, ctrl->params.text.y, text_width, text_height, ctrl->params.text.size, string);
-        draw_text(string, 
-                  x, ctrl->params.text.y,
-                  text_width, text_height, &color, 
-                  (ctrl->params.text.size != -1)?ctrl->params.text.size:0);
+        text_cache_store(ctrl, string, ctrl->params.text.size, &color,
+                         x, ctrl->params.text.y, text_width, text_height);
     }
     return;
 }
 
+/** Display the cover of the current track
+ *
+ * \param force if false, the cover is only drawn if it was pending on last call
+ */
+static void refresh_coverart(bool force){
+    /* The default cover is displayed while the thumbnail is decoded */
+    static bool pending = false;
+    const struct skin_control *ctrl;
+    const char * path;
+    enum cover_status status;
+    ILuint default_cover;
+
+    if (!force && !pending)
+        return;
+    ctrl = skin_get_ctrl(SKIN_CMD_COVERART);
+    if (ctrl == NULL)
+        return;
+    default_cover = skin_get_img(SKIN_CMD_COVERART);
+    if (default_cover == 0)
+        return;
+    path = track_get_current_path();
+    status = (path != NULL) ? cover_draw(path, ctrl->params.text.x, ctrl->params.text.y) : COVER_NONE;
+    if ((status != COVER_READY) && force){
+        draw_cursor(default_cover, 0, ctrl->params.text.x, ctrl->params.text.y);
+    }
+    pending = (status == COVER_PENDING);
+}
+
 static void refresh_tags_infos(void){
     const struct skin_control *ctrl;
     const struct track_tags *tags;          
@@ -262,31 +454,7 @@ static void refresh_tags_infos(void){
     }
 
     /* Handle coverart */    
-    ctrl = skin_get_ctrl(SKIN_CMD_COVERART);
-
-    if (ctrl != NULL){
-        ILuint default_cover;
-        int width, height;
-        
-        default_cover = skin_get_img(SKIN_CMD_COVERART);
-        if (default_cover != 0){
-            if (tags->coverart == 0){
-                /*No coverart for this file - Display default one*/
-                draw_cursor(default_cover, 0, ctrl->params.text.x, ctrl->params.text.y);
-            } else {
-                /* Resize the embedded cover and display it */      
-                ilBindImage(default_cover);
-                width  = ilGetInteger(IL_IMAGE_WIDTH);
-                height = ilGetInteger(IL_IMAGE_HEIGHT);
-                ilBindImage(tags->coverart);
-                iluScale(width, height, 1);
-                draw_cursor(tags->coverart, 0, ctrl->params.text.x, ctrl->params.text.y);
-            }
-        }
-    }
-
-
-    
+    refresh_coverart(true);
 }
 
 static int track_get_string(char * buffer, size_t len, int time, bool is_hour){        
@@ -428,6 +596,8 @@ static void display_progress_bar(int current, int length, int percent)
                 }
             }
         }
+        /* Erase previous bar if background cache is available (otherwise transparent pixels keep the previous bar) */
+        draw_restore_background(pb_zone.x1, pb_zone.y1, width, height);
         draw_RGB_buffer(buffer, pb_zone.x1, pb_zone.y1, width, height, true);
     } else {
         /* A cursor bitmap is available */
@@ -452,8 +622,19 @@ static void display_progress_bar(int current, int length, int percent)
         }
         /* Compute new position */
         new_x = percent * (pb_zone.x2 - cursor_width - pb_zone.x1) / 100;
-        /* Alloc buffer */
         buffer_height = (cursor_height > height)?cursor_height:height;
+        if (cursor_height >= height){
+            bg_y = pb_zone.y1 - ((cursor_height - height) / 2);
+        } else {
+            bg_y = pb_zone.y1;
+        }
+        /* Fast path : restore background from cache and blend the cursor over it */
+        if (draw_img_over_background(skin_get_pb_img(), pb_zone.x1 + new_x, bg_y + pb_prev_val.y,
+                                     pb_zone.x1, bg_y, width, buffer_height)){
+            pb_prev_val.x = new_x;
+            return;
+        }
+        /* Alloc buffer */
         buffer_size = width * buffer_height * 4;
         buffer = malloc( buffer_size );
         if (buffer == NULL){
@@ -461,11 +642,6 @@ static void display_progress_bar(int current, int length, int percent)
             return;
         }
         /* Copy Background */
-        if (cursor_height >= height){
-            bg_y = pb_zone.y1 - ((cursor_height - height) / 2);
-        } else {
-            bg_y = pb_zone.y1;
-        }
         ilBindImage(skin_get_background());                
         ilCopyPixels(pb_zone.x1, bg_y, 0,
                      width, buffer_height , 1,
@@ -493,12 +669,17 @@ static void refresh_progress_bar(void){
     int pos;    
     int length;       
     int percent;
+    struct playint_snapshot snap;
     
-    pos = playint_get_file_position_seconds();    
+    /* Use the values retrieved by the update thread on this tick : no extra request to mplayer */
+    playint_get_last_snapshot(&snap);
+    if (snap.paused)
+        return;
+    pos = snap.time_pos;    
     length = track_get_tags()->length;        
     if (length == 0){
-        /* No tag length available then ask mplayer */
-        length = playint_get_file_length();
+        /* No tag length available then use the one from mplayer */
+        length = snap.length;
     }
     if ((pos >= 0) && (length > 0)) {          
         /* BUG : pos may be plain wrong coz mplayer does not correctly handle VBR */
@@ -668,12 +849,18 @@ static void refresh_uptime(void){
     }    
 }
 
+/** Initialize the skin display : the cached texts are put back each time the background is restored */
+void skin_display_init(void){
+    draw_set_restore_cb(background_restored);
+}
+
 void skin_display_refresh(enum skin_display_update type){        
 
     if (type == SKIN_DISPLAY_NEW_TRACK || osd.back_refresh){
         /* We have to redraw the background for video on new track event
            coz mplayer does not keep overlay from one track to the other...
            For audio, it enables not to care about erasing tags and filename */
+        text_cache_invalidate_display();
         draw_img(skin_get_background());
         refresh_tags_infos();   
         refresh_filename();
@@ -683,6 +870,7 @@ void skin_display_refresh(enum skin_display_update type){
     
     /* Common treatments for SKIN_DISPLAY_NEW_TRACK and  SKIN_DISPLAY_PERIODIC */   
     refresh_progress_bar();
+    refresh_coverart(false);
     refresh_battery_status(false);
     refresh_gps_infos();
     refresh_time();
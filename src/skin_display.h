@@ -35,4 +35,5 @@ enum skin_display_update{
 
 void skin_display_refresh(enum skin_display_update type);
 void skin_display_text(int to, const char *txt);
+void skin_display_init(void);
 #endif
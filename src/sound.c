@@ -40,12 +40,14 @@
 #include <barcelona/Barc_snd.h>
 
 #include "sound.h"
+#include "power.h"
 #include "debug.h"
 
 #define SOUND_DEV_NAME "/dev/sound"
 #define DEVICE_NOT_OPENED -2
-#define MODELID_PATH "/proc/barcelona/modelid"
-#define MODELNAME_PATH "/proc/barcelona/modelname"
+
+/* Last state set on the internal speaker (-1 if unknown) */
+static int internal_muted = -1;
 
 static int check_fd(){
   static int snd_fd = DEVICE_NOT_OPENED;
@@ -102,6 +104,10 @@ int snd_mute_internal(bool state){
   int res;
   int snd_fd;
 
+  /* Nothing to do if the speaker is already in the expected state */
+  if (internal_muted == state){
+    return 0;
+  }
   snd_fd = check_fd();
   if (snd_fd<0){
     return -1;
@@ -114,8 +120,10 @@ int snd_mute_internal(bool state){
   }
   if ( res != 0){
     perror("Error while trying to  mute/unmuet internal  ");
+    internal_muted = -1;
     return -1;
   }
+  internal_muted = state;
   return 0;
 
 
@@ -129,33 +137,17 @@ int snd_check_headphone(void){
   int res = 0;
   unsigned int is_headphone = 0;
   int snd_fd;
-  int test_fd;
-  int isLIVE = 0;
   
   snd_fd = check_fd();
   if (snd_fd<0){
     return -1;
   }
   
-  /* test whether headconnector exists !*/
-  test_fd =  open(MODELNAME_PATH, O_RDWR);
-  if (test_fd < 0 ){
-    perror("Error while trying to open " MODELNAME_PATH);
+  /* test whether headconnector exists ! (model is probed once by the power module) */
+  if (power_get_model_name()[0] == 0){
     return -1;
-  } else {
-    char buffer[128];
-    memset(buffer,0,sizeof(buffer));
-    if (read(test_fd,buffer,sizeof(buffer)) <= 0){
-      perror("Error while reading " MODELID_PATH);
-      close (test_fd);
-      return -1;          
-    }
-    if (strstr(buffer, "LIVE") != NULL) {
-      isLIVE = 1;
-    }    
   }
-  close (test_fd);
-  if (isLIVE){
+  if (strstr(power_get_model_name(), "LIVE") != NULL){
     PRINTDF("TT GO Live - No headphoneconnector \n");
     return -1;
   }
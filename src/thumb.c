@@ -0,0 +1,660 @@
+/**
+ * \file thumb.c
+ * \brief Background extraction of the video previews and persistent cache of their thumbnails
+ *
+ * A worker thread runs mplayer once per video to extract a frame, scales it to the preview box
+ * and converts it to the pixel format of the display. The result is stored in THUMB_CACHE_DIR,
+ * in a file named after the video path and checked against its modification time and size :
+ * displaying the preview of an already seen video then only costs a read and a blit.
+ * The last thumbnails used are also kept as surfaces in a small LRU cache.
+ *
+ * Besides the thumbnail of the selected video, the worker generates in advance the ones of
+ * the neighbouring entries. It runs at the lowest priority, and so does the mplayer it spawns,
+ * so that the browser stays responsive.
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <linux/limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+#include "res_cache.h"
+#include "thumb.h"
+
+#define THUMB_CACHE_FMT     THUMB_CACHE_DIR "/%08x.thumb"
+#define THUMB_CACHE_MAGIC   "TPTH"
+#define THUMB_CACHE_VERSION 1
+
+/* Number of thumbnails kept in memory */
+#define THUMB_CACHE_SIZE 8
+/* Max number of pending prefetches (the oldest ones are dropped) */
+#define THUMB_PREFETCH_MAX 8
+
+/* Nice value of the worker thread and of mplayer */
+#define THUMB_NICE 19
+/* Position of the extracted frame (s) */
+#define THUMB_SEEK_POS 5
+/* mplayer is killed if it has not extracted the frame within this delay */
+#define THUMB_EXTRACT_TIMEOUT_MS 15000
+#define THUMB_POLL_MS 50
+/* Name of the first frame written by the png video output of mplayer */
+#define THUMB_FRAME_NAME "00000001.png"
+
+/** Header of a persistent thumbnail, followed by the pixels (height lines of pitch bytes) */
+struct thumb_header{
+    char magic[4];
+    uint32_t version;
+    char filename[256];          /**< Video filename */
+    int64_t mtime;               /**< Modification time of the video */
+    int64_t size;                /**< Size of the video */
+    int32_t box_width;           /**< Size of the preview box */
+    int32_t box_height;
+    uint32_t format;             /**< DirectFB pixel format of the pixels */
+    int32_t width;               /**< Size of the thumbnail (0 if no frame could be extracted) */
+    int32_t height;
+    int32_t pitch;
+};
+
+/** Thumbnail cache entry */
+struct thumb_entry{
+    char * filename;             /**< Video file (NULL if entry is free) */
+    time_t mtime;                /**< Modification time of the video */
+    off_t size;                  /**< Size of the video */
+    enum thumb_status status;    /**< THUMB_READY or THUMB_NONE */
+    IDirectFBSurface * surf;
+    unsigned int last_use;
+};
+
+/* state module variables */
+static struct{
+    bool initialized;
+    IDirectFB * dfb;
+    int width, height;                 /**< Size of the preview box */
+    DFBSurfacePixelFormat format;      /**< Pixel format of the thumbnails */
+    thumb_ready_cb * cb;
+    void * cb_param;
+    char mplayer[PATH_MAX];            /**< Absolute path of mplayer */
+    char tmp_dir[32];                  /**< Folder in which mplayer writes the frames */
+    pthread_t tid;
+    bool stop;
+    char * request;                    /**< Thumbnail of the selected video */
+    char * prefetch[THUMB_PREFETCH_MAX]; /**< Thumbnails to generate in advance */
+    int nb_prefetch;
+    struct thumb_entry cache[THUMB_CACHE_SIZE];
+    unsigned int use_counter;
+} state;
+
+/* Protects the state of the module */
+static pthread_mutex_t thumb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thumb_cond = PTHREAD_COND_INITIALIZER;
+
+
+/** Name of the persistent thumbnail associated with a video */
+static void cache_filename(const char * filename, char * cache_name, size_t len){
+    uint32_t hash = 2166136261U;
+
+    /* FNV-1a */
+    while (*filename){
+        hash ^= (unsigned char)*filename++;
+        hash *= 16777619U;
+    }
+    snprintf(cache_name, len, THUMB_CACHE_FMT, hash);
+}
+
+/** Fill the key part of a persistent thumbnail header */
+static void cache_fill_key(struct thumb_header * hdr, const char * filename, const struct stat * st){
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, THUMB_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = THUMB_CACHE_VERSION;
+    strncpy(hdr->filename, filename, sizeof(hdr->filename) - 1);
+    hdr->mtime = st->st_mtime;
+    hdr->size = st->st_size;
+    hdr->box_width = state.width;
+    hdr->box_height = state.height;
+    hdr->format = state.format;
+}
+
+/** Open the persistent thumbnail of a video if it is up to date
+ *
+ * \return the thumbnail file positioned on the pixels, NULL if there is no valid thumbnail
+ */
+static FILE * disk_open(const char * filename, const struct stat * st, struct thumb_header * hdr){
+    struct thumb_header key;
+    char cache_name[64];
+    FILE * fp;
+
+    cache_filename(filename, cache_name, sizeof(cache_name));
+    fp = fopen(cache_name, "rb");
+    if (fp == NULL)
+        return NULL;
+    cache_fill_key(&key, filename, st);
+    if ((fread(hdr, sizeof(*hdr), 1, fp) != 1) ||
+        (memcmp(hdr, &key, offsetof(struct thumb_header, width)) != 0) ||
+        (hdr->width > state.width) || (hdr->height > state.height) ||
+        (hdr->pitch != hdr->width * DFB_BYTES_PER_PIXEL(state.format))){
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/** Load the persistent thumbnail of a video
+ *
+ * \param keep [out] false if the result must not be kept in memory (the thumbnail could not be loaded now)
+ *
+ * \return THUMB_PENDING if there is no up to date thumbnail
+ */
+static enum thumb_status disk_load(const char * filename, const struct stat * st, IDirectFBSurface ** surf, bool * keep){
+    DFBSurfaceDescription dsc;
+    struct thumb_header hdr;
+    enum thumb_status ret = THUMB_PENDING;
+    char cache_name[64];
+    DFBResult res;
+    void * pixels;
+    int pitch, y;
+    FILE * fp;
+
+    *surf = NULL;
+    *keep = true;
+    fp = disk_open(filename, st, &hdr);
+    if (fp == NULL)
+        return THUMB_PENDING;
+    if ((hdr.width <= 0) || (hdr.height <= 0)){
+        ret = THUMB_NONE;
+        goto end;
+    }
+    dsc.flags = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+    dsc.width = hdr.width;
+    dsc.height = hdr.height;
+    dsc.pixelformat = state.format;
+    res = state.dfb->CreateSurface(state.dfb, &dsc, surf);
+    if ((res == DFB_NOSYSTEMMEMORY) || (res == DFB_NOVIDEOMEMORY)){
+        /* Give the memory of the unused GUI images and fonts back and retry */
+        res_cache_purge();
+        res = state.dfb->CreateSurface(state.dfb, &dsc, surf);
+    }
+    if (res != DFB_OK){
+        /* The thumbnail is fine on disk : nothing is displayed this time but it is not generated again */
+        *surf = NULL;
+        *keep = false;
+        ret = THUMB_NONE;
+        goto end;
+    }
+    if ((*surf)->Lock(*surf, DSLF_WRITE, &pixels, &pitch) != DFB_OK)
+        goto error;
+    for (y = 0; y < hdr.height; y++){
+        if (fread((char *)pixels + y * pitch, hdr.pitch, 1, fp) != 1)
+            break;
+    }
+    (*surf)->Unlock(*surf);
+    if (y < hdr.height)
+        goto error;
+    ret = THUMB_READY;
+    goto end;
+
+error:
+    (*surf)->Release(*surf);
+    *surf = NULL;
+    /* Unreadable thumbnail : remove it so that the worker generates it again */
+    cache_filename(filename, cache_name, sizeof(cache_name));
+    unlink(cache_name);
+end:
+    fclose(fp);
+    return ret;
+}
+
+/** Store the thumbnail of a video (NULL if no frame could be extracted) in the persistent cache */
+static void disk_store(const char * filename, const struct stat * st, IDirectFBSurface * surf){
+    char cache_name[64];
+    char tmp_name[80];
+    struct thumb_header hdr;
+    void * pixels;
+    int w, h, pitch, y;
+    bool ok;
+    FILE * fp;
+
+    cache_fill_key(&hdr, filename, st);
+    if (surf != NULL){
+        surf->GetSize(surf, &w, &h);
+        hdr.width = w;
+        hdr.height = h;
+        hdr.pitch = w * DFB_BYTES_PER_PIXEL(state.format);
+    }
+    /* Write a temporary file and rename it so that a thumbnail is always complete */
+    cache_filename(filename, cache_name, sizeof(cache_name));
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", cache_name);
+    fp = fopen(tmp_name, "wb");
+    if (fp == NULL){
+        log_write(LOG_ERROR, "Thumb - Unable to create %s", tmp_name);
+        return;
+    }
+    ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    if (ok && (surf != NULL)){
+        if (surf->Lock(surf, DSLF_READ, &pixels, &pitch) == DFB_OK){
+            for (y = 0; ok && (y < hdr.height); y++){
+                ok = (fwrite((char *)pixels + y * pitch, hdr.pitch, 1, fp) == 1);
+            }
+            surf->Unlock(surf);
+        } else {
+            ok = false;
+        }
+    }
+    if (fclose(fp) != 0)
+        ok = false;
+    if (!ok || (rename(tmp_name, cache_name) != 0)){
+        log_write(LOG_ERROR, "Thumb - Unable to write %s", cache_name);
+        unlink(tmp_name);
+    }
+}
+
+static bool is_stopped(void){
+    bool stop;
+
+    pthread_mutex_lock(&thumb_mutex);
+    stop = state.stop;
+    pthread_mutex_unlock(&thumb_mutex);
+    return stop;
+}
+
+/** Run mplayer to extract a frame of a video
+ *
+ * \param pos position of the frame (s)
+ * \param png receives the filename of the extracted frame
+ *
+ * \return true if the frame has been extracted
+ */
+static bool extract_frame(const char * filename, int pos, char * png, size_t len){
+    char scale[32];
+    char seek[16];
+    struct stat st;
+    int status, fd;
+    int waited = 0;
+    pid_t pid;
+
+    snprintf(png, len, "%s/" THUMB_FRAME_NAME, state.tmp_dir);
+    unlink(png);
+    /* Let mplayer scale the frame : a smaller PNG is quicker to write and to decode */
+    snprintf(scale, sizeof(scale), "scale=%d:-2", state.width);
+    snprintf(seek, sizeof(seek), "%d", pos);
+    pid = fork();
+    if ((pid < 0) && (errno == ENOMEM)){
+        /* Give the memory of the unused GUI images and fonts back and retry */
+        res_cache_purge();
+        pid = fork();
+    }
+    if (pid == 0){
+        fd = open("/dev/null", O_RDWR);
+        if (fd >= 0){
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        if (chdir(state.tmp_dir) == 0){
+            execl(state.mplayer, "mplayer", "-really-quiet", "-nosound", "-vo", "png:z=0", "-vf", scale,
+                  "-ss", seek, "-frames", "1", filename, (char *)NULL);
+        }
+        _exit(127);
+    }
+    if (pid < 0){
+        log_write(LOG_ERROR, "Thumb - Unable to launch mplayer");
+        return false;
+    }
+    while (waitpid(pid, &status, WNOHANG) == 0){
+        if (is_stopped() || (waited >= THUMB_EXTRACT_TIMEOUT_MS)){
+            log_write(LOG_INFO, "Thumb - Frame extraction aborted for %s", filename);
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return false;
+        }
+        usleep(THUMB_POLL_MS * 1000);
+        waited += THUMB_POLL_MS;
+    }
+    return ((stat(png, &st) == 0) && (st.st_size > 0));
+}
+
+/** Scale an extracted frame to the preview box, keeping its aspect ratio
+ *
+ * \return the thumbnail, NULL on failure
+ */
+static IDirectFBSurface * scale_frame(const char * png){
+    IDirectFBImageProvider * provider;
+    IDirectFBSurface * surf = NULL;
+    DFBSurfaceDescription dsc;
+
+    if (state.dfb->CreateImageProvider(state.dfb, png, &provider) != DFB_OK)
+        return NULL;
+    if ((provider->GetSurfaceDescription(provider, &dsc) != DFB_OK) ||
+        (dsc.width <= 0) || (dsc.height <= 0))
+        goto end;
+    if (dsc.width * state.height > dsc.height * state.width){
+        dsc.height = dsc.height * state.width / dsc.width;
+        dsc.width = state.width;
+    } else {
+        dsc.width = dsc.width * state.height / dsc.height;
+        dsc.height = state.height;
+    }
+    if (dsc.width < 1)
+        dsc.width = 1;
+    if (dsc.height < 1)
+        dsc.height = 1;
+    dsc.flags = DSDESC_WIDTH | DSDESC_HEIGHT | DSDESC_PIXELFORMAT;
+    dsc.pixelformat = state.format;
+    if (state.dfb->CreateSurface(state.dfb, &dsc, &surf) != DFB_OK){
+        surf = NULL;
+        goto end;
+    }
+    if (provider->RenderTo(provider, surf, NULL) != DFB_OK){
+        surf->Release(surf);
+        surf = NULL;
+    }
+end:
+    provider->Release(provider);
+    return surf;
+}
+
+/** Find the thumbnail of a video in memory, an entry of a video that has changed since is dropped */
+static struct thumb_entry * cache_find(const char * filename, const struct stat * st){
+    struct thumb_entry * thumb;
+    int i;
+
+    for (i = 0; i < THUMB_CACHE_SIZE; i++){
+        thumb = &state.cache[i];
+        if ((thumb->filename != NULL) && (strcmp(thumb->filename, filename) == 0)){
+            if ((thumb->mtime != st->st_mtime) || (thumb->size != st->st_size)){
+                free(thumb->filename);
+                if (thumb->surf != NULL)
+                    thumb->surf->Release(thumb->surf);
+                memset(thumb, 0, sizeof(*thumb));
+                return NULL;
+            }
+            thumb->last_use = ++state.use_counter;
+            return thumb;
+        }
+    }
+    return NULL;
+}
+
+/** Keep a thumbnail in memory (the surface is owned by the cache, even on failure) */
+static struct thumb_entry * cache_store(const char * filename, const struct stat * st,
+                                        enum thumb_status status, IDirectFBSurface * surf){
+    struct thumb_entry * thumb = &state.cache[0];
+    char * name;
+    int i;
+
+    name = strdup(filename);
+    if (name == NULL){
+        if (surf != NULL)
+            surf->Release(surf);
+        return NULL;
+    }
+    /* Replace the least recently used thumbnail */
+    for (i = 1; i < THUMB_CACHE_SIZE; i++){
+        if (state.cache[i].last_use < thumb->last_use)
+            thumb = &state.cache[i];
+    }
+    free(thumb->filename);
+    if (thumb->surf != NULL)
+        thumb->surf->Release(thumb->surf);
+    thumb->filename = name;
+    thumb->mtime = st->st_mtime;
+    thumb->size = st->st_size;
+    thumb->surf = surf;
+    thumb->status = status;
+    thumb->last_use = ++state.use_counter;
+    return thumb;
+}
+
+static void flush_prefetch(void){
+    int i;
+
+    for (i = 0; i < state.nb_prefetch; i++){
+        free(state.prefetch[i]);
+    }
+    state.nb_prefetch = 0;
+}
+
+/** Generate the thumbnail of a video
+ *
+ * \return true if the thumbnail has been generated, false if it has been aborted
+ */
+static bool generate(const char * filename){
+    IDirectFBSurface * surf = NULL;
+    char png[PATH_MAX];
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+        return false;
+    /* Short videos : fall back on the first frame */
+    if (extract_frame(filename, THUMB_SEEK_POS, png, sizeof(png)) ||
+        (!is_stopped() && extract_frame(filename, 0, png, sizeof(png)))){
+        surf = scale_frame(png);
+    }
+    unlink(png);
+    if (is_stopped()){
+        if (surf != NULL)
+            surf->Release(surf);
+        return false;
+    }
+    disk_store(filename, &st, surf);
+    pthread_mutex_lock(&thumb_mutex);
+    cache_store(filename, &st, (surf != NULL) ? THUMB_READY : THUMB_NONE, surf);
+    pthread_mutex_unlock(&thumb_mutex);
+    return true;
+}
+
+static void * worker_thread(void * param){
+    struct thumb_header hdr;
+    struct stat st;
+    char * filename;
+    bool missing;
+    FILE * fp;
+
+    /* On Linux the nice value is per thread : it is also inherited by the mplayer instances */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), THUMB_NICE);
+
+    pthread_mutex_lock(&thumb_mutex);
+    while (!state.stop){
+        if (state.request != NULL){
+            filename = state.request;
+            state.request = NULL;
+        } else if (state.nb_prefetch > 0){
+            filename = state.prefetch[0];
+            state.nb_prefetch--;
+            memmove(&state.prefetch[0], &state.prefetch[1], state.nb_prefetch * sizeof(state.prefetch[0]));
+        } else {
+            pthread_cond_wait(&thumb_cond, &thumb_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&thumb_mutex);
+
+        missing = (stat(filename, &st) == 0);
+        if (missing){
+            pthread_mutex_lock(&thumb_mutex);
+            missing = (cache_find(filename, &st) == NULL);
+            pthread_mutex_unlock(&thumb_mutex);
+        }
+        if (missing){
+            fp = disk_open(filename, &st, &hdr);
+            if (fp != NULL){
+                fclose(fp);
+            } else if (generate(filename) && (state.cb != NULL)){
+                state.cb(filename, state.cb_param);
+            }
+        }
+        free(filename);
+
+        pthread_mutex_lock(&thumb_mutex);
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+    return NULL;
+}
+
+/** Initialize the thumbnail module
+ *
+ * \param width width of the preview box
+ * \param height height of the preview box
+ * \param format pixel format of the thumbnails
+ * \param cb function called (from the worker thread) each time a thumbnail has been generated
+ */
+bool thumb_init(IDirectFB * dfb, int width, int height, DFBSurfacePixelFormat format, thumb_ready_cb * cb, void * param){
+    if (state.initialized || (width <= 0) || (height <= 0))
+        return false;
+    /* mplayer is launched from the temporary folder */
+    if ((getcwd(state.mplayer, sizeof(state.mplayer)) == NULL) ||
+        (strlen(state.mplayer) + sizeof("/mplayer") > sizeof(state.mplayer)))
+        return false;
+    strcat(state.mplayer, "/mplayer");
+    strcpy(state.tmp_dir, "/tmp/thumbXXXXXX");
+    if (mkdtemp(state.tmp_dir) == NULL){
+        log_write(LOG_ERROR, "Thumb - Unable to create temporary folder");
+        return false;
+    }
+    /* Nothing to do if the folder already exists */
+    mkdir(THUMB_CACHE_DIR, 0755);
+    state.dfb = dfb;
+    state.width = width;
+    state.height = height;
+    state.format = format;
+    state.cb = cb;
+    state.cb_param = param;
+    state.stop = false;
+    if (pthread_create(&state.tid, NULL, worker_thread, NULL) != 0){
+        log_write(LOG_ERROR, "Thumb - Unable to create worker thread");
+        rmdir(state.tmp_dir);
+        return false;
+    }
+    state.initialized = true;
+    return true;
+}
+
+void thumb_release(void){
+    int i;
+
+    if (!state.initialized)
+        return;
+    pthread_mutex_lock(&thumb_mutex);
+    state.stop = true;
+    pthread_cond_signal(&thumb_cond);
+    pthread_mutex_unlock(&thumb_mutex);
+    pthread_join(state.tid, NULL);
+    for (i = 0; i < THUMB_CACHE_SIZE; i++){
+        free(state.cache[i].filename);
+        if (state.cache[i].surf != NULL)
+            state.cache[i].surf->Release(state.cache[i].surf);
+    }
+    free(state.request);
+    flush_prefetch();
+    rmdir(state.tmp_dir);
+    memset(&state, 0, sizeof(state));
+}
+
+/** Ask for the thumbnail of the selected video (replaces any pending request and prefetch) */
+void thumb_request(const char * filename){
+    if (!state.initialized)
+        return;
+    pthread_mutex_lock(&thumb_mutex);
+    free(state.request);
+    state.request = strdup(filename);
+    /* Pending prefetches were relative to the previous selection */
+    flush_prefetch();
+    pthread_cond_signal(&thumb_cond);
+    pthread_mutex_unlock(&thumb_mutex);
+}
+
+/** Ask for the thumbnail of a video to be generated in advance */
+void thumb_prefetch(const char * filename){
+    char * name;
+    int i;
+
+    if (!state.initialized)
+        return;
+    pthread_mutex_lock(&thumb_mutex);
+    for (i = 0; i < state.nb_prefetch; i++){
+        if (strcmp(state.prefetch[i], filename) == 0)
+            goto end;
+    }
+    if ((state.request != NULL) && (strcmp(state.request, filename) == 0))
+        goto end;
+    name = strdup(filename);
+    if (name == NULL)
+        goto end;
+    if (state.nb_prefetch == THUMB_PREFETCH_MAX){
+        free(state.prefetch[0]);
+        state.nb_prefetch--;
+        memmove(&state.prefetch[0], &state.prefetch[1], state.nb_prefetch * sizeof(state.prefetch[0]));
+    }
+    state.prefetch[state.nb_prefetch++] = name;
+    pthread_cond_signal(&thumb_cond);
+end:
+    pthread_mutex_unlock(&thumb_mutex);
+}
+
+/** Draw the thumbnail of a video centered on a surface if it is available
+ *
+ * \return status of the thumbnail, nothing is drawn if not THUMB_READY
+ */
+enum thumb_status thumb_draw(const char * filename, IDirectFBSurface * dest){
+    struct thumb_entry * thumb;
+    enum thumb_status ret = THUMB_PENDING;
+    IDirectFBSurface * surf;
+    struct stat st;
+    bool keep;
+    int w, h, dw, dh;
+
+    if (!state.initialized || (stat(filename, &st) != 0))
+        return THUMB_NONE;
+    pthread_mutex_lock(&thumb_mutex);
+    thumb = cache_find(filename, &st);
+    if (thumb == NULL){
+        ret = disk_load(filename, &st, &surf, &keep);
+        if ((ret != THUMB_PENDING) && keep){
+            thumb = cache_store(filename, &st, ret, surf);
+            if (thumb == NULL)
+                ret = THUMB_NONE;
+        }
+    }
+    if (thumb != NULL){
+        ret = thumb->status;
+        if (ret == THUMB_READY){
+            thumb->surf->GetSize(thumb->surf, &w, &h);
+            dest->GetSize(dest, &dw, &dh);
+            dest->Blit(dest, thumb->surf, NULL, (dw - w) / 2, (dh - h) / 2);
+        }
+    }
+    pthread_mutex_unlock(&thumb_mutex);
+    return ret;
+}
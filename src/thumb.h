@@ -0,0 +1,53 @@
+/**
+ * \file thumb.h
+ * \brief Background extraction of the video previews and persistent cache of their thumbnails
+ *
+ * $URL$
+ * $Rev$
+ * $Author$
+ * $Date$
+ *
+ */
+
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __THUMB_H__
+#define __THUMB_H__
+
+#include <stdbool.h>
+#include <directfb.h>
+
+/* Folder of the persistent thumbnails */
+#define THUMB_CACHE_DIR "./conf/thumbs"
+
+/** State of the thumbnail of a video */
+enum thumb_status{
+    THUMB_PENDING,     /**< Not extracted yet */
+    THUMB_NONE,        /**< No frame could be extracted from the file */
+    THUMB_READY        /**< Thumbnail is available */
+};
+
+/** Callback called by the worker thread once the thumbnail of a file has been generated */
+typedef void (thumb_ready_cb)(const char * filename, void * param);
+
+bool thumb_init(IDirectFB * dfb, int width, int height, DFBSurfacePixelFormat format, thumb_ready_cb * cb, void * param);
+void thumb_release(void);
+void thumb_request(const char * filename);
+void thumb_prefetch(const char * filename);
+enum thumb_status thumb_draw(const char * filename, IDirectFBSurface * dest);
+
+#endif
@@ -25,18 +25,41 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <tag_c.h>
 
 #include "engine.h"
 #include "log.h"
+#include "library.h"
+#include "cover.h"
 #include "track.h"
 
-static TagLib_File *current_file;
+/* Pause between two files indexed by the library builder */
+#define LIBRARY_BUILDER_PACE_US 200000
+/* Number of new entries between two saves of the library index */
+#define LIBRARY_BUILDER_SAVE_NB 32
+/* Embedded covers are looked for in the beginning of the files, up to their size plus this margin */
+#define COVER_SEARCH_MARGIN (64 * 1024)
+
 static char *current_filename;
 static struct track_tags current_tags;
 
+/* Strings returned by taglib are global to the library : parsing is serialized */
+static pthread_mutex_t taglib_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Library builder thread */
+static pthread_t builder_tid;
+static bool builder_running;
+static volatile bool builder_stop;
+
+
 const char * track_get_current_filename(void){
     const char * ret; 
     if (current_filename != NULL){
@@ -48,6 +71,10 @@ const char * track_get_current_filename(void){
     return current_filename;
 }
 
+const char * track_get_current_path(void){
+    return current_filename;
+}
+
 bool track_has_changed(const char * filename){   
    if (current_filename != NULL){
       /* Check whether the current file has changed */
@@ -58,11 +85,172 @@ bool track_has_changed(const char * filename){
    return true;
 }
 
+static const char * dup_tag(const char * str){
+    if ((str == NULL) || (str[0] == 0))
+        return NULL;
+    return strdup(str);
+}
+
+static void free_entry_data(struct library_entry * entry){
+    free((char *)entry->title);
+    free((char *)entry->artist);
+    free((char *)entry->album);
+    free((char *)entry->comment);
+    free((char *)entry->genre);
+    free((void *)entry->cover);
+}
+
+/** Find where an embedded cover is stored in its media file
+ *
+ * Pictures are stored as is by the usual tag formats (ID3v2 APIC frames, FLAC pictures...),
+ * their position is recorded in the library so that they are read back without parsing the file.
+ *
+ * \return the position of the cover, 0 if it has not been found
+ */
+static off_t locate_cover(const char * filename, const void * cover, size_t len){
+    const char * first = cover;
+    char * buffer;
+    char * p;
+    size_t read_len;
+    off_t ret = 0;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    buffer = malloc(len + COVER_SEARCH_MARGIN);
+    if (buffer != NULL){
+        read_len = read(fd, buffer, len + COVER_SEARCH_MARGIN);
+        if ((read_len != (size_t)-1) && (read_len >= len)){
+            for (p = buffer + 1; p <= buffer + read_len - len; p++){
+                p = memchr(p, *first, buffer + read_len - len + 1 - p);
+                if (p == NULL)
+                    break;
+                if (memcmp(p, cover, len) == 0){
+                    ret = p - buffer;
+                    break;
+                }
+            }
+        }
+        free(buffer);
+    }
+    close(fd);
+    return ret;
+}
+
+/** Read the tags of a media file with taglib
+ *
+ * \param filename media file
+ * \param st status of the file
+ * \param entry [out] tags read (to be released with :free_entry_data())
+ * \param locate look for the position of the cover in the file (only from the background threads)
+ */
+static bool parse_file(const char * filename, const struct stat * st, struct library_entry * entry, bool locate){
+    TagLib_File *file;
+    TagLib_Tag *tag;
+    const TagLib_AudioProperties *properties;
+    size_t cover_len;
+    char * cover;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->path = filename;
+    entry->mtime = st->st_mtime;
+    entry->size = st->st_size;
+
+    pthread_mutex_lock(&taglib_mutex);
+    taglib_set_strings_unicode(1);
+    file = taglib_file_new(filename);
+    if (file == NULL){
+        pthread_mutex_unlock(&taglib_mutex);
+        return false;
+    }
+    tag = taglib_file_tag(file);
+    if (tag != NULL){
+        entry->title = dup_tag(taglib_tag_title(tag));
+        entry->artist = dup_tag(taglib_tag_artist(tag));
+        entry->album = dup_tag(taglib_tag_album(tag));
+        entry->comment = dup_tag(taglib_tag_comment(tag));
+        entry->genre = dup_tag(taglib_tag_genre(tag));
+        entry->year = taglib_tag_year(tag);
+        entry->track = taglib_tag_track(tag);
+    }
+    properties = taglib_file_audioproperties(file);
+    if (properties != NULL){
+        entry->length = taglib_audioproperties_length(properties);
+        entry->bitrate = taglib_audioproperties_bitrate(properties);
+        entry->sample_rate = taglib_audioproperties_samplerate(properties);
+        entry->channels = taglib_audioproperties_channels(properties);
+    }
+    cover_len = taglib_file_cover_size(file);
+    if (cover_len > 0){
+        cover = malloc(cover_len);
+        if (cover != NULL){
+            taglib_file_cover(file, cover, cover_len);
+            entry->cover = cover;
+            entry->cover_len = cover_len;
+        }
+    }
+    taglib_tag_free_strings();
+    taglib_file_free(file);
+    pthread_mutex_unlock(&taglib_mutex);
+    if (locate && (entry->cover != NULL))
+        entry->cover_offset = locate_cover(filename, entry->cover, entry->cover_len);
+    return true;
+}
+
+/** Read an embedded cover at the position recorded in the library
+ *
+ * \note the file is known to be unchanged since it has been indexed
+ */
+static void * read_indexed_cover(const char * filename, const struct library_entry * entry){
+    void * cover;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    cover = malloc(entry->cover_len);
+    if ((cover != NULL) &&
+        (pread(fd, cover, entry->cover_len, entry->cover_offset) != (ssize_t)entry->cover_len)){
+        free(cover);
+        cover = NULL;
+    }
+    close(fd);
+    return cover;
+}
+
+/** Set the current tags from a library entry */
+static void set_current_tags(const struct library_entry * entry){
+    current_tags.title = dup_tag(entry->title);
+    current_tags.artist = dup_tag(entry->artist);
+    current_tags.album = dup_tag(entry->album);
+    current_tags.comment = dup_tag(entry->comment);
+    current_tags.genre = dup_tag(entry->genre);
+    log_write(LOG_DEBUG, "Track - title : %s", current_tags.title);
+    log_write(LOG_DEBUG, "Track - artist : %s", current_tags.artist);
+    log_write(LOG_DEBUG, "Track - album : %s", current_tags.album);
+    if (entry->year > 0){
+        snprintf(current_tags.year, sizeof(current_tags.year), "%d", entry->year);
+    } else {
+        current_tags.year[0] = 0;
+    }
+    if (entry->track > 0){
+        snprintf(current_tags.track, sizeof(current_tags.track), "%d", entry->track);
+        snprintf(current_tags.nb, sizeof(current_tags.nb), "%02d", entry->track);
+    } else {
+        current_tags.track[0] = 0;
+        current_tags.nb[0] = 0;
+    }
+    current_tags.length = entry->length;
+    current_tags.bitrate = entry->bitrate;
+    current_tags.sample_rate = entry->sample_rate;
+    current_tags.channels = entry->channels;
+}
+
 bool track_update(const char * filename){
-  TagLib_Tag *tag;
-  const TagLib_AudioProperties *properties;
-  size_t cover_len;
-  char * buffer;  
+  struct library_entry * indexed;
+  struct library_entry parsed;
+  struct stat st;
   
   log_write(LOG_DEBUG, "Track update");
   /* Release current */
@@ -76,81 +264,168 @@ bool track_update(const char * filename){
   }
   
   if (eng_get_mode() == MODE_AUDIO){
-    taglib_set_strings_unicode(0);
-    current_file = taglib_file_new(filename);
-    if(current_file == NULL){
-        return false;  
-    }
-    
-    tag = taglib_file_tag(current_file);
-    if (tag != NULL){ 
-        current_tags.title = taglib_tag_title(tag);
-        current_tags.artist = taglib_tag_artist(tag);
-        current_tags.album =  taglib_tag_album(tag);
-        log_write(LOG_DEBUG, "Track - title : %s", current_tags.title);
-        log_write(LOG_DEBUG, "Track - artist : %s", current_tags.artist);
-        log_write(LOG_DEBUG, "Track - album : %s", current_tags.album);
-        if (taglib_tag_year(tag) > 0){
-            snprintf(current_tags.year, sizeof(current_tags.year), "%d", taglib_tag_year(tag));    
-            current_tags.year[sizeof(current_tags.year)-1] = 0;
-        } else {
-            current_tags.year[0] = 0;
-        }
-        current_tags.comment = taglib_tag_comment(tag);
-        if (taglib_tag_track(tag) > 0){
-            snprintf(current_tags.track, sizeof(current_tags.track), "%d", taglib_tag_track(tag));
-            current_tags.track[sizeof(current_tags.track)-1] = 0;
-        } else {
-            current_tags.track[0] = 0;
+    if (stat(filename, &st) != 0){
+        return false;
+    }
+    /* Tags are read from the library index if the file did not change */
+    indexed = library_lookup(filename, &st);
+    if (indexed != NULL){
+        log_write(LOG_DEBUG, "Track - tags found in library");
+        set_current_tags(indexed);
+        free(indexed);
+    } else {
+        if (!parse_file(filename, &st, &parsed, false)){
+            return false;
         }
-        current_tags.genre = taglib_tag_genre(tag);
-        if (taglib_tag_track(tag) > 0) {
-            snprintf(current_tags.nb, sizeof(current_tags.nb), "%02d", taglib_tag_track(tag));
-            current_tags.nb[sizeof(current_tags.nb) -1] = 0;    
-        } else {
-            current_tags.nb[0] = 0;
+        set_current_tags(&parsed);
+        /* A file with a cover is indexed by the cover decoding, which also locates the cover */
+        if (parsed.cover == NULL){
+            library_add(&parsed);
         }
-
-    }
-    properties = taglib_file_audioproperties(current_file);
-    if(properties != NULL) {
-        current_tags.length = taglib_audioproperties_length(properties);
-        current_tags.bitrate = taglib_audioproperties_bitrate(properties);
-        current_tags.sample_rate = taglib_audioproperties_samplerate(properties);
-        current_tags.channels =  taglib_audioproperties_channels(properties);
-    }    
-    cover_len = taglib_file_cover_size(current_file);
-    if (cover_len > 0){
-        log_write(LOG_DEBUG, "Track - coverart available. Length :%d", cover_len);
-        buffer = (char *)malloc(cover_len);
-        taglib_file_cover(current_file, buffer, cover_len);
-        ilGenImages(1, &current_tags.coverart);
-        ilBindImage(current_tags.coverart);
-        if (!ilLoadL(IL_TYPE_UNKNOWN, buffer, cover_len)){
-            log_write(LOG_ERROR, "Track - Error while loading coverart");
-            ilDeleteImages( 1, &current_tags.coverart);
-            current_tags.coverart = 0;            
-        }    
-        free(buffer);
+        free_entry_data(&parsed);
     }
+    /* Cover is decoded in background */
+    cover_request(filename);
   }
   return true;
 }
 
+/** Get the embedded cover of a media file
+ *
+ * Called from the cover decoding thread : the file is parsed again if the position of its cover is unknown.
+ *
+ * \param filename media file
+ * \param cover [out] encoded picture to be released with free()
+ * \param len [out] length of the picture
+ *
+ * \retval false the file has no cover
+ */
+bool track_read_cover(const char * filename, void ** cover, size_t * len){
+    struct library_entry * indexed;
+    struct library_entry parsed;
+    struct stat st;
+    bool known;
+
+    *cover = NULL;
+    *len = 0;
+    if (stat(filename, &st) != 0)
+        return false;
+    indexed = library_lookup(filename, &st);
+    known = (indexed != NULL);
+    if (indexed != NULL){
+        if (indexed->cover_len == 0){
+            free(indexed);
+            return false;
+        }
+        if (indexed->cover_offset != 0){
+            *cover = read_indexed_cover(filename, indexed);
+            if (*cover != NULL){
+                *len = indexed->cover_len;
+                free(indexed);
+                return true;
+            }
+        }
+        /* Position of the cover unknown : the file is parsed again */
+        free(indexed);
+    }
+    if (!parse_file(filename, &st, &parsed, true))
+        return false;
+    if (!known)
+        library_add(&parsed);
+    *cover = (void *)parsed.cover;
+    *len = parsed.cover_len;
+    parsed.cover = NULL;
+    free_entry_data(&parsed);
+    return (*cover != NULL);
+}
+
 const struct track_tags *track_get_tags(void){
     return &current_tags;
 }
 
 void track_release(void){
-    taglib_tag_free_strings();
-    if (current_file != NULL){
-        taglib_file_free(current_file);
-        current_file = NULL;
-    }
-    if (current_tags.coverart != 0){
-         ilDeleteImages( 1, &current_tags.coverart);
-    }
+    free((char *)current_tags.title);
+    free((char *)current_tags.artist);
+    free((char *)current_tags.album);
+    free((char *)current_tags.comment);
+    free((char *)current_tags.genre);
     free(current_filename);
     current_filename = NULL;
     memset(&current_tags, 0, sizeof(current_tags));
 }
+
+/** Index in background the files of a playlist that are not in the library yet */
+static void * builder_thread(void * param){
+    char * playlist = param;
+    char line[PATH_MAX];
+    struct library_entry * indexed;
+    struct library_entry parsed;
+    struct stat st;
+    int added = 0;
+    size_t len;
+    FILE * fp;
+
+    fp = fopen(playlist, "r");
+    if (fp == NULL){
+        log_write(LOG_WARNING, "Library builder : unable to open %s", playlist);
+        goto out;
+    }
+    while (!builder_stop && (fgets(line, sizeof(line), fp) != NULL)){
+        len = strlen(line);
+        while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r'))){
+            line[--len] = 0;
+        }
+        if ((len == 0) || (line[0] == '#') || (stat(line, &st) != 0) || !S_ISREG(st.st_mode))
+            continue;
+        indexed = library_lookup(line, &st);
+        if (indexed != NULL){
+            free(indexed);
+            continue;
+        }
+        if (parse_file(line, &st, &parsed, true)){
+            library_add(&parsed);
+            free_entry_data(&parsed);
+            if (++added % LIBRARY_BUILDER_SAVE_NB == 0)
+                library_save();
+        }
+        /* Do not compete with the player for the SD card */
+        usleep(LIBRARY_BUILDER_PACE_US);
+    }
+    fclose(fp);
+    log_write(LOG_INFO, "Library builder : %d files indexed", added);
+out:
+    library_save();
+    free(playlist);
+    return NULL;
+}
+
+/** Launch the indexing in background of the files of a playlist
+ *
+ * \param playlist m3u file
+ */
+bool track_library_start(const char * playlist){
+    char * param;
+
+    if (builder_running)
+        return false;
+    param = strdup(playlist);
+    if (param == NULL)
+        return false;
+    builder_stop = false;
+    if (pthread_create(&builder_tid, NULL, builder_thread, param) != 0){
+        free(param);
+        return false;
+    }
+    builder_running = true;
+    return true;
+}
+
+/** Stop the background indexing and save the library */
+void track_library_stop(void){
+    if (builder_running){
+        builder_stop = true;
+        pthread_join(builder_tid, NULL);
+        builder_running = false;
+    }
+    library_save();
+}
@@ -29,7 +29,7 @@
 #define __TRACK_H__
 
 #include <stdbool.h>
-#include <IL/ilu.h>
+#include <stddef.h>
 
 struct track_tags{
       char nb[4];
@@ -44,14 +44,17 @@ struct track_tags{
       int bitrate;
       int sample_rate;
       int channels;
-      ILuint coverart;
 };
 
 bool track_update(const char * filename);
 bool track_has_changed(const char * filename);
 const struct track_tags *track_get_tags(void);
 const char * track_get_current_filename(void);
+const char * track_get_current_path(void);
 void track_release(void);
+bool track_read_cover(const char * filename, void ** cover, size_t * len);
+bool track_library_start(const char * playlist);
+void track_library_stop(void);
 
     
 #endif
@@ -37,6 +37,7 @@
 #include "viewmeter.h"
 #include "config.h"
 #include "pwm.h"
+#include "res_cache.h"
 #include "window.h"
 
 
@@ -67,6 +68,12 @@ static struct {
   int current_win;
 } win_stack =  { .current_win = -1 };
 
+/* File selector pressed : receives the touch screen moves until the release */
+static struct {
+  gui_window win;
+  struct gui_control * control;
+} drag;
+
 
 static inline char * get_key(int ctrl_id,const char * ctrl_param){
   static char key[200];
@@ -310,53 +317,38 @@ static IDirectFBFont * load_font(gui_window win, char * filename, int height ){
  *
  * \return DirectFB surface, NULL if error
  */
-static IDirectFBSurface * load_image_to_surface(struct gui_control * ctrl, char * filename ){	
-	IDirectFBImageProvider *provider;
-	DFBSurfaceDescription dsc;
-	IDirectFBSurface * surface = NULL;
-	PRINTDF( "load_image_to_surface <%s>\n", filename );
-
-	if (ctrl->win->dfb->CreateImageProvider( ctrl->win->dfb, filename, &provider ) != DFB_OK)
-          return NULL;
+static IDirectFBSurface * load_image_to_surface(struct gui_control * ctrl, const char * filename ){	
+	IDirectFBSurface * surface;
 
-	if ((provider->GetSurfaceDescription (provider, &dsc) == DFB_OK) &&
-	    ( ctrl->win->dfb->CreateSurface( ctrl->win->dfb, &dsc, &surface ) == DFB_OK) ){
-          if ((ctrl->zone.w != -1) &&
-              (ctrl->zone.w != -1)){
-           provider->RenderTo( provider, surface, &ctrl->zone ) ;
-          } else {
-	   provider->RenderTo( provider, surface, NULL ) ;
-           ctrl->zone.w = dsc.width;
-           ctrl->zone.h = dsc.height;
-          }
-        }
-	provider->Release( provider );
-        
+	PRINTDF( "load_image_to_surface <%s>\n", filename );
+	if ((ctrl->zone.w != -1) && (ctrl->zone.h != -1)){
+	  surface = res_get_image(ctrl->win->dfb, filename, ctrl->zone.w, ctrl->zone.h);
+	} else {
+	  surface = res_get_image(ctrl->win->dfb, filename, -1, -1);
+	  if (surface != NULL){
+	    surface->GetSize(surface, &ctrl->zone.w, &ctrl->zone.h);
+	  }
+	}
 	return surface;
 }
 
-static  bool init_window(gui_window win,  dictionary * ini){
+static  bool init_window(gui_window win, const struct gui_window_desc * wdesc){
   DFBRectangle zone;
-  char* s;
   DFBWindowDescription  desc;     
-  IDirectFBImageProvider *provider;
-  int opacity,  tmp;
-
-  zone.x = iniparser_getint(ini, "general:x", 0);
-  zone.y = iniparser_getint(ini, "general:y", 0);  
-  zone.w = iniparser_getint(ini, "general:w", screen_width-zone.x);
-  zone.h = iniparser_getint(ini, "general:h", screen_height-zone.y);
+  IDirectFBSurface * background;
+  int tmp;
+
+  zone = wdesc->zone;
+  if (zone.w < 0)
+    zone.w = screen_width - zone.x;
+  if (zone.h < 0)
+    zone.h = screen_height - zone.y;
   if (is_rotated) { 
     tmp =  zone.y;
     zone.y = zone.x;
     zone.x = screen_width-zone.h -tmp;
   }
-  win->color.r = iniparser_getint(ini, "general:r", 0);
-  win->color.g = iniparser_getint(ini, "general:g", 0);
-  win->color.b = iniparser_getint(ini, "general:b", 0);
-  win->color.a = iniparser_getint(ini, "general:a", 0xFF);
-  s = iniparser_getstring(ini, "general:background", NULL);
-  
+  win->color = wdesc->color;
 
   desc.flags = ( DWDESC_POSX | DWDESC_POSY |
                  DWDESC_WIDTH | DWDESC_HEIGHT );
@@ -374,76 +366,66 @@ static  bool init_window(gui_window win,  dictionary * ini){
     win->win->LowerToBottom(win->win);
   }
   
-  
-    win->background_surface->SetBlittingFlags(win->background_surface,DSBLIT_BLEND_ALPHACHANNEL);
-  
- 
-  if (s != NULL) {  
-    win->dfb->CreateImageProvider( win->dfb, s, &provider );
-    provider->RenderTo( provider, win->background_surface, NULL ) ;
-    provider->Release(provider);
+  background = NULL;
+  if (wdesc->background != NULL) {  
+    background = res_get_image(win->dfb, wdesc->background, desc.width, desc.height);
+  }
+  if (background != NULL) {
+    win->background_surface->Blit(win->background_surface, background, NULL, 0, 0);
+    res_put_image(background);
   } else {
     win->background_surface->SetColor(win->background_surface, 0,0,0,0xFF);
     win->background_surface->FillRectangle(win->background_surface,0,0, desc.width,desc.height);
   }
+  
+    win->background_surface->SetBlittingFlags(win->background_surface,DSBLIT_BLEND_ALPHACHANNEL);
 
-  opacity = iniparser_getint(ini, "general:opacity", 0xFF);  
   if (is_rotated){
     win->win->SetOpacity(win->win, 255 );
     win->win->SetRotation(win->win, 270);
   } else {
-    win->win->SetOpacity(win->win, opacity);
+    win->win->SetOpacity(win->win, wdesc->opacity);
   }
 
-  win->is_detached = iniparser_getint(ini, "general:detached", 0);
+  win->is_detached = wdesc->detached;
   return true; 
 }
 
-static void draw_text(struct gui_control * ctrl,  dictionary * ini , int num_control, int * w , int *h){
+static void draw_text(struct gui_control * ctrl, const struct gui_control_desc * cdesc, int * w , int *h){
   struct label_config conf;  
-  char * s;
   IDirectFBFont * text_font;
 
   gui_window  window = ctrl->win;
   
-  /* Get configuration from ini File */
-  conf.height = iniparser_getint(ini, get_key(num_control,"font_height"), DEFAULT_FONT_HEIGHT);
-  conf.name = iniparser_getstring(ini, get_key(num_control,"font"), NULL);
+  conf.height = cdesc->font_height;
+  conf.name = (char *)cdesc->font;
   if( conf.name == NULL ) return ; 
-  conf.font_color.r = iniparser_getint(ini, get_key(num_control,"r"), 0);
-  conf.font_color.g = iniparser_getint(ini, get_key(num_control,"g"), 0);
-  conf.font_color.b = iniparser_getint(ini, get_key(num_control,"b"), 0);
-  conf.font_color.a = iniparser_getint(ini, get_key(num_control,"a"), 0xFF);
-  s = iniparser_getstring(ini, get_key(num_control,"msg"),  NULL);
+  conf.font_color = cdesc->color;
 
   /* Create Label */
   conf.dfb = window->dfb;
   conf.win = window->win; 
   conf.pos = ctrl->zone;
   ctrl->obj = label_create(&conf);
-  label_set_text(ctrl->obj, s);
+  label_set_text(ctrl->obj, cdesc->msg);
   text_font = label_get_font(ctrl->obj);
-  text_font->GetStringWidth (text_font, s, -1, w);
+  text_font->GetStringWidth (text_font, cdesc->msg, -1, w);
   text_font->GetHeight(text_font, h);  
 }
 
 
-static void add_viewmeter(struct gui_control * ctrl,  dictionary * ini , int num_control ){
+static void add_viewmeter(struct gui_control * ctrl, const struct gui_control_desc * cdesc){
   struct vm_config conf;    
   gui_window  window = ctrl->win;
   
-  /* Get configuration from ini File */
-  conf.height = iniparser_getint(ini, get_key(num_control,"font_height"), DEFAULT_FONT_HEIGHT);
-  conf.name = iniparser_getstring(ini, get_key(num_control,"font"), NULL);
+  conf.height = cdesc->font_height;
+  conf.name = (char *)cdesc->font;
   if( conf.name == NULL ) return ; 
-  conf.font_color.r = iniparser_getint(ini, get_key(num_control,"r"), 0);
-  conf.font_color.g = iniparser_getint(ini, get_key(num_control,"g"), 0);
-  conf.font_color.b = iniparser_getint(ini, get_key(num_control,"b"), 0);
-  conf.font_color.a = iniparser_getint(ini, get_key(num_control,"a"), 0xFF);
-  conf.format = iniparser_getstring(ini, get_key(num_control,"format"),  NULL);
-  conf.inc = iniparser_getdouble(  ini, get_key(num_control,"inc"), 1.00);
-  conf.min = iniparser_getdouble(  ini, get_key(num_control,"min"), 0.00);
-  conf.max = iniparser_getdouble(  ini, get_key(num_control,"max"), 999999999999999.99);
+  conf.font_color = cdesc->color;
+  conf.format = (char *)cdesc->format;
+  conf.inc = cdesc->inc;
+  conf.min = cdesc->min;
+  conf.max = cdesc->max;
   /*Create the object */
   conf.dfb = window->dfb;
   conf.win = window->win; 
@@ -451,10 +433,9 @@ static void add_viewmeter(struct gui_control * ctrl,  dictionary * ini , int num
   ctrl->obj = vm_create(&conf);
 }
 
-static  fs_handle load_fs_ctrl(struct gui_control * ctrl,  dictionary * ini , int num_control ){	
+static  fs_handle load_fs_ctrl(struct gui_control * ctrl, const struct gui_control_desc * cdesc){	
   #define RES_FOLDER "./res/icon/"
   #define FONT_FOLDER "./res/font/"
-  char * s;
 
   struct fs_config conf = {
                             .graphics = { .filename = {RES_FOLDER "scroll_up_0.png",
@@ -483,16 +464,12 @@ static  fs_handle load_fs_ctrl(struct gui_control * ctrl,  dictionary * ini , in
       conf.graphics.filename[FS_ICON_FOLDER ] = RES_FOLDER "folder_1.png"; 
     }
     conf.geometry.pos = ctrl->zone;
-    s = iniparser_getstring(ini, get_key(num_control,"font"), NULL);
-    if (s != NULL){
-      conf.graphics.font = s;
+    if (cdesc->font != NULL){
+      conf.graphics.font = (char *)cdesc->font;
     }
-    conf.graphics.font_color.a = iniparser_getint(ini, get_key(num_control,"a"), 0xFF);
-    conf.graphics.font_color.r = iniparser_getint(ini, get_key(num_control,"r"), 188);
-    conf.graphics.font_color.g = iniparser_getint(ini, get_key(num_control,"g"), 133);
-    conf.graphics.font_color.b = iniparser_getint(ini, get_key(num_control,"b"), 215);
-    conf.options.multiple_selection = iniparser_getint(ini, get_key(num_control,"multiple_select"), 0);
-    conf.geometry.preview_width_ratio = iniparser_getint(ini,get_key(num_control,"prev_ratio"),0);
+    conf.graphics.font_color = cdesc->color;
+    conf.options.multiple_selection = cdesc->multiple_select;
+    conf.geometry.preview_width_ratio = cdesc->prev_ratio;
     if  ((conf.geometry.preview_width_ratio>0) && 
         (conf.geometry.preview_width_ratio<100)){
       conf.options.preview_box = true;
@@ -506,86 +483,91 @@ static  fs_handle load_fs_ctrl(struct gui_control * ctrl,  dictionary * ini , in
     return fs_create (ctrl->win->dfb, ctrl->win->win, &conf);
 }
 
-/** Loading of a window configuration
- *
- * \param filename window configuration file
- * \param window structure where to store configuration
+/** Create the controls of a window from their description
  *
  * \return true on success, false on failure
  */
-static bool load_window_config( const char * filename, gui_window  window ){
-        dictionary * ini ;
-        char * s;
-        int i;
-        bool return_code = false;
+static bool create_controls(gui_window window, const struct gui_window_desc * wdesc){
+        const struct gui_control_desc * cdesc;
         struct gui_control * control;
-        int num_control = 0;
-
-        PRINTDF( "load_window_config <%s>\n", filename );
-        ini = iniparser_load(filename);
-        if (ini == NULL) {
-                PRINTDF( "Unable to load config file %s\n", filename);
-                return false ;
-        }
-
-        /* init the window itself */
-        init_window(window,ini);
+        int num_control;
 
-        /* Init each control in the window */
-        while( true ){                
-                i = iniparser_getint(ini, get_key(num_control, "type"), -1);
-                if( i < 0 ) break;
-                if ((i < GUI_TYPE_CTRL_TEXT) || (i >= GUI_TYPE_CTRL_MAX_NB )){
+        for (num_control = 0; num_control < wdesc->nb_controls; num_control++){
+                cdesc = &wdesc->controls[num_control];
+                if ((cdesc->type < GUI_TYPE_CTRL_TEXT) || (cdesc->type >= GUI_TYPE_CTRL_MAX_NB )){
                         PRINTDF( "Control type unknown for control #%d\n", num_control );
-                        goto end;
+                        return false;
                 }
                 control = ( struct gui_control * ) calloc(1, sizeof( struct gui_control ) );	
                 if (control == NULL){
                   PRINTDF( " Control Allocation failed %s \n","" );
-                  goto end;
+                  return false;
                 }
-                control->type = i;               
+                control->type = cdesc->type;               
                 control->win = window;                
-                control->zone.x = iniparser_getint(ini, get_key(num_control,"x"), 0);
-                control->zone.y = iniparser_getint(ini, get_key(num_control,"y"), 0);
-                control->zone.w = iniparser_getint(ini, get_key(num_control,"w"), -1);
-                control->zone.h = iniparser_getint(ini, get_key(num_control,"h"), -1);
-                s = iniparser_getstring(ini, get_key(num_control,"name"), NULL);
-                if( s != NULL ) control->name = strdup( s );
+                control->zone = cdesc->zone;
+                if( cdesc->name != NULL ) control->name = strdup( cdesc->name );
 
                 switch(control->type){
                   case GUI_TYPE_CTRL_TEXT:		  
-                    draw_text(control,ini, num_control,&control->zone.w, &control->zone.h);
+                    draw_text(control, cdesc, &control->zone.w, &control->zone.h);
                     break;
                   case GUI_TYPE_CTRL_BUTTON :
-                    s = iniparser_getstring(ini, get_key(num_control,"image"), NULL);
-                    if( s != NULL ) {
-                      control->obj = load_image_to_surface(control, s);
-                      window->background_surface->Blit( window->background_surface, control->obj, NULL, control->zone.x, control->zone.y );                      
+                    if( cdesc->image != NULL ) {
+                      control->obj = load_image_to_surface(control, cdesc->image);
+                      if (control->obj != NULL){
+                        window->background_surface->Blit( window->background_surface, control->obj, NULL, control->zone.x, control->zone.y );                      
+                      }
                     }
                     break;
                   case GUI_TYPE_CTRL_CLICKABLE_ZONE :
                     /* Nothing else todo */
                     break;
                   case GUI_TYPE_CTRL_FILESELECTOR :
-                    control->obj =  load_fs_ctrl(control,ini, num_control);
+                    control->obj =  load_fs_ctrl(control, cdesc);
                     break;
                   case GUI_TYPE_CTRL_VIEWMETER :
-                    add_viewmeter(control,ini, num_control);
+                    add_viewmeter(control, cdesc);
                     break;
                   default :
                     break;
                 }
                 add_to_list_sorted( &window->controls, control, cmp_control_position );
-                num_control++;
         }
-
-        return_code = true;
-end:
-        iniparser_freedict(ini);
-        return return_code;
+        return true;
 }
 
+/** Read the description of a control from a window configuration
+ *
+ * \note Strings of the description point into the dictionary
+ */
+static void parse_control(dictionary * ini, int num_control, struct gui_control_desc * cdesc){
+        bool is_fs;
+
+        memset(cdesc, 0, sizeof(*cdesc));
+        cdesc->type = iniparser_getint(ini, get_key(num_control, "type"), -1);
+        is_fs = (cdesc->type == GUI_TYPE_CTRL_FILESELECTOR);
+        cdesc->zone.x = iniparser_getint(ini, get_key(num_control,"x"), 0);
+        cdesc->zone.y = iniparser_getint(ini, get_key(num_control,"y"), 0);
+        cdesc->zone.w = iniparser_getint(ini, get_key(num_control,"w"), -1);
+        cdesc->zone.h = iniparser_getint(ini, get_key(num_control,"h"), -1);
+        cdesc->name = iniparser_getstring(ini, get_key(num_control,"name"), NULL);
+        cdesc->image = iniparser_getstring(ini, get_key(num_control,"image"), NULL);
+        cdesc->font = iniparser_getstring(ini, get_key(num_control,"font"), NULL);
+        cdesc->font_height = iniparser_getint(ini, get_key(num_control,"font_height"), DEFAULT_FONT_HEIGHT);
+        /* The file selector has its own default color */
+        cdesc->color.r = iniparser_getint(ini, get_key(num_control,"r"), is_fs ? 188 : 0);
+        cdesc->color.g = iniparser_getint(ini, get_key(num_control,"g"), is_fs ? 133 : 0);
+        cdesc->color.b = iniparser_getint(ini, get_key(num_control,"b"), is_fs ? 215 : 0);
+        cdesc->color.a = iniparser_getint(ini, get_key(num_control,"a"), 0xFF);
+        cdesc->msg = iniparser_getstring(ini, get_key(num_control,"msg"),  NULL);
+        cdesc->format = iniparser_getstring(ini, get_key(num_control,"format"),  NULL);
+        cdesc->inc = iniparser_getdouble(  ini, get_key(num_control,"inc"), 1.00);
+        cdesc->min = iniparser_getdouble(  ini, get_key(num_control,"min"), 0.00);
+        cdesc->max = iniparser_getdouble(  ini, get_key(num_control,"max"), 999999999999999.99);
+        cdesc->multiple_select = iniparser_getint(ini, get_key(num_control,"multiple_select"), 0);
+        cdesc->prev_ratio = iniparser_getint(ini,get_key(num_control,"prev_ratio"),0);
+}
 
 /** 
  * Loading of a window and initialization
@@ -595,32 +577,88 @@ end:
  * \return Handle to the created object, NULL if error
  */
 gui_window  gui_window_load(IDirectFB  *dfb, IDirectFBDisplayLayer *layer, const char * filename){
-  gui_window  window;
-  bool return_code;
+  struct gui_control_desc * controls = NULL;
+  struct gui_control_desc * tmp;
+  struct gui_window_desc wdesc;
+  gui_window  window = NULL;
+  dictionary * ini ;
+
+  PRINTDF( "load_window <%s>\n", filename );
+  ini = iniparser_load(filename);
+  if (ini == NULL) {
+    PRINTDF( "Unable to load config file %s\n", filename);
+    return NULL;
+  }
 
+  wdesc.zone.x = iniparser_getint(ini, "general:x", 0);
+  wdesc.zone.y = iniparser_getint(ini, "general:y", 0);  
+  wdesc.zone.w = iniparser_getint(ini, "general:w", -1);
+  wdesc.zone.h = iniparser_getint(ini, "general:h", -1);
+  wdesc.color.r = iniparser_getint(ini, "general:r", 0);
+  wdesc.color.g = iniparser_getint(ini, "general:g", 0);
+  wdesc.color.b = iniparser_getint(ini, "general:b", 0);
+  wdesc.color.a = iniparser_getint(ini, "general:a", 0xFF);
+  wdesc.background = iniparser_getstring(ini, "general:background", NULL);
+  wdesc.opacity = iniparser_getint(ini, "general:opacity", 0xFF);  
+  wdesc.detached = iniparser_getint(ini, "general:detached", 0);
+
+  /* Controls are numbered from 0 up to the first missing one */
+  wdesc.nb_controls = 0;
+  while (iniparser_getint(ini, get_key(wdesc.nb_controls, "type"), -1) >= 0){
+    tmp = realloc(controls, (wdesc.nb_controls + 1) * sizeof(*controls));
+    if (tmp == NULL){
+      PRINTDF( "Unable to allocate memory for creating window %s\n", filename );
+      goto end;
+    }
+    controls = tmp;
+    parse_control(ini, wdesc.nb_controls, &controls[wdesc.nb_controls]);
+    wdesc.nb_controls++;
+  }
+  wdesc.controls = controls;
+
+  window = gui_window_create(dfb, layer, &wdesc);
+  if (window == NULL){
+    PRINTDF( "Unable to load  window config\n%s", filename );
+  }
+end:
+  free(controls);
+  iniparser_freedict(ini);
+  return window;
+}
+
+/** 
+ * Create a window from an in-memory description
+ *
+ * The images are shared with the previously created windows : only the ones never used before are decoded.
+ *
+ * \param[in] wdesc description of the window and of its controls
+ *
+ * \return Handle to the created object, NULL if error
+ */
+gui_window  gui_window_create(IDirectFB  *dfb, IDirectFBDisplayLayer *layer, const struct gui_window_desc * wdesc){
+  gui_window  window;
 
   if (screen_height == 0){
     probe_screen( dfb);
   }
 
   if ( (win_stack.current_win + 1)>= GUI_WINDOW_MAX_NB) {
-       PRINTDF( "No more window object can be created while trying to instanciate %s\n", filename );
+       PRINTD( "No more window object can be created\n" );
   }
 
-  PRINTDF( "load_window <%s>\n", filename );
   window = calloc(1,  sizeof( *window));
   if( window == NULL ){
-      PRINTDF( "Unable to allocate memory for creating window %s\n", filename );
+      PRINTD( "Unable to allocate memory for creating window\n" );
       return NULL;
   }
   window->dfb = dfb;
   window->layer = layer;
 
-  return_code = load_window_config( filename, window );
-
-  if( return_code != true ){
-          PRINTDF( "Unable to load  window config\n%s", filename );
-          return NULL;
+  if (!init_window(window, wdesc) || !create_controls(window, wdesc)){
+    /* Not in the stack yet */
+    window->is_detached = true;
+    gui_window_release(window);
+    return NULL;
   }
   if (! is_rotated)  {
     window->win->RaiseToTop(window->win);
@@ -639,6 +677,28 @@ gui_window  gui_window_load(IDirectFB  *dfb, IDirectFBDisplayLayer *layer, const
   return window;
 }
 
+/** Get the size of an image (it is then kept decoded for the next windows)
+ *
+ * \retval true success
+ * \retval false the image cannot be decoded
+ */
+bool gui_window_get_image_size(IDirectFB  *dfb, const char * filename, int * w, int * h){
+  IDirectFBSurface * surface;
+
+  surface = res_get_image(dfb, filename, -1, -1);
+  if (surface == NULL){
+    return false;
+  }
+  surface->GetSize(surface, w, h);
+  res_put_image(surface);
+  return true;
+}
+
+/** Forget the decoded versions of an image whose file has been modified */
+void gui_window_forget_image(const char * filename){
+  res_forget(filename);
+}
+
 
 
 /** 
@@ -657,6 +717,10 @@ bool gui_window_release(gui_window window){
         PRINTD("unload_window\n");
 
         if( window != NULL ){
+            if (drag.win == window){
+              drag.win = NULL;
+              drag.control = NULL;
+            }
             /* Remove the window from the stack */    
             if (!window->is_detached){
               if (win_stack.winlist[win_stack.current_win] != window) {             
@@ -692,7 +756,7 @@ bool gui_window_release(gui_window window){
                         break;
                       case GUI_TYPE_CTRL_BUTTON :
                         if (control->obj != NULL)
-                          ((IDirectFBSurface *)control->obj)->Release((IDirectFBSurface *)control->obj);
+                          res_put_image(control->obj);
                         break;	
                       case GUI_TYPE_CTRL_FILESELECTOR :
                           if (control->obj != NULL){
@@ -946,15 +1010,18 @@ void gui_window_handle_key(DFBInputDeviceKeyIdentifier id){
   }    
 }
 
-void gui_window_handle_click(int  x, int y){
-  struct list_object * list_controls;
-  struct gui_control * control;  
+/** Convert touch screen coordinates to coordinates relative to the top window
+ *
+ * \return the top window, NULL if none
+ */
+static gui_window to_window_coords(int * px, int * py){
   int win_x, win_y;	
+  int x = *px;
+  int y = *py;
   gui_window win;
-  union gui_event evt;
 
   if (win_stack.current_win < 0){
-    return;
+    return NULL;
   }
   win = win_stack.winlist[win_stack.current_win];
   win->win->GetPosition(win->win, &win_x, &win_y);
@@ -980,6 +1047,23 @@ void gui_window_handle_click(int  x, int y){
     x-=win_x;
     y-=win_y;
   }
+  *px = x;
+  *py = y;
+  return win;
+}
+
+void gui_window_handle_click(int  x, int y){
+  struct list_object * list_controls;
+  struct gui_control * control;  
+  gui_window win;
+  union gui_event evt;
+
+  win = to_window_coords(&x, &y);
+  if (win == NULL){
+    return;
+  }
+  drag.win = NULL;
+  drag.control = NULL;
 
   list_controls = win->controls;
   while( list_controls != NULL ){
@@ -992,6 +1076,11 @@ void gui_window_handle_click(int  x, int y){
         if( control->cb != NULL){
 	  evt.ts.x = x;
 	  evt.ts.y = y;
+          if (control->type == GUI_TYPE_CTRL_FILESELECTOR){
+            /* Cleared if the callback releases the window */
+            drag.win = win;
+            drag.control = control;
+          }
           control->cb(control, GUI_EVT_TS, &evt);
 	  /* exit on first callback : needed as the cb may destroy the control list ! */
 	  break;
@@ -1002,6 +1091,30 @@ void gui_window_handle_click(int  x, int y){
   return;
 }
 
+/** Send a touch screen move or release to the file selector pressed */
+static void send_drag_event(int x, int y, enum gui_event_type type){
+  union gui_event evt;
+
+  if ((drag.control == NULL) || (to_window_coords(&x, &y) != drag.win)){
+    return;
+  }
+  evt.ts.x = x;
+  evt.ts.y = y;
+  drag.control->cb(drag.control, type, &evt);
+}
+
+/** Handle a move on the touch screen (sent to the file selector pressed if any) */
+void gui_window_handle_motion(int  x, int y){
+  send_drag_event(x, y, GUI_EVT_TS_MOVE);
+}
+
+/** Handle the release of the touch screen (sent to the file selector pressed if any) */
+void gui_window_handle_release(int  x, int y){
+  send_drag_event(x, y, GUI_EVT_TS_RELEASE);
+  drag.win = NULL;
+  drag.control = NULL;
+}
+
 /*
 void gui_window_get_pos(gui_window win, int *x, int* y){
   *x=*y=0;
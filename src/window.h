@@ -73,7 +73,8 @@ union gui_event{
     DFBInputDeviceKeyIdentifier key;
 };
 
-enum gui_event_type {GUI_EVT_TS, GUI_EVT_KEY, GUI_EVT_SELECT, GUI_EVT_UNSELECT};
+/* GUI_EVT_TS_MOVE and GUI_EVT_TS_RELEASE are only sent to the file selector that received the press (GUI_EVT_TS) */
+enum gui_event_type {GUI_EVT_TS, GUI_EVT_KEY, GUI_EVT_SELECT, GUI_EVT_UNSELECT, GUI_EVT_TS_MOVE, GUI_EVT_TS_RELEASE};
 
 /** Callback on a control click */
 typedef void (*gui_control_cb)(struct gui_control *, enum gui_event_type, union gui_event*);
@@ -94,12 +95,44 @@ struct gui_control{
         int            cb_param;                /**< Additionnal param passed to the callback */
 };
 
+/** In-memory description of a control (see gui_window_create()) */
+struct gui_control_desc{
+        enum gui_type_ctrl type;                /**< type of control */
+        const char * name;                      /**< Name of the control (may be NULL) */
+        DFBRectangle zone;                      /**< Zone in the window (w and h set to -1 to use the size of the image or text) */
+        const char * image;                     /**< GUI_TYPE_CTRL_BUTTON : bitmap filename */
+        const char * font;                      /**< True Type Font filename (NULL for the default one of the file selector) */
+        int font_height;
+        DFBColor color;                         /**< Text color */
+        const char * msg;                       /**< GUI_TYPE_CTRL_TEXT : text to display */
+        const char * format;                    /**< GUI_TYPE_CTRL_VIEWMETER : format, increment and bounds of the value */
+        double inc, min, max;
+        bool multiple_select;                   /**< GUI_TYPE_CTRL_FILESELECTOR : multiple selection and preview ratio */
+        int prev_ratio;
+};
+
+/** In-memory description of a window (see gui_window_create()) */
+struct gui_window_desc{
+        DFBRectangle zone;                      /**< Position of the window (w and h set to -1 to extend it up to the screen edges) */
+        DFBColor color;
+        const char * background;                /**< Background image filename (NULL for a black background) */
+        int opacity;
+        bool detached;                          /**< If detached, the window is not handled in the window stack */
+        int nb_controls;
+        const struct gui_control_desc * controls;
+};
+
 
 gui_window  gui_window_load(IDirectFB  *,  IDirectFBDisplayLayer *, const char * filename);
+gui_window  gui_window_create(IDirectFB  *,  IDirectFBDisplayLayer *, const struct gui_window_desc *);
+bool   gui_window_get_image_size(IDirectFB  *, const char * filename, int * w, int * h);
+void   gui_window_forget_image(const char * filename);
 bool   gui_window_release(gui_window );
 struct gui_control * gui_window_get_control(gui_window, const char *);
 void   gui_window_attach_cb(gui_window, const char *, gui_control_cb);
 void   gui_window_handle_click(int  x, int y);
+void   gui_window_handle_motion(int  x, int y);
+void   gui_window_handle_release(int  x, int y);
 IDirectFBSurface * gui_window_get_surface(gui_window);
 void gui_window_release_all(void);
 gui_window gui_window_get_top(void);